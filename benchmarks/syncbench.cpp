@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "syncengine.h"
+#include <QCoreApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <functional>
+
+/*
+ * Compares the native SyncEngine with rsync -aR --delete --delete-after on a generated
+ * tree of many small files, what is the case the native engine has been written for.
+ * Every engine is measured for the initial copy, a run without changes and a run
+ * after touching and deleting a part of the files.
+ */
+
+namespace {
+bool generateTree(const QString &root, int dirs, int filesPerDir, int fileSize)
+{
+    const QByteArray content(fileSize, 'x');
+    for (int d = 0; d < dirs; ++d) {
+        const QString dirPath = root + QStringLiteral("/dir%1/sub%2").arg(d / 16).arg(d);
+        if (!QDir().mkpath(dirPath)) {
+            return false;
+        }
+        for (int f = 0; f < filesPerDir; ++f) {
+            QFile file(dirPath + QStringLiteral("/file%1").arg(f));
+            if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void modifyTree(const QString &root, int dirs, int filesPerDir)
+{
+    // change about one percent of the files and remove every tenth directory
+    for (int d = 0; d < dirs; ++d) {
+        const QString dirPath = root + QStringLiteral("/dir%1/sub%2").arg(d / 16).arg(d);
+        if (d % 10 == 9) {
+            QDir(dirPath).removeRecursively();
+            continue;
+        }
+        for (int f = 0; f < filesPerDir; f += 100) {
+            QFile file(dirPath + QStringLiteral("/file%1").arg(f));
+            if (file.open(QIODevice::Append)) {
+                file.write("changed");
+            }
+        }
+    }
+}
+
+qint64 measure(const std::function<bool()> &func)
+{
+    QElapsedTimer timer;
+    timer.start();
+    if (!func()) {
+        return -1;
+    }
+    return timer.elapsed();
+}
+
+bool runRsync(const QString &rsync, const QString &source, const QString &target)
+{
+    QProcess proc;
+    proc.setProgram(rsync);
+    proc.setArguments({QStringLiteral("-aR"), QStringLiteral("--delete"), QStringLiteral("--delete-after"), source, target});
+    proc.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    proc.start();
+    return proc.waitForFinished(-1) && proc.exitStatus() == QProcess::NormalExit && proc.exitCode() == 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks the native sync engine against rsync."));
+    QCommandLineOption dirsOpt(QStringLiteral("dirs"), QStringLiteral("Number of directories to generate."), QStringLiteral("count"), QStringLiteral("500"));
+    QCommandLineOption filesOpt(QStringLiteral("files"), QStringLiteral("Number of files per directory."), QStringLiteral("count"), QStringLiteral("200"));
+    QCommandLineOption sizeOpt(QStringLiteral("size"), QStringLiteral("Size of every file in bytes."), QStringLiteral("bytes"), QStringLiteral("2048"));
+    QCommandLineOption threadsOpt(QStringLiteral("threads"), QStringLiteral("Threads used by the native engine, 0 uses the number of CPU cores."), QStringLiteral("count"), QStringLiteral("0"));
+    QCommandLineOption workdirOpt(QStringLiteral("workdir"), QStringLiteral("Directory to create the test trees in, should be on the file system to test."), QStringLiteral("path"), QDir::tempPath());
+    parser.addOptions({dirsOpt, filesOpt, sizeOpt, threadsOpt, workdirOpt});
+    parser.addHelpOption();
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    const int dirs = parser.value(dirsOpt).toInt();
+    const int files = parser.value(filesOpt).toInt();
+    const int threads = parser.value(threadsOpt).toInt();
+
+    QTemporaryDir workdir(parser.value(workdirOpt) + QStringLiteral("/syncbench-XXXXXX"));
+    if (!workdir.isValid()) {
+        out << "Failed to create working directory: " << workdir.errorString() << Qt::endl;
+        return 1;
+    }
+
+    const QString source = workdir.path() + QStringLiteral("/source");
+    out << "Generating " << dirs * files << " files in " << dirs << " directories..." << Qt::endl;
+    if (!generateTree(source, dirs, files, parser.value(sizeOpt).toInt())) {
+        out << "Failed to generate the source tree." << Qt::endl;
+        return 1;
+    }
+
+    const QString rsync = QStandardPaths::findExecutable(QStringLiteral("rsync"));
+    const QString rsyncTarget = workdir.path() + QStringLiteral("/rsync");
+    const QString nativeTarget = workdir.path() + QStringLiteral("/native");
+
+    auto native = [&](){
+        SyncEngine engine(QString(), source, nativeTarget, threads);
+        const bool ok = engine.run();
+        for (const QString &error : engine.errors()) {
+            out << "native: " << error << Qt::endl;
+        }
+        return ok;
+    };
+    auto viaRsync = [&](){
+        return runRsync(rsync, source, rsyncTarget);
+    };
+
+    const QStringList runs = {QStringLiteral("initial"), QStringLiteral("unchanged"), QStringLiteral("modified")};
+    out << qSetFieldWidth(12) << Qt::left << "run" << "rsync ms" << "native ms" << qSetFieldWidth(0) << Qt::endl;
+    for (const QString &run : runs) {
+        if (run == QLatin1String("modified")) {
+            modifyTree(source, dirs, files);
+        }
+        const qint64 rsyncTime = rsync.isEmpty() ? -1 : measure(viaRsync);
+        const qint64 nativeTime = measure(native);
+        out << qSetFieldWidth(12) << run << rsyncTime << nativeTime << qSetFieldWidth(0) << Qt::endl;
+    }
+
+    if (rsync.isEmpty()) {
+        out << "rsync has not been found, only the native engine has been measured." << Qt::endl;
+    }
+
+    return 0;
+}
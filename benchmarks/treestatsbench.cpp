@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "treestats.h"
+#include <QCoreApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <utility>
+
+/*
+ * Compares TreeStats with the recursive QDir implementation that has been used by
+ * AbstractBackup::getDirSize() before. Every walk is repeated, the first round also
+ * warms up the dentry and inode caches, so the later rounds measure the walk itself.
+ */
+
+namespace {
+std::pair<qint64,qint64> qdirSize(const QString &path)
+{
+    qint64 entries = 0;
+    qint64 size = 0;
+
+    QDir dir(path);
+
+    const auto dirEntries = dir.entryInfoList(QDir::Files|QDir::System|QDir::Hidden);
+    for (const QFileInfo &fi : dirEntries) {
+        entries++;
+        size += fi.size();
+    }
+
+    const auto childDirs = dir.entryList(QDir::Dirs|QDir::NoDotAndDotDot|QDir::System|QDir::Hidden|QDir::NoSymLinks);
+    for (const QString &child : childDirs) {
+        const auto ret = qdirSize(path + QLatin1Char('/') + child);
+        entries += ret.first;
+        size += ret.second;
+    }
+
+    return std::make_pair(entries, size);
+}
+
+bool generateTree(const QString &root, qint64 files, int filesPerDir)
+{
+    const QByteArray content(100, 'x');
+    for (qint64 f = 0; f < files; ++f) {
+        const qint64 d = f / filesPerDir;
+        const QString dirPath = root + QStringLiteral("/d%1/d%2").arg(d / 100).arg(d);
+        if (f % filesPerDir == 0 && !QDir().mkpath(dirPath)) {
+            return false;
+        }
+        QFile file(dirPath + QStringLiteral("/f%1").arg(f));
+        if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks TreeStats against a recursive QDir walk."));
+    QCommandLineOption filesOpt(QStringLiteral("files"), QStringLiteral("Number of files to generate."), QStringLiteral("count"), QStringLiteral("1000000"));
+    QCommandLineOption perDirOpt(QStringLiteral("per-dir"), QStringLiteral("Number of files per directory."), QStringLiteral("count"), QStringLiteral("250"));
+    QCommandLineOption threadsOpt(QStringLiteral("threads"), QStringLiteral("Threads used by TreeStats, 0 uses the number of CPU cores."), QStringLiteral("count"), QStringLiteral("0"));
+    QCommandLineOption roundsOpt(QStringLiteral("rounds"), QStringLiteral("Number of measured rounds."), QStringLiteral("count"), QStringLiteral("3"));
+    QCommandLineOption treeOpt(QStringLiteral("tree"), QStringLiteral("Use an existing tree instead of generating one."), QStringLiteral("path"));
+    QCommandLineOption workdirOpt(QStringLiteral("workdir"), QStringLiteral("Directory to generate the tree in."), QStringLiteral("path"), QDir::tempPath());
+    parser.addOptions({filesOpt, perDirOpt, threadsOpt, roundsOpt, treeOpt, workdirOpt});
+    parser.addHelpOption();
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    QTemporaryDir workdir(parser.value(workdirOpt) + QStringLiteral("/treestatsbench-XXXXXX"));
+    QString tree = parser.value(treeOpt);
+    if (tree.isEmpty()) {
+        if (!workdir.isValid()) {
+            out << "Failed to create working directory: " << workdir.errorString() << Qt::endl;
+            return 1;
+        }
+        tree = workdir.path();
+        const qint64 files = parser.value(filesOpt).toLongLong();
+        out << "Generating " << files << " files..." << Qt::endl;
+        if (!generateTree(tree, files, std::max(parser.value(perDirOpt).toInt(), 1))) {
+            out << "Failed to generate the tree." << Qt::endl;
+            return 1;
+        }
+    }
+
+    const int threads = parser.value(threadsOpt).toInt();
+    const int rounds = std::max(parser.value(roundsOpt).toInt(), 1);
+
+    out << qSetFieldWidth(14) << Qt::left << "round" << "QDir ms" << "TreeStats ms" << "files" << qSetFieldWidth(0) << Qt::endl;
+    for (int round = 0; round <= rounds; ++round) {
+        QElapsedTimer timer;
+        timer.start();
+        const auto old = qdirSize(tree);
+        const qint64 qdirTime = timer.restart();
+
+        TreeStats stats(tree, threads);
+        stats.run();
+        const qint64 treeStatsTime = timer.elapsed();
+        const TreeStats::Result result = stats.result();
+
+        out << qSetFieldWidth(14) << (round == 0 ? QStringLiteral("warm-up") : QString::number(round)) << qdirTime << treeStatsTime << result.files << qSetFieldWidth(0) << Qt::endl;
+
+        if (old.first != result.files || old.second != result.apparentSize) {
+            out << "Results differ: QDir " << old.first << " files, " << old.second << " bytes, TreeStats " << result.files << " files, " << result.apparentSize << " bytes" << Qt::endl;
+        }
+    }
+
+    return 0;
+}
@@ -4,12 +4,321 @@
  */
 
 #include "abstractbackup.h"
+#include "syncengine.h"
+#include "backuphistory.h"
+#include "treestats.h"
+#include "fileindex.h"
+#include "changejournal.h"
+#include "chunkstore.h"
+#include "chunksnapshot.h"
+#include "retentionpruner.h"
+#include "mountroot.h"
 #include <QTimer>
+#include <QThread>
 #include <QProcess>
 #include <QLocale>
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
+#include <QDateTime>
+#include <QRegularExpression>
+#include <QTemporaryFile>
+#include <QUrl>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <limits>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace {
+constexpr char snapshotDirName[] = ".sihhuri-snapshots";
+
+qint64 statsNumber(const QString &str)
+{
+    QString digits;
+    for (const QChar c : str) {
+        if (c.isDigit()) {
+            digits.append(c);
+        }
+    }
+    return digits.toLongLong();
+}
+
+// parses lines like "Number of files: 1,234 (reg: 1,000, dir: 200, link: 34)" and returns the entries that are not directories
+qint64 statsFileCount(const QString &output, QLatin1String label)
+{
+    const QRegularExpression re(QLatin1Char('^') + label + QStringLiteral(": ([\\d,.']+)(?: \\(([^)]*)\\))?"), QRegularExpression::MultilineOption);
+    const QRegularExpressionMatch match = re.match(output);
+    if (!match.hasMatch()) {
+        return 0;
+    }
+    qint64 count = statsNumber(match.captured(1));
+    static const QRegularExpression dirRe(QStringLiteral("dir: ([\\d,.']+)"));
+    const QRegularExpressionMatch dirMatch = dirRe.match(match.captured(2));
+    if (dirMatch.hasMatch()) {
+        count -= statsNumber(dirMatch.captured(1));
+    }
+    return count;
+}
+
+qint64 statsBytes(const QString &output, QLatin1String label)
+{
+    const QRegularExpression re(QLatin1Char('^') + label + QStringLiteral(": ([\\d,.']+) bytes"), QRegularExpression::MultilineOption);
+    const QRegularExpressionMatch match = re.match(output);
+    return match.hasMatch() ? statsNumber(match.captured(1)) : 0;
+}
+
+struct IndexJob {
+    FileIndex previous;
+    FileIndex current;
+    FileIndex::Changes changes;
+    bool mapped = false;
+    bool scanned = false;
+};
+
+/*
+ * Entries of a change journal split by their existence in the source. The statistics are
+ * taken from the entries in the source and the depot before they are synced.
+ */
+struct JournalJob {
+    std::vector<std::string> changed;
+    std::vector<std::string> deleted;
+    std::vector<std::string> recursive;
+    qint64 files = 0;
+    qint64 size = 0;
+    qint64 createdFiles = 0;
+    qint64 deletedFiles = 0;
+    qint64 transferredFiles = 0;
+    qint64 transferredBytes = 0;
+};
+
+bool isBelow(const std::string &path, const std::string &dir)
+{
+    return path.size() > dir.size() && path[dir.size()] == '/' && path.compare(0, dir.size(), dir) == 0;
+}
+
+// files and size of the entry rel in the depot, directories are walked
+std::pair<qint64,qint64> depotEntryStats(const std::string &depot, const std::string &rel, const PathFilter &filter)
+{
+    const std::string path = depot + '/' + rel;
+    struct stat st{};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return std::make_pair(0, 0);
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return std::make_pair(1, static_cast<qint64>(st.st_size));
+    }
+    TreeStats stats(QFile::decodeName(QByteArray::fromStdString(path)));
+    stats.setFilter(filter, QFile::decodeName(QByteArray::fromStdString(rel)));
+    stats.run();
+    return std::make_pair(stats.result().files, stats.result().apparentSize);
+}
+
+void prepareJournalJob(JournalJob &job, const ChangeJournal &journal, const std::string &source, const std::string &depot, const PathFilter &filter)
+{
+    std::set<std::string> changed;
+    std::string lastDeleted;
+
+    for (const std::string &rel : journal.recursive()) {
+        struct stat st{};
+        if (::lstat((source + '/' + rel).c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || filter.isPathExcluded(rel, true)) {
+            continue;
+        }
+        // nested directories are walked by their parents
+        if (!job.recursive.empty() && isBelow(rel, job.recursive.back())) {
+            continue;
+        }
+        job.recursive.push_back(rel);
+        TreeStats sourceStats(QFile::decodeName(QByteArray::fromStdString(source + '/' + rel)));
+        sourceStats.setFilter(filter, QFile::decodeName(QByteArray::fromStdString(rel)));
+        sourceStats.run();
+        const std::pair<qint64,qint64> depotStats = depotEntryStats(depot, rel, filter);
+        job.files += sourceStats.result().files - depotStats.first;
+        job.size += sourceStats.result().apparentSize - depotStats.second;
+        job.createdFiles += std::max<qint64>(sourceStats.result().files - depotStats.first, 0);
+        job.deletedFiles += std::max<qint64>(depotStats.first - sourceStats.result().files, 0);
+        job.transferredFiles += sourceStats.result().files;
+        job.transferredBytes += sourceStats.result().apparentSize;
+    }
+
+    for (const std::string &rel : journal.changed()) {
+        // excluded entries are neither synced nor deleted in the depot
+        if (!filter.isEmpty()) {
+            struct stat st{};
+            const bool inSource = ::lstat((source + '/' + rel).c_str(), &st) == 0;
+            if (!inSource && ::lstat((depot + '/' + rel).c_str(), &st) != 0) {
+                continue;
+            }
+            if (filter.isPathExcluded(rel, S_ISDIR(st.st_mode))) {
+                continue;
+            }
+        }
+
+        // parents are synced too, to restore their modification times
+        for (std::string::size_type pos = rel.find('/'); pos != std::string::npos; pos = rel.find('/', pos + 1)) {
+            changed.insert(rel.substr(0, pos));
+        }
+
+        struct stat src{};
+        if (::lstat((source + '/' + rel).c_str(), &src) != 0) {
+            // entries below deleted directories are removed together with them
+            if (lastDeleted.empty() || !isBelow(rel, lastDeleted)) {
+                lastDeleted = rel;
+                job.deleted.push_back(rel);
+                const std::pair<qint64,qint64> depotStats = depotEntryStats(depot, rel, filter);
+                job.files -= depotStats.first;
+                job.size -= depotStats.second;
+                job.deletedFiles += depotStats.first;
+            }
+            continue;
+        }
+
+        changed.insert(rel);
+
+        const bool inRecursive = std::any_of(job.recursive.cbegin(), job.recursive.cend(), [&rel](const std::string &dir){
+            return rel == dir || isBelow(rel, dir);
+        });
+        if (inRecursive || S_ISDIR(src.st_mode)) {
+            continue;
+        }
+
+        struct stat dst{};
+        const std::string dstPath = depot + '/' + rel;
+        const bool exists = ::lstat(dstPath.c_str(), &dst) == 0;
+        if (exists && S_ISDIR(dst.st_mode)) {
+            // a directory in the depot is replaced by a file
+            const std::pair<qint64,qint64> depotStats = depotEntryStats(depot, rel, filter);
+            job.files -= depotStats.first;
+            job.size -= depotStats.second;
+            job.deletedFiles += depotStats.first;
+        }
+        if (!exists || S_ISDIR(dst.st_mode)) {
+            job.files++;
+            job.createdFiles++;
+            job.size += src.st_size;
+        } else {
+            job.size += src.st_size - dst.st_size;
+        }
+        if (!exists || src.st_size != dst.st_size || src.st_mtim.tv_sec != dst.st_mtim.tv_sec || src.st_mtim.tv_nsec != dst.st_mtim.tv_nsec || (src.st_mode & S_IFMT) != (dst.st_mode & S_IFMT)) {
+            job.transferredFiles++;
+            job.transferredBytes += src.st_size;
+        }
+    }
+
+    job.changed.assign(changed.cbegin(), changed.cend());
+}
+
+struct ChunkJob {
+    explicit ChunkJob(const QString &storePath) : store(storePath) {}
+    ChunkStore store;
+    ChunkSnapshot previous;
+    ChunkSnapshot current;
+    QString error;
+    QString warning;
+    bool success = false;
+};
+
+// creates the snapshot with create() against the latest snapshot of id and saves it after its chunks have been committed
+bool storeChunks(ChunkJob &job, const QString &id, const std::function<bool()> &create)
+{
+    if (!job.store.open()) {
+        job.error = job.store.errorString();
+        return false;
+    }
+    const QString snapshotDir = job.store.snapshotDir(id);
+    const QString latest = ChunkSnapshot::latest(snapshotDir);
+    // without a previous snapshot all files are read
+    if (!latest.isEmpty() && !job.previous.map(latest)) {
+        job.warning = job.previous.errorString();
+    }
+    if (!create()) {
+        job.error = job.current.errorString();
+        return false;
+    }
+    if (!job.store.commit()) {
+        job.error = job.store.errorString();
+        return false;
+    }
+    if (!job.current.save(snapshotDir)) {
+        job.error = job.current.errorString();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Adds the values of the rsync --stats output to stats and returns the "Total file size".
+ * The values are added so that the output of multiple rsync processes for the same
+ * directory can be combined. With linkDest the regular files that have not been
+ * transferred are counted as hard linked to the previous generation.
+ */
+qint64 addRsyncStats(const QByteArray &stdOut, BackupStats &stats, bool linkDest = false)
+{
+    const QString output = QString::fromUtf8(stdOut);
+    const qint64 totalSize = statsBytes(output, QLatin1String("Total file size"));
+    const qint64 transferredSize = statsBytes(output, QLatin1String("Total transferred file size"));
+    stats.filesAfter += statsFileCount(output, QLatin1String("Number of files"));
+    stats.sizeAfter += totalSize;
+    stats.created += statsFileCount(output, QLatin1String("Number of created files"));
+    stats.deleted += statsFileCount(output, QLatin1String("Number of deleted files"));
+    const QRegularExpression transferredRe(QStringLiteral("^Number of regular files transferred: ([\\d,.']+)"), QRegularExpression::MultilineOption);
+    const QRegularExpressionMatch transferredMatch = transferredRe.match(output);
+    const qint64 transferred = transferredMatch.hasMatch() ? statsNumber(transferredMatch.captured(1)) : 0;
+    stats.transferredFiles += transferred;
+    stats.transferredBytes += transferredSize;
+    if (linkDest) {
+        static const QRegularExpression regRe(QStringLiteral("^Number of files: [\\d,.']+ \\(reg: ([\\d,.']+)"), QRegularExpression::MultilineOption);
+        const QRegularExpressionMatch regMatch = regRe.match(output);
+        if (regMatch.hasMatch()) {
+            stats.linkedFiles += std::max<qint64>(statsNumber(regMatch.captured(1)) - transferred, 0);
+            stats.linkedBytes += std::max<qint64>(totalSize - transferredSize, 0);
+        }
+    }
+    stats.literalBytes += statsBytes(output, QLatin1String("Literal data"));
+    stats.matchedBytes += statsBytes(output, QLatin1String("Matched data"));
+    return totalSize;
+}
+
+// takes over owner, mode, extended attributes and ACLs and the times of the directory from
+bool copyDirAttributes(const QByteArray &from, const QByteArray &to)
+{
+    struct stat st{};
+    if (::stat(from.constData(), &st) != 0 || ::lchown(to.constData(), st.st_uid, st.st_gid) != 0 || ::chmod(to.constData(), st.st_mode & 07777) != 0) {
+        return false;
+    }
+
+    const ssize_t listSize = ::llistxattr(from.constData(), nullptr, 0);
+    if (listSize > 0) {
+        std::vector<char> names(static_cast<std::size_t>(listSize));
+        const ssize_t len = ::llistxattr(from.constData(), names.data(), names.size());
+        for (ssize_t pos = 0; pos < len; pos += static_cast<ssize_t>(std::strlen(names.data() + pos)) + 1) {
+            const char *name = names.data() + pos;
+            const ssize_t valueSize = ::lgetxattr(from.constData(), name, nullptr, 0);
+            if (valueSize < 0) {
+                continue;
+            }
+            std::vector<char> value(static_cast<std::size_t>(valueSize));
+            const ssize_t valueLen = ::lgetxattr(from.constData(), name, value.data(), value.size());
+            if (valueLen >= 0 && ::lsetxattr(to.constData(), name, value.data(), static_cast<std::size_t>(valueLen), 0) != 0 && errno != ENOTSUP) {
+                return false;
+            }
+        }
+    }
+
+    const std::array<struct timespec, 2> times{st.st_atim, st.st_mtim};
+    return ::utimensat(AT_FDCWD, to.constData(), times.data(), 0) == 0;
+}
+}
 
 AbstractBackup::AbstractBackup(const QString &type, const QString &configFile, const QString &target, const QString &tempDir, const QVariantMap &options, QObject *parent)
     : QObject(parent),
@@ -19,7 +328,7 @@ AbstractBackup::AbstractBackup(const QString &type, const QString &configFile, c
       m_target(target),
       m_tempDir(tempDir)
 {
-
+    setObjectName(option(QStringLiteral("name")).toString());
 }
 
 AbstractBackup::~AbstractBackup() = default;
@@ -33,8 +342,6 @@ void AbstractBackup::startBackup()
 {
     setStartTime();
 
-    setObjectName(option(QStringLiteral("name")).toString());
-
     //% "Starting backup"
     logInfo(qtTrId("SIHHURI_INFO_START_BACKUP_ITEM"));
 
@@ -84,6 +391,94 @@ void AbstractBackup::startBackup()
         }
     }
 
+    const QString snapshotMode = option(QStringLiteral("snapshot")).toString();
+    if (snapshotMode.compare(QLatin1String("btrfs"), Qt::CaseInsensitive) == 0) {
+        m_snapshotMode = BtrfsSnapshot;
+    } else if (snapshotMode.compare(QLatin1String("reflink"), Qt::CaseInsensitive) == 0) {
+        m_snapshotMode = ReflinkSnapshot;
+    } else if (!snapshotMode.isEmpty() && snapshotMode.compare(QLatin1String("none"), Qt::CaseInsensitive) != 0) {
+        //% "%1 is not a valid snapshot mode. Valid modes are btrfs, reflink and none."
+        logError(qtTrId("SIHHURI_CRIT_INVALID_SNAPSHOT_MODE").arg(snapshotMode));
+        emitFinished();
+        return;
+    }
+
+    const QString syncEngine = option(QStringLiteral("engine")).toString();
+    if (syncEngine.compare(QLatin1String("native"), Qt::CaseInsensitive) == 0) {
+        m_syncEngine = NativeEngine;
+    } else if (!syncEngine.isEmpty() && syncEngine.compare(QLatin1String("rsync"), Qt::CaseInsensitive) != 0) {
+        //% "%1 is not a valid sync engine. Valid engines are rsync and native."
+        logError(qtTrId("SIHHURI_CRIT_INVALID_SYNC_ENGINE").arg(syncEngine));
+        emitFinished();
+        return;
+    }
+
+    const QString depotFormat = option(QStringLiteral("depotFormat")).toString();
+    if (depotFormat.compare(QLatin1String("cdc"), Qt::CaseInsensitive) == 0) {
+        m_depotFormat = ChunkDepot;
+    } else if (!depotFormat.isEmpty() && depotFormat.compare(QLatin1String("mirror"), Qt::CaseInsensitive) != 0) {
+        //% "%1 is not a valid depot format. Valid formats are mirror and cdc."
+        logError(qtTrId("SIHHURI_CRIT_INVALID_DEPOT_FORMAT").arg(depotFormat));
+        emitFinished();
+        return;
+    }
+
+    // the snapshot staging areas are at the roots of the mounts and therefore inside of synced directories
+    QStringList excludes = option(QStringLiteral("exclude")).toStringList();
+    excludes.append(QLatin1String(snapshotDirName) + QLatin1Char('/'));
+    m_filter = PathFilter(option(QStringLiteral("include")).toStringList(), excludes);
+    if (!m_filter.isValid()) {
+        //% "Invalid include or exclude pattern: %1"
+        logError(qtTrId("SIHHURI_CRIT_INVALID_FILTER").arg(m_filter.errorString()));
+        emitFinished();
+        return;
+    }
+
+    // either a list or a comma separated string
+    QStringList preserve = option(QStringLiteral("preserve")).toStringList();
+    if (preserve.size() == 1) {
+        preserve = preserve.first().split(QLatin1Char(','), Qt::SkipEmptyParts);
+    }
+    for (const QString &entry : std::as_const(preserve)) {
+        const QString name = entry.trimmed().toLower();
+        if (name == QLatin1String("hardlinks")) {
+            m_preserve.hardLinks = true;
+        } else if (name == QLatin1String("acls")) {
+            m_preserve.acls = true;
+        } else if (name == QLatin1String("xattrs")) {
+            m_preserve.xattrs = true;
+        } else if (name == QLatin1String("sparse")) {
+            m_preserve.sparse = true;
+        } else {
+            //% "%1 can not be preserved. Valid values are hardlinks, acls, xattrs and sparse."
+            logError(qtTrId("SIHHURI_CRIT_INVALID_PRESERVE").arg(entry));
+            emitFinished();
+            return;
+        }
+    }
+
+    m_parallelSync = std::max(option(QStringLiteral("parallelSync"), 1).toInt(), 1);
+    // snapshots in the chunk store compare against their previous snapshot on their own
+    m_useIndex = m_depotFormat == MirrorDepot && option(QStringLiteral("index"), false).toBool();
+    m_useJournal = m_depotFormat == MirrorDepot && option(QStringLiteral("journal"), false).toBool();
+    m_useManifest = m_depotFormat == MirrorDepot && option(QStringLiteral("manifest"), false).toBool();
+
+    if (m_depotFormat == MirrorDepot && option(QStringLiteral("generations"), false).toBool()) {
+        m_generation = QDateTime::currentDateTimeUtc().toString(QStringLiteral("yyyyMMdd'T'HHmmss'Z'"));
+        // empty if there is no previous generation yet
+        m_linkDest = QFileInfo(generationsPath() + QLatin1String("/latest")).canonicalFilePath();
+        // every generation starts empty, the index and the journal only describe the previous one
+        if (m_useIndex || m_useJournal) {
+            //% "The index and journal options have no effect together with the generations option, every generation is synced completely against the previous one."
+            logWarning(qtTrId("SIHHURI_WARN_INDEX_JOURNAL_WITH_GENERATIONS"));
+        }
+        m_useIndex = false;
+        m_useJournal = false;
+        m_keepDaily = option(QStringLiteral("keepDaily"), 0).toInt();
+        m_keepWeekly = option(QStringLiteral("keepWeekly"), 0).toInt();
+        m_keepMonthly = option(QStringLiteral("keepMonthly"), 0).toInt();
+    }
+
     if (!loadConfiguration()) {
         emitFinished();
         return;
@@ -98,7 +493,7 @@ void AbstractBackup::isTimerServiceActive()
 {
 
     if (m_timer.isEmpty()) {
-        enableMaintenance();
+        beforeMaintenance();
         return;
     }
 
@@ -118,7 +513,7 @@ void AbstractBackup::isTimerServiceActive()
             } else {
                 //% "Waited %1 seconds for %2 to finish without success."
                 logWarning(qtTrId("SIHHURI_WARN_SERVICE_ACTIVE_TOO_LONG").arg(QString::number(m_waitSecondsIsServiceActive * m_maxTryIsServiceActive), timerService));
-                enableMaintenance();
+                beforeMaintenance();
             }
         } else if (exitCode != 0 && exitStatus == QProcess::NormalExit) {
             stopTimer();
@@ -135,11 +530,58 @@ void AbstractBackup::stopTimer()
 {
     auto systemctl = stopSystemdTimer(m_timer);
     connect(systemctl, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this](int exitCode, QProcess::ExitStatus exitStatus){
-        enableMaintenance();
+        beforeMaintenance();
     });
     systemctl->start();
 }
 
+bool AbstractBackup::supportsPreSync() const
+{
+    return false;
+}
+
+void AbstractBackup::beforeMaintenance()
+{
+    // with snapshots the maintenance window is short anyway, so a pre-sync would only add load
+    if (supportsPreSync() && m_snapshotMode == NoSnapshot && option(QStringLiteral("presync"), true).toBool() && !m_dirQueue.empty()) {
+        preSync();
+    } else {
+        startMaintenance();
+    }
+}
+
+void AbstractBackup::preSync()
+{
+    //% "Starting live pre-sync of directories before enabling maintenance mode."
+    logInfo(qtTrId("SIHHURI_INFO_START_PRESYNC"));
+    m_phaseTimeStart = std::chrono::high_resolution_clock::now();
+    m_finalSyncQueue = m_dirQueue;
+    m_syncPhase = BackupStats::PreSync;
+    connect(this, &AbstractBackup::backupDirectoriesFinished, this, &AbstractBackup::onPreSyncFinished, Qt::SingleShotConnection);
+    backupDirectories();
+}
+
+void AbstractBackup::onPreSyncFinished()
+{
+    const auto now = std::chrono::high_resolution_clock::now();
+    m_preSyncTime = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_phaseTimeStart).count());
+    QLocale locale;
+    //% "Finished live pre-sync in %1 milliseconds."
+    logInfo(qtTrId("SIHHURI_INFO_FINISHED_PRESYNC").arg(locale.toString(m_preSyncTime)));
+
+    m_dirQueue = m_finalSyncQueue;
+    m_finalSyncQueue.clear();
+    m_syncPhase = BackupStats::FinalSync;
+    startMaintenance();
+}
+
+void AbstractBackup::startMaintenance()
+{
+    m_phaseTimeStart = std::chrono::high_resolution_clock::now();
+    m_inMaintenance = true;
+    enableMaintenance();
+}
+
 void AbstractBackup::enableMaintenance()
 {
     doBackup();
@@ -152,23 +594,402 @@ void AbstractBackup::doBackup()
 
 void AbstractBackup::backupDirectories()
 {
+    if (m_syncPhase != BackupStats::PreSync && m_snapshotMode != NoSnapshot && !m_snapshotsCaptured) {
+        m_snapshotsCaptured = true;
+        m_captureQueue = m_dirQueue;
+        m_dirQueue.clear();
+        captureNextSnapshot();
+        return;
+    }
+
     if (m_dirQueue.empty()) {
         emit backupDirectoriesFinished(QPrivateSignal());
         return;
     }
 
-    setStepStartTime();
-
     const QString dir = m_dirQueue.dequeue();
 
+    syncDirectory(dir, QString(), [this](){
+        backupDirectories();
+    });
+}
+
+void AbstractBackup::syncDirectory(const QString &dir, const QString &snapshotRoot, const std::function<void ()> &next)
+{
+    setStepStartTime();
+
     //% "Started syncing %1."
     logInfo(qtTrId("SIHHURI_INFO_START_RSYNC").arg(dir));
 
     m_currentStats = BackupStats();
     m_currentStats.type = BackupStats::Directory;
+    m_currentStats.phase = m_syncPhase;
     m_currentStats.id = dir;
 
-    const std::pair<qint64,qint64> dirSizeBefore = getDirSize(target() + dir);
+    m_fullSync = true;
+    if (m_depotFormat == ChunkDepot) {
+        syncDirectoryChunked(dir, snapshotRoot, next);
+        return;
+    }
+
+    if (!m_generation.isEmpty() && !QDir().mkpath(depotPath())) {
+        //% "Failed to create generation directory %1."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_CREATE_GENERATION").arg(depotPath()));
+        next();
+        return;
+    }
+
+    if (m_useJournal) {
+        takeJournal(dir);
+        m_pendingJournal = m_journals.take(dir);
+        if (m_pendingJournal && m_pendingJournal->status() == ChangeJournal::Valid) {
+            const QDateTime lastFullSync = m_history ? m_history->lastFullSync(id(), dir) : QDateTime();
+            const std::pair<qint64,qint64> dirStats = m_history ? m_history->directoryStats(id(), dir) : std::make_pair(Q_INT64_C(-1), Q_INT64_C(-1));
+            const int fullSyncDays = option(QStringLiteral("journalFullSyncDays"), 7).toInt();
+            if (dirStats.first < 0 || dirStats.second < 0 || !lastFullSync.isValid()) {
+                //% "No complete sync of %1 is known, syncing the complete directory."
+                logInfo(qtTrId("SIHHURI_INFO_JOURNAL_NO_FULL_SYNC").arg(dir));
+            } else if (fullSyncDays > 0 && lastFullSync.addDays(fullSyncDays) <= QDateTime::currentDateTime()) {
+                //% "The last complete sync of %1 is older than %n day(s), syncing the complete directory."
+                logInfo(qtTrId("SIHHURI_INFO_JOURNAL_FULL_SYNC_DUE", fullSyncDays).arg(dir));
+            } else {
+                m_fullSync = false;
+                syncDirectoryJournaled(dir, snapshotRoot, dirStats, next);
+                return;
+            }
+        }
+    }
+
+    if (m_useIndex) {
+        syncDirectoryIndexed(dir, snapshotRoot, next);
+    } else {
+        syncDirectoryFull(dir, snapshotRoot, next);
+    }
+}
+
+QString AbstractBackup::depotPath() const
+{
+    return m_generation.isEmpty() ? target() : generationsPath() + QLatin1Char('/') + m_generation;
+}
+
+QString AbstractBackup::generationsPath() const
+{
+    // all items share the target, every item has its own generations and latest link
+    return target() + QLatin1String("/generations/") + QString::fromLatin1(QUrl::toPercentEncoding(id()));
+}
+
+QStringList AbstractBackup::linkDestArgs() const
+{
+    if (m_linkDest.isEmpty()) {
+        return {};
+    }
+    return {QStringLiteral("--link-dest=") + m_linkDest};
+}
+
+QStringList AbstractBackup::preserveArgs() const
+{
+    QStringList args;
+    if (m_preserve.hardLinks) {
+        args << QStringLiteral("-H");
+    }
+    if (m_preserve.acls) {
+        args << QStringLiteral("-A");
+    }
+    if (m_preserve.xattrs) {
+        args << QStringLiteral("-X");
+    }
+    if (m_preserve.sparse) {
+        args << QStringLiteral("-S");
+    }
+    return args;
+}
+
+void AbstractBackup::switchLatestGeneration()
+{
+    // the symbolic link is replaced atomically, so latest always points to a complete generation
+    const QString latest = generationsPath() + QLatin1String("/latest");
+    const QByteArray tmpPath = QFile::encodeName(latest + QLatin1String(".tmp"));
+    const QByteArray linkTarget = QFile::encodeName(m_generation);
+    ::unlink(tmpPath.constData());
+    if (::symlink(linkTarget.constData(), tmpPath.constData()) != 0 || ::rename(tmpPath.constData(), QFile::encodeName(latest).constData()) != 0) {
+        const QString error = qt_error_string(errno);
+        ::unlink(tmpPath.constData());
+        //% "Failed to set %1 as latest generation: %2"
+        logError(qtTrId("SIHHURI_CRIT_FAILED_SWITCH_GENERATION").arg(m_generation, error));
+        return;
+    }
+    //% "Generation %1 is the latest generation now."
+    logInfo(qtTrId("SIHHURI_INFO_SWITCHED_GENERATION").arg(m_generation));
+}
+
+void AbstractBackup::markIncompleteGeneration()
+{
+    const QString incomplete = m_generation + QLatin1String(".incomplete");
+    if (!QDir(generationsPath()).rename(m_generation, incomplete)) {
+        //% "Failed to mark generation %1 as incomplete."
+        logWarning(qtTrId("SIHHURI_WARN_FAILED_MARK_INCOMPLETE_GENERATION").arg(m_generation));
+        return;
+    }
+    //% "Generation %1 is incomplete and will not be used as latest generation."
+    logWarning(qtTrId("SIHHURI_WARN_INCOMPLETE_GENERATION").arg(incomplete));
+    m_generation = incomplete;
+}
+
+bool AbstractBackup::pruneGenerations()
+{
+    RetentionPruner::Policy policy;
+    policy.daily = m_keepDaily;
+    policy.weekly = m_keepWeekly;
+    policy.monthly = m_keepMonthly;
+    if (policy.isEmpty()) {
+        return false;
+    }
+
+    //% "Pruning generations, keeping %1 daily, %2 weekly and %3 monthly generations."
+    logInfo(qtTrId("SIHHURI_INFO_START_PRUNE_GENERATIONS").arg(QString::number(m_keepDaily), QString::number(m_keepWeekly), QString::number(m_keepMonthly)));
+    setStepStartTime();
+
+    const QString latest = QFileInfo(QFileInfo(generationsPath() + QLatin1String("/latest")).canonicalFilePath()).fileName();
+    auto pruner = std::make_shared<RetentionPruner>(generationsPath(), latest, policy, option(QStringLiteral("pruneThreads"), 0).toInt());
+    QThread *thread = QThread::create([pruner](){
+        pruner->run();
+    });
+    connect(thread, &QThread::finished, this, [this, thread, pruner](){
+        thread->deleteLater();
+        const RetentionPruner::Result result = pruner->result();
+        if (!pruner->errorString().isEmpty()) {
+            //% "Failed to prune generations: %1"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_PRUNE_GENERATIONS").arg(pruner->errorString()));
+        } else if (result.errors > 0) {
+            //% "Failed to remove %n entries while pruning generations."
+            logWarning(qtTrId("SIHHURI_WARN_PRUNE_GENERATIONS_ERRORS", static_cast<int>(result.errors)));
+        }
+
+        BackupStats stats;
+        stats.type = BackupStats::Retention;
+        stats.id = QStringLiteral("generations");
+        stats.prunedGenerations = result.generations;
+        stats.reclaimedBytes = result.reclaimedBytes;
+        stats.timeUsed = getStepTimeUsed();
+        QLocale locale;
+        //% "Removed %1 generations with %2 files in %3 milliseconds, reclaimed %4."
+        logInfo(qtTrId("SIHHURI_INFO_FINISHED_PRUNE_GENERATIONS").arg(locale.toString(result.generations), locale.toString(result.files), locale.toString(stats.timeUsed), locale.formattedDataSize(result.reclaimedBytes)));
+        addStatistic(stats);
+        finishItem();
+    });
+    thread->start();
+    return true;
+}
+
+QString AbstractBackup::chunkStorePath() const
+{
+    return option(QStringLiteral("chunkStore"), QString(target() + QLatin1String("/.sihhuri-chunks"))).toString();
+}
+
+bool AbstractBackup::isChunkDepot() const
+{
+    return m_depotFormat == ChunkDepot;
+}
+
+void AbstractBackup::syncDirectoryChunked(const QString &dir, const QString &snapshotRoot, const std::function<void ()> &next)
+{
+    auto job = std::make_shared<ChunkJob>(chunkStorePath());
+    const QString sourcePath = snapshotRoot + dir;
+    const bool strict = strictIndexCompare(snapshotRoot);
+    const int threads = option(QStringLiteral("syncThreads"), 0).toInt();
+
+    job->current.setFilter(m_filter);
+
+    QThread *thread = QThread::create([job, dir, sourcePath, strict, threads](){
+        job->success = storeChunks(*job, dir, [job, sourcePath, strict, threads](){
+            return job->current.create(job->store, sourcePath, job->previous, strict, threads);
+        });
+    });
+    connect(thread, &QThread::finished, this, [this, thread, job, dir, next](){
+        thread->deleteLater();
+
+        if (!job->warning.isEmpty()) {
+            //% "Failed to load the previous snapshot of %1, reading all files: %2"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_LOAD_CHUNK_SNAPSHOT").arg(dir, job->warning));
+        }
+
+        if (!job->success) {
+            //% "Failed to store %1 in the chunk store: %2"
+            logError(qtTrId("SIHHURI_CRIT_FAILED_STORE_CHUNKS").arg(dir, job->error));
+            finishSync(dir, false, next);
+            return;
+        }
+
+        const ChunkSnapshot::Result result = job->current.result();
+        m_currentStats.filesBefore = result.filesBefore;
+        m_currentStats.sizeBefore = result.sizeBefore;
+        m_currentStats.filesAfter = result.files;
+        m_currentStats.sizeAfter = result.size;
+        m_currentStats.created = result.createdFiles;
+        m_currentStats.deleted = result.deletedFiles;
+        m_currentStats.transferredFiles = result.changedFiles;
+        m_currentStats.transferredBytes = result.changedBytes;
+        // only the new chunks are written, the rest of the changed files is deduplicated
+        m_currentStats.literalBytes = result.newBytes;
+        m_currentStats.matchedBytes = result.changedBytes - result.newBytes;
+
+        QLocale locale;
+        //% "Created snapshot %1 of %2 with %3 new chunks."
+        logInfo(qtTrId("SIHHURI_INFO_CHUNK_SNAPSHOT").arg(job->current.filePath(), dir, locale.toString(result.newChunks)));
+        finishSync(dir, true, next);
+    });
+    thread->start();
+}
+
+void AbstractBackup::storeFileChunks(const QString &filePath, const QString &snapshotId, const std::function<void (bool, qint64)> &next)
+{
+    auto job = std::make_shared<ChunkJob>(chunkStorePath());
+    const int threads = option(QStringLiteral("syncThreads"), 0).toInt();
+
+    QThread *thread = QThread::create([job, filePath, snapshotId, threads](){
+        job->success = storeChunks(*job, snapshotId, [job, filePath, threads](){
+            return job->current.createFromFile(job->store, filePath, job->previous, threads);
+        });
+    });
+    connect(thread, &QThread::finished, this, [this, thread, job, filePath, next](){
+        thread->deleteLater();
+
+        if (!job->warning.isEmpty()) {
+            //% "Failed to load the previous snapshot of %1, reading all files: %2"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_LOAD_CHUNK_SNAPSHOT").arg(filePath, job->warning));
+        }
+
+        if (!job->success) {
+            //% "Failed to store %1 in the chunk store: %2"
+            logError(qtTrId("SIHHURI_CRIT_FAILED_STORE_CHUNKS").arg(filePath, job->error));
+            next(false, 0);
+            return;
+        }
+
+        QLocale locale;
+        //% "Created snapshot %1 of %2 with %3 new chunks."
+        logInfo(qtTrId("SIHHURI_INFO_CHUNK_SNAPSHOT").arg(job->current.filePath(), filePath, locale.toString(job->current.result().newChunks)));
+        next(true, job->current.result().newBytes);
+    });
+    thread->start();
+}
+
+void AbstractBackup::storeDirectoryChunks(const QString &dirPath, const QString &snapshotId, const std::function<void (bool, qint64)> &next)
+{
+    auto job = std::make_shared<ChunkJob>(chunkStorePath());
+    const int threads = option(QStringLiteral("syncThreads"), 0).toInt();
+
+    QThread *thread = QThread::create([job, dirPath, snapshotId, threads](){
+        job->success = storeChunks(*job, snapshotId, [job, dirPath, threads](){
+            return job->current.create(job->store, dirPath, job->previous, true, threads);
+        });
+    });
+    connect(thread, &QThread::finished, this, [this, thread, job, dirPath, next](){
+        thread->deleteLater();
+
+        if (!job->warning.isEmpty()) {
+            //% "Failed to load the previous snapshot of %1, reading all files: %2"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_LOAD_CHUNK_SNAPSHOT").arg(dirPath, job->warning));
+        }
+
+        if (!job->success) {
+            //% "Failed to store %1 in the chunk store: %2"
+            logError(qtTrId("SIHHURI_CRIT_FAILED_STORE_CHUNKS").arg(dirPath, job->error));
+            next(false, 0);
+            return;
+        }
+
+        QLocale locale;
+        //% "Created snapshot %1 of %2 with %3 new chunks."
+        logInfo(qtTrId("SIHHURI_INFO_CHUNK_SNAPSHOT").arg(job->current.filePath(), dirPath, locale.toString(job->current.result().newChunks)));
+        next(true, job->current.result().newBytes);
+    });
+    thread->start();
+}
+
+void AbstractBackup::setJournalDir(const QString &journalDir)
+{
+    m_journalDir = journalDir;
+}
+
+void AbstractBackup::takeJournal(const QString &dir)
+{
+    if (!m_useJournal || m_journalDir.isEmpty() || m_journals.contains(dir)) {
+        return;
+    }
+
+    auto journal = std::make_shared<ChangeJournal>(m_journalDir, dir);
+    switch (journal->take(option(QStringLiteral("journalMaxEntries"), 1000000).toLongLong())) {
+    case ChangeJournal::Valid:
+        break;
+    case ChangeJournal::Inactive:
+        //% "No change recorder is running for %1, syncing the complete directory."
+        logInfo(qtTrId("SIHHURI_INFO_JOURNAL_INACTIVE").arg(dir));
+        break;
+    case ChangeJournal::Incomplete:
+        //% "The change journal of %1 is incomplete, syncing the complete directory."
+        logInfo(qtTrId("SIHHURI_INFO_JOURNAL_INCOMPLETE").arg(dir));
+        break;
+    case ChangeJournal::Failed:
+        //% "Failed to read the change journal of %1, syncing the complete directory: %2"
+        logWarning(qtTrId("SIHHURI_WARN_JOURNAL_FAILED").arg(dir, journal->errorString()));
+        break;
+    }
+    m_journals.insert(dir, journal);
+}
+
+void AbstractBackup::syncDirectoryJournaled(const QString &dir, const QString &snapshotRoot, std::pair<qint64,qint64> dirStats, const std::function<void ()> &next)
+{
+    m_currentStats.filesBefore = dirStats.first;
+    m_currentStats.sizeBefore = dirStats.second;
+
+    const std::shared_ptr<ChangeJournal> journal = m_pendingJournal;
+    QLocale locale;
+    //% "Change journal of %1: %2 changed entries."
+    logInfo(qtTrId("SIHHURI_INFO_JOURNAL_CHANGES").arg(dir, locale.toString(journal->changed().size())));
+
+    auto job = std::make_shared<JournalJob>();
+    const std::string source = QFile::encodeName(snapshotRoot + dir).toStdString();
+    const std::string depot = QFile::encodeName(target() + dir).toStdString();
+
+    const PathFilter filter = m_filter;
+    QThread *thread = QThread::create([job, journal, source, depot, filter](){
+        prepareJournalJob(*job, *journal, source, depot, filter);
+    });
+    connect(thread, &QThread::finished, this, [this, thread, job, dir, snapshotRoot, next](){
+        thread->deleteLater();
+
+        m_currentStats.filesAfter = m_currentStats.filesBefore + job->files;
+        m_currentStats.sizeAfter = m_currentStats.sizeBefore + job->size;
+        m_currentStats.created = job->createdFiles;
+        m_currentStats.deleted = job->deletedFiles;
+        m_currentStats.transferredFiles = job->transferredFiles;
+        m_currentStats.transferredBytes = job->transferredBytes;
+        m_currentStats.literalBytes = job->transferredBytes;
+
+        if (job->changed.empty() && job->deleted.empty()) {
+            finishSync(dir, true, next);
+            return;
+        }
+
+        syncFileList(dir, snapshotRoot, job->changed, job->deleted, job->recursive, next);
+    });
+    thread->start();
+}
+
+void AbstractBackup::syncDirectoryFull(const QString &dir, const QString &snapshotRoot, const std::function<void ()> &next)
+{
+    // the depot only changes by our syncs, so its content is what the last sync left behind,
+    // only if that is unknown the depot has to be walked
+    std::pair<qint64,qint64> dirSizeBefore = m_history ? m_history->directoryStats(id(), dir) : std::make_pair(Q_INT64_C(-1), Q_INT64_C(-1));
+    if (dirSizeBefore.first < 0 || dirSizeBefore.second < 0) {
+        // a new generation is compared with the previous one
+        if (m_generation.isEmpty()) {
+            dirSizeBefore = getDirSize(target() + dir);
+        } else {
+            dirSizeBefore = m_linkDest.isEmpty() ? std::make_pair(Q_INT64_C(0), Q_INT64_C(0)) : getDirSize(m_linkDest + dir);
+        }
+    }
     m_currentStats.filesBefore = dirSizeBefore.first;
     m_currentStats.sizeBefore = dirSizeBefore.second;
 
@@ -176,31 +997,634 @@ void AbstractBackup::backupDirectories()
     //% "Current size of the backed up data for %1: Files: %2, Size: %3"
     logInfo(qtTrId("SIHHURI_INFO_CURRENT_DIR_SIZE").arg(dir, locale.toString(m_currentStats.filesBefore), locale.formattedDataSize(m_currentStats.sizeBefore)));
 
+    const QString source = rsyncSource(snapshotRoot, dir);
+    if (m_syncEngine == NativeEngine) {
+        auto engine = std::make_shared<SyncEngine>(snapshotRoot, dir, depotPath(), option(QStringLiteral("syncThreads"), 0).toInt());
+        engine->setFilter(m_filter);
+        engine->setPreserve(m_preserve);
+        if (!m_linkDest.isEmpty()) {
+            engine->setLinkDest(m_linkDest);
+        }
+        runSyncEngine(engine, dir, next);
+        return;
+    }
+
+    if (m_parallelSync > 1) {
+        const QStringList subtreeList = subtrees(snapshotRoot + dir);
+        if (!subtreeList.empty()) {
+            syncDirectoryParallel(dir, snapshotRoot, subtreeList, next);
+            return;
+        }
+    }
+
     auto rsync = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
     rsync->setProgram(QStringLiteral("rsync"));
-    rsync->setArguments({QStringLiteral("-aR"), QStringLiteral("--delete"), QStringLiteral("--delete-after"), dir, target()});
+    QStringList args({QStringLiteral("-aR"), QStringLiteral("--delete"), QStringLiteral("--delete-after"), QStringLiteral("--stats")});
+    args << preserveArgs() << linkDestArgs() << m_filter.rsyncArgs(dir) << source << depotPath();
+    rsync->setArguments(args);
     connect(rsync, &QProcess::readyReadStandardError, this, [this, rsync](){
         logCritical(QStringLiteral("rsync: %1").arg(QString::fromUtf8(rsync->readAllStandardError())));
     });
-    connect(rsync, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, dir](int exitCode, QProcess::ExitStatus exitStatus){
-        if (exitCode == 0 && exitStatus == QProcess::NormalExit) {
-            const std::pair<qint64,qint64> dirSizeAfter = getDirSize(dir);
-            m_currentStats.filesAfter = dirSizeAfter.first;
-            m_currentStats.sizeAfter = dirSizeAfter.second;
-            m_currentStats.timeUsed = getStepTimeUsed();
-            QLocale locale;
-            //% "Finished syncing %1 in %2 milliseconds: Files: %3, Size: %4"
-            logInfo(qtTrId("SIHHURI_INFO_FINISHED_RSYNC").arg(dir, locale.toString(m_currentStats.timeUsed), locale.toString(m_currentStats.filesAfter), locale.formattedDataSize(m_currentStats.sizeAfter)));
-            addStatistic(m_currentStats);
+    connect(rsync, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, rsync, dir, next](int exitCode, QProcess::ExitStatus exitStatus){
+        const bool success = exitCode == 0 && exitStatus == QProcess::NormalExit;
+        if (success) {
+            addRsyncStats(rsync->readAllStandardOutput(), m_currentStats, !m_linkDest.isEmpty());
+            addPreserveStats(dir);
+        }
+        finishSync(dir, success, next);
+    });
+    rsync->start();
+}
+
+void AbstractBackup::runSyncEngine(const std::shared_ptr<SyncEngine> &engine, const QString &dir, const std::function<void ()> &next)
+{
+    QThread *thread = QThread::create([engine](){
+        engine->run();
+    });
+    connect(thread, &QThread::finished, this, [this, thread, engine, dir, next](){
+        thread->deleteLater();
+        const QStringList errors = engine->errors();
+        for (const QString &error : errors) {
+            logCritical(QStringLiteral("sync: %1").arg(error));
+        }
+        const SyncEngine::Result result = engine->result();
+        // with a file list the statistics have already been taken from the file index
+        if (!engine->hasFileList()) {
+            m_currentStats.filesAfter = result.files;
+            m_currentStats.sizeAfter = result.totalSize;
+            m_currentStats.created = result.created;
+            m_currentStats.deleted = result.deleted;
+            m_currentStats.transferredFiles = result.transferred;
+            m_currentStats.transferredBytes = result.transferredBytes;
+            // the native engine copies whole files
+            m_currentStats.literalBytes = result.transferredBytes;
+            m_currentStats.linkedFiles = result.linked;
+            m_currentStats.linkedBytes = result.linkedBytes;
+            m_currentStats.hardLinkedFiles = result.hardLinked;
+            m_currentStats.hardLinkedBytes = result.hardLinkedBytes;
+            m_currentStats.sparseBytes = result.sparseBytes;
         } else {
-            //% "Failed to sync %1."
-            logError(qtTrId("SIHHURI_CRIT_FAILED_RSYNC").arg(dir));
+            // the file list only covers the changed entries
+            addPreserveStats(dir);
         }
-        backupDirectories();
+        QLocale locale;
+        //% "Native sync of %1 with %2 threads, %3 files have been copied as reflink."
+        logInfo(qtTrId("SIHHURI_INFO_NATIVE_SYNC_RESULT").arg(dir, locale.toString(engine->threads()), locale.toString(result.reflinked)));
+        finishSync(dir, errors.empty(), next);
+    });
+    thread->start();
+}
+
+QString AbstractBackup::indexFilePath(const QString &dir) const
+{
+    const QString indexDir = option(QStringLiteral("indexDir"), QString(target() + QLatin1String("/.sihhuri-index"))).toString();
+    return indexDir + QLatin1Char('/') + QString::fromLatin1(QUrl::toPercentEncoding(dir)) + QLatin1String(".idx");
+}
+
+void AbstractBackup::syncDirectoryIndexed(const QString &dir, const QString &snapshotRoot, const std::function<void ()> &next)
+{
+    auto job = std::make_shared<IndexJob>();
+    const QString indexPath = indexFilePath(dir);
+    const QString sourcePath = snapshotRoot + dir;
+    const bool strict = strictIndexCompare(snapshotRoot);
+    const bool hashes = option(QStringLiteral("indexHashes"), true).toBool();
+    const int threads = option(QStringLiteral("syncThreads"), 0).toInt();
+
+    const PathFilter filter = m_filter;
+    job->current.setFilter(filter);
+
+    QThread *thread = QThread::create([job, indexPath, sourcePath, strict, hashes, threads, filter](){
+        job->mapped = job->previous.map(indexPath);
+        job->scanned = job->current.scan(sourcePath, threads);
+        if (!job->scanned) {
+            return;
+        }
+        if (job->mapped) {
+            job->changes = job->current.compareTo(job->previous, strict);
+            // entries that have been excluded after the last index was saved stay in the depot, like with rsync
+            std::vector<std::string> &deleted = job->changes.deleted;
+            deleted.erase(std::remove_if(deleted.begin(), deleted.end(), [&filter](const std::string &rel){
+                return filter.isPathExcluded(rel, false) || filter.isPathExcluded(rel, true);
+            }), deleted.end());
+        }
+        if (hashes) {
+            job->current.updateHashes(job->previous, job->changes, sourcePath, threads);
+        }
+    });
+    connect(thread, &QThread::finished, this, [this, thread, job, indexPath, dir, snapshotRoot, next](){
+        thread->deleteLater();
+
+        if (!job->scanned) {
+            // an incomplete scan would delete the entries it could not read from the depot,
+            // the index of the last run is kept for the next one
+            //% "Failed to scan %1 for the file index, syncing the complete directory: %2"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_SCAN_DIR").arg(snapshotRoot + dir, job->current.errorString()));
+            syncDirectoryFull(dir, snapshotRoot, next);
+            return;
+        }
+
+        // the index is saved after a successful sync, it shares the lifetime of the job
+        m_pendingIndex = std::shared_ptr<FileIndex>(job, &job->current);
+        m_pendingIndexPath = indexPath;
+
+        if (!job->mapped) {
+            //% "No file index available for %1, syncing the complete directory."
+            logInfo(qtTrId("SIHHURI_INFO_NO_FILE_INDEX").arg(dir));
+            syncDirectoryFull(dir, snapshotRoot, next);
+            return;
+        }
+
+        const FileIndex::Changes &changes = job->changes;
+        m_currentStats.filesBefore = changes.filesBefore;
+        m_currentStats.sizeBefore = changes.sizeBefore;
+        m_currentStats.filesAfter = changes.filesAfter;
+        m_currentStats.sizeAfter = changes.sizeAfter;
+        m_currentStats.created = changes.createdFiles;
+        m_currentStats.deleted = changes.deletedFiles;
+        m_currentStats.transferredFiles = changes.changedFiles;
+        m_currentStats.transferredBytes = changes.changedBytes;
+        m_currentStats.literalBytes = changes.changedBytes;
+
+        QLocale locale;
+        //% "File index of %1: %2 changed and %3 deleted entries."
+        logInfo(qtTrId("SIHHURI_INFO_FILE_INDEX_CHANGES").arg(dir, locale.toString(changes.changed.size()), locale.toString(changes.deleted.size())));
+
+        if (changes.changed.empty() && changes.deleted.empty()) {
+            m_pendingIndex.reset();
+            finishSync(dir, true, next);
+            return;
+        }
+
+        syncFileList(dir, snapshotRoot, changes.changed, changes.deleted, std::vector<std::string>(), next);
+    });
+    thread->start();
+}
+
+void AbstractBackup::syncFileList(const QString &dir, const QString &snapshotRoot, const std::vector<std::string> &changed, const std::vector<std::string> &deleted, const std::vector<std::string> &recursive, const std::function<void ()> &next)
+{
+    if (m_syncEngine == NativeEngine) {
+        auto engine = std::make_shared<SyncEngine>(snapshotRoot, dir, target(), option(QStringLiteral("syncThreads"), 0).toInt());
+        engine->setFilter(m_filter);
+        engine->setPreserve(m_preserve);
+        engine->setFileList(changed, deleted, recursive);
+        runSyncEngine(engine, dir, next);
+        return;
+    }
+
+    // rsync does not delete anything with --files-from and can not replace a directory by another type,
+    // so the deleted and replaced entries are removed first and rsync restores the times of their parents
+    auto engine = std::make_shared<SyncEngine>(snapshotRoot, dir, target(), option(QStringLiteral("syncThreads"), 0).toInt());
+    engine->setFilter(m_filter);
+    engine->setPreserve(m_preserve);
+    const std::string source = QFile::encodeName(snapshotRoot + dir).toStdString();
+    const std::string depot = QFile::encodeName(target() + dir).toStdString();
+
+    QThread *thread = QThread::create([engine, source, depot, changed, deleted](){
+        std::vector<std::string> remove = deleted;
+        for (const std::string &rel : changed) {
+            struct stat src{};
+            struct stat dst{};
+            if (::lstat((source + '/' + rel).c_str(), &src) == 0 && ::lstat((depot + '/' + rel).c_str(), &dst) == 0 && (src.st_mode & S_IFMT) != (dst.st_mode & S_IFMT)) {
+                remove.push_back(rel);
+            }
+        }
+        if (!remove.empty()) {
+            engine->setFileList(std::vector<std::string>(), std::move(remove));
+            engine->run();
+        }
+    });
+    connect(thread, &QThread::finished, this, [this, thread, engine, dir, snapshotRoot, changed, recursive, next](){
+        thread->deleteLater();
+        const QStringList errors = engine->errors();
+        for (const QString &error : errors) {
+            logCritical(QStringLiteral("sync: %1").arg(error));
+        }
+        if (!errors.empty()) {
+            finishSync(dir, false, next);
+            return;
+        }
+        syncFileListRsync(dir, snapshotRoot, changed, recursive, next);
+    });
+    thread->start();
+}
+
+void AbstractBackup::syncFileListRsync(const QString &dir, const QString &snapshotRoot, const std::vector<std::string> &changed, const std::vector<std::string> &recursive, const std::function<void ()> &next)
+{
+    // the recursive directories are mirrored by the native engine afterwards
+    auto list = std::make_shared<QTemporaryFile>(tempDir() + QLatin1String("/rsync-files-XXXXXX"));
+    if (!list->open()) {
+        //% "Failed to create temporary file %1: %2"
+        logError(qtTrId("SIHHURI_CRIT_FAILED_CREATE_TEMP_FILE").arg(list->fileTemplate(), list->errorString()));
+        finishSync(dir, false, next);
+        return;
+    }
+    // paths are relative to the source root, the directory itself restores its own attributes
+    const QByteArray dirPath = QFile::encodeName(dir.mid(1));
+    list->write(dirPath);
+    list->putChar('\0');
+    for (const std::string &path : changed) {
+        list->write(dirPath + '/' + QByteArray::fromStdString(path));
+        list->putChar('\0');
+    }
+    list->flush();
+
+    auto rsync = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+    rsync->setProgram(QStringLiteral("rsync"));
+    QStringList args({QStringLiteral("-aR"), QStringLiteral("--stats"), QStringLiteral("--from0"), QStringLiteral("--files-from=") + list->fileName()});
+    args << preserveArgs() << snapshotRoot + QLatin1Char('/') << target();
+    rsync->setArguments(args);
+    connect(rsync, &QProcess::readyReadStandardError, this, [this, rsync](){
+        logCritical(QStringLiteral("rsync: %1").arg(QString::fromUtf8(rsync->readAllStandardError())));
+    });
+    connect(rsync, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, rsync, list, recursive, dir, snapshotRoot, next](int exitCode, QProcess::ExitStatus exitStatus){
+        rsync->deleteLater();
+        if (exitCode != 0 || exitStatus != QProcess::NormalExit) {
+            finishSync(dir, false, next);
+            return;
+        }
+        BackupStats rsyncStats;
+        addRsyncStats(rsync->readAllStandardOutput(), rsyncStats);
+        m_currentStats.literalBytes = rsyncStats.literalBytes;
+        m_currentStats.matchedBytes = rsyncStats.matchedBytes;
+        if (recursive.empty()) {
+            addPreserveStats(dir);
+            finishSync(dir, true, next);
+            return;
+        }
+        auto engine = std::make_shared<SyncEngine>(snapshotRoot, dir, target(), option(QStringLiteral("syncThreads"), 0).toInt());
+        engine->setFilter(m_filter);
+        engine->setPreserve(m_preserve);
+        engine->setFileList(recursive, std::vector<std::string>(), recursive);
+        runSyncEngine(engine, dir, next);
+    });
+    rsync->start();
+}
+
+QString AbstractBackup::rsyncSource(const QString &snapshotRoot, const QString &path) const
+{
+    // the /./ marker lets rsync -R recreate only the original path below the target
+    return snapshotRoot.isEmpty() ? path : snapshotRoot + QLatin1String("/.") + path;
+}
+
+QStringList AbstractBackup::subtrees(const QString &sourcePath) const
+{
+    // top level sub trees of the split paths like data/<user> or repositories/<owner>,
+    // the split paths are relative to the synced directory, "." splits the directory itself
+    QStringList splitPaths = option(QStringLiteral("splitPaths")).toStringList();
+    if (splitPaths.empty()) {
+        splitPaths.append(QStringLiteral("."));
+    }
+    for (QString &splitPath : splitPaths) {
+        splitPath = QDir::cleanPath(splitPath);
+    }
+
+    QStringList list;
+    for (const QString &splitPath : std::as_const(splitPaths)) {
+        const QDir splitDir(sourcePath + QLatin1Char('/') + splitPath);
+        if (!splitDir.exists()) {
+            continue;
+        }
+        const QStringList children = splitDir.entryList(QDir::Dirs|QDir::NoDotAndDotDot|QDir::Hidden|QDir::System|QDir::NoSymLinks);
+        for (const QString &child : children) {
+            const QString subtree = splitPath == QLatin1String(".") ? child : splitPath + QLatin1Char('/') + child;
+            // nested split paths are handled on their own level
+            const bool containsSplitPath = std::any_of(splitPaths.cbegin(), splitPaths.cend(), [&subtree](const QString &sp){
+                return sp == subtree || sp.startsWith(subtree + QLatin1Char('/'));
+            });
+            if (!containsSplitPath && !m_filter.isPathExcluded(QFile::encodeName(subtree).toStdString(), true)) {
+                list.append(subtree);
+            }
+        }
+    }
+
+    return list;
+}
+
+void AbstractBackup::syncDirectoryParallel(const QString &dir, const QString &snapshotRoot, const QStringList &subtrees, const std::function<void ()> &next)
+{
+    m_parallel = ParallelSync();
+    m_parallel.dir = dir;
+    m_parallel.snapshotRoot = snapshotRoot;
+    m_parallel.subtrees = subtrees;
+    m_parallel.next = next;
+
+    // longest processing time first by the sizes of the last run, unknown sub trees might be big and start first
+    std::vector<std::pair<qint64,QString>> jobs;
+    jobs.reserve(subtrees.size());
+    for (const QString &subtree : subtrees) {
+        const qint64 lastSize = m_history ? m_history->subtreeSize(id(), dir + QLatin1Char('/') + subtree) : -1;
+        jobs.emplace_back(lastSize < 0 ? std::numeric_limits<qint64>::max() : lastSize, subtree);
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [](const auto &a, const auto &b){
+        return a.first > b.first;
+    });
+    for (const auto &job : jobs) {
+        m_parallel.queue.enqueue(job.second);
+    }
+
+    QLocale locale;
+    //% "Syncing %1 with %2 parallel rsync workers in %3 sub trees."
+    logInfo(qtTrId("SIHHURI_INFO_START_PARALLEL_RSYNC").arg(dir, locale.toString(m_parallelSync), locale.toString(subtrees.size())));
+
+    startSubtreeJobs();
+}
+
+void AbstractBackup::startSubtreeJobs()
+{
+    if (m_parallel.queue.empty() && m_parallel.running == 0) {
+        syncRemainder();
+        return;
+    }
+
+    while (!m_parallel.queue.empty() && m_parallel.running < m_parallelSync) {
+        const QString subtree = m_parallel.queue.dequeue();
+        const QString path = m_parallel.dir + QLatin1Char('/') + subtree;
+        m_parallel.running++;
+
+        auto rsync = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+        rsync->setProgram(QStringLiteral("rsync"));
+        QStringList args({QStringLiteral("-aR"), QStringLiteral("--delete"), QStringLiteral("--delete-after"), QStringLiteral("--stats")});
+        args << preserveArgs() << linkDestArgs() << m_filter.rsyncArgs(m_parallel.dir) << rsyncSource(m_parallel.snapshotRoot, path) << depotPath();
+        rsync->setArguments(args);
+        connect(rsync, &QProcess::readyReadStandardError, this, [this, rsync](){
+            logCritical(QStringLiteral("rsync: %1").arg(QString::fromUtf8(rsync->readAllStandardError())));
+        });
+        connect(rsync, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, rsync, path](int exitCode, QProcess::ExitStatus exitStatus){
+            m_parallel.running--;
+            if (exitCode == 0 && exitStatus == QProcess::NormalExit) {
+                const qint64 size = addRsyncStats(rsync->readAllStandardOutput(), m_currentStats, !m_linkDest.isEmpty());
+                if (m_history) {
+                    m_history->setSubtreeSize(id(), path, size);
+                }
+            } else {
+                m_parallel.failed = true;
+                //% "Failed to sync %1."
+                logError(qtTrId("SIHHURI_CRIT_FAILED_RSYNC").arg(path));
+            }
+            rsync->deleteLater();
+            startSubtreeJobs();
+        });
+        rsync->start();
+    }
+}
+
+void AbstractBackup::syncRemainder()
+{
+    // Everything that is not part of a sub tree job is synced last. The sub trees are excluded
+    // and thereby protected from --delete, sub trees that vanished from the source are not excluded
+    // and will be deleted here. Running last also fixes the modification times of the parents.
+    auto excludes = std::make_shared<QTemporaryFile>(tempDir() + QLatin1String("/rsync-excludes-XXXXXX"));
+    if (!excludes->open()) {
+        //% "Failed to create temporary file %1: %2"
+        logError(qtTrId("SIHHURI_CRIT_FAILED_CREATE_TEMP_FILE").arg(excludes->fileTemplate(), excludes->errorString()));
+        finishSync(m_parallel.dir, false, m_parallel.next);
+        return;
+    }
+    static const QRegularExpression wildcards(QStringLiteral("[*?\\[]"));
+    for (const QString &subtree : std::as_const(m_parallel.subtrees)) {
+        QString pattern = m_parallel.dir + QLatin1Char('/') + subtree;
+        // backslashes are only escape characters if the pattern contains wildcards
+        if (pattern.contains(wildcards)) {
+            pattern.replace(QRegularExpression(QStringLiteral("([*?\\[\\\\])")), QStringLiteral("\\\\1"));
+        }
+        excludes->write(pattern.toUtf8() + "/\n");
+    }
+    excludes->flush();
+
+    auto rsync = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+    rsync->setProgram(QStringLiteral("rsync"));
+    QStringList args({QStringLiteral("-aR"), QStringLiteral("--delete"), QStringLiteral("--delete-after"), QStringLiteral("--stats"), QStringLiteral("--exclude-from=") + excludes->fileName()});
+    // the sub tree excludes come first, so the filter can not take them back
+    args << preserveArgs() << linkDestArgs() << m_filter.rsyncArgs(m_parallel.dir) << rsyncSource(m_parallel.snapshotRoot, m_parallel.dir) << depotPath();
+    rsync->setArguments(args);
+    connect(rsync, &QProcess::readyReadStandardError, this, [this, rsync](){
+        logCritical(QStringLiteral("rsync: %1").arg(QString::fromUtf8(rsync->readAllStandardError())));
+    });
+    connect(rsync, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, rsync, excludes](int exitCode, QProcess::ExitStatus exitStatus){
+        rsync->deleteLater();
+        const bool remainderSuccess = exitCode == 0 && exitStatus == QProcess::NormalExit;
+        if (remainderSuccess) {
+            addRsyncStats(rsync->readAllStandardOutput(), m_currentStats, !m_linkDest.isEmpty());
+            addPreserveStats(m_parallel.dir);
+        }
+        const bool success = !m_parallel.failed && remainderSuccess;
+        const auto next = m_parallel.next;
+        const QString dir = m_parallel.dir;
+        m_parallel = ParallelSync();
+        finishSync(dir, success, next);
     });
     rsync->start();
 }
 
+void AbstractBackup::finishSync(const QString &dir, bool success, const std::function<void ()> &next)
+{
+    if (success) {
+        m_currentStats.timeUsed = getStepTimeUsed();
+        if (!m_generation.isEmpty()) {
+            // everything in a new generation has been created, but linked files are unchanged
+            // since the previous generation and changed files count as deleted and created
+            m_currentStats.created = std::max<qint64>(m_currentStats.created - m_currentStats.linkedFiles, 0);
+            m_currentStats.deleted = std::max<qint64>(m_currentStats.filesBefore + m_currentStats.created - m_currentStats.filesAfter, 0);
+        }
+        QLocale locale;
+        //% "Finished syncing %1 in %2 milliseconds: Files: %3, Size: %4"
+        logInfo(qtTrId("SIHHURI_INFO_FINISHED_RSYNC").arg(dir, locale.toString(m_currentStats.timeUsed), locale.toString(m_currentStats.filesAfter), locale.formattedDataSize(m_currentStats.sizeAfter)));
+        //% "Changes of %1: created %2 and deleted %3 files, transferred %4 files with %5 (literal: %6, matched: %7)"
+        logInfo(qtTrId("SIHHURI_INFO_SYNC_CHANGES").arg(dir, locale.toString(m_currentStats.created), locale.toString(m_currentStats.deleted), locale.toString(m_currentStats.transferredFiles), locale.formattedDataSize(m_currentStats.transferredBytes), locale.formattedDataSize(m_currentStats.literalBytes), locale.formattedDataSize(m_currentStats.matchedBytes)));
+        if (!m_generation.isEmpty()) {
+            //% "Generation %1 of %2: linked %3 files with %4, copied %5 files with %6"
+            logInfo(qtTrId("SIHHURI_INFO_GENERATION_CHANGES").arg(m_generation, dir, locale.toString(m_currentStats.linkedFiles), locale.formattedDataSize(m_currentStats.linkedBytes), locale.toString(m_currentStats.transferredFiles), locale.formattedDataSize(m_currentStats.transferredBytes)));
+        }
+        if (m_currentStats.hardLinkedFiles > 0 || m_currentStats.sparseBytes > 0) {
+            //% "Preserved in %1: %2 hard links saving %3, holes of sparse files saving %4"
+            logInfo(qtTrId("SIHHURI_INFO_PRESERVE_SAVINGS").arg(dir, locale.toString(m_currentStats.hardLinkedFiles), locale.formattedDataSize(m_currentStats.hardLinkedBytes), locale.formattedDataSize(m_currentStats.sparseBytes)));
+        }
+        if (m_history) {
+            m_history->setDirectoryStats(id(), dir, m_currentStats.filesAfter, m_currentStats.sizeAfter);
+            if (m_fullSync) {
+                m_history->setLastFullSync(id(), dir, QDateTime::currentDateTime());
+            }
+        }
+        if (m_pendingJournal) {
+            m_pendingJournal->commit();
+        }
+        if (m_pendingIndex && !m_pendingIndex->save(m_pendingIndexPath)) {
+            //% "Failed to save file index %1: %2"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_SAVE_FILE_INDEX").arg(m_pendingIndexPath, m_pendingIndex->errorString()));
+        }
+        // hashing the depot is left until the maintenance mode has been disabled again
+        if (m_useManifest && m_syncPhase != BackupStats::PreSync && !m_manifestQueue.contains(dir)) {
+            m_manifestQueue.enqueue(dir);
+        }
+        addStatistic(m_currentStats);
+    } else {
+        //% "Failed to sync %1."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_RSYNC").arg(dir));
+        // the depot no longer matches the last index, the next run has to sync everything
+        if (m_pendingIndex) {
+            QFile::remove(m_pendingIndexPath);
+        }
+    }
+    m_pendingIndex.reset();
+    // a failed journal is merged with the next one
+    m_pendingJournal.reset();
+    next();
+}
+
+QString AbstractBackup::snapshotRoot(const QString &dir) const
+{
+    const QString snapshotDir = option(QStringLiteral("snapshotDir")).toString();
+    if (!snapshotDir.isEmpty()) {
+        return snapshotDir.endsWith(QLatin1Char('/')) ? snapshotDir.chopped(1) : snapshotDir;
+    }
+    // reflinks and btrfs snapshots only work inside the same file system, the parent directory
+    // is on another one if the directory is a mount point or a separately mounted sub volume
+    const QString canonicalDir = QFileInfo(dir).canonicalFilePath();
+    const std::string mountRoot = canonicalDir.isEmpty() ? std::string() : MountRoot::of(QFile::encodeName(canonicalDir).toStdString());
+    if (mountRoot.empty()) {
+        return QString();
+    }
+    const QString rootPath = QFile::decodeName(QByteArray::fromStdString(mountRoot));
+    return (rootPath == QLatin1String("/") ? QString() : rootPath) + QLatin1Char('/') + QLatin1String(snapshotDirName);
+}
+
+bool AbstractBackup::strictIndexCompare(const QString &snapshotRoot) const
+{
+    // reflink snapshots are new copies with new inodes and change times on every run
+    return snapshotRoot.isEmpty() || m_snapshotMode != ReflinkSnapshot;
+}
+
+void AbstractBackup::captureNextSnapshot()
+{
+    if (m_captureQueue.empty()) {
+        // directories that could not be captured have been put back into the queue
+        // and will be synced directly inside the maintenance window
+        backupDirectories();
+        return;
+    }
+
+    const QString dir = m_captureQueue.dequeue();
+    const QString root = snapshotRoot(dir);
+    if (root.isEmpty()) {
+        //% "Failed to find the mount of %1 for its snapshot, syncing it inside the maintenance window."
+        logWarning(qtTrId("SIHHURI_WARN_FAILED_FIND_SNAPSHOT_ROOT").arg(dir));
+        m_dirQueue.enqueue(dir);
+        captureNextSnapshot();
+        return;
+    }
+    const QString snapshotPath = root + dir;
+
+    // the staging area is an entry of the directory itself if the directory is the root of its mount
+    const QString canonicalDir = QFileInfo(dir).canonicalFilePath();
+    const bool stagingInside = !canonicalDir.isEmpty() && QFileInfo(root).absolutePath() == canonicalDir;
+    const bool copyEntries = stagingInside && m_snapshotMode == ReflinkSnapshot;
+
+    if (QFileInfo::exists(snapshotPath)) {
+        //% "Removing stale snapshot %1."
+        logWarning(qtTrId("SIHHURI_WARN_REMOVE_STALE_SNAPSHOT").arg(snapshotPath));
+        removeSnapshot(snapshotPath, [this, dir, snapshotPath](){
+            if (QFileInfo::exists(snapshotPath)) {
+                m_dirQueue.enqueue(dir);
+            } else {
+                m_captureQueue.prepend(dir);
+            }
+            captureNextSnapshot();
+        });
+        return;
+    }
+
+    if (!QDir().mkpath(copyEntries ? snapshotPath : QFileInfo(snapshotPath).absolutePath())) {
+        //% "Failed to create snapshot directory %1 for %2, syncing it inside the maintenance window."
+        logWarning(qtTrId("SIHHURI_WARN_FAILED_CREATE_SNAPSHOT_DIR").arg(root, dir));
+        m_dirQueue.enqueue(dir);
+        captureNextSnapshot();
+        return;
+    }
+
+    setStepStartTime();
+
+    // changes after this point are not part of the snapshot and have to stay in the journal for the next run
+    takeJournal(dir);
+
+    auto snapshot = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+    if (m_snapshotMode == BtrfsSnapshot) {
+        snapshot->setProgram(QStringLiteral("btrfs"));
+        snapshot->setArguments({QStringLiteral("subvolume"), QStringLiteral("snapshot"), QStringLiteral("-r"), dir, snapshotPath});
+    } else if (copyEntries) {
+        // a directory can not be copied into itself, so its entries are copied without the staging area
+        snapshot->setProgram(QStringLiteral("find"));
+        snapshot->setArguments({dir, QStringLiteral("-mindepth"), QStringLiteral("1"), QStringLiteral("-maxdepth"), QStringLiteral("1"),
+                                QStringLiteral("!"), QStringLiteral("-name"), QFileInfo(root).fileName(),
+                                QStringLiteral("-exec"), QStringLiteral("cp"), QStringLiteral("-a"), QStringLiteral("--reflink=always"),
+                                QStringLiteral("-t"), snapshotPath, QStringLiteral("{}"), QStringLiteral("+")});
+    } else {
+        snapshot->setProgram(QStringLiteral("cp"));
+        snapshot->setArguments({QStringLiteral("-a"), QStringLiteral("--reflink=always"), dir, snapshotPath});
+    }
+    connect(snapshot, &QProcess::readyReadStandardError, this, [this, snapshot](){
+        logCritical(QStringLiteral("%1: %2").arg(snapshot->program(), QString::fromUtf8(snapshot->readAllStandardError())));
+    });
+    connect(snapshot, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, dir, root, snapshotPath, copyEntries](int exitCode, QProcess::ExitStatus exitStatus){
+        const bool captured = exitCode == 0 && exitStatus == QProcess::NormalExit
+                && (!copyEntries || copyDirAttributes(QFile::encodeName(dir), QFile::encodeName(snapshotPath)));
+        if (captured) {
+            QLocale locale;
+            //% "Captured snapshot of %1 in %2 milliseconds."
+            logInfo(qtTrId("SIHHURI_INFO_CAPTURED_SNAPSHOT").arg(dir, locale.toString(getStepTimeUsed())));
+            m_snapshots.enqueue(std::make_pair(dir, root));
+            captureNextSnapshot();
+        } else {
+            //% "Failed to capture snapshot of %1 in %2, syncing it inside the maintenance window. The snapshot directory has to be on the same file system as the directory."
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_CAPTURE_SNAPSHOT").arg(dir, root));
+            removeSnapshot(snapshotPath, [this, dir](){
+                m_dirQueue.enqueue(dir);
+                captureNextSnapshot();
+            });
+        }
+    });
+    snapshot->start();
+}
+
+void AbstractBackup::syncNextSnapshot()
+{
+    if (m_snapshots.empty()) {
+        emitFinished();
+        return;
+    }
+
+    const std::pair<QString,QString> snapshot = m_snapshots.dequeue();
+    syncDirectory(snapshot.first, snapshot.second, [this, snapshot](){
+        removeSnapshot(snapshot.second + snapshot.first, [this](){
+            syncNextSnapshot();
+        });
+    });
+}
+
+void AbstractBackup::removeSnapshot(const QString &snapshotPath, const std::function<void ()> &next)
+{
+    if (!QFileInfo::exists(snapshotPath)) {
+        next();
+        return;
+    }
+
+    auto remove = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+    if (m_snapshotMode == BtrfsSnapshot) {
+        remove->setProgram(QStringLiteral("btrfs"));
+        remove->setArguments({QStringLiteral("subvolume"), QStringLiteral("delete"), snapshotPath});
+    } else {
+        remove->setProgram(QStringLiteral("rm"));
+        remove->setArguments({QStringLiteral("-rf"), snapshotPath});
+    }
+    connect(remove, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, snapshotPath, next](int exitCode, QProcess::ExitStatus exitStatus){
+        if (exitCode != 0 || exitStatus != QProcess::NormalExit) {
+            //% "Failed to remove snapshot %1."
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_REMOVE_SNAPSHOT").arg(snapshotPath));
+        }
+        next();
+    });
+    remove->start();
+}
+
 void AbstractBackup::disableMaintenance()
 {
     startTimer();
@@ -208,14 +1632,25 @@ void AbstractBackup::disableMaintenance()
 
 void AbstractBackup::startTimer()
 {
+    if (m_inMaintenance) {
+        m_inMaintenance = false;
+        const auto now = std::chrono::high_resolution_clock::now();
+        m_downtime = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_phaseTimeStart).count());
+        if (supportsPreSync()) {
+            QLocale locale;
+            //% "Maintenance window lasted %1 milliseconds."
+            logInfo(qtTrId("SIHHURI_INFO_MAINTENANCE_WINDOW").arg(locale.toString(m_downtime)));
+        }
+    }
+
     if (m_timer.isEmpty()) {
-        emitFinished();
+        syncNextSnapshot();
         return;
     }
 
     auto systemctl = startSystemdTimer(m_timer);
     connect(systemctl, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this](int exitCode, QProcess::ExitStatus exitStatus){
-        emitFinished();
+        syncNextSnapshot();
     });
     systemctl->start();
 }
@@ -225,6 +1660,21 @@ std::vector<BackupStats> AbstractBackup::statistics() const
     return m_stats;
 }
 
+void AbstractBackup::setHistory(BackupHistory *history)
+{
+    m_history = history;
+}
+
+qint64 AbstractBackup::preSyncTime() const
+{
+    return m_preSyncTime;
+}
+
+qint64 AbstractBackup::downtime() const
+{
+    return supportsPreSync() ? m_downtime : -1;
+}
+
 void AbstractBackup::addStatistic(const BackupStats &statistic)
 {
     m_stats.push_back(statistic);
@@ -287,25 +1737,34 @@ qint64 AbstractBackup::getStepTimeUsed() const
 
 std::pair<qint64, qint64> AbstractBackup::getDirSize(const QString &path) const
 {
-    qint64 entries = 0;
-    qint64 size = 0;
-
-    QDir dir(path);
-
-    const auto dirEntries = dir.entryInfoList(QDir::Files|QDir::System|QDir::Hidden);
-    for (const QFileInfo &fi : dirEntries) {
-        entries++;
-        size += fi.size();
+    TreeStats stats(path);
+    stats.setFilter(m_filter);
+    if (!stats.run()) {
+        return std::make_pair(0, 0);
     }
+    const TreeStats::Result result = stats.result();
+    return std::make_pair(result.files, result.apparentSize);
+}
 
-    const auto childDirs = dir.entryList(QDir::Dirs|QDir::NoDotAndDotDot|QDir::System|QDir::Hidden|QDir::NoSymLinks);
-    for (const QString &child : childDirs) {
-        const auto ret = getDirSize(path + QLatin1Char('/') + child);
-        entries += ret.first;
-        size += ret.second;
+void AbstractBackup::addPreserveStats(const QString &dir)
+{
+    if (!m_preserve.hardLinks && !m_preserve.sparse) {
+        return;
+    }
+    // rsync reports neither hard links nor holes, they are counted in the synced tree
+    TreeStats stats(depotPath() + dir);
+    stats.setCountHardLinks(m_preserve.hardLinks);
+    if (!stats.run()) {
+        return;
+    }
+    const TreeStats::Result result = stats.result();
+    if (m_preserve.hardLinks) {
+        m_currentStats.hardLinkedFiles = result.hardLinkedFiles;
+        m_currentStats.hardLinkedBytes = result.hardLinkedSize;
+    }
+    if (m_preserve.sparse) {
+        m_currentStats.sparseBytes = result.holeSize;
     }
-
-    return std::make_pair(entries, size);
 }
 
 QVariant AbstractBackup::option(const QString &key, const QVariant &defValue) const
@@ -349,6 +1808,98 @@ void AbstractBackup::setDirectoryQueue(const QQueue<QString> &queue)
 }
 
 void AbstractBackup::emitFinished()
+{
+    if (!m_manifestQueue.empty()) {
+        createNextManifest();
+        return;
+    }
+
+    finishGeneration();
+}
+
+QString AbstractBackup::manifestFilePath(const QString &base, const QString &dir) const
+{
+    return base + QLatin1String("/.sihhuri-manifest/") + QString::fromLatin1(QUrl::toPercentEncoding(id())) + QLatin1Char('/') + QString::fromLatin1(QUrl::toPercentEncoding(dir)) + QLatin1String(".idx");
+}
+
+void AbstractBackup::createNextManifest()
+{
+    if (m_manifestQueue.empty()) {
+        finishGeneration();
+        return;
+    }
+
+    const QString dir = m_manifestQueue.dequeue();
+    const QString root = depotPath() + dir;
+    const QString filePath = manifestFilePath(depotPath(), dir);
+    // a new generation is compared with the previous one, its unchanged files are hard links with the same inode
+    const QString previousPath = m_generation.isEmpty() ? filePath : m_linkDest.isEmpty() ? QString() : manifestFilePath(m_linkDest, dir);
+    const int threads = option(QStringLiteral("manifestThreads"), 0).toInt();
+
+    //% "Creating content manifest of %1."
+    logInfo(qtTrId("SIHHURI_INFO_START_MANIFEST").arg(dir));
+    setStepStartTime();
+
+    struct ManifestJob {
+        FileIndex::HashStats stats;
+        qint64 files = 0;
+        QString error;
+    };
+    auto job = std::make_shared<ManifestJob>();
+    QThread *thread = QThread::create([job, root, filePath, previousPath, threads](){
+        FileIndex previous;
+        if (!previousPath.isEmpty()) {
+            // without a previous manifest every file is hashed
+            previous.map(previousPath);
+        }
+        FileIndex current;
+        if (!current.scan(root, threads)) {
+            job->error = current.errorString();
+            return;
+        }
+        job->stats = current.updateHashes(previous, root, threads);
+        job->files = job->stats.cachedFiles + job->stats.hashedFiles + job->stats.failedFiles;
+        if (!current.save(filePath)) {
+            job->error = current.errorString();
+        }
+    });
+    connect(thread, &QThread::finished, this, [this, thread, job, dir](){
+        thread->deleteLater();
+        if (!job->error.isEmpty()) {
+            //% "Failed to create content manifest of %1: %2"
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_MANIFEST").arg(dir, job->error));
+        } else {
+            if (job->stats.failedFiles > 0) {
+                //% "Failed to hash %n file(s) for the content manifest of %1."
+                logWarning(qtTrId("SIHHURI_WARN_MANIFEST_HASH_ERRORS", static_cast<int>(job->stats.failedFiles)).arg(dir));
+            }
+            QLocale locale;
+            //% "Created content manifest of %1 with %2 files in %3 milliseconds: hashed %4 files with %5, %6 files unchanged."
+            logInfo(qtTrId("SIHHURI_INFO_FINISHED_MANIFEST").arg(dir, locale.toString(job->files), locale.toString(getStepTimeUsed()), locale.toString(job->stats.hashedFiles), locale.formattedDataSize(job->stats.hashedBytes), locale.toString(job->stats.cachedFiles)));
+        }
+        createNextManifest();
+    });
+    thread->start();
+}
+
+void AbstractBackup::finishGeneration()
+{
+    // only a completely successful generation may become the base of the next one
+    if (!m_generation.isEmpty() && QFileInfo(depotPath()).isDir()) {
+        if (m_errors.empty()) {
+            switchLatestGeneration();
+        } else {
+            markIncompleteGeneration();
+        }
+        if (pruneGenerations()) {
+            return;
+        }
+    }
+
+    finishItem();
+}
+
+void AbstractBackup::finishItem()
 {
     QLocale locale;
     const auto timeUsed = getTimeUsed();
@@ -6,24 +6,42 @@
 #ifndef ABSTRACTBACKUP_H
 #define ABSTRACTBACKUP_H
 
+#include "pathfilter.h"
+#include "syncengine.h"
 #include <QObject>
 #include <QVariantMap>
 #include <QQueue>
+#include <QHash>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 class QProcess;
+class BackupHistory;
+class FileIndex;
+class ChangeJournal;
 
 struct BackupStats {
     enum Type : quint8 {
         Undefined,
         Directory,
         MySQL,
-        PostgreSQL
+        PostgreSQL,
+        MariaDBPhysical,
+        Retention
+    };
+
+    enum Phase : quint8 {
+        SinglePass,
+        PreSync,
+        FinalSync
     };
 
     Type type = Undefined;
+    Phase phase = SinglePass;
     QString id;
     qint64 filesBefore = 0;
     qint64 sizeBefore = 0;
@@ -31,6 +49,27 @@ struct BackupStats {
     qint64 sizeAfter = 0;
     qint64 uncompressedSize = 0;
     qint64 compressedSize = 0;
+    // codec and level of compressed dumps and the time spent in the compressor, empty for uncompressed dumps
+    QString codec;
+    int codecLevel = 0;
+    qint64 compressionTime = 0;
+    // changes of directory syncs, created and deleted count files like filesBefore and filesAfter
+    qint64 created = 0;
+    qint64 deleted = 0;
+    qint64 transferredFiles = 0;
+    qint64 transferredBytes = 0;
+    qint64 literalBytes = 0;
+    qint64 matchedBytes = 0;
+    // files of a generation that are hard links to the previous generation
+    qint64 linkedFiles = 0;
+    qint64 linkedBytes = 0;
+    // additional paths of files that are hard linked inside the synced tree and the holes of its sparse files
+    qint64 hardLinkedFiles = 0;
+    qint64 hardLinkedBytes = 0;
+    qint64 sparseBytes = 0;
+    // removed generations and the space freed by removing them
+    qint64 prunedGenerations = 0;
+    qint64 reclaimedBytes = 0;
     qint64 timeUsed = 0;
 };
 
@@ -48,10 +87,32 @@ public:
     [[nodiscard]] QStringList warnings() const;
     [[nodiscard]] QString id() const;
     [[nodiscard]] std::vector<BackupStats> statistics() const;
+    [[nodiscard]] qint64 preSyncTime() const;
+    [[nodiscard]] qint64 downtime() const;
+
+    /*!
+     * \brief Sets the \a history used to balance parallel rsync workers by sub tree size.
+     */
+    void setHistory(BackupHistory *history);
+
+    /*!
+     * \brief Sets the directory containing the change journals written by the ChangeRecorder.
+     */
+    void setJournalDir(const QString &journalDir);
 
 protected:
     virtual bool loadConfiguration() = 0;
 
+    /*!
+     * \brief Returns \c true if the item has a maintenance window that benefits from a pre-sync.
+     *
+     * If this returns \c true and the \c presync option is not disabled, all directories
+     * will first be synced while the service is still live before enableMaintenance() is
+     * called. The sync inside the maintenance window will then only transfer the delta.
+     * The default implementation returns \c false.
+     */
+    [[nodiscard]] virtual bool supportsPreSync() const;
+
     virtual void enableMaintenance();
     virtual void disableMaintenance();
 
@@ -81,6 +142,33 @@ protected:
     [[nodiscard]] QString configFileRoot() const;
     [[nodiscard]] QString user() const;
     [[nodiscard]] QQueue<QString> directoryQueue() const;
+
+    /*!
+     * \brief Returns \c true if the item uses the deduplicating depot format.
+     *
+     * Directories and database dumps are then stored as snapshots in the ChunkStore at the
+     * path of the \c chunkStore option, by default \c .sihhuri-chunks below the target.
+     */
+    [[nodiscard]] bool isChunkDepot() const;
+
+    /*!
+     * \brief Returns the directory the current run writes to.
+     *
+     * This is the target, or if the \c generations option is enabled, the directory of the
+     * generation created by the current run. Every item has its own generations and \c latest
+     * link in a directory named after the percent encoded id() below \c generations in the target.
+     * The \c index and \c journal options are ignored with generations, a warning is logged if
+     * they are set, because both only describe the previous generation.
+     */
+    [[nodiscard]] QString depotPath() const;
+
+    /*!
+     * \brief Stores the file at \a filePath as a new snapshot with \a snapshotId in the chunk store.
+     *
+     * \a next is called with the result and the size of the newly stored chunks.
+     */
+    void storeFileChunks(const QString &filePath, const QString &snapshotId, const std::function<void(bool,qint64)> &next);
+    void storeDirectoryChunks(const QString &dirPath, const QString &snapshotId, const std::function<void(bool,qint64)> &next);
     void setDirectoryQueue(const QQueue<QString> &queue);
 
     void emitFinished();
@@ -200,8 +288,72 @@ signals:
 private slots:
     void startBackup();
     void isTimerServiceActive();
+    void onPreSyncFinished();
 
 private:
+    enum SnapshotMode : quint8 {
+        NoSnapshot,
+        BtrfsSnapshot,
+        ReflinkSnapshot
+    };
+
+    enum SyncEngineType : quint8 {
+        RsyncEngine,
+        NativeEngine
+    };
+
+    enum DepotFormat : quint8 {
+        MirrorDepot,
+        ChunkDepot
+    };
+
+    void beforeMaintenance();
+    void preSync();
+    void startMaintenance();
+    void syncDirectory(const QString &dir, const QString &snapshotRoot, const std::function<void()> &next);
+    [[nodiscard]] QString generationsPath() const;
+    [[nodiscard]] QStringList linkDestArgs() const;
+    [[nodiscard]] QStringList preserveArgs() const;
+    void addPreserveStats(const QString &dir);
+    void switchLatestGeneration();
+    void markIncompleteGeneration();
+    [[nodiscard]] bool pruneGenerations();
+    [[nodiscard]] QString manifestFilePath(const QString &base, const QString &dir) const;
+    void createNextManifest();
+    void finishGeneration();
+    void finishItem();
+    void syncDirectoryFull(const QString &dir, const QString &snapshotRoot, const std::function<void()> &next);
+    void syncDirectoryIndexed(const QString &dir, const QString &snapshotRoot, const std::function<void()> &next);
+    void syncDirectoryChunked(const QString &dir, const QString &snapshotRoot, const std::function<void()> &next);
+    [[nodiscard]] QString chunkStorePath() const;
+    void syncDirectoryJournaled(const QString &dir, const QString &snapshotRoot, std::pair<qint64,qint64> dirStats, const std::function<void()> &next);
+    void syncFileList(const QString &dir, const QString &snapshotRoot, const std::vector<std::string> &changed, const std::vector<std::string> &deleted, const std::vector<std::string> &recursive, const std::function<void()> &next);
+    void syncFileListRsync(const QString &dir, const QString &snapshotRoot, const std::vector<std::string> &changed, const std::vector<std::string> &recursive, const std::function<void()> &next);
+    void takeJournal(const QString &dir);
+    void runSyncEngine(const std::shared_ptr<SyncEngine> &engine, const QString &dir, const std::function<void()> &next);
+    [[nodiscard]] QString indexFilePath(const QString &dir) const;
+    void finishSync(const QString &dir, bool success, const std::function<void()> &next);
+    void syncDirectoryParallel(const QString &dir, const QString &snapshotRoot, const QStringList &subtrees, const std::function<void()> &next);
+    [[nodiscard]] QStringList subtrees(const QString &sourcePath) const;
+    void startSubtreeJobs();
+    void syncRemainder();
+    [[nodiscard]] QString rsyncSource(const QString &snapshotRoot, const QString &path) const;
+    /*!
+     * \brief Returns the staging area for the snapshot of \a dir.
+     *
+     * That is the \c snapshotDir option or a \c .sihhuri-snapshots directory at the root of
+     * the mount \a dir is on. Returns an empty string if the mount can not be determined.
+     */
+    [[nodiscard]] QString snapshotRoot(const QString &dir) const;
+    /*!
+     * \brief Returns \c true if inodes and change times have to match too when comparing
+     * the entries of the sources at \a snapshotRoot with the previous index or snapshot.
+     */
+    [[nodiscard]] bool strictIndexCompare(const QString &snapshotRoot) const;
+    void captureNextSnapshot();
+    void syncNextSnapshot();
+    void removeSnapshot(const QString &snapshotPath, const std::function<void()> &next);
+
     QVariantMap m_options;
     QString m_type;
     QString m_configFileName;
@@ -214,9 +366,50 @@ private:
     QString m_user;
     QString m_timer;
     QQueue<QString> m_dirQueue;
+    QQueue<QString> m_finalSyncQueue;
+    QQueue<QString> m_captureQueue;
+    QQueue<std::pair<QString,QString>> m_snapshots;
+    struct ParallelSync {
+        QString dir;
+        QString snapshotRoot;
+        QStringList subtrees;
+        QQueue<QString> queue;
+        std::function<void()> next;
+        int running = 0;
+        bool failed = false;
+    };
+    ParallelSync m_parallel;
+    BackupHistory *m_history = nullptr;
+    std::shared_ptr<FileIndex> m_pendingIndex;
+    QString m_pendingIndexPath;
+    QHash<QString,std::shared_ptr<ChangeJournal>> m_journals;
+    std::shared_ptr<ChangeJournal> m_pendingJournal;
+    QString m_journalDir;
+    QString m_generation;
+    QString m_linkDest;
+    QQueue<QString> m_manifestQueue;
+    PathFilter m_filter;
+    SyncEngine::Preserve m_preserve;
+    int m_keepDaily = 0;
+    int m_keepWeekly = 0;
+    int m_keepMonthly = 0;
     std::vector<BackupStats> m_stats;
     std::chrono::time_point<std::chrono::high_resolution_clock> m_timeStart;
     std::chrono::time_point<std::chrono::high_resolution_clock> m_stepTimeStart;
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_phaseTimeStart;
+    qint64 m_preSyncTime = -1;
+    qint64 m_downtime = -1;
+    BackupStats::Phase m_syncPhase = BackupStats::SinglePass;
+    SnapshotMode m_snapshotMode = NoSnapshot;
+    SyncEngineType m_syncEngine = RsyncEngine;
+    DepotFormat m_depotFormat = MirrorDepot;
+    bool m_inMaintenance = false;
+    bool m_snapshotsCaptured = false;
+    int m_parallelSync = 1;
+    bool m_useIndex = false;
+    bool m_useJournal = false;
+    bool m_useManifest = false;
+    bool m_fullSync = true;
     int m_maxTryIsServiceActive = 30;
     int m_tryCountIsServiceActive = 0;
     int m_waitSecondsIsServiceActive = 10;
@@ -0,0 +1,297 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "backupdaemon.h"
+#include "backupmanager.h"
+#include "changerecorder.h"
+#include "config.h"
+#include "executables.h"
+#include "returncodes.h"
+#include <QCoreApplication>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QLocale>
+#include <algorithm>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include <systemd/sd-daemon.h>
+}
+
+namespace {
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+int signalFds[2] = {-1, -1};
+
+void signalHandler(int signum)
+{
+    const char sig = static_cast<char>(signum);
+    // only async-signal-safe functions here, the real work is done in BackupDaemon::onSignal()
+    [[maybe_unused]] const auto written = ::write(signalFds[0], &sig, sizeof(sig));
+}
+}
+
+BackupDaemon::BackupDaemon(const QString &configFile, const QStringList &types, QObject *parent)
+    : QObject(parent),
+      m_types(types),
+      m_configFile(configFile)
+{
+
+}
+
+BackupDaemon::~BackupDaemon() = default;
+
+bool BackupDaemon::start()
+{
+    if (!setupSignalHandlers()) {
+        return false;
+    }
+
+    if (!loadConfiguration()) {
+        return false;
+    }
+
+    m_timer = new QTimer(this); // NOLINT(cppcoreguidelines-owning-memory)
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &BackupDaemon::onTimeout);
+
+    scheduleNext();
+
+    //% "Backup daemon started with %n scheduled items."
+    qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_DAEMON_STARTED", static_cast<int>(m_items.size()))));
+    sd_notify(0, "READY=1");
+
+    return true;
+}
+
+bool BackupDaemon::setupSignalHandlers()
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, signalFds) != 0) {
+        //% "Failed to create socket pair for signal handling."
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_DAEMON_FAILED_SIGNAL_SOCKETS")));
+        return false;
+    }
+
+    m_signalNotifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, this); // NOLINT(cppcoreguidelines-owning-memory)
+    connect(m_signalNotifier, &QSocketNotifier::activated, this, &BackupDaemon::onSignal);
+
+    // handlers are reset to the defaults on exec, so child processes are not affected
+    struct sigaction action{};
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+
+    for (const int sig : {SIGHUP, SIGTERM, SIGINT}) {
+        if (::sigaction(sig, &action, nullptr) != 0) {
+            //% "Failed to install signal handler for signal %1."
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_DAEMON_FAILED_SIGNAL_HANDLER").arg(sig)));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BackupDaemon::loadConfiguration()
+{
+    const QVariantMap config = loadConfig(m_configFile);
+    if (config.isEmpty()) {
+        return false;
+    }
+
+    const QVariantMap globalConfig = config.value(QStringLiteral("global")).toMap();
+    const QString defaultSchedule = globalConfig.value(QStringLiteral("schedule"), QStringLiteral("30 3 * * *")).toString();
+
+    std::vector<ScheduledItem> scheduledItems;
+    const QDateTime now = QDateTime::currentDateTime();
+    const QVariantList items = config.value(QStringLiteral("items")).toList();
+    for (int i = 0; i < items.size(); ++i) {
+        const QVariantMap o = items.at(i).toMap();
+        if (!o.value(QStringLiteral("enabled"), true).toBool()) {
+            continue;
+        }
+        const QString type = o.value(QStringLiteral("type")).toString();
+        if (!m_types.empty() && !m_types.contains(type, Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        ScheduledItem item;
+        item.index = i;
+        const QString name = o.value(QStringLiteral("name")).toString();
+        item.id = name.isEmpty() ? type : QStringLiteral("%1(%2)").arg(type, name);
+        item.schedule = CronSchedule(o.value(QStringLiteral("schedule"), defaultSchedule).toString());
+        if (!item.schedule.isValid()) {
+            //% "Invalid schedule \"%1\" for %2."
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_DAEMON_INVALID_SCHEDULE").arg(item.schedule.expression(), item.id)));
+            return false;
+        }
+        item.nextRun = item.schedule.next(now);
+        //% "Scheduled %1 with \"%2\", next run at %3."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_DAEMON_ITEM_SCHEDULED").arg(item.id, item.schedule.expression(), QLocale().toString(item.nextRun, QLocale::ShortFormat))));
+        scheduledItems.push_back(item);
+    }
+
+    const QString stateDir = globalConfig.value(QStringLiteral("stateDir"), QStringLiteral(SIHHURI_STATEDIR)).toString();
+    const QString historyFile = stateDir + QLatin1String("/history.json");
+    if (!m_history || m_history->filePath() != historyFile) {
+        m_history = std::make_unique<BackupHistory>(historyFile);
+        if (Q_UNLIKELY(!m_history->load())) {
+            qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_FAILED_LOAD_HISTORY").arg(m_history->filePath(), m_history->errorString())));
+        }
+    }
+
+    m_config = config;
+    m_items = scheduledItems;
+    m_pendingItems.clear();
+
+    updateRecorder(ChangeRecorder::journaledDirectories(config, m_types), stateDir + QLatin1String("/journal"));
+
+    return true;
+}
+
+void BackupDaemon::updateRecorder(const QStringList &directories, const QString &journalDir)
+{
+    if (m_recorder && m_recorder->directories() == directories && m_recorder->journalDir() == journalDir) {
+        return;
+    }
+
+    // the old recorder has to release the journal locks first
+    delete m_recorder; // NOLINT(cppcoreguidelines-owning-memory)
+    m_recorder = nullptr;
+
+    if (directories.empty()) {
+        return;
+    }
+
+    m_recorder = new ChangeRecorder(journalDir, this); // NOLINT(cppcoreguidelines-owning-memory)
+    if (!m_recorder->start(directories)) {
+        //% "Failed to start the change recorder, the directories will be synced completely."
+        qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_DAEMON_RECORDER_FAILED")));
+        delete m_recorder; // NOLINT(cppcoreguidelines-owning-memory)
+        m_recorder = nullptr;
+    }
+}
+
+void BackupDaemon::onSignal()
+{
+    m_signalNotifier->setEnabled(false);
+    char sig = 0;
+    if (::read(signalFds[1], &sig, sizeof(sig)) == sizeof(sig)) {
+        if (sig == SIGHUP) {
+            m_reloadRequested = true;
+            if (!m_currentRun) {
+                reload();
+            } else {
+                //% "Received SIGHUP, reloading configuration after the current backup run."
+                qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_DAEMON_RELOAD_DEFERRED")));
+            }
+        } else {
+            m_quitRequested = true;
+            sd_notify(0, "STOPPING=1");
+            if (!m_currentRun) {
+                QCoreApplication::exit(static_cast<int>(RC::OK));
+            } else {
+                //% "Stopping backup daemon after the current backup run."
+                qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_DAEMON_STOP_DEFERRED")));
+            }
+        }
+    }
+    m_signalNotifier->setEnabled(true);
+}
+
+void BackupDaemon::reload()
+{
+    m_reloadRequested = false;
+    sd_notify(0, "RELOADING=1");
+
+    //% "Reloading configuration from %1."
+    qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_DAEMON_RELOADING").arg(m_configFile)));
+
+    Executables::clearCache();
+
+    if (!loadConfiguration()) {
+        //% "Failed to reload configuration, keeping the previous one."
+        qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_DAEMON_RELOAD_FAILED")));
+    }
+
+    scheduleNext();
+    sd_notify(0, "READY=1");
+}
+
+void BackupDaemon::onTimeout()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+
+    for (ScheduledItem &item : m_items) {
+        if (item.nextRun.isValid() && item.nextRun <= now) {
+            if (!m_pendingItems.contains(item.index)) {
+                m_pendingItems.append(item.index);
+            }
+            item.nextRun = item.schedule.next(now);
+        }
+    }
+
+    if (!m_currentRun && !m_pendingItems.empty()) {
+        startRun();
+    }
+
+    scheduleNext();
+}
+
+void BackupDaemon::startRun()
+{
+    m_currentRun = new BackupManager(m_config, m_types, this); // NOLINT(cppcoreguidelines-owning-memory)
+    m_currentRun->setItemIndexes(m_pendingItems);
+    m_currentRun->setHistory(m_history.get());
+    connect(m_currentRun, &BackupManager::finished, this, &BackupDaemon::onRunFinished);
+    m_pendingItems.clear();
+    m_currentRun->start();
+}
+
+void BackupDaemon::onRunFinished(int exitCode)
+{
+    Q_UNUSED(exitCode)
+
+    m_currentRun->deleteLater();
+    m_currentRun = nullptr;
+
+    if (m_quitRequested) {
+        QCoreApplication::exit(static_cast<int>(RC::OK));
+        return;
+    }
+
+    if (m_reloadRequested) {
+        reload();
+    }
+
+    if (!m_pendingItems.empty()) {
+        startRun();
+    }
+}
+
+void BackupDaemon::scheduleNext()
+{
+    QDateTime next;
+    for (const ScheduledItem &item : std::as_const(m_items)) {
+        if (item.nextRun.isValid() && (!next.isValid() || item.nextRun < next)) {
+            next = item.nextRun;
+        }
+    }
+
+    if (!next.isValid()) {
+        m_timer->stop();
+        return;
+    }
+
+    // wake up at least once an hour, this keeps the timer interval small and catches
+    // changes of the system clock
+    constexpr qint64 maxInterval = 3600000;
+    const qint64 msecs = std::clamp(QDateTime::currentDateTime().msecsTo(next), Q_INT64_C(0), maxInterval);
+    m_timer->start(static_cast<int>(msecs));
+}
+
+#include "moc_backupdaemon.cpp"
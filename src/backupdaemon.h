@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BACKUPDAEMON_H
+#define BACKUPDAEMON_H
+
+#include "backuphistory.h"
+#include "cronschedule.h"
+#include <QObject>
+#include <QVariantMap>
+#include <QDateTime>
+#include <memory>
+#include <vector>
+
+class QTimer;
+class QSocketNotifier;
+class BackupManager;
+class ChangeRecorder;
+
+/*!
+ * \brief Long running service that runs the backup items on their own schedules.
+ *
+ * Every item can have a cron like \c schedule option, items without will use the
+ * \c schedule from the global section that defaults to <tt>30 3 * * *</tt>. Due items
+ * are backed up together by a BackupManager, items that get due while a run is in
+ * progress will be backed up directly after it. The run history and cached lookups
+ * are kept between the runs. The configuration is reloaded on \c SIGHUP, \c SIGTERM
+ * and \c SIGINT will stop the daemon after the current run has finished.
+ *
+ * If any item has the \c journal option enabled, the daemon also runs the ChangeRecorder
+ * for the directories of these items.
+ */
+class BackupDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BackupDaemon(const QString &configFile, const QStringList &types, QObject *parent = nullptr);
+    ~BackupDaemon() override;
+
+    bool start();
+
+private slots:
+    void onSignal();
+    void onTimeout();
+    void onRunFinished(int exitCode);
+
+private:
+    struct ScheduledItem {
+        CronSchedule schedule;
+        QDateTime nextRun;
+        QString id;
+        int index = -1;
+    };
+
+    bool loadConfiguration();
+    bool setupSignalHandlers();
+    void reload();
+    void startRun();
+    void scheduleNext();
+    void updateRecorder(const QStringList &directories, const QString &journalDir);
+
+    std::vector<ScheduledItem> m_items;
+    QList<int> m_pendingItems;
+    QVariantMap m_config;
+    QStringList m_types;
+    QString m_configFile;
+    std::unique_ptr<BackupHistory> m_history;
+    QTimer *m_timer = nullptr;
+    QSocketNotifier *m_signalNotifier = nullptr;
+    BackupManager *m_currentRun = nullptr;
+    ChangeRecorder *m_recorder = nullptr;
+    bool m_reloadRequested = false;
+    bool m_quitRequested = false;
+
+    Q_DISABLE_COPY(BackupDaemon)
+};
+
+#endif // BACKUPDAEMON_H
@@ -0,0 +1,151 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "backuphistory.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+BackupHistory::BackupHistory(const QString &filePath)
+    : m_filePath(filePath)
+{
+
+}
+
+BackupHistory::~BackupHistory() = default;
+
+bool BackupHistory::load()
+{
+    QFile f(m_filePath);
+    if (!f.exists()) {
+        return true;
+    }
+
+    if (!f.open(QIODevice::ReadOnly)) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    QJsonParseError jsonError;
+    const QJsonDocument json = QJsonDocument::fromJson(f.readAll(), &jsonError);
+    if (jsonError.error != QJsonParseError::NoError) {
+        m_errorString = jsonError.errorString();
+        return false;
+    }
+
+    m_items = json.object().value(QLatin1String("items")).toObject();
+
+    return true;
+}
+
+bool BackupHistory::save() const
+{
+    const QFileInfo fi(m_filePath);
+    if (!QDir().mkpath(fi.absolutePath())) {
+        m_errorString = QStringLiteral("Failed to create directory %1").arg(fi.absolutePath());
+        return false;
+    }
+
+    QSaveFile f(m_filePath);
+    if (!f.open(QIODevice::WriteOnly)) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    QJsonObject root;
+    root.insert(QLatin1String("items"), m_items);
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+
+    if (!f.commit()) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+QString BackupHistory::filePath() const
+{
+    return m_filePath;
+}
+
+QString BackupHistory::errorString() const
+{
+    return m_errorString;
+}
+
+qint64 BackupHistory::duration(const QString &itemId) const
+{
+    return item(itemId).value(QLatin1String("duration")).toInteger(-1);
+}
+
+void BackupHistory::setDuration(const QString &itemId, qint64 msecs)
+{
+    QJsonObject o = item(itemId);
+    o.insert(QLatin1String("duration"), msecs);
+    setItem(itemId, o);
+}
+
+qint64 BackupHistory::subtreeSize(const QString &itemId, const QString &path) const
+{
+    return item(itemId).value(QLatin1String("subtrees")).toObject().value(path).toInteger(-1);
+}
+
+void BackupHistory::setSubtreeSize(const QString &itemId, const QString &path, qint64 bytes)
+{
+    QJsonObject o = item(itemId);
+    QJsonObject subtrees = o.value(QLatin1String("subtrees")).toObject();
+    subtrees.insert(path, bytes);
+    o.insert(QLatin1String("subtrees"), subtrees);
+    setItem(itemId, o);
+}
+
+std::pair<qint64, qint64> BackupHistory::directoryStats(const QString &itemId, const QString &dir) const
+{
+    const QJsonObject o = item(itemId).value(QLatin1String("directories")).toObject().value(dir).toObject();
+    return std::make_pair(o.value(QLatin1String("files")).toInteger(-1), o.value(QLatin1String("size")).toInteger(-1));
+}
+
+void BackupHistory::setDirectoryStats(const QString &itemId, const QString &dir, qint64 files, qint64 bytes)
+{
+    QJsonObject o = item(itemId);
+    QJsonObject dirs = o.value(QLatin1String("directories")).toObject();
+    QJsonObject d = dirs.value(dir).toObject();
+    d.insert(QLatin1String("files"), files);
+    d.insert(QLatin1String("size"), bytes);
+    dirs.insert(dir, d);
+    o.insert(QLatin1String("directories"), dirs);
+    setItem(itemId, o);
+}
+
+QDateTime BackupHistory::lastFullSync(const QString &itemId, const QString &dir) const
+{
+    const qint64 secs = item(itemId).value(QLatin1String("directories")).toObject().value(dir).toObject().value(QLatin1String("fullSync")).toInteger(-1);
+    return secs < 0 ? QDateTime() : QDateTime::fromSecsSinceEpoch(secs);
+}
+
+void BackupHistory::setLastFullSync(const QString &itemId, const QString &dir, const QDateTime &time)
+{
+    QJsonObject o = item(itemId);
+    QJsonObject dirs = o.value(QLatin1String("directories")).toObject();
+    QJsonObject d = dirs.value(dir).toObject();
+    d.insert(QLatin1String("fullSync"), time.toSecsSinceEpoch());
+    dirs.insert(dir, d);
+    o.insert(QLatin1String("directories"), dirs);
+    setItem(itemId, o);
+}
+
+QJsonObject BackupHistory::item(const QString &itemId) const
+{
+    return m_items.value(itemId).toObject();
+}
+
+void BackupHistory::setItem(const QString &itemId, const QJsonObject &item)
+{
+    m_items.insert(itemId, item);
+}
@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BACKUPHISTORY_H
+#define BACKUPHISTORY_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QDateTime>
+#include <utility>
+
+/*!
+ * \brief Persists per-item data of previous backup runs.
+ *
+ * The history is stored as JSON file in the state directory and is keyed by the
+ * item id as returned by AbstractBackup::id().
+ */
+class BackupHistory
+{
+public:
+    explicit BackupHistory(const QString &filePath);
+    ~BackupHistory();
+
+    bool load();
+    bool save() const;
+
+    [[nodiscard]] QString filePath() const;
+    [[nodiscard]] QString errorString() const;
+
+    /*!
+     * \brief Returns the duration in milliseconds of the last successful run of \a itemId
+     * or \c -1 if there is no history for this item.
+     */
+    [[nodiscard]] qint64 duration(const QString &itemId) const;
+    void setDuration(const QString &itemId, qint64 msecs);
+
+    /*!
+     * \brief Returns the size in bytes of the sub tree \a path of \a itemId as measured
+     * by the last run or \c -1 if the size is unknown.
+     */
+    [[nodiscard]] qint64 subtreeSize(const QString &itemId, const QString &path) const;
+    void setSubtreeSize(const QString &itemId, const QString &path, qint64 bytes);
+
+    /*!
+     * \brief Returns the number of files and their size in bytes of the synced directory
+     * \a dir of \a itemId after the last sync or \c -1 for both if they are unknown.
+     */
+    [[nodiscard]] std::pair<qint64,qint64> directoryStats(const QString &itemId, const QString &dir) const;
+    void setDirectoryStats(const QString &itemId, const QString &dir, qint64 files, qint64 bytes);
+
+    /*!
+     * \brief Returns the time of the last sync of \a dir of \a itemId that compared the complete
+     * directory, or an invalid QDateTime if there was none.
+     */
+    [[nodiscard]] QDateTime lastFullSync(const QString &itemId, const QString &dir) const;
+    void setLastFullSync(const QString &itemId, const QString &dir, const QDateTime &time);
+
+private:
+    [[nodiscard]] QJsonObject item(const QString &itemId) const;
+    void setItem(const QString &itemId, const QJsonObject &item);
+
+    QJsonObject m_items;
+    QString m_filePath;
+    mutable QString m_errorString;
+
+    Q_DISABLE_COPY(BackupHistory)
+};
+
+#endif // BACKUPHISTORY_H
@@ -16,9 +16,13 @@
 #include <QTimer>
 #include <QCoreApplication>
 #include <QFileInfo>
+#include <QFile>
 #include <QDate>
 #include <QLocalServer>
-#include <QStandardPaths>
+#include <algorithm>
+#include <map>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 BackupManager::BackupManager(const QVariantMap &config, const QStringList &types, QObject *parent)
     : QObject(parent),
@@ -30,6 +34,16 @@ BackupManager::BackupManager(const QVariantMap &config, const QStringList &types
 
 BackupManager::~BackupManager() = default;
 
+void BackupManager::setItemIndexes(const QList<int> &indexes)
+{
+    m_itemIndexes = indexes;
+}
+
+void BackupManager::setHistory(BackupHistory *history)
+{
+    m_history = history;
+}
+
 void BackupManager::start()
 {
     QTimer::singleShot(0, this, &BackupManager::doStart);
@@ -42,6 +56,19 @@ void BackupManager::doStart()
     const QVariantMap globalConfig = m_config.value(QStringLiteral("global")).toMap();
     m_depot = globalConfig.value(QStringLiteral("depot")).toString();
     m_owner = globalConfig.value(QStringLiteral("owner"), QStringLiteral("root")).toString();
+    m_maxParallelItems = std::max(globalConfig.value(QStringLiteral("maxParallelItems"), 1).toInt(), 1);
+    m_maxJobsPerDevice = std::max(globalConfig.value(QStringLiteral("maxJobsPerDevice"), 1).toInt(), 0);
+    m_maxJobsPerDepotDevice = std::max(globalConfig.value(QStringLiteral("maxJobsPerDepotDevice"), 0).toInt(), 0);
+
+    const QString stateDir = globalConfig.value(QStringLiteral("stateDir"), QStringLiteral(SIHHURI_STATEDIR)).toString();
+    if (!m_history) {
+        m_ownHistory = std::make_unique<BackupHistory>(stateDir + QLatin1String("/history.json"));
+        m_history = m_ownHistory.get();
+        if (Q_UNLIKELY(!m_history->load())) {
+            //% "Failed to load backup history from %1: %2"
+            qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_FAILED_LOAD_HISTORY").arg(m_history->filePath(), m_history->errorString())));
+        }
+    }
 
     QFileInfo depotFi(m_depot);
     if (Q_UNLIKELY(!depotFi.exists() || !depotFi.isDir())) {
@@ -57,98 +84,463 @@ void BackupManager::doStart()
         return;
     }
 
-    const QString xzExecPath = QStandardPaths::findExecutable(QStringLiteral("xz"));
-    if (Q_UNLIKELY(xzExecPath.isEmpty())) {
-        //% "Can not find xz executable to compress database dump files."
-        handleError(qtTrId("SIHHURI_CRIT_NO_PIXZ_EXECUTABE"), RC::InvalidConfig);
-        return;
-    }
-
-    for (const QVariant &item : items) {
-        const QVariantMap o = item.toMap();
+    for (int itemIdx = 0; itemIdx < items.size(); ++itemIdx) {
+        if (!m_itemIndexes.empty() && !m_itemIndexes.contains(itemIdx)) {
+            continue;
+        }
+        const QVariantMap o = items.at(itemIdx).toMap();
         if (o.value(QStringLiteral("enabled"), true).toBool()) {
             const QString type = o.value(QStringLiteral("type")).toString();
             if (!m_types.empty() && !m_types.contains(type, Qt::CaseInsensitive)) {
                 continue;
             }
+            AbstractBackup *backupItem = nullptr;
             if (type.compare(QLatin1String("directory"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new DirectoryBackup(m_depot, m_tempDir.path(), o, this));
-            } else if (type.compare(QLatin1String("mariadb"), Qt::CaseInsensitive) == 0 || type.compare(QLatin1String("mysql"), Qt::CaseInsensitive) == 0) {
+                backupItem = new DirectoryBackup(m_depot, m_tempDir.path(), o, this);
+            } else if (type.compare(QLatin1String("mariadb"), Qt::CaseInsensitive) == 0 || type.compare(QLatin1String("mysql"), Qt::CaseInsensitive) == 0 || type.compare(QLatin1String("mariadb-physical"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new DbBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new DbBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("wordpress"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new WordPressBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new WordPressBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("nextcloud"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new NextcloudBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new NextcloudBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("joomla"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new JoomlaBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new JoomlaBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("matomo"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new MatomoBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new MatomoBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("cyrus"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new CyrusBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new CyrusBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("roundcube"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new RoundcubeBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new RoundcubeBackup(m_depot, m_tempDir.path(), o, this);
             } else if (type.compare(QLatin1String("gitea"), Qt::CaseInsensitive) == 0) {
                 // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-                m_items.enqueue(new GiteaBackup(m_depot, m_tempDir.path(), o, this));
+                backupItem = new GiteaBackup(m_depot, m_tempDir.path(), o, this);
             } else {
                 //% "%1 is not a valid backup item type. Omitting this entry."
                 qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_INVALID_ITEM_TYPE").arg(type)));
             }
+            if (backupItem) {
+                backupItem->setHistory(m_history);
+                backupItem->setJournalDir(stateDir + QLatin1String("/journal"));
+                Node node;
+                node.item = backupItem;
+                node.name = o.value(QStringLiteral("name")).toString();
+                node.after = o.value(QStringLiteral("after")).toStringList();
+                node.devices = resolveDevices(backupItem, o);
+                m_nodes.push_back(node);
+            }
         }
     }
 
-    if (Q_UNLIKELY(m_items.empty())) {
+    if (Q_UNLIKELY(m_nodes.empty())) {
         //% "No backup items are available."
         handleError(qtTrId("SIHHURI_CRIT_NO_BACK_ITEMS_AVAILABLE"), RC::InvalidConfig);
         return;
     }
 
-    m_enabledItemsSize = m_items.size();
+    if (Q_UNLIKELY(!buildGraph())) {
+        return;
+    }
+
+    rankNodes();
+    sortReadyNodes(m_readyNodes);
+
+    m_enabledItemsSize = static_cast<int>(m_nodes.size());
     //% "Starting backup of %n items."
     qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_BACKUPMANAGER_START", m_enabledItemsSize)));
 
+    if (m_maxParallelItems > 1) {
+        //% "Running up to %1 items in parallel."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_BACKUPMANAGER_PARALLEL").arg(m_maxParallelItems)));
+    }
+
+    if (m_predictedMakespan > -1) {
+        QLocale locale;
+        //% "Predicted run time based on previous runs: %1 seconds."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_PREDICTED_MAKESPAN").arg(locale.toString(m_predictedMakespan / 1000))));
+    }
+
     runBackup();
 }
 
-void BackupManager::runBackup()
+bool BackupManager::buildGraph()
 {
-    if (m_currentItem) {
-        const QStringList errors = m_currentItem->errors();
-        if (!errors.empty()) {
-            // m_errors.push_back(std::make_pair(m_currentItem->id(), errors));
-            m_errors.emplace_back(m_currentItem->id(), errors);
+    QHash<QString, std::vector<qsizetype>> nodesByName;
+    for (qsizetype i = 0; i < static_cast<qsizetype>(m_nodes.size()); ++i) {
+        if (!m_nodes[i].name.isEmpty()) {
+            nodesByName[m_nodes[i].name].push_back(i);
         }
-        const QStringList warnings = m_currentItem->warnings();
-        if (!warnings.empty()) {
-            // m_warnings.push_back(std::make_pair(m_currentItem->id(), warnings));
-            m_warnings.emplace_back(m_currentItem->id(), warnings);
+    }
+
+    for (qsizetype i = 0; i < static_cast<qsizetype>(m_nodes.size()); ++i) {
+        Node &node = m_nodes[i];
+        for (const QString &dependency : std::as_const(node.after)) {
+            const auto it = nodesByName.constFind(dependency);
+            if (it == nodesByName.cend()) {
+                //% "%1 should run after %2, but %2 is not part of this backup run. Ignoring this dependency."
+                qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_UNKNOWN_DEPENDENCY").arg(node.name, dependency)));
+                continue;
+            }
+            for (const qsizetype depIdx : it.value()) {
+                if (std::find(node.dependencies.cbegin(), node.dependencies.cend(), depIdx) == node.dependencies.cend()) {
+                    node.dependencies.push_back(depIdx);
+                    m_nodes[depIdx].dependents.push_back(i);
+                }
+            }
         }
+        node.pendingDependencies = static_cast<int>(node.dependencies.size());
+    }
 
-        const std::vector<BackupStats> stats = m_currentItem->statistics();
-        for (const BackupStats &s : stats) {
-            m_stats.push_back(s);
+    // Kahn's algorithm, everything that is left over afterwards is part of a cycle
+    std::vector<int> inDegree;
+    inDegree.reserve(m_nodes.size());
+    QQueue<qsizetype> ready;
+    for (qsizetype i = 0; i < static_cast<qsizetype>(m_nodes.size()); ++i) {
+        inDegree.push_back(m_nodes[i].pendingDependencies);
+        if (m_nodes[i].pendingDependencies == 0) {
+            ready.enqueue(i);
+            m_readyNodes.append(i);
+        }
+    }
+
+    m_topoOrder.clear();
+    while (!ready.empty()) {
+        const qsizetype idx = ready.dequeue();
+        m_topoOrder.push_back(idx);
+        for (const qsizetype dependent : m_nodes[idx].dependents) {
+            if (--inDegree[dependent] == 0) {
+                ready.enqueue(dependent);
+            }
+        }
+    }
+
+    if (Q_UNLIKELY(m_topoOrder.size() != m_nodes.size())) {
+        QStringList cycleNodes;
+        for (qsizetype i = 0; i < static_cast<qsizetype>(m_nodes.size()); ++i) {
+            if (inDegree[i] > 0) {
+                cycleNodes << m_nodes[i].name;
+            }
         }
+        //% "The dependencies between the following backup items contain a cycle: %1"
+        handleError(qtTrId("SIHHURI_CRIT_DEPENDENCY_CYCLE").arg(cycleNodes.join(QLatin1String(", "))), RC::InvalidConfig);
+        return false;
+    }
+
+    return true;
+}
 
-        m_currentItem->deleteLater();
-        m_currentItem = nullptr;
+void BackupManager::runBackup()
+{
+    for (qsizetype i = 0; i < m_readyNodes.size() && m_runningNodes.size() < m_maxParallelItems;) {
+        const qsizetype nodeIdx = m_readyNodes.at(i);
+        Node &node = m_nodes[nodeIdx];
+        if (!m_runningNodes.empty() && !devicesAvailable(node.devices, m_sourceDeviceJobs, m_depotDeviceJobs)) {
+            ++i;
+            continue;
+        }
+        m_readyNodes.removeAt(i);
+        changeDeviceJobs(node.devices, m_sourceDeviceJobs, m_depotDeviceJobs, 1);
+        m_runningNodes.append(nodeIdx);
+        node.startTime = elapsed();
+        connect(node.item, &AbstractBackup::finished, this, [this, nodeIdx](){
+            onItemFinished(nodeIdx);
+        });
+        node.item->start();
     }
 
-    if (m_items.empty()) {
+    if (m_readyNodes.empty() && m_runningNodes.empty()) {
         changeOwner();
+    }
+}
+
+void BackupManager::onItemFinished(qsizetype nodeIdx)
+{
+    Node &node = m_nodes[nodeIdx];
+    AbstractBackup *item = node.item;
+
+    node.finishTime = elapsed();
+    node.id = item->id();
+    m_runningNodes.removeOne(nodeIdx);
+    changeDeviceJobs(node.devices, m_sourceDeviceJobs, m_depotDeviceJobs, -1);
+
+    const QStringList errors = item->errors();
+    if (!errors.empty()) {
+        m_errors.emplace_back(item->id(), errors);
+    }
+    const QStringList warnings = item->warnings();
+    if (!warnings.empty()) {
+        m_warnings.emplace_back(item->id(), warnings);
+    }
+
+    const std::vector<BackupStats> stats = item->statistics();
+    m_stats.insert(m_stats.end(), stats.cbegin(), stats.cend());
+    if (!stats.empty()) {
+        node.timeUsed = 0;
+        for (const BackupStats &s : stats) {
+            node.timeUsed += s.timeUsed;
+        }
+    }
+
+    node.downtime = item->downtime();
+    node.preSyncTime = item->preSyncTime();
+
+    item->deleteLater();
+    node.item = nullptr;
+
+    for (const qsizetype dependent : node.dependents) {
+        if (--m_nodes[dependent].pendingDependencies == 0) {
+            m_readyNodes.append(dependent);
+        }
+    }
+    sortReadyNodes(m_readyNodes);
+
+    runBackup();
+}
+
+void BackupManager::rankNodes()
+{
+    qint64 knownDurations = 0;
+    qint64 knownCount = 0;
+    for (Node &node : m_nodes) {
+        node.predictedDuration = m_history->duration(node.item->id());
+        if (node.predictedDuration > -1) {
+            knownDurations += node.predictedDuration;
+            knownCount++;
+        }
+    }
+
+    if (knownCount == 0) {
+        for (Node &node : m_nodes) {
+            node.predictedDuration = 0;
+        }
+        return;
+    }
+
+    // items without history are assumed to take as long as an average item
+    const qint64 averageDuration = knownDurations / knownCount;
+    for (Node &node : m_nodes) {
+        if (node.predictedDuration < 0) {
+            node.predictedDuration = averageDuration;
+        }
+    }
+
+    // the rank of a node is the longest predicted path from its start to the end of the
+    // graph, for independent items this is simply longest processing time first
+    for (auto it = m_topoOrder.crbegin(); it != m_topoOrder.crend(); ++it) {
+        Node &node = m_nodes[*it];
+        qint64 longestDependent = 0;
+        for (const qsizetype dependent : node.dependents) {
+            longestDependent = std::max(longestDependent, m_nodes[dependent].rank);
+        }
+        node.rank = node.predictedDuration + longestDependent;
+    }
+
+    m_predictedMakespan = predictMakespan();
+}
+
+void BackupManager::sortReadyNodes(QList<qsizetype> &readyNodes) const
+{
+    std::stable_sort(readyNodes.begin(), readyNodes.end(), [this](qsizetype a, qsizetype b){
+        return m_nodes[a].rank > m_nodes[b].rank;
+    });
+}
+
+qint64 BackupManager::predictMakespan() const
+{
+    // simulate the scheduling of runBackup() with the predicted durations
+    QHash<QString, int> sourceDeviceJobs;
+    QHash<QString, int> depotDeviceJobs;
+    std::vector<int> pendingDependencies;
+    pendingDependencies.reserve(m_nodes.size());
+    QList<qsizetype> readyNodes;
+    for (qsizetype i = 0; i < static_cast<qsizetype>(m_nodes.size()); ++i) {
+        pendingDependencies.push_back(static_cast<int>(m_nodes[i].dependencies.size()));
+        if (pendingDependencies.back() == 0) {
+            readyNodes.append(i);
+        }
+    }
+    sortReadyNodes(readyNodes);
+
+    std::vector<std::pair<qint64, qsizetype>> running;
+    qint64 now = 0;
+
+    while (!readyNodes.empty() || !running.empty()) {
+        for (qsizetype i = 0; i < readyNodes.size() && static_cast<int>(running.size()) < m_maxParallelItems;) {
+            const qsizetype nodeIdx = readyNodes.at(i);
+            const Node &node = m_nodes[nodeIdx];
+            if (!running.empty() && !devicesAvailable(node.devices, sourceDeviceJobs, depotDeviceJobs)) {
+                ++i;
+                continue;
+            }
+            readyNodes.removeAt(i);
+            changeDeviceJobs(node.devices, sourceDeviceJobs, depotDeviceJobs, 1);
+            running.emplace_back(now + node.predictedDuration, nodeIdx);
+        }
+
+        const auto next = std::min_element(running.cbegin(), running.cend());
+        now = next->first;
+        const qsizetype finishedIdx = next->second;
+        running.erase(next);
+
+        changeDeviceJobs(m_nodes[finishedIdx].devices, sourceDeviceJobs, depotDeviceJobs, -1);
+        for (const qsizetype dependent : m_nodes[finishedIdx].dependents) {
+            if (--pendingDependencies[dependent] == 0) {
+                readyNodes.append(dependent);
+            }
+        }
+        sortReadyNodes(readyNodes);
+    }
+
+    return now;
+}
+
+void BackupManager::saveHistory()
+{
+    for (const Node &node : std::as_const(m_nodes)) {
+        if (node.timeUsed > -1) {
+            m_history->setDuration(node.id, node.timeUsed);
+        }
+    }
+
+    if (Q_UNLIKELY(!m_history->save())) {
+        //% "Failed to save backup history to %1: %2"
+        qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_FAILED_SAVE_HISTORY").arg(m_history->filePath(), m_history->errorString())));
+    }
+}
+
+void BackupManager::logCriticalPath() const
+{
+    if (m_topoOrder.empty()) {
         return;
     }
 
-    m_currentItem = m_items.dequeue();
-    connect(m_currentItem, &AbstractBackup::finished, this, &BackupManager::runBackup);
-    m_currentItem->start();
+    std::vector<qint64> pathTime(m_nodes.size(), 0);
+    std::vector<qsizetype> predecessor(m_nodes.size(), -1);
+    qsizetype last = m_topoOrder.front();
+
+    for (const qsizetype idx : m_topoOrder) {
+        const Node &node = m_nodes[idx];
+        qint64 longestDependency = 0;
+        for (const qsizetype dep : node.dependencies) {
+            if (pathTime[dep] > longestDependency) {
+                longestDependency = pathTime[dep];
+                predecessor[idx] = dep;
+            }
+        }
+        pathTime[idx] = longestDependency + (node.finishTime - node.startTime);
+        if (pathTime[idx] > pathTime[last]) {
+            last = idx;
+        }
+    }
+
+    QStringList path;
+    for (qsizetype idx = last; idx > -1; idx = predecessor[idx]) {
+        path.prepend(m_nodes[idx].id);
+    }
+
+    QLocale locale;
+    //% "Critical path of %1 seconds: %2"
+    qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_CRITICAL_PATH").arg(locale.toString(pathTime[last] / 1000), path.join(QLatin1String(" -> ")))));
+}
+
+qint64 BackupManager::elapsed() const
+{
+    const auto now = std::chrono::high_resolution_clock::now();
+    return static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_timeStart).count());
+}
+
+BackupManager::ItemDevices BackupManager::resolveDevices(AbstractBackup *item, const QVariantMap &options) const
+{
+    ItemDevices devices;
+
+    const QStringList dirs = options.value(QStringLiteral("directories")).toStringList();
+    for (const QString &dir : dirs) {
+        const QString sourceDevice = backingDevice(dir);
+        if (!sourceDevice.isEmpty()) {
+            devices.source.insert(sourceDevice);
+        }
+        const QString depotDevice = backingDevice(m_depot + dir);
+        if (!depotDevice.isEmpty()) {
+            devices.depot.insert(depotDevice);
+        }
+    }
+
+    if (qobject_cast<DbBackup*>(item)) {
+        const QString dumpDevice = backingDevice(m_depot + QLatin1String("/Databases"));
+        if (!dumpDevice.isEmpty()) {
+            devices.depot.insert(dumpDevice);
+        }
+    }
+
+    return devices;
+}
+
+bool BackupManager::devicesAvailable(const ItemDevices &devices, const QHash<QString, int> &sourceDeviceJobs, const QHash<QString, int> &depotDeviceJobs) const
+{
+    if (m_maxJobsPerDevice > 0) {
+        for (const QString &dev : devices.source) {
+            if (sourceDeviceJobs.value(dev) >= m_maxJobsPerDevice) {
+                return false;
+            }
+        }
+    }
+
+    if (m_maxJobsPerDepotDevice > 0) {
+        for (const QString &dev : devices.depot) {
+            if (depotDeviceJobs.value(dev) >= m_maxJobsPerDepotDevice) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void BackupManager::changeDeviceJobs(const ItemDevices &devices, QHash<QString, int> &sourceDeviceJobs, QHash<QString, int> &depotDeviceJobs, int change)
+{
+    for (const QString &dev : devices.source) {
+        sourceDeviceJobs[dev] += change;
+    }
+    for (const QString &dev : devices.depot) {
+        depotDeviceJobs[dev] += change;
+    }
+}
+
+QString BackupManager::backingDevice(const QString &path)
+{
+    // the depot side might not exist yet, so use the nearest existing parent
+    QString p = path;
+    struct stat st{};
+    while (::stat(QFile::encodeName(p).constData(), &st) != 0) {
+        const qsizetype slashIdx = p.lastIndexOf(QLatin1Char('/'));
+        if (p == QLatin1String("/") || slashIdx < 0) {
+            return {};
+        }
+        p = slashIdx == 0 ? QStringLiteral("/") : p.left(slashIdx);
+    }
+
+    QString dev = QString::number(major(st.st_dev)) + QLatin1Char(':') + QString::number(minor(st.st_dev));
+
+    // partitions of the same disk compete for the same spindles, so map them to their parent disk
+    const QString sysPath = QFileInfo(QLatin1String("/sys/dev/block/") + dev).canonicalFilePath();
+    if (!sysPath.isEmpty() && QFileInfo::exists(sysPath + QLatin1String("/partition"))) {
+        QFile parentDevFile(sysPath.left(sysPath.lastIndexOf(QLatin1Char('/'))) + QLatin1String("/dev"));
+        if (parentDevFile.open(QIODevice::ReadOnly|QIODevice::Text)) {
+            const QString parentDev = QString::fromLatin1(parentDevFile.readAll()).trimmed();
+            if (!parentDev.isEmpty()) {
+                dev = parentDev;
+            }
+        }
+    }
+
+    return dev;
 }
 
 void BackupManager::changeOwner()
@@ -216,15 +608,93 @@ void BackupManager::finish()
 
     qint64 files = 0;
     qint64 size = 0;
+    qint64 transferred = 0;
+    qint64 linked = 0;
+    qint64 preserved = 0;
+    qint64 reclaimed = 0;
+
+    struct CodecStats {
+        qint64 uncompressed = 0;
+        qint64 compressed = 0;
+        qint64 time = 0;
+    };
+    // by codec and level, to compare what more CPU time saves in depot space
+    std::map<std::pair<QString,int>,CodecStats> codecs;
+
+    qint64 downtime = 0;
+    qint64 preSyncTime = 0;
 
     for (const BackupStats &stats : m_stats) {
+        transferred += stats.transferredBytes;
+        linked += stats.linkedBytes;
+        if (stats.phase != BackupStats::PreSync) {
+            preserved += stats.hardLinkedBytes + stats.sparseBytes;
+        }
+        reclaimed += stats.reclaimedBytes;
+        if (stats.phase == BackupStats::PreSync) {
+            continue;
+        }
         files += stats.filesAfter;
         size += stats.sizeAfter;
         size += stats.compressedSize;
+        if (!stats.codec.isEmpty()) {
+            CodecStats &codec = codecs[{stats.codec, stats.codecLevel}];
+            codec.uncompressed += stats.uncompressedSize;
+            codec.compressed += stats.compressedSize;
+            codec.time += stats.compressionTime;
+        }
+    }
+
+    for (const Node &node : std::as_const(m_nodes)) {
+        downtime += std::max(node.downtime, Q_INT64_C(0));
+        preSyncTime += std::max(node.preSyncTime, Q_INT64_C(0));
     }
 
     QLocale locale;
 
+    logCriticalPath();
+    saveHistory();
+
+    if (preSyncTime > 0) {
+        //% "Maintenance windows lasted %1 seconds in total after %2 seconds of live pre-sync."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_TOTAL_DOWNTIME").arg(locale.toString(downtime / 1000), locale.toString(preSyncTime / 1000))));
+    }
+
+    if (transferred > 0) {
+        //% "Transferred %1 of changed directory data in total."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_TOTAL_TRANSFERRED").arg(locale.formattedDataSize(transferred))));
+    }
+
+    if (linked > 0) {
+        //% "Hard linked %1 of unchanged directory data to previous generations in total."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_TOTAL_LINKED").arg(locale.formattedDataSize(linked))));
+    }
+
+    if (preserved > 0) {
+        //% "Saved %1 in total by preserving hard links and holes of sparse files."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_TOTAL_PRESERVED").arg(locale.formattedDataSize(preserved))));
+    }
+
+    for (const auto &[codec, codecStats] : codecs) {
+        if (codecStats.compressed <= 0) {
+            continue;
+        }
+        const double ratio = static_cast<double>(codecStats.uncompressed) / static_cast<double>(codecStats.compressed);
+        const qint64 throughput = codecStats.uncompressed * 1000 / std::max(codecStats.time, Q_INT64_C(1));
+        //% "Compressed %1 of database dumps with %2 level %3 to %4 in total, ratio %5 at %6 per second."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_TOTAL_COMPRESSION").arg(locale.formattedDataSize(codecStats.uncompressed), codec.first, locale.toString(codec.second), locale.formattedDataSize(codecStats.compressed), locale.toString(ratio, 'f', 2), locale.formattedDataSize(throughput))));
+    }
+
+    if (reclaimed > 0) {
+        //% "Reclaimed %1 by pruning old generations in total."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_TOTAL_RECLAIMED").arg(locale.formattedDataSize(reclaimed))));
+    }
+
+    if (m_predictedMakespan > -1) {
+        //% "Predicted run time was %1 seconds, actual run time was %2 seconds."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_PREDICTED_ACTUAL_MAKESPAN").arg(locale.toString(m_predictedMakespan / 1000), locale.toString(timeUsed))));
+    }
+
     //% "Finished backup of %1 items in %2 seconds. Errors: %3, Warnings: %4, Files: %5, Size: %6"
     const QString msg = qtTrId("SIHHURI_INFO_FINISHED_COMPLETE_BACKUP").arg(QString::number(m_enabledItemsSize), QString::number(timeUsed), QString::number(errorCount), QString::number(warningCount), locale.toString(files), locale.formattedDataSize(size));
     if (errorCount > 0) {
@@ -234,14 +704,14 @@ void BackupManager::finish()
     } else {
         qInfo("%s", qUtf8Printable(msg));
     }
-    QCoreApplication::exit();
+    emit finished(static_cast<int>(RC::OK));
 }
 
 void BackupManager::handleError(const QString &msg, RC exitCode)
 {
     qCritical("%s", qUtf8Printable(msg));
 
-    QCoreApplication::exit(static_cast<int>(exitCode));
+    emit finished(static_cast<int>(exitCode));
 }
 
 #include "moc_backupmanager.cpp"
@@ -8,13 +8,17 @@
 
 #include "abstractbackup.h"
 #include "returncodes.h"
+#include "backuphistory.h"
 #include <QObject>
 #include <QVariantMap>
 #include <QTemporaryDir>
 #include <QQueue>
 #include <QProcess>
 #include <QFileInfo>
+#include <QHash>
+#include <QSet>
 #include <chrono>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -25,14 +29,67 @@ public:
     explicit BackupManager(const QVariantMap &config, const QStringList &types, QObject *parent = nullptr);
     ~BackupManager() override;
 
+    /*!
+     * \brief Restricts the run to the items at \a indexes in the configured items list.
+     *
+     * If not set or empty, all enabled items will be backed up.
+     */
+    void setItemIndexes(const QList<int> &indexes);
+
+    /*!
+     * \brief Sets the \a history to use for this run.
+     *
+     * The history will not be owned by the BackupManager. If no history has been set,
+     * it will be loaded from the state directory when the run starts.
+     */
+    void setHistory(BackupHistory *history);
+
     void start();
 
+signals:
+    void finished(int exitCode);
+
 private slots:
     void doStart();
     void runBackup();
     void doChangeOwner();
 
 private:
+    struct ItemDevices {
+        QSet<QString> source;
+        QSet<QString> depot;
+    };
+
+    struct Node {
+        AbstractBackup *item = nullptr;
+        QString id;
+        QString name;
+        QStringList after;
+        std::vector<qsizetype> dependencies;
+        std::vector<qsizetype> dependents;
+        ItemDevices devices;
+        qint64 startTime = 0;
+        qint64 finishTime = 0;
+        qint64 timeUsed = -1;
+        qint64 downtime = -1;
+        qint64 preSyncTime = -1;
+        qint64 predictedDuration = 0;
+        qint64 rank = 0;
+        int pendingDependencies = 0;
+    };
+
+    [[nodiscard]] bool buildGraph();
+    void onItemFinished(qsizetype nodeIdx);
+    void rankNodes();
+    void sortReadyNodes(QList<qsizetype> &readyNodes) const;
+    [[nodiscard]] qint64 predictMakespan() const;
+    void saveHistory();
+    void logCriticalPath() const;
+    [[nodiscard]] qint64 elapsed() const;
+    [[nodiscard]] ItemDevices resolveDevices(AbstractBackup *item, const QVariantMap &options) const;
+    [[nodiscard]] bool devicesAvailable(const ItemDevices &devices, const QHash<QString, int> &sourceDeviceJobs, const QHash<QString, int> &depotDeviceJobs) const;
+    static void changeDeviceJobs(const ItemDevices &devices, QHash<QString, int> &sourceDeviceJobs, QHash<QString, int> &depotDeviceJobs, int change);
+    [[nodiscard]] static QString backingDevice(const QString &path);
     void changeOwner();
     void finish();
     void handleError(const QString &msg, RC exitCode);
@@ -45,11 +102,22 @@ private:
     QString m_depot;
     QString m_owner;
     QTemporaryDir m_tempDir;
-    QQueue<AbstractBackup*> m_items;
+    std::vector<Node> m_nodes;
+    std::vector<qsizetype> m_topoOrder;
+    QList<qsizetype> m_readyNodes;
+    QList<qsizetype> m_runningNodes;
+    QHash<QString, int> m_sourceDeviceJobs;
+    QHash<QString, int> m_depotDeviceJobs;
     QQueue<QFileInfo> m_changeOwnerQueue;
-    AbstractBackup* m_currentItem = nullptr;
+    std::unique_ptr<BackupHistory> m_ownHistory;
+    BackupHistory *m_history = nullptr;
+    QList<int> m_itemIndexes;
     std::chrono::time_point<std::chrono::high_resolution_clock> m_timeStart;
+    qint64 m_predictedMakespan = -1;
     int m_enabledItemsSize = 0;
+    int m_maxParallelItems = 1;
+    int m_maxJobsPerDevice = 1;
+    int m_maxJobsPerDepotDevice = 0;
 
     Q_DISABLE_COPY(BackupManager)
 };
@@ -0,0 +1,273 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "changejournal.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUrl>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ChangeJournal::ChangeJournal(const QString &journalDir, const QString &directory)
+    : m_directory(directory)
+{
+    const QString base = journalDir + QLatin1Char('/') + QString::fromLatin1(QUrl::toPercentEncoding(directory));
+    m_filePath = base + QLatin1String(".journal");
+    m_takenPath = base + QLatin1String(".taken");
+    m_lockPath = base + QLatin1String(".lock");
+}
+
+ChangeJournal::~ChangeJournal()
+{
+    if (m_lockFd >= 0) {
+        ::close(m_lockFd);
+    }
+}
+
+QString ChangeJournal::directory() const
+{
+    return m_directory;
+}
+
+QString ChangeJournal::filePath() const
+{
+    return m_filePath;
+}
+
+QString ChangeJournal::errorString() const
+{
+    return m_errorString;
+}
+
+bool ChangeJournal::lock()
+{
+    if (!QDir().mkpath(QFileInfo(m_lockPath).absolutePath())) {
+        //% "Failed to create directory %1."
+        m_errorString = qtTrId("SIHHURI_CRIT_JOURNAL_FAILED_CREATE_DIR").arg(QFileInfo(m_lockPath).absolutePath());
+        return false;
+    }
+
+    m_lockFd = ::open(QFile::encodeName(m_lockPath).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_lockFd < 0) {
+        m_errorString = qt_error_string(errno);
+        return false;
+    }
+
+    if (::flock(m_lockFd, LOCK_EX | LOCK_NB) != 0) {
+        //% "The journal is already recorded by another process."
+        m_errorString = errno == EWOULDBLOCK ? qtTrId("SIHHURI_CRIT_JOURNAL_ALREADY_LOCKED") : qt_error_string(errno);
+        ::close(m_lockFd);
+        m_lockFd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool ChangeJournal::append(const QByteArray &records)
+{
+    const QByteArray path = QFile::encodeName(m_filePath);
+
+    for (;;) {
+        const int fd = ::open(path.constData(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            m_errorString = qt_error_string(errno);
+            return false;
+        }
+
+        if (::flock(fd, LOCK_EX) != 0) {
+            m_errorString = qt_error_string(errno);
+            ::close(fd);
+            return false;
+        }
+
+        // the consumer might have moved the journal aside while we were waiting for the lock
+        struct stat opened{};
+        struct stat current{};
+        if (::fstat(fd, &opened) != 0 || ::stat(path.constData(), &current) != 0 || opened.st_dev != current.st_dev || opened.st_ino != current.st_ino) {
+            ::close(fd);
+            continue;
+        }
+
+        const char *data = records.constData();
+        qsizetype remaining = records.size();
+        while (remaining > 0) {
+            const ssize_t written = ::write(fd, data, static_cast<size_t>(remaining));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                m_errorString = qt_error_string(errno);
+                ::close(fd);
+                return false;
+            }
+            data += written;
+            remaining -= written;
+        }
+
+        ::close(fd);
+        return true;
+    }
+}
+
+QByteArray ChangeJournal::record(RecordType type, const QByteArray &path)
+{
+    QByteArray r;
+    r.reserve(path.size() + 2);
+    r.append(static_cast<char>(type));
+    r.append(path);
+    r.append('\0');
+    return r;
+}
+
+ChangeJournal::Status ChangeJournal::take(qsizetype maxEntries)
+{
+    m_changed.clear();
+    m_recursive.clear();
+    m_status = Inactive;
+
+    // the lock is held by the recorder as long as it is running
+    const int lockFd = ::open(QFile::encodeName(m_lockPath).constData(), O_RDONLY | O_CLOEXEC);
+    if (lockFd < 0) {
+        return Inactive;
+    }
+    const bool running = ::flock(lockFd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+    ::close(lockFd);
+    if (!running) {
+        return Inactive;
+    }
+
+    m_status = rotate() ? read(maxEntries) : Failed;
+    return m_status;
+}
+
+ChangeJournal::Status ChangeJournal::status() const
+{
+    return m_status;
+}
+
+bool ChangeJournal::rotate()
+{
+    const QByteArray path = QFile::encodeName(m_filePath);
+    const int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            // nothing has been changed since the last take
+            return true;
+        }
+        m_errorString = qt_error_string(errno);
+        return false;
+    }
+
+    // waits for the recorder to finish its current write
+    if (::flock(fd, LOCK_EX) != 0) {
+        m_errorString = qt_error_string(errno);
+        ::close(fd);
+        return false;
+    }
+
+    bool ok = true;
+    if (QFileInfo::exists(m_takenPath)) {
+        // the journal taken by the last run has not been committed, the new records are merged into it
+        QFile current;
+        QFile taken(m_takenPath);
+        if (!current.open(fd, QIODevice::ReadOnly) || !taken.open(QIODevice::WriteOnly|QIODevice::Append)) {
+            m_errorString = taken.errorString();
+            ok = false;
+        } else {
+            while (ok && !current.atEnd()) {
+                const QByteArray chunk = current.read(1024 * 1024);
+                ok = !chunk.isEmpty() && taken.write(chunk) == chunk.size();
+            }
+            if (!ok || !taken.flush()) {
+                m_errorString = taken.errorString();
+                ok = false;
+            }
+            current.close();
+        }
+        if (ok && ::unlink(path.constData()) != 0) {
+            m_errorString = qt_error_string(errno);
+            ok = false;
+        }
+    } else if (::rename(path.constData(), QFile::encodeName(m_takenPath).constData()) != 0) {
+        m_errorString = qt_error_string(errno);
+        ok = false;
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+ChangeJournal::Status ChangeJournal::read(qsizetype maxEntries)
+{
+    QFile taken(m_takenPath);
+    if (!taken.exists()) {
+        return Valid;
+    }
+    if (!taken.open(QIODevice::ReadOnly)) {
+        m_errorString = taken.errorString();
+        return Failed;
+    }
+
+    const QByteArray data = taken.readAll();
+    qsizetype pos = 0;
+    while (pos < data.size()) {
+        qsizetype end = data.indexOf('\0', pos);
+        if (end < 0) {
+            // incomplete last record of an interrupted write
+            end = data.size();
+        }
+        const QByteArrayView rec(data.constData() + pos, end - pos);
+        pos = end + 1;
+        if (rec.isEmpty()) {
+            continue;
+        }
+        switch (rec.front()) {
+        case Changed:
+            m_changed.emplace_back(rec.constData() + 1, static_cast<std::size_t>(rec.size() - 1));
+            break;
+        case Recursive:
+            m_changed.emplace_back(rec.constData() + 1, static_cast<std::size_t>(rec.size() - 1));
+            m_recursive.emplace_back(rec.constData() + 1, static_cast<std::size_t>(rec.size() - 1));
+            break;
+        default:
+            m_changed.clear();
+            m_recursive.clear();
+            return Incomplete;
+        }
+        if (static_cast<qsizetype>(m_changed.size()) > maxEntries) {
+            m_changed.clear();
+            m_recursive.clear();
+            return Incomplete;
+        }
+    }
+
+    for (std::vector<std::string> *list : {&m_changed, &m_recursive}) {
+        std::sort(list->begin(), list->end());
+        list->erase(std::unique(list->begin(), list->end()), list->end());
+    }
+
+    return Valid;
+}
+
+void ChangeJournal::commit()
+{
+    QFile::remove(m_takenPath);
+}
+
+const std::vector<std::string> &ChangeJournal::changed() const
+{
+    return m_changed;
+}
+
+const std::vector<std::string> &ChangeJournal::recursive() const
+{
+    return m_recursive;
+}
@@ -0,0 +1,116 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <QString>
+#include <QByteArray>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Journal of the entries that have been changed below a synced directory.
+ *
+ * The journal is written by the ChangeRecorder and consumed by the directory syncs.
+ * Every synced directory has its own journal file in the journal directory, the
+ * records are separated by null bytes and start with the record type followed by the
+ * path relative to the synced directory. While the recorder is running it holds an
+ * exclusive lock on the lock file of the journal, so the consumer knows if the journal
+ * is complete.
+ *
+ * The consumer calls take() to move the current journal aside, changes that are recorded
+ * afterwards go into a new journal for the next run. After a successful sync commit()
+ * removes the taken journal, otherwise it is merged with the next journal on the next run.
+ */
+class ChangeJournal
+{
+public:
+    enum RecordType : char {
+        Changed = 'P',
+        Recursive = 'R',
+        Overflow = 'O',
+        Gap = 'G'
+    };
+
+    enum Status : quint8 {
+        Valid,
+        Inactive,
+        Incomplete,
+        Failed
+    };
+
+    ChangeJournal(const QString &journalDir, const QString &directory);
+    ~ChangeJournal();
+
+    [[nodiscard]] QString directory() const;
+    [[nodiscard]] QString filePath() const;
+    [[nodiscard]] QString errorString() const;
+
+    /*!
+     * \brief Takes the exclusive lock that marks the journal as recorded.
+     *
+     * Used by the recorder, the lock is held until the object is destroyed.
+     */
+    bool lock();
+
+    /*!
+     * \brief Appends the null byte separated \a records to the journal.
+     */
+    bool append(const QByteArray &records);
+
+    /*!
+     * \brief Returns a journal record of \a type for \a path.
+     */
+    [[nodiscard]] static QByteArray record(RecordType type, const QByteArray &path = QByteArray());
+
+    /*!
+     * \brief Moves the current journal aside and reads it.
+     *
+     * Returns Valid if the recorder is running and the journal contains every change
+     * since the last committed take. Incomplete journals contain a gap, an overflow of
+     * the event queue or more than \a maxEntries entries. The entries are only available
+     * for valid journals.
+     */
+    Status take(qsizetype maxEntries);
+
+    /*!
+     * \brief Returns the result of the last take().
+     */
+    [[nodiscard]] Status status() const;
+
+    /*!
+     * \brief Removes the journal taken by take().
+     */
+    void commit();
+
+    /*!
+     * \brief Returns the sorted changed entries of the taken journal.
+     */
+    [[nodiscard]] const std::vector<std::string> &changed() const;
+
+    /*!
+     * \brief Returns the sorted directories of the taken journal that have to be synced recursively.
+     */
+    [[nodiscard]] const std::vector<std::string> &recursive() const;
+
+private:
+    bool rotate();
+    Status read(qsizetype maxEntries);
+
+    std::vector<std::string> m_changed;
+    std::vector<std::string> m_recursive;
+    QString m_directory;
+    QString m_filePath;
+    QString m_takenPath;
+    QString m_lockPath;
+    QString m_errorString;
+    int m_lockFd = -1;
+    Status m_status = Inactive;
+
+    Q_DISABLE_COPY(ChangeJournal)
+};
+
+#endif // CHANGEJOURNAL_H
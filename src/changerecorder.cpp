@@ -0,0 +1,355 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "changerecorder.h"
+#include "mountroot.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSocketNotifier>
+#include <QVariantList>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr quint64 eventMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR;
+
+QByteArray toFsidKey(const void *fsid)
+{
+    return QByteArray(static_cast<const char *>(fsid), sizeof(__kernel_fsid_t));
+}
+}
+
+ChangeRecorder::ChangeRecorder(const QString &journalDir, QObject *parent)
+    : QObject(parent),
+      m_journalDir(journalDir)
+{
+
+}
+
+ChangeRecorder::~ChangeRecorder()
+{
+    flush();
+    for (const Mount &mount : m_mounts) {
+        ::close(mount.fd);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+QStringList ChangeRecorder::journaledDirectories(const QVariantMap &config, const QStringList &types)
+{
+    QStringList dirs;
+    const QVariantList items = config.value(QStringLiteral("items")).toList();
+    for (const QVariant &i : items) {
+        const QVariantMap o = i.toMap();
+        if (!o.value(QStringLiteral("enabled"), true).toBool() || !o.value(QStringLiteral("journal"), false).toBool()) {
+            continue;
+        }
+        if (!types.empty() && !types.contains(o.value(QStringLiteral("type")).toString(), Qt::CaseInsensitive)) {
+            continue;
+        }
+        const QStringList itemDirs = o.value(QStringLiteral("directories")).toStringList();
+        for (const QString &dir : itemDirs) {
+            QString d = dir;
+            if (d.endsWith(QLatin1Char('/'))) {
+                d.chop(1);
+            }
+            if (!d.isEmpty() && !dirs.contains(d)) {
+                dirs.append(d);
+            }
+        }
+    }
+    return dirs;
+}
+
+bool ChangeRecorder::start(const QStringList &directories)
+{
+    m_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME, O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+    if (m_fd < 0) {
+        //% "Failed to initialize fanotify: %1"
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RECORDER_FAILED_INIT").arg(qt_error_string(errno))));
+        return false;
+    }
+
+    for (const QString &dir : directories) {
+        Watch watch;
+        watch.journal = std::make_unique<ChangeJournal>(m_journalDir, dir);
+        // the resolved event paths never contain symbolic links
+        const QString canonicalDir = QFileInfo(dir).canonicalFilePath();
+        watch.path = QFile::encodeName(canonicalDir.isEmpty() ? dir : canonicalDir);
+
+        if (!watch.journal->lock()) {
+            //% "Failed to lock the change journal of %1: %2"
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RECORDER_FAILED_LOCK").arg(dir, watch.journal->errorString())));
+            return false;
+        }
+
+        const int dirFd = ::open(watch.path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct statfs sfs{};
+        const QByteArray mountRoot = dirFd >= 0 ? QByteArray::fromStdString(MountRoot::of(watch.path.toStdString())) : QByteArray();
+        if (dirFd < 0 || ::fstatfs(dirFd, &sfs) != 0 || mountRoot.isEmpty()) {
+            //% "Failed to open %1: %2"
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RECORDER_FAILED_OPEN_DIR").arg(dir, qt_error_string(errno))));
+            if (dirFd >= 0) {
+                ::close(dirFd);
+            }
+            return false;
+        }
+        // the paths of the resolved handles are relative to the mount they are opened with,
+        // bind mounts only show a part of the file system, so every watched mount is kept
+        watch.fsid = toFsidKey(&sfs.f_fsid);
+        const bool knownMount = std::any_of(m_mounts.cbegin(), m_mounts.cend(), [&mountRoot](const Mount &m){return m.root == mountRoot;});
+        if (knownMount) {
+            ::close(dirFd);
+        } else {
+            m_mounts.push_back(Mount{watch.fsid, mountRoot, dirFd});
+        }
+
+        if (fanotify_mark(m_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, eventMask, AT_FDCWD, watch.path.constData()) != 0) {
+            //% "Failed to watch the file system of %1: %2"
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RECORDER_FAILED_MARK").arg(dir, qt_error_string(errno))));
+            return false;
+        }
+
+        // changes before the mark have not been seen, the next sync has to compare the complete directory
+        if (!watch.journal->append(ChangeJournal::record(ChangeJournal::Gap))) {
+            //% "Failed to write the change journal of %1: %2"
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RECORDER_FAILED_WRITE").arg(dir, watch.journal->errorString())));
+            return false;
+        }
+
+        m_watches.push_back(std::move(watch));
+    }
+
+    m_directories = directories;
+    const QString canonicalJournalDir = QFileInfo(m_journalDir).canonicalFilePath();
+    m_journalDirPath = QFile::encodeName(canonicalJournalDir.isEmpty() ? m_journalDir : canonicalJournalDir);
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this); // NOLINT(cppcoreguidelines-owning-memory)
+    connect(m_notifier, &QSocketNotifier::activated, this, &ChangeRecorder::onActivated);
+
+    //% "Recording changes of %n directories."
+    qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_RECORDER_STARTED", static_cast<int>(m_watches.size()))));
+
+    return true;
+}
+
+QStringList ChangeRecorder::directories() const
+{
+    return m_directories;
+}
+
+QString ChangeRecorder::journalDir() const
+{
+    return m_journalDir;
+}
+
+void ChangeRecorder::onActivated()
+{
+    alignas(struct fanotify_event_metadata) std::array<char, 64 * 1024> buffer{};
+    // events of the same directory usually come in bulks
+    QHash<QByteArray,Resolved> resolved;
+
+    for (;;) {
+        const ssize_t len = ::read(m_fd, buffer.data(), buffer.size());
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len < 0 && errno != EAGAIN) {
+                //% "Failed to read file system events: %1"
+                qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_RECORDER_FAILED_READ").arg(qt_error_string(errno))));
+            }
+            break;
+        }
+
+        ssize_t remaining = len;
+        for (auto md = reinterpret_cast<const struct fanotify_event_metadata *>(buffer.data()); FAN_EVENT_OK(md, remaining); md = FAN_EVENT_NEXT(md, remaining)) {
+            if (md->fd >= 0) {
+                ::close(md->fd);
+            }
+
+            if ((md->mask & FAN_Q_OVERFLOW) || md->event_len <= md->metadata_len) {
+                recordAll(ChangeJournal::Overflow);
+                continue;
+            }
+
+            const auto fid = reinterpret_cast<const struct fanotify_event_info_fid *>(reinterpret_cast<const char *>(md) + md->metadata_len);
+            if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                continue;
+            }
+            const auto fh = reinterpret_cast<const struct file_handle *>(fid->handle);
+            const QByteArray handle(reinterpret_cast<const char *>(fid->handle), static_cast<qsizetype>(sizeof(struct file_handle) + fh->handle_bytes));
+            const char *name = reinterpret_cast<const char *>(fh->f_handle + fh->handle_bytes);
+
+            const QByteArray fsid = toFsidKey(&fid->fsid);
+            const QByteArray key = fsid + handle;
+            auto it = resolved.constFind(key);
+            if (it == resolved.cend()) {
+                it = resolved.insert(key, resolve(fsid, handle));
+            }
+            const QByteArray &dir = it->path;
+
+            if (it->removed) {
+                // the directory has been removed, that is recorded by the event of its own removal
+                continue;
+            }
+            if (it->unreachable) {
+                // the path can not be compared with the watched directories
+                recordFileSystem(fsid, ChangeJournal::Overflow);
+                continue;
+            }
+            if (dir.isEmpty()) {
+                recordAll(ChangeJournal::Overflow);
+                continue;
+            }
+
+            QByteArray path = dir;
+            if (std::strcmp(name, ".") != 0) {
+                if (!path.endsWith('/')) {
+                    path.append('/');
+                }
+                path.append(name);
+            }
+
+            // directories moved into the tree bring their content without any further events
+            const bool movedDir = (md->mask & FAN_ONDIR) && (md->mask & FAN_MOVED_TO);
+            record(path, movedDir ? ChangeJournal::Recursive : ChangeJournal::Changed);
+        }
+    }
+
+    flush();
+}
+
+ChangeRecorder::Resolved ChangeRecorder::resolve(const QByteArray &fsid, const QByteArray &handle) const
+{
+    // file systems like btrfs report other ids for their sub volumes, any directory on the same file system works
+    std::vector<const Mount *> mounts;
+    for (const Mount &mount : m_mounts) {
+        if (mount.fsid == fsid) {
+            mounts.push_back(&mount);
+        }
+    }
+    const bool knownFsid = !mounts.empty();
+    if (!knownFsid) {
+        for (const Mount &mount : m_mounts) {
+            mounts.push_back(&mount);
+        }
+    }
+
+    Resolved result;
+    QByteArray unreachablePath;
+    for (const Mount *mount : mounts) {
+        QByteArray fh = handle;
+        const int fd = ::open_by_handle_at(mount->fd, reinterpret_cast<struct file_handle *>(fh.data()), O_PATH | O_CLOEXEC);
+        if (fd < 0) {
+            // handles of other file systems are stale too
+            result.removed = result.removed || (knownFsid && errno == ESTALE);
+            continue;
+        }
+        std::array<char, PATH_MAX> link{};
+        const QByteArray proc = "/proc/self/fd/" + QByteArray::number(fd);
+        const ssize_t len = ::readlink(proc.constData(), link.data(), link.size());
+        ::close(fd);
+        if (len <= 0) {
+            continue;
+        }
+        const QByteArray path(link.data(), len);
+        if (path.endsWith(" (deleted)")) {
+            result.removed = true;
+            continue;
+        }
+        // directories outside of the part a bind mount shows get a path that is not below its root
+        const QByteArray rootPrefix = mount->root.endsWith('/') ? mount->root : mount->root + '/';
+        if (path != mount->root && !path.startsWith(rootPrefix)) {
+            unreachablePath = path;
+            continue;
+        }
+        result.removed = false;
+        result.path = path;
+        return result;
+    }
+
+    if (!unreachablePath.isEmpty() && !result.removed) {
+        if (knownFsid) {
+            result.unreachable = true;
+        } else {
+            // other sub volumes of a watched file system, they are never below a watched directory
+            result.path = unreachablePath;
+        }
+    }
+
+    return result;
+}
+
+void ChangeRecorder::record(const QByteArray &path, ChangeJournal::RecordType type)
+{
+    if (path.startsWith(m_journalDirPath + '/')) {
+        return;
+    }
+
+    for (Watch &watch : m_watches) {
+        const QByteArray prefix = watch.path.endsWith('/') ? watch.path : watch.path + '/';
+        if (!path.startsWith(prefix)) {
+            continue;
+        }
+        const QByteArray rel = path.mid(prefix.size());
+        // the attributes of the directory itself are synced every time
+        if (rel.isEmpty()) {
+            continue;
+        }
+        const QByteArray r = ChangeJournal::record(type, rel);
+        if (!watch.seen.contains(r)) {
+            watch.seen.insert(r);
+            watch.records.append(r);
+        }
+    }
+}
+
+void ChangeRecorder::recordFileSystem(const QByteArray &fsid, ChangeJournal::RecordType type)
+{
+    for (Watch &watch : m_watches) {
+        if (watch.fsid == fsid) {
+            watch.records.append(ChangeJournal::record(type));
+        }
+    }
+}
+
+void ChangeRecorder::recordAll(ChangeJournal::RecordType type)
+{
+    for (Watch &watch : m_watches) {
+        watch.records.append(ChangeJournal::record(type));
+    }
+}
+
+void ChangeRecorder::flush()
+{
+    for (Watch &watch : m_watches) {
+        if (watch.records.isEmpty()) {
+            continue;
+        }
+        if (!watch.journal->append(watch.records)) {
+            // the records are kept and written with the next events
+            //% "Failed to write the change journal of %1: %2"
+            qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_RECORDER_FAILED_WRITE").arg(QFile::decodeName(watch.path), watch.journal->errorString())));
+            continue;
+        }
+        watch.records.clear();
+        watch.seen.clear();
+    }
+}
+
+#include "moc_changerecorder.cpp"
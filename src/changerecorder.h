@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CHANGERECORDER_H
+#define CHANGERECORDER_H
+
+#include "changejournal.h"
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QVariantMap>
+#include <memory>
+#include <vector>
+
+class QSocketNotifier;
+
+/*!
+ * \brief Records the changes below the synced directories into their ChangeJournal.
+ *
+ * Uses fanotify with \c FAN_REPORT_DFID_NAME to get notified about created, deleted,
+ * moved, modified and changed entries on the file systems of the \a directories. The
+ * events only contain the handle of the parent directory and the name of the entry,
+ * the directory path is resolved by open_by_handle_at(), what requires the
+ * \c CAP_SYS_ADMIN and \c CAP_DAC_READ_SEARCH capabilities. The handles are opened
+ * relative to the mount of every watched directory and matched against the canonical
+ * directory paths, so symbolic links and bind mounts in the configured paths do not
+ * hide the events. Events inside directories that have already been removed are
+ * dropped, the removal of the directory itself is recorded by the event of its parent.
+ * Directories moved into the tree are recorded to be synced recursively.
+ *
+ * Every start records a gap, as changes might have been missed while the recorder was
+ * not running. Gaps, overflows of the event queue, handles that can not be resolved and
+ * paths of a watched file system that are not reachable through any watched mount let
+ * the next sync of the affected directories compare the complete directory.
+ */
+class ChangeRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChangeRecorder(const QString &journalDir, QObject *parent = nullptr);
+    ~ChangeRecorder() override;
+
+    /*!
+     * \brief Returns the directories of the items in \a config that have the \c journal option
+     * enabled, restricted to the item \a types if not empty.
+     */
+    [[nodiscard]] static QStringList journaledDirectories(const QVariantMap &config, const QStringList &types = QStringList());
+
+    bool start(const QStringList &directories);
+
+    [[nodiscard]] QStringList directories() const;
+    [[nodiscard]] QString journalDir() const;
+
+private slots:
+    void onActivated();
+
+private:
+    struct Watch {
+        std::unique_ptr<ChangeJournal> journal;
+        QByteArray path;
+        QByteArray fsid;
+        QByteArray records;
+        QSet<QByteArray> seen;
+    };
+
+    struct Mount {
+        QByteArray fsid;
+        QByteArray root;
+        int fd = -1;
+    };
+
+    struct Resolved {
+        QByteArray path;
+        bool removed = false;
+        bool unreachable = false;
+    };
+
+    [[nodiscard]] Resolved resolve(const QByteArray &fsid, const QByteArray &handle) const;
+    void record(const QByteArray &path, ChangeJournal::RecordType type);
+    void recordFileSystem(const QByteArray &fsid, ChangeJournal::RecordType type);
+    void recordAll(ChangeJournal::RecordType type);
+    void flush();
+
+    std::vector<Watch> m_watches;
+    std::vector<Mount> m_mounts;
+    QByteArray m_journalDirPath;
+    QStringList m_directories;
+    QString m_journalDir;
+    QSocketNotifier *m_notifier = nullptr;
+    int m_fd = -1;
+
+    Q_DISABLE_COPY(ChangeRecorder)
+};
+
+#endif // CHANGERECORDER_H
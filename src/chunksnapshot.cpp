@@ -0,0 +1,617 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "chunksnapshot.h"
+#include "fastcdc.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::array<char,8> snapshotMagic = {'S', 'I', 'H', 'S', 'N', 'P', '\0', '\0'};
+constexpr quint32 snapshotVersion = 1;
+
+int threadCount(int threads)
+{
+    return threads > 0 ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+}
+
+std::string joinPath(const std::string &base, std::string_view rel)
+{
+    std::string path = base;
+    path += '/';
+    path += rel;
+    return path;
+}
+
+template<typename Func>
+void runParallel(std::size_t count, int threads, Func &&func)
+{
+    std::atomic<std::size_t> next{0};
+    const auto workers = std::min<std::size_t>(static_cast<std::size_t>(threadCount(threads)), std::max<std::size_t>(count, 1));
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (std::size_t worker = 0; worker < workers; ++worker) {
+        pool.emplace_back([&](){
+            for (std::size_t idx = next.fetch_add(1); idx < count; idx = next.fetch_add(1)) {
+                func(idx);
+            }
+        });
+    }
+    for (auto &thread : pool) {
+        thread.join();
+    }
+}
+}
+
+struct ChunkSnapshot::Header {
+    std::array<char,8> magic;
+    quint32 version;
+    quint32 recordSize;
+    quint64 count;
+    quint64 chunkCount;
+    quint64 pathsSize;
+};
+
+struct ChunkSnapshot::Record {
+    quint64 pathOffset;
+    quint64 inode;
+    quint64 size;
+    qint64 mtimeSec;
+    qint64 ctimeSec;
+    quint64 firstChunk;
+    quint32 mtimeNsec;
+    quint32 ctimeNsec;
+    quint32 pathLength;
+    quint32 targetLength;
+    quint32 mode;
+    quint32 uid;
+    quint32 gid;
+    quint32 chunkCount;
+};
+
+ChunkSnapshot::ChunkSnapshot() = default;
+
+ChunkSnapshot::~ChunkSnapshot()
+{
+    unmap();
+}
+
+QString ChunkSnapshot::latest(const QString &snapshotDir)
+{
+    // the names are sortable time stamps
+    const QStringList snapshots = QDir(snapshotDir).entryList({QStringLiteral("*.snap")}, QDir::Files, QDir::Name);
+    return snapshots.empty() ? QString() : snapshotDir + QLatin1Char('/') + snapshots.back();
+}
+
+bool ChunkSnapshot::map(const QString &filePath)
+{
+    unmap();
+
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        return false;
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        setError(QStringLiteral("Invalid snapshot file %1").arg(filePath));
+        return false;
+    }
+
+    void *data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        return false;
+    }
+
+    m_mapped = static_cast<const char *>(data);
+    m_mappedSize = static_cast<std::size_t>(st.st_size);
+
+    Header header{};
+    std::memcpy(&header, m_mapped, sizeof(Header));
+    const quint64 expectedSize = sizeof(Header) + header.count * sizeof(Record) + header.chunkCount * sizeof(ChunkStore::Hash) + header.pathsSize;
+    if (header.magic != snapshotMagic || header.version != snapshotVersion || header.recordSize != sizeof(Record) || expectedSize != m_mappedSize) {
+        unmap();
+        setError(QStringLiteral("Invalid snapshot file %1").arg(filePath));
+        return false;
+    }
+
+    m_mappedCount = header.count;
+    m_mappedChunks = header.chunkCount;
+    m_filePath = filePath;
+
+    return true;
+}
+
+void ChunkSnapshot::unmap()
+{
+    if (m_mapped) {
+        ::munmap(const_cast<char *>(m_mapped), m_mappedSize); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        m_mapped = nullptr;
+        m_mappedSize = 0;
+        m_mappedCount = 0;
+        m_mappedChunks = 0;
+    }
+}
+
+const ChunkSnapshot::Record *ChunkSnapshot::record(quint64 index) const
+{
+    return reinterpret_cast<const Record *>(m_mapped + sizeof(Header) + index * sizeof(Record)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+const ChunkStore::Hash *ChunkSnapshot::recordChunks(const Record *record) const
+{
+    const char *chunks = m_mapped + sizeof(Header) + m_mappedCount * sizeof(Record);
+    return reinterpret_cast<const ChunkStore::Hash *>(chunks) + record->firstChunk; // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+std::string_view ChunkSnapshot::recordPath(const Record *record) const
+{
+    const char *paths = m_mapped + sizeof(Header) + m_mappedCount * sizeof(Record) + m_mappedChunks * sizeof(ChunkStore::Hash);
+    return {paths + record->pathOffset, record->pathLength};
+}
+
+std::string_view ChunkSnapshot::recordTarget(const Record *record) const
+{
+    const char *paths = m_mapped + sizeof(Header) + m_mappedCount * sizeof(Record) + m_mappedChunks * sizeof(ChunkStore::Hash);
+    return {paths + record->pathOffset + record->pathLength, record->targetLength};
+}
+
+bool ChunkSnapshot::create(ChunkStore &store, const QString &root, const ChunkSnapshot &previous, bool strict, int threads)
+{
+    FileIndex index;
+    index.setFilter(m_filter);
+    if (!index.scan(root, threads)) {
+        setError(QStringLiteral("%1: %2").arg(root, index.errorString()));
+        return false;
+    }
+    std::string base = QFile::encodeName(root).toStdString();
+    while (base.size() > 1 && base.back() == '/') {
+        base.pop_back();
+    }
+    return build(store, base, index.entries(), previous, strict, threads);
+}
+
+void ChunkSnapshot::setFilter(const PathFilter &filter)
+{
+    m_filter = filter;
+}
+
+bool ChunkSnapshot::createFromFile(ChunkStore &store, const QString &filePath, const ChunkSnapshot &previous, int threads)
+{
+    const QFileInfo fi(filePath);
+    struct statx st{};
+    if (statx(AT_FDCWD, QFile::encodeName(fi.absoluteFilePath()).constData(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_BASIC_STATS, &st) != 0) {
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        return false;
+    }
+
+    FileIndex::Entry entry;
+    entry.path = QFile::encodeName(fi.fileName()).toStdString();
+    entry.inode = st.stx_ino;
+    entry.size = st.stx_size;
+    entry.mtimeSec = st.stx_mtime.tv_sec;
+    entry.mtimeNsec = st.stx_mtime.tv_nsec;
+    entry.ctimeSec = st.stx_ctime.tv_sec;
+    entry.ctimeNsec = st.stx_ctime.tv_nsec;
+    entry.mode = st.stx_mode;
+    entry.uid = st.stx_uid;
+    entry.gid = st.stx_gid;
+
+    return build(store, QFile::encodeName(fi.absolutePath()).toStdString(), {entry}, previous, true, threads);
+}
+
+bool ChunkSnapshot::build(ChunkStore &store, const std::string &root, const std::vector<FileIndex::Entry> &entries, const ChunkSnapshot &previous, bool strict, int threads)
+{
+    m_items.clear();
+    m_items.reserve(entries.size());
+    m_result = Result();
+
+    for (quint64 j = 0; j < previous.m_mappedCount; ++j) {
+        const Record *rec = previous.record(j);
+        if (!S_ISDIR(rec->mode)) {
+            m_result.filesBefore++;
+            m_result.sizeBefore += static_cast<qint64>(rec->size);
+        }
+    }
+
+    // both lists are sorted by path, unchanged files take over the chunks of the previous snapshot
+    std::vector<Item *> changed;
+    quint64 j = 0;
+    for (const FileIndex::Entry &entry : entries) {
+        Item &item = m_items.emplace_back();
+        item.entry = entry;
+
+        const Record *rec = nullptr;
+        while (j < previous.m_mappedCount && previous.recordPath(previous.record(j)) < std::string_view(entry.path)) {
+            if (!S_ISDIR(previous.record(j)->mode)) {
+                m_result.deletedFiles++;
+            }
+            ++j;
+        }
+        if (j < previous.m_mappedCount && previous.recordPath(previous.record(j)) == std::string_view(entry.path)) {
+            rec = previous.record(j++);
+        }
+
+        if (!S_ISDIR(entry.mode) && (!rec || (rec->mode & S_IFMT) != (entry.mode & S_IFMT))) {
+            item.created = true;
+            m_result.createdFiles++;
+        }
+
+        if (S_ISLNK(entry.mode)) {
+            std::string target(entry.size > 0 ? entry.size : 4096, '\0');
+            const ssize_t len = ::readlink(joinPath(root, entry.path).c_str(), target.data(), target.size());
+            if (len < 0) {
+                // removed or replaced by another type since the scan
+                if (errno == ENOENT || errno == EINVAL) {
+                    item.skipped = true;
+                    continue;
+                }
+                setError(QStringLiteral("%1: %2").arg(QFile::decodeName(QByteArray::fromStdString(joinPath(root, entry.path))), qt_error_string(errno)));
+                return false;
+            }
+            target.resize(static_cast<std::size_t>(len));
+            item.target = std::move(target);
+        } else if (S_ISREG(entry.mode)) {
+            const bool unchanged = rec && rec->mode == entry.mode && rec->uid == entry.uid && rec->gid == entry.gid && rec->size == entry.size
+                    && rec->mtimeSec == entry.mtimeSec && rec->mtimeNsec == entry.mtimeNsec
+                    && (!strict || (rec->inode == entry.inode && rec->ctimeSec == entry.ctimeSec && rec->ctimeNsec == entry.ctimeNsec));
+            if (unchanged) {
+                const ChunkStore::Hash *chunks = previous.recordChunks(rec);
+                item.chunks.assign(chunks, chunks + rec->chunkCount);
+            } else {
+                changed.push_back(&item);
+            }
+        }
+    }
+    for (; j < previous.m_mappedCount; ++j) {
+        if (!S_ISDIR(previous.record(j)->mode)) {
+            m_result.deletedFiles++;
+        }
+    }
+
+    std::atomic<bool> failed{false};
+    runParallel(changed.size(), threads, [&](std::size_t idx){
+        thread_local std::vector<char> buffer;
+        if (!failed && !chunkFile(store, joinPath(root, changed[idx]->entry.path), *changed[idx], buffer)) {
+            failed = true;
+        }
+    });
+    if (failed) {
+        return false;
+    }
+
+    for (const Item &item : m_items) {
+        if (item.skipped) {
+            // vanished while creating the snapshot
+            if (item.created) {
+                m_result.createdFiles--;
+            } else if (!S_ISDIR(item.entry.mode)) {
+                m_result.deletedFiles++;
+            }
+            continue;
+        }
+        if (!S_ISDIR(item.entry.mode)) {
+            m_result.files++;
+            m_result.size += static_cast<qint64>(item.entry.size);
+        }
+        if (item.chunked) {
+            m_result.changedFiles++;
+            m_result.changedBytes += static_cast<qint64>(item.entry.size);
+        }
+    }
+
+    return true;
+}
+
+bool ChunkSnapshot::chunkFile(ChunkStore &store, const std::string &path, Item &item, std::vector<char> &buffer)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ELOOP) {
+            item.skipped = true;
+            return true;
+        }
+        setError(QStringLiteral("%1: %2").arg(QFile::decodeName(QByteArray::fromStdString(path)), qt_error_string(errno)));
+        return false;
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    static const FastCdc cdc;
+    buffer.resize(cdc.maxSize() * 2);
+
+    qint64 newChunks = 0;
+    qint64 newBytes = 0;
+    quint64 total = 0;
+    std::size_t start = 0;
+    std::size_t filled = 0;
+    bool eof = false;
+    bool ok = true;
+    while (ok) {
+        // the chunker needs at least the maximum chunk size in front of every cut point
+        if (!eof && filled - start < cdc.maxSize()) {
+            std::memmove(buffer.data(), buffer.data() + start, filled - start);
+            filled -= start;
+            start = 0;
+            while (filled < buffer.size()) {
+                const ssize_t n = ::read(fd, buffer.data() + filled, buffer.size() - filled);
+                if (n == 0) {
+                    eof = true;
+                    break;
+                }
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    setError(QStringLiteral("%1: %2").arg(QFile::decodeName(QByteArray::fromStdString(path)), qt_error_string(errno)));
+                    ok = false;
+                    break;
+                }
+                filled += static_cast<std::size_t>(n);
+            }
+        }
+        if (!ok || start == filled) {
+            break;
+        }
+
+        const auto *data = reinterpret_cast<const quint8 *>(buffer.data() + start); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        const std::size_t length = cdc.cut(data, filled - start);
+        const QByteArray digest = QCryptographicHash::hash(QByteArrayView(buffer.data() + start, static_cast<qsizetype>(length)), QCryptographicHash::Sha256);
+        ChunkStore::Hash hash{};
+        std::copy_n(digest.constData(), hash.size(), hash.begin());
+
+        bool added = false;
+        if (!store.add(hash, buffer.data() + start, static_cast<quint32>(length), &added)) {
+            setError(store.errorString());
+            ok = false;
+            break;
+        }
+        if (added) {
+            newChunks++;
+            newBytes += static_cast<qint64>(length);
+        }
+        item.chunks.push_back(hash);
+        start += length;
+        total += length;
+    }
+    ::close(fd);
+
+    if (ok) {
+        // the content is what counts if the file has been changed while reading it
+        item.entry.size = total;
+        item.chunked = true;
+        const std::lock_guard<std::mutex> locker(m_mutex);
+        m_result.newChunks += newChunks;
+        m_result.newBytes += newBytes;
+    }
+
+    return ok;
+}
+
+bool ChunkSnapshot::save(const QString &snapshotDir)
+{
+    if (!QDir().mkpath(snapshotDir)) {
+        setError(QStringLiteral("Failed to create directory %1").arg(snapshotDir));
+        return false;
+    }
+
+    std::vector<Record> records;
+    records.reserve(m_items.size());
+    std::vector<ChunkStore::Hash> chunks;
+    std::string paths;
+
+    for (const Item &item : m_items) {
+        if (item.skipped) {
+            continue;
+        }
+        const FileIndex::Entry &entry = item.entry;
+        Record rec{};
+        rec.pathOffset = paths.size();
+        rec.pathLength = static_cast<quint32>(entry.path.size());
+        rec.targetLength = static_cast<quint32>(item.target.size());
+        rec.inode = entry.inode;
+        rec.size = entry.size;
+        rec.mtimeSec = entry.mtimeSec;
+        rec.mtimeNsec = entry.mtimeNsec;
+        rec.ctimeSec = entry.ctimeSec;
+        rec.ctimeNsec = entry.ctimeNsec;
+        rec.mode = entry.mode;
+        rec.uid = entry.uid;
+        rec.gid = entry.gid;
+        rec.firstChunk = chunks.size();
+        rec.chunkCount = static_cast<quint32>(item.chunks.size());
+        records.push_back(rec);
+        chunks.insert(chunks.end(), item.chunks.cbegin(), item.chunks.cend());
+        paths.append(entry.path);
+        paths.append(item.target);
+    }
+
+    Header header{};
+    header.magic = snapshotMagic;
+    header.version = snapshotVersion;
+    header.recordSize = sizeof(Record);
+    header.count = records.size();
+    header.chunkCount = chunks.size();
+    header.pathsSize = paths.size();
+
+    const QString filePath = snapshotDir + QLatin1Char('/') + QDateTime::currentDateTimeUtc().toString(QStringLiteral("yyyyMMdd'T'HHmmsszzz'Z'")) + QLatin1String(".snap");
+    QSaveFile f(filePath);
+    if (!f.open(QIODevice::WriteOnly)) {
+        setError(QStringLiteral("%1: %2").arg(filePath, f.errorString()));
+        return false;
+    }
+    f.write(reinterpret_cast<const char *>(&header), sizeof(Header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    f.write(reinterpret_cast<const char *>(records.data()), static_cast<qint64>(records.size() * sizeof(Record))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    f.write(reinterpret_cast<const char *>(chunks.data()), static_cast<qint64>(chunks.size() * sizeof(ChunkStore::Hash))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    f.write(paths.data(), static_cast<qint64>(paths.size()));
+    if (!f.commit()) {
+        setError(QStringLiteral("%1: %2").arg(filePath, f.errorString()));
+        return false;
+    }
+
+    m_filePath = filePath;
+    return true;
+}
+
+std::vector<std::string> ChunkSnapshot::missingChunks(const ChunkStore &store) const
+{
+    std::vector<std::string> missing;
+    for (quint64 i = 0; i < m_mappedCount; ++i) {
+        const Record *rec = record(i);
+        if (!S_ISREG(rec->mode)) {
+            continue;
+        }
+        // a chunk list outside of the file is as good as missing
+        bool complete = rec->firstChunk + rec->chunkCount <= m_mappedChunks;
+        const ChunkStore::Hash *chunks = complete ? recordChunks(rec) : nullptr;
+        for (quint32 c = 0; complete && c < rec->chunkCount; ++c) {
+            complete = store.contains(chunks[c]);
+        }
+        if (!complete) {
+            missing.emplace_back(recordPath(rec));
+        }
+    }
+    return missing;
+}
+
+bool ChunkSnapshot::restore(const ChunkStore &store, const QString &destination, int threads) const
+{
+    const std::string base = QFile::encodeName(destination).toStdString();
+    if (!QDir().mkpath(destination)) {
+        setError(QStringLiteral("Failed to create directory %1").arg(destination));
+        return false;
+    }
+
+    std::atomic<bool> failed{false};
+    auto fail = [this, &failed](const std::string &path, const QString &error){
+        setError(QStringLiteral("%1: %2").arg(QFile::decodeName(QByteArray::fromStdString(path)), error));
+        failed = true;
+    };
+
+    auto setAttributes = [&fail](const std::string &path, const Record *rec){
+        if (::fchownat(AT_FDCWD, path.c_str(), rec->uid, rec->gid, AT_SYMLINK_NOFOLLOW) != 0 && errno != EPERM) {
+            fail(path, qt_error_string(errno));
+        }
+        if (!S_ISLNK(rec->mode) && ::chmod(path.c_str(), rec->mode & 07777) != 0) {
+            fail(path, qt_error_string(errno));
+        }
+        const std::array<struct timespec,2> times = {{{rec->mtimeSec, rec->mtimeNsec}, {rec->mtimeSec, rec->mtimeNsec}}};
+        if (::utimensat(AT_FDCWD, path.c_str(), times.data(), AT_SYMLINK_NOFOLLOW) != 0) {
+            fail(path, qt_error_string(errno));
+        }
+    };
+
+    // parents are sorted before their children
+    std::vector<const Record *> files;
+    for (quint64 i = 0; i < m_mappedCount; ++i) {
+        const Record *rec = record(i);
+        const std::string path = joinPath(base, recordPath(rec));
+        if (S_ISDIR(rec->mode)) {
+            if (::mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+                fail(path, qt_error_string(errno));
+            }
+        } else if (S_ISREG(rec->mode)) {
+            files.push_back(rec);
+        } else if (S_ISLNK(rec->mode)) {
+            ::unlink(path.c_str());
+            if (::symlink(std::string(recordTarget(rec)).c_str(), path.c_str()) != 0) {
+                fail(path, qt_error_string(errno));
+            } else {
+                setAttributes(path, rec);
+            }
+        } else if (S_ISFIFO(rec->mode)) {
+            if (::mkfifo(path.c_str(), 0600) != 0 && errno != EEXIST) {
+                fail(path, qt_error_string(errno));
+            } else {
+                setAttributes(path, rec);
+            }
+        }
+    }
+
+    runParallel(files.size(), threads, [&](std::size_t idx){
+        const Record *rec = files[idx];
+        const std::string path = joinPath(base, recordPath(rec));
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            fail(path, qt_error_string(errno));
+            return;
+        }
+        thread_local std::vector<char> data;
+        const ChunkStore::Hash *chunks = recordChunks(rec);
+        bool ok = true;
+        for (quint32 c = 0; ok && c < rec->chunkCount; ++c) {
+            if (!store.read(chunks[c], data)) {
+                fail(path, store.errorString());
+                ok = false;
+                break;
+            }
+            std::size_t written = 0;
+            while (written < data.size()) {
+                const ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    fail(path, qt_error_string(errno));
+                    ok = false;
+                    break;
+                }
+                written += static_cast<std::size_t>(n);
+            }
+        }
+        ::close(fd);
+        if (ok) {
+            setAttributes(path, rec);
+        }
+    });
+
+    // the modification times of the directories are set after their content
+    for (quint64 i = m_mappedCount; i > 0; --i) {
+        const Record *rec = record(i - 1);
+        if (S_ISDIR(rec->mode)) {
+            setAttributes(joinPath(base, recordPath(rec)), rec);
+        }
+    }
+
+    return !failed;
+}
+
+ChunkSnapshot::Result ChunkSnapshot::result() const
+{
+    return m_result;
+}
+
+QString ChunkSnapshot::filePath() const
+{
+    return m_filePath;
+}
+
+QString ChunkSnapshot::errorString() const
+{
+    const std::lock_guard<std::mutex> locker(m_mutex);
+    return m_errorString;
+}
+
+void ChunkSnapshot::setError(const QString &error) const
+{
+    const std::lock_guard<std::mutex> locker(m_mutex);
+    m_errorString = error;
+}
@@ -0,0 +1,139 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CHUNKSNAPSHOT_H
+#define CHUNKSNAPSHOT_H
+
+#include "chunkstore.h"
+#include "fileindex.h"
+#include <QString>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+ * \brief Snapshot of a tree in the deduplicating depot format.
+ *
+ * A snapshot contains the metadata of every entry below the snapshotted directory and
+ * the list of chunks in the ChunkStore that make up the content of the regular files.
+ * It is stored as a binary file with fixed size records sorted by path, followed by the
+ * table of chunk hashes and the paths and symbolic link targets. Like the FileIndex it is
+ * memory mapped on load and uses the byte order of the host.
+ *
+ * create() scans the tree and takes over the chunk lists of the files that are unchanged
+ * since the \a previous snapshot, only the changed files are read, split by FastCdc and
+ * hashed, with one file per thread. Hard links are stored as separate files, their
+ * content is deduplicated anyway. Device nodes and sockets are recorded but not restored.
+ */
+class ChunkSnapshot
+{
+public:
+    /*!
+     * \brief Statistics of create(), file counts and sizes do not include directories.
+     */
+    struct Result {
+        qint64 filesBefore = 0;
+        qint64 sizeBefore = 0;
+        qint64 files = 0;
+        qint64 size = 0;
+        qint64 createdFiles = 0;
+        qint64 deletedFiles = 0;
+        qint64 changedFiles = 0;
+        qint64 changedBytes = 0;
+        qint64 newChunks = 0;
+        qint64 newBytes = 0;
+    };
+
+    ChunkSnapshot();
+    ~ChunkSnapshot();
+
+    /*!
+     * \brief Returns the path of the newest snapshot in \a snapshotDir or an empty string.
+     */
+    [[nodiscard]] static QString latest(const QString &snapshotDir);
+
+    /*!
+     * \brief Memory maps the snapshot file at \a filePath.
+     */
+    bool map(const QString &filePath);
+
+    /*!
+     * \brief Creates a snapshot of the tree below \a root and adds the content to \a store.
+     *
+     * Files are unchanged if type, mode, owner, size and modification time are the same
+     * as in the mapped \a previous snapshot, with \a strict also inode and change time,
+     * see FileIndex::compareTo(). \a threads <= 0 uses the number of CPU cores.
+     * Fails if any directory or entry below \a root can not be read, an incomplete
+     * snapshot would lose the entries on restore.
+     */
+    bool create(ChunkStore &store, const QString &root, const ChunkSnapshot &previous, bool strict, int threads = 0);
+
+    /*!
+     * \brief Leaves out the entries excluded by \a filter in the next create().
+     */
+    void setFilter(const PathFilter &filter);
+
+    /*!
+     * \brief Creates a snapshot that only contains the file at \a filePath.
+     */
+    bool createFromFile(ChunkStore &store, const QString &filePath, const ChunkSnapshot &previous, int threads = 0);
+
+    /*!
+     * \brief Writes the created snapshot to a new file in \a snapshotDir named after the current time.
+     */
+    bool save(const QString &snapshotDir);
+
+    /*!
+     * \brief Restores the mapped snapshot from \a store to \a destination.
+     */
+    bool restore(const ChunkStore &store, const QString &destination, int threads = 0) const;
+
+    /*!
+     * \brief Returns the paths of the files in the mapped snapshot that reference chunks missing in \a store.
+     */
+    [[nodiscard]] std::vector<std::string> missingChunks(const ChunkStore &store) const;
+
+    [[nodiscard]] Result result() const;
+    [[nodiscard]] QString filePath() const;
+    [[nodiscard]] QString errorString() const;
+
+private:
+    struct Header;
+    struct Record;
+    struct Item {
+        FileIndex::Entry entry;
+        std::string target;
+        std::vector<ChunkStore::Hash> chunks;
+        bool chunked = false;
+        bool skipped = false;
+        // counted in createdFiles, otherwise the file existed in the previous snapshot
+        bool created = false;
+    };
+
+    bool build(ChunkStore &store, const std::string &root, const std::vector<FileIndex::Entry> &entries, const ChunkSnapshot &previous, bool strict, int threads);
+    bool chunkFile(ChunkStore &store, const std::string &path, Item &item, std::vector<char> &buffer);
+    void setError(const QString &error) const;
+    [[nodiscard]] const Record *record(quint64 index) const;
+    [[nodiscard]] std::string_view recordPath(const Record *record) const;
+    [[nodiscard]] std::string_view recordTarget(const Record *record) const;
+    [[nodiscard]] const ChunkStore::Hash *recordChunks(const Record *record) const;
+    void unmap();
+
+    std::vector<Item> m_items;
+    PathFilter m_filter;
+    Result m_result;
+    QString m_filePath;
+    mutable QString m_errorString;
+    mutable std::mutex m_mutex;
+    const char *m_mapped = nullptr;
+    std::size_t m_mappedSize = 0;
+    quint64 m_mappedCount = 0;
+    quint64 m_mappedChunks = 0;
+
+    Q_DISABLE_COPY(ChunkSnapshot)
+};
+
+#endif // CHUNKSNAPSHOT_H
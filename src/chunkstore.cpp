@@ -0,0 +1,533 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "chunkstore.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QUrl>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::array<char,8> indexMagic = {'S', 'I', 'H', 'C', 'I', 'X', '\0', '\0'};
+constexpr std::array<char,8> packMagic = {'S', 'I', 'H', 'P', 'A', 'C', 'K', '1'};
+constexpr quint32 indexVersion = 1;
+constexpr quint64 maxPackSize = Q_UINT64_C(512) * 1024 * 1024;
+constexpr std::size_t maxSegments = 16;
+// every chunk in a pack is preceded by its hash and its length
+constexpr std::size_t chunkHeaderSize = 32 + sizeof(quint32);
+
+bool pwriteAll(int fd, const char *data, std::size_t length, quint64 offset)
+{
+    while (length > 0) {
+        const ssize_t written = ::pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<std::size_t>(written);
+        offset += static_cast<quint64>(written);
+    }
+    return true;
+}
+
+bool preadAll(int fd, char *data, std::size_t length, quint64 offset)
+{
+    while (length > 0) {
+        const ssize_t n = ::pread(fd, data, length, static_cast<off_t>(offset));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n == 0) {
+                errno = EIO;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+        offset += static_cast<quint64>(n);
+    }
+    return true;
+}
+
+QString hashHex(const ChunkStore::Hash &hash)
+{
+    return QString::fromLatin1(QByteArray(reinterpret_cast<const char *>(hash.data()), static_cast<qsizetype>(hash.size())).toHex()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+// the file names are the zero padded decimal numbers
+std::vector<quint32> fileNumbers(const QString &dirPath, const QString &suffix)
+{
+    std::vector<quint32> numbers;
+    const QStringList files = QDir(dirPath).entryList({QLatin1Char('*') + suffix}, QDir::Files);
+    for (const QString &file : files) {
+        bool ok = false;
+        const quint32 number = QStringView(file).chopped(suffix.size()).toUInt(&ok);
+        if (ok) {
+            numbers.push_back(number);
+        }
+    }
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+}
+
+struct ChunkStore::Header {
+    std::array<char,8> magic;
+    quint32 version;
+    quint32 recordSize;
+    quint64 count;
+};
+
+struct ChunkStore::Record {
+    Hash hash;
+    quint32 pack;
+    quint32 length;
+    quint64 offset;
+};
+
+ChunkStore::ChunkStore(const QString &path)
+    : m_path(path)
+{
+
+}
+
+ChunkStore::~ChunkStore()
+{
+    for (const int fd : std::as_const(m_writtenFds)) {
+        ::close(fd);
+    }
+    for (const int fd : std::as_const(m_readFds)) {
+        ::close(fd);
+    }
+    unmapSegments();
+    if (m_lockFd >= 0) {
+        ::close(m_lockFd);
+    }
+}
+
+bool ChunkStore::open()
+{
+    for (const QLatin1String sub : {QLatin1String("packs"), QLatin1String("index"), QLatin1String("snapshots")}) {
+        if (!QDir().mkpath(m_path + QLatin1Char('/') + sub)) {
+            setError(QStringLiteral("Failed to create directory %1").arg(m_path + QLatin1Char('/') + sub));
+            return false;
+        }
+    }
+
+    const QString lockPath = m_path + QLatin1String("/lock");
+    m_lockFd = ::open(QFile::encodeName(lockPath).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_lockFd < 0) {
+        setError(QStringLiteral("%1: %2").arg(lockPath, qt_error_string(errno)));
+        return false;
+    }
+    // items sharing the store run one after another, their chunks are deduplicated against each other
+    while (::flock(m_lockFd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            setError(QStringLiteral("%1: %2").arg(lockPath, qt_error_string(errno)));
+            return false;
+        }
+    }
+
+    const std::vector<quint32> segments = fileNumbers(m_path + QLatin1String("/index"), QStringLiteral(".idx"));
+    for (const quint32 number : segments) {
+        if (!mapSegment(number)) {
+            return false;
+        }
+    }
+
+    const std::vector<quint32> packs = fileNumbers(m_path + QLatin1String("/packs"), QStringLiteral(".pack"));
+    m_packNumber = packs.empty() ? 0 : packs.back();
+
+    return true;
+}
+
+bool ChunkStore::openReadOnly()
+{
+    // a backup merging the segments at the same time removes the old ones after writing the new one
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        unmapSegments();
+        bool mapped = true;
+        const std::vector<quint32> segments = fileNumbers(m_path + QLatin1String("/index"), QStringLiteral(".idx"));
+        for (const quint32 number : segments) {
+            if (!mapSegment(number)) {
+                mapped = false;
+                break;
+            }
+        }
+        if (mapped) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ChunkStore::contains(const Hash &hash) const
+{
+    const std::lock_guard<std::mutex> locker(m_mutex);
+    Location location;
+    return find(hash, &location);
+}
+
+std::vector<ChunkStore::Chunk> ChunkStore::chunks() const
+{
+    const std::lock_guard<std::mutex> locker(m_mutex);
+    std::vector<Chunk> chunks;
+    for (const Segment &segment : m_segments) {
+        const auto *begin = reinterpret_cast<const Record *>(segment.data + sizeof(Header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        for (const Record *record = begin; record != begin + segment.count; ++record) {
+            chunks.push_back(Chunk{record->hash, record->pack, record->length, record->offset});
+        }
+    }
+    // read the packs from the start to the end
+    std::sort(chunks.begin(), chunks.end(), [](const Chunk &a, const Chunk &b){
+        return a.pack < b.pack || (a.pack == b.pack && a.offset < b.offset);
+    });
+    // segments that have not been merged yet can list the same chunk
+    chunks.erase(std::unique(chunks.begin(), chunks.end(), [](const Chunk &a, const Chunk &b){
+        return a.pack == b.pack && a.offset == b.offset;
+    }), chunks.end());
+    return chunks;
+}
+
+bool ChunkStore::add(const Hash &hash, const char *data, quint32 length, bool *added)
+{
+    *added = false;
+    Location location;
+    int fd = -1;
+    {
+        const std::lock_guard<std::mutex> locker(m_mutex);
+        if (find(hash, &location)) {
+            return true;
+        }
+
+        // continue the last pack of the previous runs until it is full
+        const quint64 needed = chunkHeaderSize + length;
+        while (m_packFd < 0 || (m_packOffset > packMagic.size() && m_packOffset + needed > maxPackSize)) {
+            const quint32 number = m_packFd < 0 && m_packNumber > 0 ? m_packNumber : m_packNumber + 1;
+            if (!openPack(number)) {
+                return false;
+            }
+        }
+
+        location.pack = m_packNumber;
+        location.length = length;
+        location.offset = m_packOffset + chunkHeaderSize;
+        fd = m_packFd;
+        m_packOffset += needed;
+        m_pending.emplace(hash, location);
+    }
+
+    // the space is reserved, the data is written without holding the lock
+    std::array<char,chunkHeaderSize> header{};
+    std::memcpy(header.data(), hash.data(), hash.size());
+    std::memcpy(header.data() + hash.size(), &length, sizeof(length));
+    if (!pwriteAll(fd, header.data(), header.size(), location.offset - chunkHeaderSize) || !pwriteAll(fd, data, length, location.offset)) {
+        setError(QStringLiteral("%1: %2").arg(packPath(location.pack), qt_error_string(errno)));
+        const std::lock_guard<std::mutex> locker(m_mutex);
+        m_pending.erase(hash);
+        return false;
+    }
+
+    *added = true;
+    return true;
+}
+
+bool ChunkStore::read(const Hash &hash, std::vector<char> &data) const
+{
+    Location location;
+    int fd = -1;
+    {
+        const std::lock_guard<std::mutex> locker(m_mutex);
+        if (!find(hash, &location)) {
+            setError(QStringLiteral("Chunk %1 not found").arg(hashHex(hash)));
+            return false;
+        }
+        fd = packFd(location.pack);
+        if (fd < 0) {
+            return false;
+        }
+    }
+
+    data.resize(location.length);
+    if (!preadAll(fd, data.data(), location.length, location.offset)) {
+        setError(QStringLiteral("%1: %2").arg(packPath(location.pack), qt_error_string(errno)));
+        return false;
+    }
+
+    const QByteArray actual = QCryptographicHash::hash(QByteArrayView(data.data(), static_cast<qsizetype>(data.size())), QCryptographicHash::Sha256);
+    if (std::memcmp(actual.constData(), hash.data(), hash.size()) != 0) {
+        setError(QStringLiteral("Chunk %1 in %2 is corrupted").arg(hashHex(hash), packPath(location.pack)));
+        return false;
+    }
+
+    return true;
+}
+
+bool ChunkStore::commit()
+{
+    const std::lock_guard<std::mutex> locker(m_mutex);
+
+    // the index must never reference chunks that are not on the disk
+    bool synced = true;
+    for (const int fd : std::as_const(m_writtenFds)) {
+        if (synced && ::fdatasync(fd) != 0) {
+            setError(QStringLiteral("%1: %2").arg(m_path + QLatin1String("/packs"), qt_error_string(errno)));
+            synced = false;
+        }
+        ::close(fd);
+    }
+    if (synced && !m_writtenFds.empty()) {
+        const int dirFd = ::open(QFile::encodeName(m_path + QLatin1String("/packs")).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            ::fsync(dirFd);
+            ::close(dirFd);
+        }
+    }
+    m_writtenFds.clear();
+    m_packFd = -1;
+    if (!synced) {
+        return false;
+    }
+
+    if (m_pending.empty()) {
+        return true;
+    }
+
+    std::vector<Record> records;
+    records.reserve(m_pending.size());
+    for (const auto &pending : m_pending) {
+        records.push_back(Record{pending.first, pending.second.pack, pending.second.length, pending.second.offset});
+    }
+    std::sort(records.begin(), records.end(), [](const Record &a, const Record &b){
+        return a.hash < b.hash;
+    });
+
+    const quint32 number = m_segments.empty() ? 1 : m_segments.back().number + 1;
+    if (!writeSegment(number, records) || !mapSegment(number)) {
+        return false;
+    }
+    m_pending.clear();
+
+    return m_segments.size() <= maxSegments || mergeSegments();
+}
+
+QString ChunkStore::snapshotDir(const QString &id) const
+{
+    return m_path + QLatin1String("/snapshots/") + QString::fromLatin1(QUrl::toPercentEncoding(id));
+}
+
+QString ChunkStore::path() const
+{
+    return m_path;
+}
+
+QString ChunkStore::errorString() const
+{
+    const std::lock_guard<std::mutex> locker(m_errorMutex);
+    return m_errorString;
+}
+
+void ChunkStore::setError(const QString &error) const
+{
+    // errors of the worker threads are rare, only the last one is kept
+    const std::lock_guard<std::mutex> locker(m_errorMutex);
+    m_errorString = error;
+}
+
+bool ChunkStore::find(const Hash &hash, Location *location) const
+{
+    const auto it = m_pending.find(hash);
+    if (it != m_pending.end()) {
+        *location = it->second;
+        return true;
+    }
+    for (auto segment = m_segments.crbegin(); segment != m_segments.crend(); ++segment) {
+        const Record *record = findInSegment(*segment, hash);
+        if (record) {
+            location->pack = record->pack;
+            location->length = record->length;
+            location->offset = record->offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+const ChunkStore::Record *ChunkStore::findInSegment(const Segment &segment, const Hash &hash) const
+{
+    const auto *begin = reinterpret_cast<const Record *>(segment.data + sizeof(Header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto *end = begin + segment.count;
+    const auto *record = std::lower_bound(begin, end, hash, [](const Record &r, const Hash &h){
+        return r.hash < h;
+    });
+    return record != end && record->hash == hash ? record : nullptr;
+}
+
+bool ChunkStore::mapSegment(quint32 number)
+{
+    const QString filePath = segmentPath(number);
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        return false;
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        setError(QStringLiteral("Invalid chunk index %1").arg(filePath));
+        return false;
+    }
+
+    void *data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        return false;
+    }
+
+    Segment segment;
+    segment.data = static_cast<const char *>(data);
+    segment.size = static_cast<std::size_t>(st.st_size);
+    segment.number = number;
+
+    Header header{};
+    std::memcpy(&header, segment.data, sizeof(Header));
+    if (header.magic != indexMagic || header.version != indexVersion || header.recordSize != sizeof(Record) || sizeof(Header) + header.count * sizeof(Record) != segment.size) {
+        ::munmap(data, segment.size);
+        setError(QStringLiteral("Invalid chunk index %1").arg(filePath));
+        return false;
+    }
+    segment.count = header.count;
+    // lookups of random hashes jump around the whole file
+    ::madvise(data, segment.size, MADV_RANDOM);
+
+    m_segments.push_back(segment);
+    return true;
+}
+
+bool ChunkStore::writeSegment(quint32 number, const std::vector<Record> &records)
+{
+    Header header{};
+    header.magic = indexMagic;
+    header.version = indexVersion;
+    header.recordSize = sizeof(Record);
+    header.count = records.size();
+
+    QSaveFile f(segmentPath(number));
+    if (!f.open(QIODevice::WriteOnly)) {
+        setError(QStringLiteral("%1: %2").arg(f.fileName(), f.errorString()));
+        return false;
+    }
+    f.write(reinterpret_cast<const char *>(&header), sizeof(Header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    f.write(reinterpret_cast<const char *>(records.data()), static_cast<qint64>(records.size() * sizeof(Record))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (!f.commit()) {
+        setError(QStringLiteral("%1: %2").arg(f.fileName(), f.errorString()));
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStore::mergeSegments()
+{
+    std::vector<Record> records;
+    std::size_t total = 0;
+    for (const Segment &segment : m_segments) {
+        total += segment.count;
+    }
+    records.reserve(total);
+    for (const Segment &segment : m_segments) {
+        const auto *begin = reinterpret_cast<const Record *>(segment.data + sizeof(Header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        records.insert(records.end(), begin, begin + segment.count);
+    }
+    std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b){
+        return a.hash < b.hash;
+    });
+    records.erase(std::unique(records.begin(), records.end(), [](const Record &a, const Record &b){
+        return a.hash == b.hash;
+    }), records.end());
+
+    // the old segments are only removed after the merged one has been written, duplicates do no harm
+    const quint32 number = m_segments.back().number + 1;
+    if (!writeSegment(number, records)) {
+        return false;
+    }
+    const std::vector<Segment> old = m_segments;
+    unmapSegments();
+    for (const Segment &segment : old) {
+        QFile::remove(segmentPath(segment.number));
+    }
+    return mapSegment(number);
+}
+
+bool ChunkStore::openPack(quint32 number)
+{
+    const QString filePath = packPath(number);
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    struct stat st{};
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (st.st_size == 0 && !pwriteAll(fd, packMagic.data(), packMagic.size(), 0)) {
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        ::close(fd);
+        return false;
+    }
+    m_writtenFds.push_back(fd);
+    m_packFd = fd;
+    m_packNumber = number;
+    m_packOffset = std::max<quint64>(static_cast<quint64>(st.st_size), packMagic.size());
+    return true;
+}
+
+int ChunkStore::packFd(quint32 pack) const
+{
+    const auto it = m_readFds.constFind(pack);
+    if (it != m_readFds.cend()) {
+        return *it;
+    }
+    const QString filePath = packPath(pack);
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        setError(QStringLiteral("%1: %2").arg(filePath, qt_error_string(errno)));
+        return -1;
+    }
+    m_readFds.insert(pack, fd);
+    return fd;
+}
+
+QString ChunkStore::packPath(quint32 number) const
+{
+    return m_path + QLatin1String("/packs/") + QStringLiteral("%1.pack").arg(number, 8, 10, QLatin1Char('0'));
+}
+
+QString ChunkStore::segmentPath(quint32 number) const
+{
+    return m_path + QLatin1String("/index/") + QStringLiteral("%1.idx").arg(number, 8, 10, QLatin1Char('0'));
+}
+
+void ChunkStore::unmapSegments()
+{
+    for (const Segment &segment : m_segments) {
+        ::munmap(const_cast<char *>(segment.data), segment.size); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    }
+    m_segments.clear();
+}
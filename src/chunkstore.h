@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*!
+ * \brief Content addressed store for the chunks of the deduplicating depot format.
+ *
+ * Chunks are identified by their SHA-256 hash and appended to pack files below
+ * \c packs, every chunk is preceded by its hash and length so that the index can be
+ * rebuilt from the packs. The index consists of segment files below \c index with fixed
+ * size records sorted by hash, they are memory mapped and searched binary, so only the
+ * touched pages of the index are loaded. Chunks added since open() are kept in memory
+ * and written as a new segment by commit(), after the packs have been synced to disk.
+ * Chunks of an interrupted run stay unreferenced in the packs. If there are more than
+ * 16 segments, they are merged into one. The files use the byte order of the host.
+ *
+ * The snapshots referencing the chunks are stored below \c snapshots, see ChunkSnapshot.
+ * The store is locked exclusively from open() until it is destroyed, add() and read()
+ * are thread safe.
+ */
+class ChunkStore
+{
+public:
+    using Hash = std::array<quint8,32>;
+
+    /*!
+     * \brief Location of a chunk in the packs, see chunks().
+     */
+    struct Chunk {
+        Hash hash{};
+        quint32 pack = 0;
+        quint32 length = 0;
+        quint64 offset = 0;
+    };
+
+    explicit ChunkStore(const QString &path);
+    ~ChunkStore();
+
+    /*!
+     * \brief Locks the store and maps the index, waits until other users have closed the store.
+     */
+    bool open();
+
+    /*!
+     * \brief Maps the index without locking the store, for readers like the DepotVerifier.
+     *
+     * Chunks added by a backup running at the same time are not visible before its commit().
+     * Nothing can be added to a store opened this way.
+     */
+    bool openReadOnly();
+
+    /*!
+     * \brief Returns \c true if the chunk with \a hash is in the index.
+     */
+    [[nodiscard]] bool contains(const Hash &hash) const;
+
+    /*!
+     * \brief Returns all chunks in the mapped index, sorted by pack and offset.
+     */
+    [[nodiscard]] std::vector<Chunk> chunks() const;
+
+    /*!
+     * \brief Adds the chunk with \a hash and \a data if it is not already stored.
+     *
+     * \a added is set to \c true if the chunk was new.
+     */
+    bool add(const Hash &hash, const char *data, quint32 length, bool *added);
+
+    /*!
+     * \brief Reads the chunk with \a hash into \a data.
+     */
+    bool read(const Hash &hash, std::vector<char> &data) const;
+
+    /*!
+     * \brief Syncs the packs written since open() and saves the index of the added chunks.
+     */
+    bool commit();
+
+    /*!
+     * \brief Returns the directory containing the snapshots for \a id.
+     */
+    [[nodiscard]] QString snapshotDir(const QString &id) const;
+
+    [[nodiscard]] QString packPath(quint32 number) const;
+    [[nodiscard]] QString path() const;
+    [[nodiscard]] QString errorString() const;
+
+private:
+    struct Header;
+    struct Record;
+    struct Location {
+        quint32 pack = 0;
+        quint32 length = 0;
+        quint64 offset = 0;
+    };
+    struct Segment {
+        const char *data = nullptr;
+        std::size_t size = 0;
+        quint64 count = 0;
+        quint32 number = 0;
+    };
+    struct HashHasher {
+        std::size_t operator()(const Hash &hash) const noexcept
+        {
+            std::size_t h = 0;
+            std::memcpy(&h, hash.data(), sizeof(h));
+            return h;
+        }
+    };
+
+    [[nodiscard]] bool find(const Hash &hash, Location *location) const;
+    [[nodiscard]] const Record *findInSegment(const Segment &segment, const Hash &hash) const;
+    bool mapSegment(quint32 number);
+    bool writeSegment(quint32 number, const std::vector<Record> &records);
+    bool mergeSegments();
+    bool openPack(quint32 number);
+    [[nodiscard]] int packFd(quint32 pack) const;
+    [[nodiscard]] QString segmentPath(quint32 number) const;
+    void setError(const QString &error) const;
+    void unmapSegments();
+
+    std::unordered_map<Hash,Location,HashHasher> m_pending;
+    std::vector<Segment> m_segments;
+    std::vector<int> m_writtenFds;
+    mutable QHash<quint32,int> m_readFds;
+    QString m_path;
+    mutable QString m_errorString;
+    mutable std::mutex m_mutex;
+    mutable std::mutex m_errorMutex;
+    quint64 m_packOffset = 0;
+    int m_lockFd = -1;
+    int m_packFd = -1;
+    quint32 m_packNumber = 0;
+
+    Q_DISABLE_COPY(ChunkStore)
+};
+
+#endif // CHUNKSTORE_H
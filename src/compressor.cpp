@@ -0,0 +1,353 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "compressor.h"
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <lzma.h>
+#include <unistd.h>
+#include <zstd.h>
+
+namespace {
+constexpr std::size_t xzOutputSize = 1024 * 1024;
+
+int threadCount(int threads)
+{
+    if (threads > 0) {
+        return threads;
+    }
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+QString lzmaErrorString(lzma_ret ret)
+{
+    switch (ret) {
+    case LZMA_MEM_ERROR:
+        return QStringLiteral("xz: cannot allocate memory");
+    case LZMA_OPTIONS_ERROR:
+        return QStringLiteral("xz: unsupported options");
+    case LZMA_UNSUPPORTED_CHECK:
+        return QStringLiteral("xz: unsupported integrity check");
+    case LZMA_DATA_ERROR:
+        return QStringLiteral("xz: file size limits exceeded");
+    default:
+        return QStringLiteral("xz: internal error %1").arg(static_cast<int>(ret));
+    }
+}
+
+class PlainCompressor final : public Compressor
+{
+public:
+    explicit PlainCompressor(int fd)
+        : Compressor(fd)
+    {
+    }
+
+    bool write(const char *data, std::size_t size) override
+    {
+        return writeOutput(data, size);
+    }
+
+    bool finish() override
+    {
+        return true;
+    }
+};
+
+class XzCompressor final : public Compressor
+{
+public:
+    explicit XzCompressor(int fd)
+        : Compressor(fd),
+          m_output(xzOutputSize)
+    {
+    }
+
+    ~XzCompressor() override
+    {
+        lzma_end(&m_stream);
+    }
+
+    bool init(int level, int threads)
+    {
+        lzma_mt mt{};
+        mt.preset = static_cast<uint32_t>(level);
+        mt.check = LZMA_CHECK_CRC64;
+        mt.threads = static_cast<uint32_t>(threadCount(threads));
+
+        // like xz -T0 the threads are reduced until the encoder fits into a quarter of the memory,
+        // every thread needs about three times the dictionary for its block on the higher levels
+        const uint64_t memLimit = lzma_physmem() / 4;
+        while (mt.threads > 1 && memLimit > 0 && lzma_stream_encoder_mt_memusage(&mt) > memLimit) {
+            mt.threads--;
+        }
+
+        const lzma_ret ret = lzma_stream_encoder_mt(&m_stream, &mt);
+        if (ret != LZMA_OK) {
+            m_errorString = lzmaErrorString(ret);
+            return false;
+        }
+        return true;
+    }
+
+    bool write(const char *data, std::size_t size) override
+    {
+        m_stream.next_in = reinterpret_cast<const uint8_t *>(data); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        m_stream.avail_in = size;
+        while (m_stream.avail_in > 0) {
+            if (!code(LZMA_RUN)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool finish() override
+    {
+        m_stream.next_in = nullptr;
+        m_stream.avail_in = 0;
+        for (;;) {
+            m_stream.next_out = m_output.data();
+            m_stream.avail_out = m_output.size();
+            const lzma_ret ret = lzma_code(&m_stream, LZMA_FINISH);
+            if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+                m_errorString = lzmaErrorString(ret);
+                return false;
+            }
+            if (!writeOutput(reinterpret_cast<const char *>(m_output.data()), m_output.size() - m_stream.avail_out)) { // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                return false;
+            }
+            if (ret == LZMA_STREAM_END) {
+                return true;
+            }
+        }
+    }
+
+private:
+    bool code(lzma_action action)
+    {
+        m_stream.next_out = m_output.data();
+        m_stream.avail_out = m_output.size();
+        const lzma_ret ret = lzma_code(&m_stream, action);
+        if (ret != LZMA_OK) {
+            m_errorString = lzmaErrorString(ret);
+            return false;
+        }
+        return writeOutput(reinterpret_cast<const char *>(m_output.data()), m_output.size() - m_stream.avail_out); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+
+    lzma_stream m_stream = LZMA_STREAM_INIT;
+    std::vector<uint8_t> m_output;
+};
+
+class ZstdCompressor final : public Compressor
+{
+public:
+    explicit ZstdCompressor(int fd)
+        : Compressor(fd),
+          m_context(ZSTD_createCCtx()),
+          m_output(ZSTD_CStreamOutSize())
+    {
+    }
+
+    ~ZstdCompressor() override
+    {
+        ZSTD_freeCCtx(m_context);
+    }
+
+    bool init(int level, int threads)
+    {
+        if (!m_context) {
+            m_errorString = QStringLiteral("zstd: cannot allocate memory");
+            return false;
+        }
+
+        std::size_t rc = ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, level);
+        if (!ZSTD_isError(rc)) {
+            rc = ZSTD_CCtx_setParameter(m_context, ZSTD_c_checksumFlag, 1);
+        }
+        // long distance matching finds the repeated rows of big dumps far behind the normal window,
+        // the window stays at 128 MiB that the zstd tool decompresses without --long
+        if (!ZSTD_isError(rc)) {
+            rc = ZSTD_CCtx_setParameter(m_context, ZSTD_c_enableLongDistanceMatching, 1);
+        }
+        if (ZSTD_isError(rc)) {
+            m_errorString = QStringLiteral("zstd: %1").arg(QString::fromLatin1(ZSTD_getErrorName(rc)));
+            return false;
+        }
+
+        // a library built without multi-threading support compresses in the calling thread
+        ZSTD_CCtx_setParameter(m_context, ZSTD_c_nbWorkers, threadCount(threads));
+
+        return true;
+    }
+
+    bool write(const char *data, std::size_t size) override
+    {
+        ZSTD_inBuffer input{data, size, 0};
+        while (input.pos < input.size) {
+            if (compress(&input, ZSTD_e_continue) == static_cast<std::size_t>(-1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool finish() override
+    {
+        ZSTD_inBuffer input{nullptr, 0, 0};
+        for (;;) {
+            const std::size_t remaining = compress(&input, ZSTD_e_end);
+            if (remaining == static_cast<std::size_t>(-1)) {
+                return false;
+            }
+            if (remaining == 0) {
+                return true;
+            }
+        }
+    }
+
+private:
+    // returns the number of bytes still to flush, or -1 on error
+    std::size_t compress(ZSTD_inBuffer *input, ZSTD_EndDirective directive)
+    {
+        ZSTD_outBuffer output{m_output.data(), m_output.size(), 0};
+        const std::size_t rc = ZSTD_compressStream2(m_context, &output, input, directive);
+        if (ZSTD_isError(rc)) {
+            m_errorString = QStringLiteral("zstd: %1").arg(QString::fromLatin1(ZSTD_getErrorName(rc)));
+            return static_cast<std::size_t>(-1);
+        }
+        if (!writeOutput(m_output.data(), output.pos)) {
+            return static_cast<std::size_t>(-1);
+        }
+        return rc;
+    }
+
+    ZSTD_CCtx *m_context = nullptr;
+    std::vector<char> m_output;
+};
+}
+
+Compressor::Compressor(int fd)
+    : m_fd(fd)
+{
+}
+
+Compressor::~Compressor() = default;
+
+std::unique_ptr<Compressor> Compressor::create(Codec codec, int level, int threads, int fd, QString *error)
+{
+    switch (codec) {
+    case Xz:
+    {
+        auto xz = std::make_unique<XzCompressor>(fd);
+        if (!xz->init(level, threads)) {
+            *error = xz->errorString();
+            return {};
+        }
+        return xz;
+    }
+    case Zstd:
+    {
+        auto zstd = std::make_unique<ZstdCompressor>(fd);
+        if (!zstd->init(level, threads)) {
+            *error = zstd->errorString();
+            return {};
+        }
+        return zstd;
+    }
+    default:
+        return std::make_unique<PlainCompressor>(fd);
+    }
+}
+
+Compressor::Codec Compressor::codecFromName(const QString &name, bool *ok)
+{
+    *ok = true;
+    if (name.compare(QLatin1String("xz"), Qt::CaseInsensitive) == 0) {
+        return Xz;
+    }
+    if (name.compare(QLatin1String("zstd"), Qt::CaseInsensitive) == 0) {
+        return Zstd;
+    }
+    if (name.compare(QLatin1String("none"), Qt::CaseInsensitive) == 0) {
+        return None;
+    }
+    *ok = false;
+    return None;
+}
+
+QString Compressor::codecName(Codec codec)
+{
+    switch (codec) {
+    case Xz:
+        return QStringLiteral("xz");
+    case Zstd:
+        return QStringLiteral("zstd");
+    default:
+        return QStringLiteral("none");
+    }
+}
+
+QString Compressor::fileExtension(Codec codec)
+{
+    switch (codec) {
+    case Xz:
+        return QStringLiteral(".xz");
+    case Zstd:
+        return QStringLiteral(".zst");
+    default:
+        return {};
+    }
+}
+
+int Compressor::defaultLevel(Codec codec)
+{
+    switch (codec) {
+    case Xz:
+        return 6;
+    case Zstd:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+std::pair<int,int> Compressor::levelRange(Codec codec)
+{
+    switch (codec) {
+    case Xz:
+        return {0, 9};
+    case Zstd:
+        return {1, ZSTD_maxCLevel()};
+    default:
+        return {0, 0};
+    }
+}
+
+QString Compressor::errorString() const
+{
+    return m_errorString;
+}
+
+bool Compressor::writeOutput(const char *data, std::size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::write(m_fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_errorString = QString::fromStdString(std::generic_category().message(errno));
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
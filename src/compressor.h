@@ -0,0 +1,87 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <QString>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*!
+ * \brief Compresses a stream in-process and writes the result into a file descriptor.
+ *
+ * Implementations exist for the multi-threaded encoder of liblzma, for libzstd with
+ * worker threads and long distance matching and for plain output without compression.
+ * Create an instance with create(), feed the data with write() and call finish() at the
+ * end of the stream. The compressors do not take ownership of the file descriptor.
+ */
+class Compressor
+{
+public:
+    enum Codec : quint8 {
+        None,
+        Xz,
+        Zstd
+    };
+
+    virtual ~Compressor();
+
+    /*!
+     * \brief Creates a compressor for \a codec that writes into \a fd.
+     *
+     * \a level has to be inside the range of levelRange(), \a threads <= 0 uses the number
+     * of CPU cores. Returns \c nullptr and sets \a error if the encoder can not be initialized.
+     */
+    [[nodiscard]] static std::unique_ptr<Compressor> create(Codec codec, int level, int threads, int fd, QString *error);
+
+    /*!
+     * \brief Returns the codec for the case insensitive \a name, sets \a ok to \c false for unknown names.
+     */
+    [[nodiscard]] static Codec codecFromName(const QString &name, bool *ok);
+
+    [[nodiscard]] static QString codecName(Codec codec);
+
+    /*!
+     * \brief Returns the file name extension of \a codec, including the dot.
+     */
+    [[nodiscard]] static QString fileExtension(Codec codec);
+
+    [[nodiscard]] static int defaultLevel(Codec codec);
+
+    /*!
+     * \brief Returns the lowest and the highest level supported by \a codec.
+     */
+    [[nodiscard]] static std::pair<int,int> levelRange(Codec codec);
+
+    /*!
+     * \brief Compresses \a size bytes of \a data, returns \c false on error, see errorString().
+     */
+    virtual bool write(const char *data, std::size_t size) = 0;
+
+    /*!
+     * \brief Writes the remaining compressed data and the end of the stream.
+     */
+    virtual bool finish() = 0;
+
+    [[nodiscard]] QString errorString() const;
+
+protected:
+    explicit Compressor(int fd);
+
+    /*!
+     * \brief Writes \a size bytes of compressed \a data into the file descriptor.
+     */
+    bool writeOutput(const char *data, std::size_t size);
+
+    int m_fd = -1;
+    QString m_errorString;
+
+private:
+    Q_DISABLE_COPY(Compressor)
+};
+
+#endif // COMPRESSOR_H
@@ -0,0 +1,65 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2021 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QFile>
+#include <QJsonParseError>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+QVariantMap loadConfig(const QString &filepath)
+{
+    QVariantMap map;
+
+    QFileInfo cfi(filepath);
+
+    if (Q_UNLIKELY(!cfi.exists())) {
+        //: Error message, %1 will be replaced by the file path
+        //% "Can not find configuration file at %1"
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_CONFIG_NOT_FOUND").arg(cfi.absoluteFilePath())));
+        return map;
+    }
+
+    if (Q_UNLIKELY(!cfi.isReadable())) {
+        //: Error message, %1 will be replaced by the file path
+        //% "Can not read configuration file at %1. Permission denied."
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_CONFIG_UNREADABLE").arg(cfi.absoluteFilePath())));
+        return map;
+    }
+
+    qDebug("Reading settings from %s", qUtf8Printable(cfi.absoluteFilePath()));
+
+    QFile fi(filepath);
+
+    if (Q_UNLIKELY(!fi.open(QIODevice::ReadOnly|QIODevice::Text))) {
+        //: Error message, %1 will be replaced by the file path, %2 by the error string
+        //% "Can not open configuration file at %1: %2"
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_CONFIG_FAILED_OPEN").arg(cfi.absoluteFilePath(), fi.errorString())));
+        return map;
+    }
+
+    QJsonParseError jsonError;
+    const QJsonDocument json = QJsonDocument::fromJson(fi.readAll(), &jsonError);
+    fi.close();
+    if (jsonError.error != QJsonParseError::NoError) {
+        //: Error message, %1 will be replaced by the file path, %2 by the JSON error string
+        //% "Failed to parse JSON configuration file at %1: %2"
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_JSON_PARSE").arg(cfi.absoluteFilePath(), jsonError.errorString())));
+        return map;
+    }
+
+    if (!json.isObject()) {
+        //: Error message, %1 will be replaced by the file path
+        //% "JSON configuration file at %1 does not contain an object as root"
+        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_JSON_NO_OBJECT").arg(cfi.absoluteFilePath())));
+        return map;
+    }
+
+    map = json.object().toVariantMap();
+
+    return map;
+}
@@ -0,0 +1,18 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <QVariantMap>
+
+/*!
+ * \brief Loads the JSON configuration file at \a filepath.
+ *
+ * Returns an empty map if the file can not be read or parsed. Errors are logged.
+ */
+QVariantMap loadConfig(const QString &filepath);
+
+#endif // CONFIG_H
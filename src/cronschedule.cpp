@@ -0,0 +1,179 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "cronschedule.h"
+#include <QStringList>
+
+namespace {
+
+template<std::size_t N>
+bool parseField(const QString &field, int min, int max, std::bitset<N> &values, bool *restricted = nullptr)
+{
+    values.reset();
+
+    if (restricted) {
+        *restricted = field != QLatin1String("*");
+    }
+
+    const QStringList parts = field.split(QLatin1Char(','));
+    for (const QString &part : parts) {
+        QString range = part;
+        int step = 1;
+
+        const qsizetype slashIdx = part.indexOf(QLatin1Char('/'));
+        if (slashIdx > -1) {
+            bool ok = false;
+            step = part.mid(slashIdx + 1).toInt(&ok);
+            if (!ok || step < 1) {
+                return false;
+            }
+            range = part.left(slashIdx);
+        }
+
+        int from = min;
+        int to = max;
+        if (range != QLatin1String("*")) {
+            bool ok = false;
+            const qsizetype dashIdx = range.indexOf(QLatin1Char('-'));
+            if (dashIdx > -1) {
+                from = range.left(dashIdx).toInt(&ok);
+                if (!ok) {
+                    return false;
+                }
+                to = range.mid(dashIdx + 1).toInt(&ok);
+                if (!ok) {
+                    return false;
+                }
+            } else {
+                from = range.toInt(&ok);
+                if (!ok) {
+                    return false;
+                }
+                // a single value with a step like 5/10 runs from the value to the maximum
+                to = slashIdx > -1 ? max : from;
+            }
+        }
+
+        if (from < min || to > max || from > to) {
+            return false;
+        }
+
+        for (int i = from; i <= to; i += step) {
+            values.set(static_cast<std::size_t>(i));
+        }
+    }
+
+    return values.any();
+}
+
+}
+
+CronSchedule::CronSchedule() = default;
+
+CronSchedule::CronSchedule(const QString &expression)
+    : m_expression(expression.simplified())
+{
+    QString expr = m_expression;
+    if (expr == QLatin1String("@hourly")) {
+        expr = QStringLiteral("0 * * * *");
+    } else if (expr == QLatin1String("@daily") || expr == QLatin1String("@midnight")) {
+        expr = QStringLiteral("0 0 * * *");
+    } else if (expr == QLatin1String("@weekly")) {
+        expr = QStringLiteral("0 0 * * 0");
+    } else if (expr == QLatin1String("@monthly")) {
+        expr = QStringLiteral("0 0 1 * *");
+    } else if (expr == QLatin1String("@yearly") || expr == QLatin1String("@annually")) {
+        expr = QStringLiteral("0 0 1 1 *");
+    }
+
+    const QStringList fields = expr.split(QLatin1Char(' '));
+    if (fields.size() != 5) {
+        return;
+    }
+
+    std::bitset<8> daysOfWeek;
+    m_valid = parseField(fields.at(0), 0, 59, m_minutes)
+            && parseField(fields.at(1), 0, 23, m_hours)
+            && parseField(fields.at(2), 1, 31, m_daysOfMonth, &m_daysOfMonthRestricted)
+            && parseField(fields.at(3), 1, 12, m_months)
+            && parseField(fields.at(4), 0, 7, daysOfWeek, &m_daysOfWeekRestricted);
+
+    for (std::size_t i = 0; i < 7; ++i) {
+        m_daysOfWeek.set(i, daysOfWeek.test(i));
+    }
+    if (daysOfWeek.test(7)) {
+        m_daysOfWeek.set(0);
+    }
+}
+
+bool CronSchedule::isValid() const
+{
+    return m_valid;
+}
+
+QString CronSchedule::expression() const
+{
+    return m_expression;
+}
+
+bool CronSchedule::dayMatches(const QDate &date) const
+{
+    const bool dayOfMonth = m_daysOfMonth.test(static_cast<std::size_t>(date.day()));
+    // Qt counts from Monday = 1 to Sunday = 7, cron from Sunday = 0 to Saturday = 6
+    const bool dayOfWeek = m_daysOfWeek.test(static_cast<std::size_t>(date.dayOfWeek() % 7));
+
+    if (m_daysOfMonthRestricted && m_daysOfWeekRestricted) {
+        return dayOfMonth || dayOfWeek;
+    }
+    if (m_daysOfMonthRestricted) {
+        return dayOfMonth;
+    }
+    if (m_daysOfWeekRestricted) {
+        return dayOfWeek;
+    }
+    return true;
+}
+
+QDateTime CronSchedule::next(const QDateTime &after) const
+{
+    if (!m_valid) {
+        return {};
+    }
+
+    QDateTime t(after.date(), QTime(after.time().hour(), after.time().minute()));
+    t = t.addSecs(60);
+
+    // jumping to the next month, day or hour keeps this far below the limit even for
+    // rare schedules, it only prevents endless loops on schedules that never match
+    constexpr int maxIterations = 100000;
+    for (int i = 0; i < maxIterations; ++i) {
+        const QDate date = t.date();
+        const QTime time = t.time();
+
+        if (!m_months.test(static_cast<std::size_t>(date.month()))) {
+            t = QDateTime(QDate(date.year(), date.month(), 1).addMonths(1), QTime(0, 0));
+            continue;
+        }
+
+        if (!dayMatches(date)) {
+            t = QDateTime(date.addDays(1), QTime(0, 0));
+            continue;
+        }
+
+        if (!m_hours.test(static_cast<std::size_t>(time.hour()))) {
+            t = QDateTime(date, QTime(time.hour(), 0)).addSecs(3600);
+            continue;
+        }
+
+        if (!m_minutes.test(static_cast<std::size_t>(time.minute()))) {
+            t = t.addSecs(60);
+            continue;
+        }
+
+        return t;
+    }
+
+    return {};
+}
@@ -0,0 +1,54 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CRONSCHEDULE_H
+#define CRONSCHEDULE_H
+
+#include <QString>
+#include <QDateTime>
+#include <bitset>
+
+/*!
+ * \brief Parses cron like schedule expressions and calculates the next due time.
+ *
+ * Supports the five standard fields minute, hour, day of month, month and day of
+ * week with lists, ranges and steps like \c "0-59/15 2-5 * * 1,3". Day of week can be
+ * 0 to 7 where 0 and 7 are Sunday. If both, day of month and day of week are
+ * restricted, a day matches if either of them matches. The shortcuts \c @hourly,
+ * \c @daily, \c @midnight, \c @weekly, \c @monthly, \c @yearly and \c @annually are
+ * supported, too.
+ */
+class CronSchedule
+{
+public:
+    CronSchedule();
+    explicit CronSchedule(const QString &expression);
+
+    [[nodiscard]] bool isValid() const;
+    [[nodiscard]] QString expression() const;
+
+    /*!
+     * \brief Returns the first point in time after \a after that matches the schedule.
+     *
+     * Returns an invalid QDateTime if the schedule is invalid or never matches, like
+     * on the 31st of February.
+     */
+    [[nodiscard]] QDateTime next(const QDateTime &after) const;
+
+private:
+    [[nodiscard]] bool dayMatches(const QDate &date) const;
+
+    QString m_expression;
+    std::bitset<60> m_minutes;
+    std::bitset<24> m_hours;
+    std::bitset<32> m_daysOfMonth;
+    std::bitset<13> m_months;
+    std::bitset<7> m_daysOfWeek;
+    bool m_daysOfMonthRestricted = false;
+    bool m_daysOfWeekRestricted = false;
+    bool m_valid = false;
+};
+
+#endif // CRONSCHEDULE_H
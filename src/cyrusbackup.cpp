@@ -4,9 +4,9 @@
  */
 
 #include "cyrusbackup.h"
+#include "executables.h"
 #include <QProcess>
 #include <QFileInfo>
-#include <QStandardPaths>
 #include <QLocale>
 #include <QTimer>
 #include <chrono>
@@ -36,22 +36,20 @@ bool CyrusBackup::loadConfiguration()
     return true;
 }
 
+bool CyrusBackup::supportsPreSync() const
+{
+    return true;
+}
+
 void CyrusBackup::doBackup()
 {
-    m_secondRun = directoryQueue();
     connect(this, &AbstractBackup::backupDirectoriesFinished, this, &CyrusBackup::onBackupDirectoriesFinished);
-    backupDirectories();
+    backupMailboxes();
 }
 
 void CyrusBackup::onBackupDirectoriesFinished()
 {
-    if (m_isFirstRun) {
-        m_isFirstRun = false;
-        setDirectoryQueue(m_secondRun);
-        backupMailboxes();
-    } else {
-        startService();
-    }
+    startService();
 }
 
 void CyrusBackup::backupMailboxes()
@@ -63,10 +61,10 @@ void CyrusBackup::backupMailboxes()
         return;
     }
 
-    QString ctl_mboxlistPath = QStandardPaths::findExecutable(QStringLiteral("ctl_mboxlist"));
+    QString ctl_mboxlistPath = Executables::find(QStringLiteral("ctl_mboxlist"));
 
     if (ctl_mboxlistPath.isEmpty()) {
-        ctl_mboxlistPath = QStandardPaths::findExecutable(QStringLiteral("ctl_mboxlist"), {QStringLiteral("/usr/lib/cyrus"), QStringLiteral("/usr/lib/cyrus/bin"), QStringLiteral("/usr/libexec/cyrus"), QStringLiteral("/usr/libexec/cyrus/bin")});
+        ctl_mboxlistPath = Executables::find(QStringLiteral("ctl_mboxlist"), {QStringLiteral("/usr/lib/cyrus"), QStringLiteral("/usr/lib/cyrus/bin"), QStringLiteral("/usr/libexec/cyrus"), QStringLiteral("/usr/libexec/cyrus/bin")});
     }
 
     if (ctl_mboxlistPath.isEmpty()) {
@@ -19,16 +19,16 @@ public:
 protected:
     bool loadConfiguration() final;
 
+    [[nodiscard]] bool supportsPreSync() const final;
+
     void doBackup() final;
 
 private slots:
     void onBackupDirectoriesFinished();
 
 private:
-    QQueue<QString> m_secondRun;
     QString m_service;
     QString m_configDirectory;
-    bool m_isFirstRun = true;
 
     void backupMailboxes();
     void stopService();
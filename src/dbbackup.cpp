@@ -4,13 +4,34 @@
  */
 
 #include "dbbackup.h"
+#include "dumppipeline.h"
+#include "executables.h"
+#include "mysqlparalleldump.h"
 #include <QTextStream>
 #include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
 #include <QCryptographicHash>
+#include <QProcessEnvironment>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+#include <memory>
 
 const int DbBackup::mysqlDefaultPort = 3306;
 const int DbBackup::pgsqlDefaultPort = 5432;
 
+namespace {
+// colons separate the fields of a PostgreSQL password file
+QString pgPassEscape(const QString &value)
+{
+    QString escaped = value;
+    escaped.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+    escaped.replace(QLatin1Char(':'), QLatin1String("\\:"));
+    return escaped;
+}
+}
+
 DbBackup::DbBackup(const QString &target, const QString &tempDir, const QVariantMap &options, QObject *parent)
     : AbstractBackup(QStringLiteral("MariaDB"), QString(), target, tempDir, options, parent)
 {
@@ -32,6 +53,8 @@ bool DbBackup::loadConfiguration()
         setDbType(MySQL);
     } else if (type.compare(QLatin1String("mariadb")) == 0) {
         setDbType(MariaDB);
+    } else if (type.compare(QLatin1String("mariadb-physical")) == 0) {
+        setDbType(MariaDBPhysical);
     } else if (type.compare(QLatin1String("postgresql")) == 0 || type.compare(QLatin1String("pgsql")) == 0) {
         setDbType(PostgreSQL);
     } else {
@@ -43,7 +66,7 @@ bool DbBackup::loadConfiguration()
     setDbUser(option(QStringLiteral("user")).toString());
     setDbPassword(option(QStringLiteral("password")).toString());
     setDbHost(option(QStringLiteral("host"), QStringLiteral("localhost")).toString());
-    setDbPort(option(QStringLiteral("port"), DbBackup::mysqlDefaultPort).toInt());
+    setDbPort(option(QStringLiteral("port"), dbType() == PostgreSQL ? DbBackup::pgsqlDefaultPort : DbBackup::mysqlDefaultPort).toInt());
 
     return true;
 }
@@ -69,6 +92,9 @@ void DbBackup::backupDatabase()
     case MariaDB:
         backupMariaDb();
         break;
+    case MariaDBPhysical:
+        backupMariaDbPhysical();
+        break;
     case PostgreSQL:
         backupPgSql();
         break;
@@ -85,25 +111,21 @@ void DbBackup::backupDatabase()
 
 QString DbBackup::dbDirPath() const
 {
-    return target() + QLatin1String("/Databases");
+    // with generations the dumps are part of every generation and pruned with it
+    return depotPath() + QLatin1String("/Databases");
 }
 
-void DbBackup::backupMySql()
+bool DbBackup::writeMySqlClientConfig(const QString &group)
 {
-    //% "Starting dump of MySQL/MariaDB database %1."
-    logInfo(qtTrId("SIHHURI_INFO_START_DUMP_MYSQL").arg(dbName()));
-    setStepStartTime();
-
     if (!m_dbConfigFile.open()) {
         //% "Failed to open temporary file for database configuration: %1"
         logError(qtTrId("SIHHURI_CRIT_FAILED_OPEN_TEMP_DBCONFFILE").arg(m_dbConfigFile.errorString()));
-        emit backupDatabaseFailed(QPrivateSignal());
-        return;
+        return false;
     }
 
     {
         QTextStream confOut(&m_dbConfigFile);
-        confOut << "[client]" << '\n';
+        confOut << '[' << group << ']' << '\n';
         confOut << "user=\"" << dbUser() << "\"" << '\n';
         confOut << "password=\"" << dbPassword() << "\"" << '\n';
         if (dbHost().startsWith(QLatin1Char('/'))) {
@@ -122,6 +144,20 @@ void DbBackup::backupMySql()
     m_dbConfigFile.close();
     m_dbConfigFile.setPermissions(QFileDevice::ReadOwner|QFileDevice::WriteOwner);
 
+    return true;
+}
+
+void DbBackup::backupMySql()
+{
+    //% "Starting dump of MySQL/MariaDB database %1."
+    logInfo(qtTrId("SIHHURI_INFO_START_DUMP_MYSQL").arg(dbName()));
+    setStepStartTime();
+
+    if (!writeMySqlClientConfig(QStringLiteral("client"))) {
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
     QDir dbDir(dbDirPath());
     if (!dbDir.mkpath(dbDir.path())) {
         //% "Failed to create database directory."
@@ -130,150 +166,816 @@ void DbBackup::backupMySql()
         return;
     }
 
-    m_dumpFile = new QFile(this); // NOLINT(cppcoreguidelines-owning-memory)
-    m_dumpFile->setFileName(dbDir.absoluteFilePath(QLatin1String("mysql_") + dbName() + QLatin1String(".sql")));
+    // the dump is hashed and compressed while it is read, only the compressed file is written;
+    // the chunk store needs the plain dump, compressed dumps change completely on every change
+    Compressor::Codec codec = Compressor::None;
+    int level = 0;
+    if (!isChunkDepot()) {
+        const QString codecName = option(QStringLiteral("compression"), QStringLiteral("xz")).toString();
+        bool ok = false;
+        codec = Compressor::codecFromName(codecName, &ok);
+        if (!ok) {
+            //% "%1 is not a valid compression. Valid compressions are xz, zstd and none."
+            logError(qtTrId("SIHHURI_CRIT_INVALID_DUMP_COMPRESSION").arg(codecName));
+            emit backupDatabaseFailed(QPrivateSignal());
+            return;
+        }
+        const std::pair<int,int> levelRange = Compressor::levelRange(codec);
+        level = option(QStringLiteral("compressionLevel"), Compressor::defaultLevel(codec)).toInt(&ok);
+        if (!ok || level < levelRange.first || level > levelRange.second) {
+            //% "%1 is not a valid level for %2 compression. Valid levels are %3 to %4."
+            logError(qtTrId("SIHHURI_CRIT_INVALID_DUMP_COMPRESSION_LEVEL").arg(option(QStringLiteral("compressionLevel")).toString(), Compressor::codecName(codec), QString::number(levelRange.first), QString::number(levelRange.second)));
+            emit backupDatabaseFailed(QPrivateSignal());
+            return;
+        }
+    }
 
-    if (!m_dumpFile->open(QIODevice::WriteOnly|QIODevice::Text|QIODevice::Truncate)) {
-        //% "Failed to open %1 to store MySQL/MariaDB database dump: %2"
-        logError(qtTrId("SIHHURI_CRIT_FAILED_OPEN_DUMPFILE_WRITE").arg(m_dumpFile->fileName(), m_dumpFile->errorString()));
-        emit backupDatabaseFailed(QPrivateSignal());
+    // every job uses its own connection to the server besides the one holding the global read lock
+    const int jobs = std::max(option(QStringLiteral("dumpJobs"), 1).toInt(), 1);
+    if (jobs > 1) {
+        backupMySqlParallel(codec, level, jobs);
         return;
     }
 
+    m_dumpFileName = QLatin1String("mysql_") + dbName() + QLatin1String(".sql");
+    const QString outputFile = dbDir.absoluteFilePath(m_dumpFileName + Compressor::fileExtension(codec));
+
     m_currentStats = BackupStats();
     m_currentStats.type = BackupStats::MySQL;
     m_currentStats.id = dbName();
+    if (codec != Compressor::None) {
+        m_currentStats.codec = Compressor::codecName(codec);
+        m_currentStats.codecLevel = level;
+    }
 
     const QString defFileArg = QLatin1String("--defaults-file=") + m_dbConfigFile.fileName();
-    QStringList dumpArgs({defFileArg, dbName()});
-
-    auto mysqldump = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
-    mysqldump->setProgram(QStringLiteral("mysqldump"));
-    mysqldump->setArguments(dumpArgs);
-    connect(mysqldump, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &DbBackup::onDatabaseDumpFinished);
-    connect(mysqldump, &QProcess::readyReadStandardError, this, [this, mysqldump](){
-        logCritical(QStringLiteral("mysqldump: %1").arg(QString::fromUtf8(mysqldump->readAllStandardError())));
+
+    auto pipeline = std::make_shared<DumpPipeline>(QStringLiteral("mysqldump"), QStringList({defFileArg, dbName()}), outputFile);
+    pipeline->setCompression(codec, level, option(QStringLiteral("compressionThreads"), 0).toInt());
+    auto success = std::make_shared<bool>(false);
+    QThread *thread = QThread::create([pipeline, success](){
+        *success = pipeline->run();
     });
-    connect(mysqldump, &QProcess::readyReadStandardOutput, this, [this, mysqldump](){
-        m_dumpFile->write(mysqldump->readAllStandardOutput());
+    connect(thread, &QThread::finished, this, [this, thread, pipeline, success, codec, outputFile](){
+        thread->deleteLater();
+        onDatabaseDumpFinished(*pipeline, *success, codec, outputFile);
     });
-    mysqldump->start();
+    thread->start();
 }
 
-void DbBackup::backupMariaDb()
+void DbBackup::backupMySqlParallel(Compressor::Codec codec, int level, int jobs)
 {
-    backupMySql();
-}
+    // the last dump is replaced after success
+    m_dumpDir = QDir(dbDirPath()).absoluteFilePath(QLatin1String("mysql_") + dbName());
+    const QString tmpDir = m_dumpDir + QLatin1String(".tmp");
+    QDir(tmpDir).removeRecursively();
 
-void DbBackup::backupPgSql()
-{
+    m_currentStats = BackupStats();
+    m_currentStats.type = BackupStats::MySQL;
+    m_currentStats.id = dbName();
+    if (codec != Compressor::None) {
+        m_currentStats.codec = Compressor::codecName(codec);
+        m_currentStats.codecLevel = level;
+    }
 
+    auto dump = std::make_shared<MySqlParallelDump>(m_dbConfigFile.fileName(), dbName(), tmpDir, jobs);
+    dump->setCompression(codec, level, option(QStringLiteral("compressionThreads"), 0).toInt());
+    dump->setLockTimeout(option(QStringLiteral("lockTimeout"), 60).toInt());
+    auto success = std::make_shared<bool>(false);
+    QThread *thread = QThread::create([dump, success](){
+        *success = dump->run();
+    });
+    connect(thread, &QThread::finished, this, [this, thread, dump, success](){
+        thread->deleteLater();
+        onMySqlParallelDumpFinished(*dump, *success);
+    });
+    thread->start();
 }
 
-void DbBackup::onDatabaseDumpFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void DbBackup::onMySqlParallelDumpFinished(const MySqlParallelDump &dump, bool success)
 {
-    m_dumpFile->close();
-    if (exitCode == 0 && exitStatus == QProcess::NormalExit) {
-        const qint64 timeUsed = getStepTimeUsed();
-        m_currentStats.timeUsed += timeUsed;
-        QLocale locale;
-        QFileInfo fi(m_dumpFile->fileName());
-        m_currentStats.uncompressedSize = fi.size();
-        //% "Finished dump of MySQL/MariaDB database %1 with %2 in %3 milliseconds."
-        logInfo(qtTrId("SIHHURI_INFO_FINISHED_DUMP_MYSQL").arg(dbName(), locale.formattedDataSize(fi.size()), locale.toString(timeUsed)));
-        hashDatabase();
-    } else {
+    const QStringList standardError = dump.standardError().split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    for (const QString &line : standardError) {
+        logCritical(QStringLiteral("mysqldump: %1").arg(line));
+    }
+
+    const QString tmpDir = m_dumpDir + QLatin1String(".tmp");
+    if (!success) {
+        QDir(tmpDir).removeRecursively();
         //% "Failed to create MySQL/MariaDB database dump of %1."
         logError(qtTrId("SIHHURI_CRIT_FAILED_DBDUMP").arg(dbName()));
+        logCritical(dump.errorString());
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    QDir(m_dumpDir).removeRecursively();
+    if (!QDir().rename(tmpDir, m_dumpDir)) {
+        //% "Failed to move MySQL/MariaDB database dump %1 into place."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_MOVE_MYSQLDUMP").arg(tmpDir));
         emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    // single file dumps of earlier runs would be verified and restored instead
+    const QString dumpDirName = QFileInfo(m_dumpDir).fileName();
+    for (const Compressor::Codec codec : {Compressor::None, Compressor::Xz, Compressor::Zstd}) {
+        QFile::remove(m_dumpDir + QLatin1String(".sql") + Compressor::fileExtension(codec));
+    }
+
+    const MySqlParallelDump::Result result = dump.result();
+    m_currentStats.timeUsed += result.timeUsed;
+    m_currentStats.uncompressedSize = result.uncompressedSize;
+
+    QLocale locale;
+    //% "Finished dump of MySQL/MariaDB database %1 in %2 parallel parts with %3 in %4 milliseconds."
+    logInfo(qtTrId("SIHHURI_INFO_FINISHED_PARALLEL_DUMP_MYSQL").arg(dbName(), locale.toString(static_cast<qint64>(result.parts.size())), locale.formattedDataSize(result.uncompressedSize), locale.toString(result.timeUsed)));
+    //% "Held the global read lock on %1 for %2 milliseconds to start the consistent snapshots."
+    logInfo(qtTrId("SIHHURI_INFO_MYSQL_LOCK_TIME").arg(dbName(), locale.toString(result.lockTime)));
+
+    // the sums are calculated from the plain parts, what the verification expects for every compression
+    QStringList sums;
+    for (const MySqlParallelDump::Part &part : result.parts) {
+        sums << QString::fromLatin1(part.sha256.toHex()) + QLatin1Char(' ') + dumpDirName + QLatin1Char('/') + part.fileName;
+    }
+    // in a chunk store the parts are verified by the content addresses of their chunks
+    replaceDumpDirSums(dbDirPath(), dumpDirName, isChunkDepot() ? QStringList() : sums);
+
+    if (!isChunkDepot()) {
+        m_currentStats.compressedSize = result.fileSize;
+        m_currentStats.compressionTime = result.compressionTime;
+        //% "Finished compression of MySQL/MariaDB database dump %1 with %2 in %3 milliseconds."
+        logInfo(qtTrId("SIHHURI_INFO_FINISHED_COMPRESS_MYSQL").arg(dbName(), locale.formattedDataSize(result.fileSize), locale.toString(result.compressionTime)));
+        addStatistic(m_currentStats);
+        emit backupDatabaseFinished(QPrivateSignal());
+        return;
     }
+
+    //% "Starting to store MySQL/MariaDB database dump %1 in the chunk store."
+    logInfo(qtTrId("SIHHURI_INFO_START_CHUNK_MYSQL").arg(dumpDirName));
+    setStepStartTime();
+
+    storeDirectoryChunks(m_dumpDir, QLatin1String("Databases/") + dumpDirName, [this](bool success, qint64 storedBytes){
+        if (success) {
+            if (!QDir(m_dumpDir).removeRecursively()) {
+                //% "Failed to remove uncompressed MySQL/MariaDB database dump %1."
+                logWarning(qtTrId("SIHHURI_WARN_FAILED_REMOVE_MYSQL_DUMP_DIR").arg(m_dumpDir));
+            }
+            const qint64 timeUsed = getStepTimeUsed();
+            m_currentStats.timeUsed += timeUsed;
+            m_currentStats.compressedSize = storedBytes;
+            QLocale locale;
+            //% "Finished storing MySQL/MariaDB database dump %1 with %2 of new chunks in %3 milliseconds."
+            logInfo(qtTrId("SIHHURI_INFO_FINISHED_CHUNK_MYSQL").arg(dbName(), locale.formattedDataSize(storedBytes), locale.toString(timeUsed)));
+            addStatistic(m_currentStats);
+        }
+        // on failure the plain dump is kept in the database directory
+        emit backupDatabaseFinished(QPrivateSignal());
+    });
 }
 
-void DbBackup::hashDatabase()
+void DbBackup::backupMariaDb()
 {
+    backupMySql();
+}
+
+void DbBackup::backupMariaDbPhysical()
+{
+    // without a database name the whole server is backed up
+    const QString label = dbName().isEmpty() ? QStringLiteral("server") : dbName();
+
+    //% "Starting physical backup of MariaDB %1."
+    logInfo(qtTrId("SIHHURI_INFO_START_MARIABACKUP").arg(label));
     setStepStartTime();
-    const QFileInfo dumpFileFi(m_dumpFile->fileName());
-    if (m_dumpFile->open(QIODevice::ReadOnly)) {
 
-        QCryptographicHash hasher(QCryptographicHash::Sha256);
-        hasher.addData(m_dumpFile);
-        const QByteArray hash = hasher.result();
-        const QString sha256sum = QString::fromLatin1(hash.toHex());
-        const qint64 timeUsed = getStepTimeUsed();
-        m_currentStats.timeUsed += timeUsed;
+    m_mariaBackupPath = Executables::find(QStringLiteral("mariadb-backup"));
+    if (m_mariaBackupPath.isEmpty()) {
+        m_mariaBackupPath = Executables::find(QStringLiteral("mariabackup"));
+    }
+    if (m_mariaBackupPath.isEmpty()) {
+        //% "Can not find mariadb-backup or mariabackup executable."
+        logError(qtTrId("SIHHURI_CRIT_NO_MARIABACKUP_EXECUTABLE"));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
 
-        QLocale locale;
-        //% "Calculated SHA256 hash sum of %1 in %2 milliseconds: %3"
-        logInfo(qtTrId("SIHHURI_INFO_FINISHED_SHASUM_MYSQLDUMP").arg(dumpFileFi.fileName(), locale.toString(timeUsed), sha256sum));
-        m_dumpFile->close();
+    // the server options like the data directory are read from the default option files
+    if (!writeMySqlClientConfig(QStringLiteral("mariabackup"))) {
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
 
-        QFile hashValuesFile(dbDirPath() + QLatin1String("/sha256sums.txt"));
-        if (hashValuesFile.open(QIODevice::WriteOnly|QIODevice::Text|QIODevice::Append)) {
+    // the chain of full and incremental backups spans multiple runs, so it is not part of the generations
+    const QString dbDir = target() + QLatin1String("/Databases");
+    if (!QDir().mkpath(dbDir)) {
+        //% "Failed to create database directory."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_CREATE_DBDIR"));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+    m_dumpDir = dbDir + QLatin1String("/mariabackup_") + label;
 
-            QTextStream out(&hashValuesFile);
-            out << sha256sum << " " << dumpFileFi.fileName() << '\n';
-            out.flush();
+    m_currentStats = BackupStats();
+    m_currentStats.type = BackupStats::MariaDBPhysical;
+    m_currentStats.id = label;
+
+    // number of incremental backups before the next full backup starts a new chain
+    const int incrementals = std::max(option(QStringLiteral("incrementals"), 6).toInt(), 0);
 
-            hashValuesFile.close();
+    m_mariaBackupChain = std::make_unique<MariaBackupChain>(m_dumpDir);
+    bool incremental = false;
+    if (incrementals > 0 && QFileInfo(m_dumpDir).isDir()) {
+        if (m_mariaBackupChain->load() && m_mariaBackupChain->isUsable()) {
+            incremental = static_cast<int>(m_mariaBackupChain->links().size()) - 1 < incrementals;
         } else {
-            //% "Failed to open %1 for writing SHA256 hash values."
-            logWarning(qtTrId("SIHHURI_WARN_FAILED_OPEN_SHA256SUMS_FILE").arg(hashValuesFile.fileName()));
+            //% "The chain of physical MariaDB backups in %1 is not usable, starting a new chain with a full backup."
+            logWarning(qtTrId("SIHHURI_WARN_MARIABACKUP_CHAIN_NOT_USABLE").arg(m_dumpDir));
         }
-    } else {
-        //% "Failed to open MySQL/MariaDB database dump file %1, omitting SHA256 hash sum calculation."
-        logWarning(qtTrId("SIHHURI_WARN_FAILD_OPEN_MYSQL_DUMP_OMIT_HASH").arg(m_dumpFile->fileName()));
     }
-    compressDatabase();
+
+    if (!incremental) {
+        // the complete chain is replaced after success
+        m_mariaBackupTmpDir = m_dumpDir + QLatin1String(".tmp");
+        QDir(m_mariaBackupTmpDir).removeRecursively();
+        if (!QDir().mkpath(m_mariaBackupTmpDir)) {
+            //% "Failed to create database directory."
+            logError(qtTrId("SIHHURI_CRIT_FAILED_CREATE_DBDIR"));
+            emit backupDatabaseFailed(QPrivateSignal());
+            return;
+        }
+        runMariaBackupStep(m_mariaBackupPath, mariaBackupArgs(QStringLiteral("--backup"), m_mariaBackupTmpDir + QLatin1String("/full")), [this](){
+            onFullMariaBackupFinished();
+        });
+        return;
+    }
+
+    const QString incDirName = m_mariaBackupChain->nextIncrementalDir();
+    m_mariaBackupTmpDir = m_dumpDir + QLatin1Char('/') + incDirName + QLatin1String(".tmp");
+    QDir(m_mariaBackupTmpDir).removeRecursively();
+    QStringList args = mariaBackupArgs(QStringLiteral("--backup"), m_mariaBackupTmpDir);
+    args << QStringLiteral("--incremental-basedir=") + m_dumpDir + QLatin1Char('/') + m_mariaBackupChain->links().back().dir;
+    runMariaBackupStep(m_mariaBackupPath, args, [this, incDirName](){
+        onIncrementalMariaBackupFinished(incDirName);
+    });
+}
+
+QStringList DbBackup::mariaBackupArgs(const QString &mode, const QString &targetDir) const
+{
+    // the defaults file has to be the first argument
+    QStringList args({QLatin1String("--defaults-extra-file=") + m_dbConfigFile.fileName(), mode, QLatin1String("--target-dir=") + targetDir});
+    if (mode == QLatin1String("--backup")) {
+        // number of threads copying the data files
+        const int jobs = std::max(option(QStringLiteral("dumpJobs"), std::min(QThread::idealThreadCount(), 4)).toInt(), 1);
+        args << QStringLiteral("--parallel=") + QString::number(jobs);
+        if (!dbName().isEmpty()) {
+            args << QStringLiteral("--databases=") + dbName();
+        }
+    }
+    return args;
+}
+
+void DbBackup::runMariaBackupStep(const QString &program, const QStringList &args, const std::function<void()> &onSuccess)
+{
+    // mariabackup logs every copied file, only the end of the output is kept for the error message
+    auto output = std::make_shared<QByteArray>();
+    auto proc = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+    proc->setProgram(program);
+    proc->setArguments(args);
+    proc->setProcessChannelMode(QProcess::MergedChannels);
+    connect(proc, &QProcess::readyReadStandardOutput, this, [proc, output](){
+        output->append(proc->readAllStandardOutput());
+        constexpr qsizetype maxOutput = 16 * 1024;
+        if (output->size() > maxOutput) {
+            output->remove(0, output->size() - maxOutput);
+        }
+    });
+    auto fail = [this, proc, output](const QString &reason){
+        const QString name = QFileInfo(proc->program()).fileName();
+        const QList<QByteArray> lines = output->trimmed().split('\n');
+        for (qsizetype i = std::max<qsizetype>(lines.size() - 20, 0); i < lines.size(); ++i) {
+            logCritical(QStringLiteral("%1: %2").arg(name, QString::fromUtf8(lines.at(i))));
+        }
+        if (!m_mariaBackupTmpDir.isEmpty()) {
+            QDir(m_mariaBackupTmpDir).removeRecursively();
+            m_mariaBackupTmpDir.clear();
+        }
+        //% "Failed to run %1 for the physical backup of MariaDB %2: %3"
+        logError(qtTrId("SIHHURI_CRIT_FAILED_MARIABACKUP_STEP").arg(name, m_currentStats.id, reason));
+        emit backupDatabaseFailed(QPrivateSignal());
+    };
+    connect(proc, &QProcess::errorOccurred, this, [proc, fail](QProcess::ProcessError error){
+        // otherwise finished will be emitted
+        if (error == QProcess::FailedToStart) {
+            fail(proc->errorString());
+            proc->deleteLater();
+        }
+    });
+    connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [proc, output, fail, onSuccess](int exitCode, QProcess::ExitStatus exitStatus){
+        output->append(proc->readAllStandardOutput());
+        proc->deleteLater();
+        if (exitStatus != QProcess::NormalExit) {
+            fail(proc->errorString());
+            return;
+        }
+        if (exitCode != 0) {
+            fail(QStringLiteral("exit code %1").arg(exitCode));
+            return;
+        }
+        onSuccess();
+    });
+    proc->start();
+}
+
+void DbBackup::onFullMariaBackupFinished()
+{
+    MariaBackupChain::Link link;
+    link.dir = QStringLiteral("full");
+    link.created = QDateTime::currentDateTimeUtc();
+    const QString fullDir = m_mariaBackupTmpDir + QLatin1String("/full");
+    if (!MariaBackupChain::readCheckpoints(fullDir, &link.fromLsn, &link.toLsn)) {
+        QDir(m_mariaBackupTmpDir).removeRecursively();
+        m_mariaBackupTmpDir.clear();
+        //% "Failed to read the LSN of the physical backup in %1."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_READ_MARIABACKUP_LSN").arg(fullDir));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    // preparing changes the files, the unprepared full backup is the base of the incremental backups;
+    // on file systems with reflinks the copy shares the data with the full backup
+    const QString preparedDir = m_mariaBackupTmpDir + QLatin1String("/prepared");
+    runMariaBackupStep(QStringLiteral("cp"), {QStringLiteral("-a"), QStringLiteral("--reflink=auto"), fullDir, preparedDir}, [this, link, preparedDir](){
+        runMariaBackupStep(m_mariaBackupPath, mariaBackupArgs(QStringLiteral("--prepare"), preparedDir), [this, link](){
+            MariaBackupChain chain(m_mariaBackupTmpDir);
+            chain.append(link);
+            chain.setPreparedLsn(link.toLsn);
+            if (!chain.save()) {
+                QDir(m_mariaBackupTmpDir).removeRecursively();
+                m_mariaBackupTmpDir.clear();
+                //% "Failed to save the chain of physical MariaDB backups: %1"
+                logError(qtTrId("SIHHURI_CRIT_FAILED_SAVE_MARIABACKUP_CHAIN").arg(chain.errorString()));
+                emit backupDatabaseFailed(QPrivateSignal());
+                return;
+            }
+
+            // the old chain is kept until the new one is in place
+            const QString oldDir = m_dumpDir + QLatin1String(".old");
+            QDir(oldDir).removeRecursively();
+            const bool hasOld = QFileInfo::exists(m_dumpDir);
+            if ((hasOld && !QDir().rename(m_dumpDir, oldDir)) || !QDir().rename(m_mariaBackupTmpDir, m_dumpDir)) {
+                if (hasOld && !QFileInfo::exists(m_dumpDir)) {
+                    QDir().rename(oldDir, m_dumpDir);
+                }
+                //% "Failed to move physical MariaDB backup %1 into place."
+                logError(qtTrId("SIHHURI_CRIT_FAILED_MOVE_MARIABACKUP").arg(m_mariaBackupTmpDir));
+                m_mariaBackupTmpDir.clear();
+                emit backupDatabaseFailed(QPrivateSignal());
+                return;
+            }
+            m_mariaBackupTmpDir.clear();
+            QDir(oldDir).removeRecursively();
+
+            //% "Finished full physical backup of MariaDB %1 up to LSN %2 in %3 milliseconds."
+            logInfo(qtTrId("SIHHURI_INFO_FINISHED_FULL_MARIABACKUP").arg(m_currentStats.id, QString::number(link.toLsn), QLocale().toString(getStepTimeUsed())));
+            hashMariaBackup(m_dumpDir + QLatin1String("/full"), false);
+        });
+    });
+}
+
+void DbBackup::onIncrementalMariaBackupFinished(const QString &incDirName)
+{
+    const QString incDir = m_dumpDir + QLatin1Char('/') + incDirName;
+    QDir(incDir).removeRecursively();
+    if (!QDir().rename(m_mariaBackupTmpDir, incDir)) {
+        QDir(m_mariaBackupTmpDir).removeRecursively();
+        m_mariaBackupTmpDir.clear();
+        //% "Failed to move physical MariaDB backup %1 into place."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_MOVE_MARIABACKUP").arg(incDir));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+    m_mariaBackupTmpDir.clear();
+
+    MariaBackupChain::Link link;
+    link.dir = incDirName;
+    link.created = QDateTime::currentDateTimeUtc();
+    link.incremental = true;
+    if (!MariaBackupChain::readCheckpoints(incDir, &link.fromLsn, &link.toLsn)) {
+        QDir(incDir).removeRecursively();
+        //% "Failed to read the LSN of the physical backup in %1."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_READ_MARIABACKUP_LSN").arg(incDir));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+    const quint64 lastLsn = m_mariaBackupChain->links().back().toLsn;
+    if (link.fromLsn != lastLsn) {
+        QDir(incDir).removeRecursively();
+        //% "The incremental physical backup %1 starts at LSN %2 instead of %3."
+        logError(qtTrId("SIHHURI_CRIT_MARIABACKUP_LSN_GAP").arg(incDir, QString::number(link.fromLsn), QString::number(lastLsn)));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    // until the prepared copy has the new LSN, the next run starts a new chain
+    m_mariaBackupChain->append(link);
+    if (!m_mariaBackupChain->save()) {
+        //% "Failed to save the chain of physical MariaDB backups: %1"
+        logError(qtTrId("SIHHURI_CRIT_FAILED_SAVE_MARIABACKUP_CHAIN").arg(m_mariaBackupChain->errorString()));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    QStringList args = mariaBackupArgs(QStringLiteral("--prepare"), m_dumpDir + QLatin1String("/prepared"));
+    args << QStringLiteral("--incremental-dir=") + incDir;
+    runMariaBackupStep(m_mariaBackupPath, args, [this, link, incDir](){
+        m_mariaBackupChain->setPreparedLsn(link.toLsn);
+        if (!m_mariaBackupChain->save()) {
+            //% "Failed to save the chain of physical MariaDB backups: %1"
+            logError(qtTrId("SIHHURI_CRIT_FAILED_SAVE_MARIABACKUP_CHAIN").arg(m_mariaBackupChain->errorString()));
+            emit backupDatabaseFailed(QPrivateSignal());
+            return;
+        }
+
+        //% "Finished incremental physical backup of MariaDB %1 from LSN %2 to %3 in %4 milliseconds."
+        logInfo(qtTrId("SIHHURI_INFO_FINISHED_INCREMENTAL_MARIABACKUP").arg(m_currentStats.id, QString::number(link.fromLsn), QString::number(link.toLsn), QLocale().toString(getStepTimeUsed())));
+        hashMariaBackup(incDir, true);
+    });
 }
 
-void DbBackup::compressDatabase()
+void DbBackup::hashMariaBackup(const QString &backupDir, bool incremental)
 {
-    const QFileInfo dumpFileFi(m_dumpFile->fileName());
+    m_currentStats.timeUsed += getStepTimeUsed();
+    setStepStartTime();
+
+    // sums are relative to the database directory, a full backup replaces the sums of the whole chain
+    const QString dbDir = target() + QLatin1String("/Databases");
+    const QString dumpDirName = QFileInfo(m_dumpDir).fileName();
+    const QString sumsPrefix = incremental ? dumpDirName + QLatin1Char('/') + QFileInfo(backupDir).fileName() : dumpDirName;
+
+    struct Hashes {
+        QStringList sums;
+        QStringList failed;
+        qint64 size = 0;
+    };
+    auto hashes = std::make_shared<Hashes>();
+    QThread *thread = QThread::create([hashes, backupDir, dbDir](){
+        const QDir base(dbDir);
+        QDirIterator it(backupDir, QDir::Files|QDir::Hidden, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            QFile file(it.filePath());
+            QCryptographicHash hasher(QCryptographicHash::Sha256);
+            if (!file.open(QIODevice::ReadOnly) || !hasher.addData(&file)) {
+                hashes->failed << file.fileName();
+                continue;
+            }
+            hashes->size += it.fileInfo().size();
+            hashes->sums << QString::fromLatin1(hasher.result().toHex()) + QLatin1Char(' ') + base.relativeFilePath(file.fileName());
+        }
+        hashes->sums.sort();
+    });
+    connect(thread, &QThread::finished, this, [this, thread, hashes, dbDir, sumsPrefix](){
+        thread->deleteLater();
+        for (const QString &fileName : std::as_const(hashes->failed)) {
+            //% "Failed to open physical MariaDB backup file %1, omitting SHA256 hash sum calculation."
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_OPEN_MARIABACKUP_OMIT_HASH").arg(fileName));
+        }
+        replaceDumpDirSums(dbDir, sumsPrefix, hashes->sums);
+
+        const qint64 timeUsed = getStepTimeUsed();
+        m_currentStats.timeUsed += timeUsed;
+        // the data files are stored as they are, only the new ones of this run are counted
+        m_currentStats.uncompressedSize = hashes->size;
+        m_currentStats.compressedSize = hashes->size;
+        QLocale locale;
+        //% "Calculated SHA256 hash sums of %1 files of physical MariaDB backup %2 in %3 milliseconds."
+        logInfo(qtTrId("SIHHURI_INFO_FINISHED_SHASUM_MARIABACKUP").arg(locale.toString(hashes->sums.size()), sumsPrefix, locale.toString(timeUsed)));
+        addStatistic(m_currentStats);
+        emit backupDatabaseFinished(QPrivateSignal());
+    });
+    thread->start();
+}
 
-    //% "Starting compression of MySQL/MariaDB database dump %1."
-    logInfo(qtTrId("SIHHURI_INFO_START_COMPRESS_MYSQL").arg(dumpFileFi.fileName()));
+void DbBackup::backupPgSql()
+{
+    //% "Starting dump of PostgreSQL database %1."
+    logInfo(qtTrId("SIHHURI_INFO_START_DUMP_PGSQL").arg(dbName()));
     setStepStartTime();
 
-    auto xz = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
-    xz->setWorkingDirectory(dbDirPath());
-    xz->setProgram(QStringLiteral("xz"));
-
-    xz->setArguments({QStringLiteral("-k"),     // keep input file
-                      QStringLiteral("-f"),     // force overwrite output file
-                      QStringLiteral("-6"),     // compression preset
-                      QStringLiteral("-T 0"),   // use all available cores
-                      dumpFileFi.fileName()});
-    connect(xz, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &DbBackup::onCompressDatabaseFinished);
-    connect(xz, &QProcess::readyReadStandardError, this, [this, xz](){
-        logCritical(QStringLiteral("xz: %1").arg(QString::fromUtf8(xz->readAllStandardError())));
+    if (!m_dbConfigFile.open()) {
+        //% "Failed to open temporary file for database configuration: %1"
+        logError(qtTrId("SIHHURI_CRIT_FAILED_OPEN_TEMP_DBCONFFILE").arg(m_dbConfigFile.errorString()));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    {
+        // host and port are given on the command line, the password file only has to match database and user
+        QTextStream confOut(&m_dbConfigFile);
+        confOut << "*:*:" << pgPassEscape(dbName()) << ':' << pgPassEscape(dbUser()) << ':' << pgPassEscape(dbPassword()) << '\n';
+        confOut.flush();
+    }
+
+    m_dbConfigFile.close();
+    // libpq ignores password files that are accessible by others
+    m_dbConfigFile.setPermissions(QFileDevice::ReadOwner|QFileDevice::WriteOwner);
+
+    QDir dbDir(dbDirPath());
+    if (!dbDir.mkpath(dbDir.path())) {
+        //% "Failed to create database directory."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_CREATE_DBDIR"));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    // pg_dump refuses to write into an existing directory, the last dump is replaced after success
+    m_dumpDir = dbDir.absoluteFilePath(QLatin1String("pgsql_") + dbName());
+    const QString tmpDir = m_dumpDir + QLatin1String(".tmp");
+    QDir(tmpDir).removeRecursively();
+
+    m_currentStats = BackupStats();
+    m_currentStats.type = BackupStats::PostgreSQL;
+    m_currentStats.id = dbName();
+
+    // every job uses its own connection to the server besides the main connection
+    const int jobs = std::max(option(QStringLiteral("dumpJobs"), std::min(QThread::idealThreadCount(), 4)).toInt(), 1);
+
+    QStringList dumpArgs({QStringLiteral("--format=directory"),
+                          QStringLiteral("--jobs=") + QString::number(jobs),
+                          QStringLiteral("--file=") + tmpDir,
+                          QStringLiteral("--no-password"),
+                          QStringLiteral("--username=") + dbUser(),
+                          QStringLiteral("--port=") + QString::number(dbPort())});
+    // a host starting with a slash is the directory of the unix domain socket
+    if (!dbHost().isEmpty()) {
+        dumpArgs << QStringLiteral("--host=") + dbHost();
+    }
+    // chunks of compressed tables change completely on every change
+    if (isChunkDepot()) {
+        dumpArgs << QStringLiteral("--compress=0");
+    }
+    dumpArgs << dbName();
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert(QStringLiteral("PGPASSFILE"), m_dbConfigFile.fileName());
+
+    auto pgdump = new QProcess(this); // NOLINT(cppcoreguidelines-owning-memory)
+    pgdump->setProgram(QStringLiteral("pg_dump"));
+    pgdump->setArguments(dumpArgs);
+    pgdump->setProcessEnvironment(env);
+    connect(pgdump, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &DbBackup::onPgSqlDumpFinished);
+    connect(pgdump, &QProcess::readyReadStandardError, this, [this, pgdump](){
+        logCritical(QStringLiteral("pg_dump: %1").arg(QString::fromUtf8(pgdump->readAllStandardError())));
     });
-    xz->start();
+    pgdump->start();
 }
 
-void DbBackup::onCompressDatabaseFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void DbBackup::onPgSqlDumpFinished(int exitCode, QProcess::ExitStatus exitStatus)
 {
-    if (exitCode == 0 && exitStatus == QProcess::NormalExit) {
-        QFileInfo xzFi(m_dumpFile->fileName() + QLatin1String(".xz"));
-        if (!m_dumpFile->remove()) {
-            //% "Failed to remove uncompressed MySQL/MariaDB database dump file %1."
-            logWarning(qtTrId("SIHHURI_WARN_FAILED_REMOVE_UNCOMPRESSED_MYSQL_DUMP_FILE").arg(m_dumpFile->fileName()));
+    const QString tmpDir = m_dumpDir + QLatin1String(".tmp");
+    if (exitCode != 0 || exitStatus != QProcess::NormalExit) {
+        QDir(tmpDir).removeRecursively();
+        //% "Failed to create PostgreSQL database dump of %1."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_PGDUMP").arg(dbName()));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    QDir(m_dumpDir).removeRecursively();
+    if (!QDir().rename(tmpDir, m_dumpDir)) {
+        //% "Failed to move PostgreSQL database dump %1 into place."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_MOVE_PGDUMP").arg(tmpDir));
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    qint64 size = 0;
+    QDirIterator it(m_dumpDir, QDir::Files);
+    while (it.hasNext()) {
+        it.next();
+        size += it.fileInfo().size();
+    }
+
+    const qint64 timeUsed = getStepTimeUsed();
+    m_currentStats.timeUsed += timeUsed;
+    // without a chunk store the tables are compressed by pg_dump
+    if (isChunkDepot()) {
+        m_currentStats.uncompressedSize = size;
+    } else {
+        m_currentStats.compressedSize = size;
+    }
+    QLocale locale;
+    //% "Finished dump of PostgreSQL database %1 with %2 in %3 milliseconds."
+    logInfo(qtTrId("SIHHURI_INFO_FINISHED_DUMP_PGSQL").arg(dbName(), locale.formattedDataSize(size), locale.toString(timeUsed)));
+
+    if (isChunkDepot()) {
+        // in a chunk store the dump is verified by the content addresses of its chunks
+        replaceDumpDirSums(dbDirPath(), QFileInfo(m_dumpDir).fileName(), {});
+        storePgSqlChunks();
+        return;
+    }
+
+    hashPgSqlDump();
+}
+
+void DbBackup::hashPgSqlDump()
+{
+    setStepStartTime();
+    const QString dumpDir = m_dumpDir;
+    const QString dumpDirName = QFileInfo(m_dumpDir).fileName();
+
+    // reading big dumps would block the event loop of the daemon for minutes
+    struct Hashes {
+        QStringList sums;
+        QStringList failed;
+    };
+    auto hashes = std::make_shared<Hashes>();
+    QThread *thread = QThread::create([hashes, dumpDir, dumpDirName](){
+        // one sum per file of the dump directory, relative to the database directory
+        const QStringList files = QDir(dumpDir).entryList(QDir::Files, QDir::Name);
+        for (const QString &fileName : files) {
+            QFile file(dumpDir + QLatin1Char('/') + fileName);
+            QCryptographicHash hasher(QCryptographicHash::Sha256);
+            if (!file.open(QIODevice::ReadOnly) || !hasher.addData(&file)) {
+                hashes->failed << file.fileName();
+                continue;
+            }
+            hashes->sums << QString::fromLatin1(hasher.result().toHex()) + QLatin1Char(' ') + dumpDirName + QLatin1Char('/') + fileName;
         }
-        delete m_dumpFile;
-        m_dumpFile = nullptr;
+    });
+    connect(thread, &QThread::finished, this, [this, thread, hashes, dumpDirName](){
+        thread->deleteLater();
+        for (const QString &fileName : std::as_const(hashes->failed)) {
+            //% "Failed to open PostgreSQL database dump file %1, omitting SHA256 hash sum calculation."
+            logWarning(qtTrId("SIHHURI_WARN_FAILED_OPEN_PGSQL_DUMP_OMIT_HASH").arg(fileName));
+        }
+
         const qint64 timeUsed = getStepTimeUsed();
         m_currentStats.timeUsed += timeUsed;
-        m_currentStats.compressedSize = xzFi.size();
         QLocale locale;
-        //% "Finished compression of MySQL/MariaDB database dump %1 with %2 in %3 milliseconds."
-        logInfo(qtTrId("SIHHURI_INFO_FINISHED_COMPRESS_MYSQL").arg(dbName(), locale.formattedDataSize(xzFi.size()), locale.toString(timeUsed)));
+        //% "Calculated SHA256 hash sums of %1 files of %2 in %3 milliseconds."
+        logInfo(qtTrId("SIHHURI_INFO_FINISHED_SHASUM_PGDUMP").arg(locale.toString(hashes->sums.size()), dumpDirName, locale.toString(timeUsed)));
+
+        replaceDumpDirSums(dbDirPath(), dumpDirName, hashes->sums);
+
         addStatistic(m_currentStats);
+        emit backupDatabaseFinished(QPrivateSignal());
+    });
+    thread->start();
+}
+
+void DbBackup::storePgSqlChunks()
+{
+    const QString dumpDirName = QFileInfo(m_dumpDir).fileName();
+
+    //% "Starting to store PostgreSQL database dump %1 in the chunk store."
+    logInfo(qtTrId("SIHHURI_INFO_START_CHUNK_PGSQL").arg(dumpDirName));
+    setStepStartTime();
+
+    storeDirectoryChunks(m_dumpDir, QLatin1String("Databases/") + dumpDirName, [this](bool success, qint64 storedBytes){
+        if (success) {
+            if (!QDir(m_dumpDir).removeRecursively()) {
+                //% "Failed to remove uncompressed PostgreSQL database dump %1."
+                logWarning(qtTrId("SIHHURI_WARN_FAILED_REMOVE_PGSQL_DUMP").arg(m_dumpDir));
+            }
+            const qint64 timeUsed = getStepTimeUsed();
+            m_currentStats.timeUsed += timeUsed;
+            m_currentStats.compressedSize = storedBytes;
+            QLocale locale;
+            //% "Finished storing PostgreSQL database dump %1 with %2 of new chunks in %3 milliseconds."
+            logInfo(qtTrId("SIHHURI_INFO_FINISHED_CHUNK_PGSQL").arg(dbName(), locale.formattedDataSize(storedBytes), locale.toString(timeUsed)));
+            addStatistic(m_currentStats);
+        }
+        // on failure the plain dump is kept in the database directory
+        emit backupDatabaseFinished(QPrivateSignal());
+    });
+}
+
+void DbBackup::replaceDumpDirSums(const QString &sumsDir, const QString &dumpDirName, const QStringList &sums)
+{
+    // the files of a directory dump are not stable between runs, so the sums of the last dump are replaced;
+    // the name of a single file dump only removes its sums
+    QFile oldSums(sumsDir + QLatin1String("/sha256sums.txt"));
+    QStringList lines;
+    if (oldSums.open(QIODevice::ReadOnly|QIODevice::Text)) {
+        const QString prefix = dumpDirName + QLatin1Char('/');
+        while (!oldSums.atEnd()) {
+            const QString line = QString::fromUtf8(oldSums.readLine()).trimmed();
+            const QString name = line.mid(65);
+            if (!line.isEmpty() && name != dumpDirName && !name.startsWith(prefix)) {
+                lines << line;
+            }
+        }
+        oldSums.close();
+    }
+    lines << sums;
+
+    QSaveFile hashValuesFile(oldSums.fileName());
+    if (hashValuesFile.open(QIODevice::WriteOnly|QIODevice::Text)) {
+        hashValuesFile.write(lines.join(QLatin1Char('\n')).toUtf8() + '\n');
+    }
+    if (!hashValuesFile.commit()) {
+        //% "Failed to open %1 for writing SHA256 hash values."
+        logWarning(qtTrId("SIHHURI_WARN_FAILED_OPEN_SHA256SUMS_FILE").arg(hashValuesFile.fileName()));
+    }
+}
+
+void DbBackup::onDatabaseDumpFinished(const DumpPipeline &pipeline, bool success, Compressor::Codec codec, const QString &outputFile)
+{
+    const QString standardError = pipeline.standardError().trimmed();
+    if (!standardError.isEmpty()) {
+        logCritical(QStringLiteral("mysqldump: %1").arg(standardError));
+    }
+
+    if (!success) {
+        //% "Failed to create MySQL/MariaDB database dump of %1."
+        logError(qtTrId("SIHHURI_CRIT_FAILED_DBDUMP").arg(dbName()));
+        logCritical(pipeline.errorString());
+        emit backupDatabaseFailed(QPrivateSignal());
+        return;
+    }
+
+    const DumpPipeline::Result result = pipeline.result();
+    m_currentStats.timeUsed += result.timeUsed;
+    m_currentStats.uncompressedSize = result.uncompressedSize;
+    const QString sha256sum = QString::fromLatin1(result.sha256.toHex());
+
+    QLocale locale;
+    //% "Finished dump of MySQL/MariaDB database %1 with %2 in %3 milliseconds."
+    logInfo(qtTrId("SIHHURI_INFO_FINISHED_DUMP_MYSQL").arg(dbName(), locale.formattedDataSize(result.uncompressedSize), locale.toString(result.timeUsed)));
+    //% "SHA256 hash sum of %1: %2"
+    logInfo(qtTrId("SIHHURI_INFO_SHASUM_MYSQLDUMP").arg(m_dumpFileName, sha256sum));
+
+    // the sum is calculated from the plain dump, what the verification expects for every compression;
+    // in a chunk store the dump is verified by the content addresses of its chunks
+    QFile hashValuesFile(dbDirPath() + QLatin1String("/sha256sums.txt"));
+    if (isChunkDepot()) {
+        replaceDumpDirSums(dbDirPath(), m_dumpFileName, {});
+    } else if (hashValuesFile.open(QIODevice::WriteOnly|QIODevice::Text|QIODevice::Append)) {
+
+        QTextStream out(&hashValuesFile);
+        out << sha256sum << " " << m_dumpFileName << '\n';
+        out.flush();
+
+        hashValuesFile.close();
     } else {
-        //% "Failed to compress MySQL/MariaDB database dump %1."
-        logWarning(qtTrId("SIHHURI_CRIT_FAILED_FAILED_COMPRESS_MYSQL").arg(dbName()));
+        //% "Failed to open %1 for writing SHA256 hash values."
+        logWarning(qtTrId("SIHHURI_WARN_FAILED_OPEN_SHA256SUMS_FILE").arg(hashValuesFile.fileName()));
     }
+
+    // dumps of earlier runs with another compression would be found first by the verification
+    for (const Compressor::Codec other : {Compressor::None, Compressor::Xz, Compressor::Zstd}) {
+        if (other != codec) {
+            QFile::remove(dbDirPath() + QLatin1Char('/') + m_dumpFileName + Compressor::fileExtension(other));
+        }
+    }
+    // as well as the parts of a parallel dump
+    const QString dumpDirName = QLatin1String("mysql_") + dbName();
+    if (QDir dumpDir(dbDirPath() + QLatin1Char('/') + dumpDirName); dumpDir.exists()) {
+        dumpDir.removeRecursively();
+        replaceDumpDirSums(dbDirPath(), dumpDirName, {});
+    }
+
+    if (isChunkDepot()) {
+        storeDatabaseChunks(outputFile);
+        return;
+    }
+
+    m_currentStats.compressedSize = result.fileSize;
+    m_currentStats.compressionTime = result.compressionTime;
+    //% "Finished compression of MySQL/MariaDB database dump %1 with %2 in %3 milliseconds."
+    logInfo(qtTrId("SIHHURI_INFO_FINISHED_COMPRESS_MYSQL").arg(dbName(), locale.formattedDataSize(result.fileSize), locale.toString(result.compressionTime)));
+    addStatistic(m_currentStats);
     emit backupDatabaseFinished(QPrivateSignal());
 }
 
+void DbBackup::storeDatabaseChunks(const QString &dumpFile)
+{
+    const QFileInfo dumpFileFi(dumpFile);
+
+    //% "Starting to store MySQL/MariaDB database dump %1 in the chunk store."
+    logInfo(qtTrId("SIHHURI_INFO_START_CHUNK_MYSQL").arg(dumpFileFi.fileName()));
+    setStepStartTime();
+
+    storeFileChunks(dumpFile, QLatin1String("Databases/") + dumpFileFi.fileName(), [this, dumpFile](bool success, qint64 storedBytes){
+        if (success) {
+            if (!QFile::remove(dumpFile)) {
+                //% "Failed to remove uncompressed MySQL/MariaDB database dump file %1."
+                logWarning(qtTrId("SIHHURI_WARN_FAILED_REMOVE_UNCOMPRESSED_MYSQL_DUMP_FILE").arg(dumpFile));
+            }
+            const qint64 timeUsed = getStepTimeUsed();
+            m_currentStats.timeUsed += timeUsed;
+            m_currentStats.compressedSize = storedBytes;
+            QLocale locale;
+            //% "Finished storing MySQL/MariaDB database dump %1 with %2 of new chunks in %3 milliseconds."
+            logInfo(qtTrId("SIHHURI_INFO_FINISHED_CHUNK_MYSQL").arg(dbName(), locale.formattedDataSize(storedBytes), locale.toString(timeUsed)));
+            addStatistic(m_currentStats);
+        }
+        // on failure the plain dump is kept in the database directory
+        emit backupDatabaseFinished(QPrivateSignal());
+    });
+}
+
 void DbBackup::setDbType(DbBackup::Type type)
 {
     m_type = type;
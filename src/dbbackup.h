@@ -7,9 +7,14 @@
 #define DBBACKUP_H
 
 #include "abstractbackup.h"
+#include "dumppipeline.h"
+#include "mariabackupchain.h"
+#include "mysqlparalleldump.h"
 #include <QObject>
 #include <QProcess>
 #include <QTemporaryFile>
+#include <functional>
+#include <memory>
 
 class DbBackup : public AbstractBackup
 {
@@ -24,6 +29,7 @@ protected:
     enum Type : quint8 {
         MySQL,
         MariaDB,
+        MariaDBPhysical,
         PostgreSQL,
         SQLite,
         Invalid
@@ -61,29 +67,41 @@ signals:
     void backupDatabaseFailed(QPrivateSignal);
 
 private slots:
-    void onDatabaseDumpFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onCompressDatabaseFinished(int exitCode, QProcess::ExitStatus exitStatus);
     void onBackupDatabaseFinished();
 
 private:
     QTemporaryFile m_dbConfigFile;
-    qint64 m_fileSize = 0;
-    QString m_backupFileName;
+    QString m_dumpFileName;
     QString m_dbName;
     QString m_dbUser;
     QString m_dbPass;
     QString m_dbHost;
-    QString m_hashSum;
-    QFile* m_dumpFile = nullptr;
+    QString m_dumpDir;
+    QString m_mariaBackupPath;
+    QString m_mariaBackupTmpDir;
+    std::unique_ptr<MariaBackupChain> m_mariaBackupChain;
     int m_dbPort = 0;
     Type m_type = Invalid;
 
     [[nodiscard]] QString dbDirPath() const;
+    bool writeMySqlClientConfig(const QString &group);
     void backupMySql();
+    void backupMySqlParallel(Compressor::Codec codec, int level, int jobs);
+    void onMySqlParallelDumpFinished(const MySqlParallelDump &dump, bool success);
     void backupMariaDb();
+    void backupMariaDbPhysical();
+    [[nodiscard]] QStringList mariaBackupArgs(const QString &mode, const QString &targetDir) const;
+    void runMariaBackupStep(const QString &program, const QStringList &args, const std::function<void()> &onSuccess);
+    void onFullMariaBackupFinished();
+    void onIncrementalMariaBackupFinished(const QString &incDirName);
+    void hashMariaBackup(const QString &backupDir, bool incremental);
     void backupPgSql();
-    void hashDatabase();
-    void compressDatabase();
+    void onPgSqlDumpFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void hashPgSqlDump();
+    void storePgSqlChunks();
+    void replaceDumpDirSums(const QString &sumsDir, const QString &dumpDirName, const QStringList &sums);
+    void onDatabaseDumpFinished(const DumpPipeline &pipeline, bool success, Compressor::Codec codec, const QString &outputFile);
+    void storeDatabaseChunks(const QString &dumpFile);
 
     Q_DISABLE_COPY(DbBackup)
 };
@@ -0,0 +1,589 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "depotverifier.h"
+#include "chunksnapshot.h"
+#include "fileindex.h"
+#include "ioprio.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QUrl>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t readBufferSize = 1024 * 1024;
+const QLatin1String manifestDirName("/.sihhuri-manifest");
+const QLatin1String sumsFileName("/Databases/sha256sums.txt");
+const QLatin1String chunkStoreDirName("/.sihhuri-chunks");
+}
+
+class DepotVerifier::RateLimiter
+{
+public:
+    explicit RateLimiter(qint64 bytesPerSecond)
+        : m_rate(bytesPerSecond)
+    {
+    }
+
+    // every caller reserves its bytes on a shared time line and sleeps until its slot has been reached
+    void consume(qint64 bytes)
+    {
+        if (m_rate <= 0) {
+            return;
+        }
+        std::chrono::steady_clock::duration wait{};
+        {
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            const auto now = std::chrono::steady_clock::now();
+            // unused time is not saved up, so there are no bursts after idle phases
+            if (m_next < now) {
+                m_next = now;
+            }
+            m_next += std::chrono::nanoseconds(bytes * 1000000000 / m_rate);
+            wait = m_next - now;
+        }
+        std::this_thread::sleep_for(wait);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_next;
+    qint64 m_rate = 0;
+};
+
+struct DepotVerifier::Worker {
+    std::vector<char> buffer = std::vector<char>(readBufferSize);
+    std::vector<Issue> issues;
+    qint64 files = 0;
+    qint64 bytes = 0;
+    qint64 skippedFiles = 0;
+};
+
+DepotVerifier::DepotVerifier(const QString &depot, int threads)
+    : m_depot(depot),
+      m_threads(threads > 0 ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency())))
+{
+}
+
+DepotVerifier::~DepotVerifier() = default;
+
+bool DepotVerifier::collect(const QStringList &items)
+{
+    m_tasks.clear();
+    m_chunkStores.clear();
+    m_result = Result();
+    m_errorString.clear();
+
+    if (!QFileInfo(m_depot).isDir()) {
+        m_errorString = QStringLiteral("%1 does not exist").arg(m_depot);
+        return false;
+    }
+
+    auto matches = [&items](const QString &encodedId){
+        if (items.empty()) {
+            return true;
+        }
+        const QString id = QUrl::fromPercentEncoding(encodedId.toLatin1());
+        return std::any_of(items.cbegin(), items.cend(), [&id](const QString &item){
+            return id.compare(item, Qt::CaseInsensitive) == 0 || id.endsWith(QLatin1Char('(') + item + QLatin1Char(')'), Qt::CaseInsensitive);
+        });
+    };
+
+    const QDir manifests(m_depot + manifestDirName);
+    const QStringList manifestIds = manifests.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QString &encodedId : manifestIds) {
+        if (matches(encodedId)) {
+            collectManifests(m_depot, manifests.absoluteFilePath(encodedId));
+        }
+    }
+    if (items.empty()) {
+        collectSums(m_depot + sumsFileName);
+    }
+
+    // older generations mostly share their files with the latest one
+    const QDir generations(m_depot + QLatin1String("/generations"));
+    const QStringList generationIds = generations.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QString &encodedId : generationIds) {
+        if (!matches(encodedId)) {
+            continue;
+        }
+        const QString latest = QFileInfo(generations.absoluteFilePath(encodedId) + QLatin1String("/latest")).canonicalFilePath();
+        if (latest.isEmpty()) {
+            continue;
+        }
+        collectManifests(latest, latest + manifestDirName + QLatin1Char('/') + encodedId);
+        collectSums(latest + sumsFileName);
+    }
+
+    QStringList chunkStores = m_chunkStorePaths;
+    chunkStores.prepend(m_depot + chunkStoreDirName);
+    chunkStores.removeDuplicates();
+    for (const QString &chunkStore : std::as_const(chunkStores)) {
+        if (QFileInfo(chunkStore + QLatin1String("/index")).isDir() && !collectChunkStore(chunkStore, items.empty(), matches)) {
+            return false;
+        }
+    }
+
+    std::sort(m_tasks.begin(), m_tasks.end(), [](const Task &a, const Task &b){ return a.path < b.path; });
+    m_tasks.erase(std::unique(m_tasks.begin(), m_tasks.end(), [](const Task &a, const Task &b){ return a.path == b.path; }), m_tasks.end());
+
+    m_result.totalFiles = static_cast<qint64>(m_tasks.size());
+    for (const Task &task : m_tasks) {
+        m_result.totalBytes += std::max<qint64>(task.size, 0);
+    }
+
+    return true;
+}
+
+void DepotVerifier::collectManifests(const QString &root, const QString &manifestDir)
+{
+    const QDir dir(manifestDir);
+    const QStringList files = dir.entryList({QStringLiteral("*.idx")}, QDir::Files, QDir::Name);
+    for (const QString &fileName : files) {
+        FileIndex manifest;
+        if (!manifest.map(dir.absoluteFilePath(fileName))) {
+            continue;
+        }
+        const QString syncedDir = QUrl::fromPercentEncoding(fileName.chopped(4).toLatin1());
+        const std::string base = QFile::encodeName(root + syncedDir).toStdString();
+        const qint64 count = manifest.count();
+        for (qint64 i = 0; i < count; ++i) {
+            const FileIndex::Entry entry = manifest.entryAt(i);
+            if (!entry.hasHash || !S_ISREG(entry.mode)) {
+                continue;
+            }
+            Task task;
+            task.path = base + '/' + entry.path;
+            task.size = static_cast<qint64>(entry.size);
+            task.mtimeSec = entry.mtimeSec;
+            task.mtimeNsec = entry.mtimeNsec;
+            task.hasMetadata = true;
+            task.hash = entry.hash;
+            m_tasks.push_back(std::move(task));
+        }
+    }
+}
+
+void DepotVerifier::collectSums(const QString &sumsFile)
+{
+    QFile f(sumsFile);
+    if (!f.open(QIODevice::ReadOnly|QIODevice::Text)) {
+        return;
+    }
+
+    // the file is appended on every run, only the last sum of a dump is the current one
+    QHash<QString,QByteArray> sums;
+    while (!f.atEnd()) {
+        const QString line = QString::fromUtf8(f.readLine()).trimmed();
+        const qsizetype space = line.indexOf(QLatin1Char(' '));
+        if (space != 64) {
+            continue;
+        }
+        QString name = line.mid(space + 1).trimmed();
+        if (name.startsWith(QLatin1Char('*'))) {
+            name.remove(0, 1);
+        }
+        const QByteArray hash = QByteArray::fromHex(line.left(space).toLatin1());
+        if (!name.isEmpty() && hash.size() == 32) {
+            sums.insert(name, hash);
+        }
+    }
+
+    const QString dir = QFileInfo(sumsFile).absolutePath();
+    for (auto it = sums.cbegin(); it != sums.cend(); ++it) {
+        Task task;
+        QFileInfo fi(dir + QLatin1Char('/') + it.key());
+        if (!fi.exists()) {
+            // the sums are calculated from the plain dumps
+            const QFileInfo xzFi(fi.filePath() + QLatin1String(".xz"));
+            const QFileInfo zstdFi(fi.filePath() + QLatin1String(".zst"));
+            if (xzFi.exists()) {
+                fi = xzFi;
+                task.decompressor = "xz";
+            } else if (zstdFi.exists()) {
+                fi = zstdFi;
+                task.decompressor = "zstd";
+            }
+        }
+        task.path = QFile::encodeName(fi.filePath()).toStdString();
+        task.size = fi.exists() ? fi.size() : -1;
+        std::copy_n(it.value().constData(), task.hash.size(), task.hash.begin());
+        m_tasks.push_back(std::move(task));
+    }
+}
+
+bool DepotVerifier::collectChunkStore(const QString &path, bool packs, const std::function<bool(const QString &)> &matches)
+{
+    auto store = std::make_unique<ChunkStore>(path);
+
+    // snapshots are saved after the commit of their chunks, so the index mapped afterwards contains all of them
+    const QDir snapshots(path + QLatin1String("/snapshots"));
+    const QStringList snapshotIds = snapshots.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QString &encodedId : snapshotIds) {
+        if (!matches(encodedId)) {
+            continue;
+        }
+        const QDir dir(snapshots.absoluteFilePath(encodedId));
+        const QFileInfoList files = dir.entryInfoList({QStringLiteral("*.snap")}, QDir::Files, QDir::Name);
+        for (const QFileInfo &fi : files) {
+            Task task;
+            task.path = QFile::encodeName(fi.absoluteFilePath()).toStdString();
+            task.size = fi.size();
+            task.store = store.get();
+            m_tasks.push_back(std::move(task));
+        }
+    }
+
+    if (!store->openReadOnly()) {
+        m_errorString = store->errorString();
+        return false;
+    }
+
+    // the packs are shared by all items
+    if (packs) {
+        const std::vector<ChunkStore::Chunk> chunks = store->chunks();
+        for (auto it = chunks.cbegin(); it != chunks.cend();) {
+            Task task;
+            const quint32 pack = it->pack;
+            task.path = QFile::encodeName(store->packPath(pack)).toStdString();
+            task.size = 0;
+            for (; it != chunks.cend() && it->pack == pack; ++it) {
+                task.chunks.push_back(*it);
+                task.size += it->length;
+            }
+            m_tasks.push_back(std::move(task));
+        }
+    }
+
+    m_chunkStores.push_back(std::move(store));
+    return true;
+}
+
+void DepotVerifier::addChunkStore(const QString &path)
+{
+    m_chunkStorePaths.append(path);
+}
+
+void DepotVerifier::setRateLimit(qint64 bytesPerSecond)
+{
+    m_rateLimit = std::max<qint64>(bytesPerSecond, 0);
+}
+
+void DepotVerifier::setParts(int parts)
+{
+    m_parts = std::max(parts, 1);
+}
+
+void DepotVerifier::setStateFile(const QString &filePath)
+{
+    m_stateFile = filePath;
+}
+
+bool DepotVerifier::run()
+{
+    const auto start = std::chrono::steady_clock::now();
+    m_issues.clear();
+    m_result.files = 0;
+    m_result.bytes = 0;
+    m_result.skippedFiles = 0;
+    m_result.issues = 0;
+    m_result.passCompleted = false;
+    m_errorString.clear();
+
+    if (m_tasks.empty()) {
+        m_result.passCompleted = true;
+        return true;
+    }
+
+    // continue behind the file verified last, the paths stay valid if the depot has changed in between
+    std::size_t first = 0;
+    const bool usesParts = m_parts > 1 && !m_stateFile.isEmpty();
+    if (usesParts) {
+        QFile state(m_stateFile);
+        if (state.open(QIODevice::ReadOnly)) {
+            const std::string last = state.readAll().toStdString();
+            const auto it = std::upper_bound(m_tasks.cbegin(), m_tasks.cend(), last, [](const std::string &path, const Task &task){ return path < task.path; });
+            first = it == m_tasks.cend() ? 0 : static_cast<std::size_t>(std::distance(m_tasks.cbegin(), it));
+        }
+    }
+
+    const qint64 budget = usesParts ? (m_result.totalBytes + m_parts - 1) / m_parts : m_result.totalBytes;
+    std::vector<const Task *> selected;
+    qint64 selectedBytes = 0;
+    for (std::size_t n = 0; n < m_tasks.size(); ++n) {
+        const std::size_t idx = (first + n) % m_tasks.size();
+        selected.push_back(&m_tasks[idx]);
+        selectedBytes += std::max<qint64>(m_tasks[idx].size, 0);
+        if (idx == m_tasks.size() - 1) {
+            m_result.passCompleted = true;
+        }
+        if (usesParts && selectedBytes >= budget) {
+            break;
+        }
+    }
+
+    IoPriority::setIdle();
+
+    RateLimiter limiter(m_rateLimit);
+    const auto count = std::min<std::size_t>(static_cast<std::size_t>(m_threads), selected.size());
+    std::vector<Worker> workers(count);
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (std::size_t index = 0; index < count; ++index) {
+        threads.emplace_back([this, index, &workers, &selected, &next, &limiter](){
+            IoPriority::setIdle();
+            Worker &worker = workers[index];
+            for (std::size_t idx = next.fetch_add(1); idx < selected.size(); idx = next.fetch_add(1)) {
+                verify(worker, *selected[idx], limiter);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (Worker &worker : workers) {
+        m_result.files += worker.files;
+        m_result.bytes += worker.bytes;
+        m_result.skippedFiles += worker.skippedFiles;
+        std::move(worker.issues.begin(), worker.issues.end(), std::back_inserter(m_issues));
+    }
+    std::sort(m_issues.begin(), m_issues.end(), [](const Issue &a, const Issue &b){ return a.path < b.path; });
+    m_result.issues = static_cast<qint64>(m_issues.size());
+    m_result.timeUsed = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    if (usesParts) {
+        QSaveFile state(m_stateFile);
+        if (!QDir().mkpath(QFileInfo(m_stateFile).absolutePath()) || !state.open(QIODevice::WriteOnly)) {
+            m_errorString = state.errorString();
+            return false;
+        }
+        const std::string &last = selected.back()->path;
+        state.write(last.data(), static_cast<qint64>(last.size()));
+        if (!state.commit()) {
+            m_errorString = state.errorString();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DepotVerifier::verify(Worker &worker, const Task &task, RateLimiter &limiter)
+{
+    if (!task.chunks.empty()) {
+        verifyPack(worker, task, limiter);
+        return;
+    }
+    if (task.store) {
+        verifySnapshot(worker, task, limiter);
+        return;
+    }
+
+    auto addIssue = [&worker, &task](Problem problem){
+        worker.issues.push_back({QFile::decodeName(QByteArray::fromStdString(task.path)), problem});
+    };
+
+    const int fd = ::open(task.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        addIssue(errno == ENOENT ? Missing : ReadError);
+        return;
+    }
+
+    if (task.hasMetadata) {
+        struct statx st{};
+        if (statx(fd, "", AT_EMPTY_PATH, STATX_SIZE | STATX_MTIME, &st) != 0) {
+            ::close(fd);
+            addIssue(ReadError);
+            return;
+        }
+        // replaced by a later sync, the manifest of that sync has not been written yet
+        if (st.stx_mtime.tv_sec != task.mtimeSec || st.stx_mtime.tv_nsec != task.mtimeNsec) {
+            ::close(fd);
+            worker.skippedFiles++;
+            return;
+        }
+        if (static_cast<qint64>(st.stx_size) != task.size) {
+            ::close(fd);
+            addIssue(static_cast<qint64>(st.stx_size) < task.size ? Truncated : Corrupted);
+            return;
+        }
+    }
+
+    int input = fd;
+    pid_t pid = -1;
+    if (task.decompressor) {
+        // the decompressor reads the dump from the already opened file and writes the plain dump into the pipe
+        int pipeFds[2] = {-1, -1};
+        if (::pipe2(pipeFds, O_CLOEXEC) != 0) {
+            ::close(fd);
+            addIssue(ReadError);
+            return;
+        }
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fd, STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, pipeFds[1], STDOUT_FILENO);
+        std::array<char *, 3> argv = {const_cast<char *>(task.decompressor), const_cast<char *>("-dc"), nullptr}; // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        const int rc = posix_spawnp(&pid, task.decompressor, &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(pipeFds[1]);
+        ::close(fd);
+        if (rc != 0) {
+            ::close(pipeFds[0]);
+            addIssue(ReadError);
+            return;
+        }
+        input = pipeFds[0];
+    } else {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    qint64 bytes = 0;
+    bool readError = false;
+    for (;;) {
+        const ssize_t n = ::read(input, worker.buffer.data(), worker.buffer.size());
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            readError = true;
+            break;
+        }
+        limiter.consume(n);
+        hash.addData(QByteArrayView(worker.buffer.data(), n));
+        bytes += n;
+    }
+    ::close(input);
+
+    // xz and zstd check their own checksums, a failed decompression is a corrupted dump
+    bool decompressError = false;
+    if (pid > 0) {
+        int status = 0;
+        while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        decompressError = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+
+    worker.files++;
+    worker.bytes += bytes;
+    const QByteArray result = hash.result();
+
+    if (readError) {
+        addIssue(ReadError);
+    } else if (task.hasMetadata && bytes < task.size) {
+        addIssue(Truncated);
+    } else if (decompressError || QByteArrayView(reinterpret_cast<const char *>(task.hash.data()), static_cast<qsizetype>(task.hash.size())) != result) { // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        addIssue(Corrupted);
+    }
+}
+
+void DepotVerifier::verifyPack(Worker &worker, const Task &task, RateLimiter &limiter)
+{
+    const QString packPath = QFile::decodeName(QByteArray::fromStdString(task.path));
+    const int fd = ::open(task.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        worker.issues.push_back({packPath, errno == ENOENT ? Missing : ReadError});
+        return;
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // the chunks are sorted by offset, the unreferenced chunks of interrupted runs are skipped
+    std::vector<char> data;
+    for (const ChunkStore::Chunk &chunk : task.chunks) {
+        data.resize(chunk.length);
+        std::size_t got = 0;
+        bool readError = false;
+        while (got < data.size()) {
+            const ssize_t n = ::pread(fd, data.data() + got, data.size() - got, static_cast<off_t>(chunk.offset + got));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                readError = n < 0;
+                break;
+            }
+            got += static_cast<std::size_t>(n);
+        }
+        limiter.consume(static_cast<qint64>(got));
+        worker.bytes += static_cast<qint64>(got);
+
+        if (readError) {
+            worker.issues.push_back({packPath, ReadError});
+            break;
+        }
+        // all following chunks are behind the end of the pack as well
+        if (got < data.size()) {
+            worker.issues.push_back({packPath, Truncated});
+            break;
+        }
+        const QByteArray actual = QCryptographicHash::hash(QByteArrayView(data.data(), static_cast<qsizetype>(data.size())), QCryptographicHash::Sha256);
+        if (QByteArrayView(reinterpret_cast<const char *>(chunk.hash.data()), static_cast<qsizetype>(chunk.hash.size())) != actual) { // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+            const QByteArray hex = QByteArray(reinterpret_cast<const char *>(chunk.hash.data()), static_cast<qsizetype>(chunk.hash.size())).toHex(); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+            worker.issues.push_back({packPath + QLatin1String(" chunk ") + QString::fromLatin1(hex), Corrupted});
+        }
+    }
+    ::close(fd);
+
+    worker.files++;
+}
+
+void DepotVerifier::verifySnapshot(Worker &worker, const Task &task, RateLimiter &limiter)
+{
+    const QString snapshotPath = QFile::decodeName(QByteArray::fromStdString(task.path));
+    // removed by the retention of a later run
+    if (!QFileInfo::exists(snapshotPath)) {
+        worker.skippedFiles++;
+        return;
+    }
+
+    ChunkSnapshot snapshot;
+    if (!snapshot.map(snapshotPath)) {
+        worker.issues.push_back({snapshotPath, Corrupted});
+        return;
+    }
+    limiter.consume(task.size);
+    worker.files++;
+    worker.bytes += task.size;
+
+    const std::vector<std::string> missing = snapshot.missingChunks(*task.store);
+    for (const std::string &path : missing) {
+        worker.issues.push_back({snapshotPath + QLatin1String(": ") + QFile::decodeName(QByteArray::fromStdString(path)), Missing});
+    }
+}
+
+std::vector<DepotVerifier::Issue> DepotVerifier::issues() const
+{
+    return m_issues;
+}
+
+DepotVerifier::Result DepotVerifier::result() const
+{
+    return m_result;
+}
+
+QString DepotVerifier::errorString() const
+{
+    return m_errorString;
+}
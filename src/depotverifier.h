@@ -0,0 +1,165 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef DEPOTVERIFIER_H
+#define DEPOTVERIFIER_H
+
+#include "chunkstore.h"
+#include <QString>
+#include <QStringList>
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Re-reads the files of a depot and compares them against their stored hashes.
+ *
+ * The files are taken from the content manifests of the directories, see FileIndex, and
+ * from the \c sha256sums.txt files of the database dumps. Both are searched directly in
+ * the depot and in the \c latest generation of every item. A dump that has only been
+ * stored compressed is decompressed with \c xz or \c zstd, because the sums are calculated
+ * from the plain dumps.
+ *
+ * A manifest entry whose modification time has changed has been replaced by a later sync
+ * and is skipped. A file with an unchanged modification time but another size has been
+ * truncated, one with the same size but another hash has been corrupted on the storage.
+ *
+ * Chunk stores of the deduplicating depot format are verified by re-reading every chunk
+ * of the index from its pack and comparing it against its hash, the content address. The
+ * snapshots are checked for references to chunks that are not in the index. Database
+ * dumps in a chunk store are not listed in the \c sha256sums.txt files, their chunks are
+ * verified with the packs.
+ *
+ * The files are read by multiple threads with idle I/O priority, all threads together
+ * are limited to the rate set with setRateLimit(). With setParts() every run only
+ * verifies a part of the depot by size, the state file remembers the last verified
+ * file, so that the next run continues behind it. After \a parts runs the complete
+ * depot has been verified once.
+ */
+class DepotVerifier
+{
+public:
+    enum Problem : quint8 {
+        Missing,
+        Truncated,
+        Corrupted,
+        ReadError
+    };
+
+    struct Issue {
+        QString path;
+        Problem problem = Corrupted;
+    };
+
+    struct Result {
+        // all files known to the manifests and sums files
+        qint64 totalFiles = 0;
+        qint64 totalBytes = 0;
+        // files verified by this run
+        qint64 files = 0;
+        qint64 bytes = 0;
+        qint64 skippedFiles = 0;
+        qint64 issues = 0;
+        qint64 timeUsed = 0;
+        // true if this run verified the last file of the depot
+        bool passCompleted = false;
+    };
+
+    /*!
+     * \brief Constructs a new verifier for \a depot, \a threads <= 0 uses the number of CPU cores.
+     */
+    explicit DepotVerifier(const QString &depot, int threads = 0);
+    ~DepotVerifier();
+
+    /*!
+     * \brief Collects the files of the items in \a items, all items if \a items is empty.
+     *
+     * Items are given by their id like <tt>Directory(www)</tt> or only by their name. The
+     * database dumps directly in the depot are shared by all items and are only collected
+     * if \a items is empty. Returns \c false if the depot can not be read.
+     */
+    bool collect(const QStringList &items = QStringList());
+
+    /*!
+     * \brief Also verifies the chunk store at \a path in the next collect().
+     *
+     * The chunk store at <tt>.sihhuri-chunks</tt> in the depot is always verified if it exists.
+     * The packs are shared by all items and are only verified if collect() gets no items.
+     */
+    void addChunkStore(const QString &path);
+
+    /*!
+     * \brief Limits the read rate of all threads together to \a bytesPerSecond, \c 0 disables the limit.
+     */
+    void setRateLimit(qint64 bytesPerSecond);
+
+    /*!
+     * \brief Only verifies about 1/\a parts of the collected bytes per run().
+     */
+    void setParts(int parts);
+
+    /*!
+     * \brief Sets the file that stores the position for the next run if parts are used.
+     */
+    void setStateFile(const QString &filePath);
+
+    /*!
+     * \brief Verifies the next part of the collected files and blocks until it has been finished.
+     *
+     * Returns \c false if the state file can not be written.
+     */
+    bool run();
+
+    /*!
+     * \brief Returns the issues found by run(), sorted by path.
+     */
+    [[nodiscard]] std::vector<Issue> issues() const;
+    [[nodiscard]] Result result() const;
+    [[nodiscard]] QString errorString() const;
+
+private:
+    struct Task {
+        std::string path;
+        qint64 size = -1;
+        qint64 mtimeSec = 0;
+        quint32 mtimeNsec = 0;
+        // sums of database dumps have no metadata and can be compressed
+        bool hasMetadata = false;
+        // xz or zstd if the dump has been compressed
+        const char *decompressor = nullptr;
+        std::array<quint8,32> hash{};
+        // the indexed chunks if the file is a pack of a chunk store
+        std::vector<ChunkStore::Chunk> chunks;
+        // the store of the chunks if the file is a snapshot of a chunk store
+        const ChunkStore *store = nullptr;
+    };
+    struct Worker;
+    class RateLimiter;
+
+    void collectManifests(const QString &root, const QString &manifestDir);
+    void collectSums(const QString &sumsFile);
+    bool collectChunkStore(const QString &path, bool packs, const std::function<bool(const QString &)> &matches);
+    void verify(Worker &worker, const Task &task, RateLimiter &limiter);
+    static void verifyPack(Worker &worker, const Task &task, RateLimiter &limiter);
+    static void verifySnapshot(Worker &worker, const Task &task, RateLimiter &limiter);
+
+    QString m_depot;
+    QString m_stateFile;
+    QString m_errorString;
+    QStringList m_chunkStorePaths;
+    std::vector<std::unique_ptr<ChunkStore>> m_chunkStores;
+    std::vector<Task> m_tasks;
+    std::vector<Issue> m_issues;
+    Result m_result;
+    qint64 m_rateLimit = 0;
+    int m_parts = 1;
+    int m_threads = 1;
+
+    Q_DISABLE_COPY(DepotVerifier)
+};
+
+#endif // DEPOTVERIFIER_H
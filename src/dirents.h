@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef DIRENTS_H
+#define DIRENTS_H
+
+#include <vector>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace Dirents {
+
+// layout of the records returned by getdents64, glibc does not export it
+struct LinuxDirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+constexpr std::size_t defaultBufferSize = 64 * 1024;
+
+/*!
+ * \brief Reads all entries of the directory \a fd with raw getdents64() calls.
+ *
+ * \a buffer is reused for all calls and should be kept by the caller across directories.
+ * \a func is called with the entry name and the d_type for every entry except "." and "..".
+ * Returns \c false if reading the directory failed.
+ */
+template<typename Func>
+bool forEach(int fd, std::vector<char> &buffer, Func &&func)
+{
+    if (buffer.size() < defaultBufferSize) {
+        buffer.resize(defaultBufferSize);
+    }
+
+    for (;;) {
+        const long n = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (n == 0) {
+            return true;
+        }
+        if (n < 0) {
+            return false;
+        }
+
+        for (long offset = 0; offset < n;) {
+            const auto *entry = reinterpret_cast<const LinuxDirent64 *>(buffer.data() + offset); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            func(name, entry->d_type);
+        }
+    }
+}
+
+}
+
+#endif // DIRENTS_H
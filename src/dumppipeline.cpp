@@ -0,0 +1,315 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "dumppipeline.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <csignal>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t pipeBufferSize = 1024 * 1024;
+// only the end of a long error output is interesting
+constexpr qsizetype maxStandardError = 64 * 1024;
+
+QString errorMessage(int errorNumber)
+{
+    return QString::fromStdString(std::generic_category().message(errorNumber));
+}
+
+void closeFd(int &fd)
+{
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// returns 0 or the error number, the parent ends of the pipes are closed in the child by O_CLOEXEC
+int spawn(pid_t *pid, std::vector<std::string> &args, int out, int err)
+{
+    std::vector<char *> argv;
+    argv.reserve(args.size() + 1);
+    for (std::string &arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+
+    // the dump has to end by SIGPIPE if this thread stops reading, even if the parent ignores or blocks it
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &pipeSignal);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    const int rc = posix_spawnp(pid, argv.front(), &actions, &attr, argv.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return rc;
+}
+
+// returns the exit code, or -1 if the program has been killed by a signal
+int waitFor(pid_t pid)
+{
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+}
+
+DumpPipeline::DumpPipeline(const QString &program, const QStringList &arguments, const QString &outputFile)
+    : m_program(program),
+      m_arguments(arguments),
+      m_outputFile(outputFile)
+{
+}
+
+DumpPipeline::~DumpPipeline() = default;
+
+void DumpPipeline::setCompression(Compressor::Codec codec, int level, int threads)
+{
+    m_codec = codec;
+    m_level = level;
+    m_threads = std::max(threads, 0);
+}
+
+void DumpPipeline::setProgressMarkers(const QByteArrayList &markers, const std::function<void()> &callback)
+{
+    m_progressMarkers = markers;
+    m_progressCallback = callback;
+}
+
+void DumpPipeline::addStandardError(const char *data, qsizetype size)
+{
+    if (m_progressMarkers.empty()) {
+        m_standardError.append(data, size);
+    } else {
+        // a null data pointer ends the last line at the end of the output
+        m_errorLine.append(data, size);
+        qsizetype lineStart = 0;
+        for (;;) {
+            qsizetype lineEnd = m_errorLine.indexOf('\n', lineStart);
+            if (lineEnd < 0) {
+                if (data || lineStart >= m_errorLine.size()) {
+                    break;
+                }
+                lineEnd = m_errorLine.size() - 1;
+            }
+            const QByteArrayView line(m_errorLine.constData() + lineStart, lineEnd - lineStart + 1);
+            lineStart = lineEnd + 1;
+            if (!line.startsWith("-- ")) {
+                m_standardError.append(line);
+            } else if (m_progressCallback) {
+                for (const QByteArray &marker : std::as_const(m_progressMarkers)) {
+                    if (line.startsWith(marker)) {
+                        m_progressCallback();
+                        m_progressCallback = nullptr;
+                        break;
+                    }
+                }
+            }
+        }
+        m_errorLine.remove(0, lineStart);
+    }
+
+    if (m_standardError.size() > maxStandardError) {
+        m_standardError.remove(0, m_standardError.size() - maxStandardError);
+    }
+}
+
+bool DumpPipeline::run()
+{
+    const auto start = std::chrono::steady_clock::now();
+    m_result = Result();
+    m_errorString.clear();
+    m_standardError.clear();
+    m_errorLine.clear();
+
+    const std::string outPath = QFile::encodeName(m_outputFile).toStdString();
+    const std::string tmpPath = outPath + ".tmp";
+
+    std::vector<std::string> dumpArgs{QFile::encodeName(m_program).toStdString()};
+    for (const QString &arg : std::as_const(m_arguments)) {
+        dumpArgs.push_back(arg.toStdString());
+    }
+
+    std::array<int, 2> errPipe = {-1, -1};
+    std::array<int, 2> dumpPipe = {-1, -1};
+    pid_t dumpPid = -1;
+    int outFd = -1;
+
+    auto cleanup = [&](){
+        closeFd(errPipe[0]);
+        closeFd(errPipe[1]);
+        closeFd(dumpPipe[0]);
+        closeFd(dumpPipe[1]);
+        closeFd(outFd);
+    };
+
+    auto fail = [&](const QString &error){
+        m_errorString = error;
+        cleanup();
+        if (dumpPid > 0) {
+            waitFor(dumpPid);
+        }
+        ::unlink(tmpPath.c_str());
+        return false;
+    };
+
+    outFd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (outFd < 0) {
+        return fail(QStringLiteral("Failed to open %1: %2").arg(QFile::decodeName(tmpPath.c_str()), errorMessage(errno)));
+    }
+
+    QString compressorError;
+    std::unique_ptr<Compressor> compressor = Compressor::create(m_codec, m_level, m_threads, outFd, &compressorError);
+    if (!compressor) {
+        return fail(compressorError);
+    }
+
+    if (::pipe2(errPipe.data(), O_CLOEXEC) != 0 || ::pipe2(dumpPipe.data(), O_CLOEXEC) != 0) {
+        return fail(QStringLiteral("Failed to create pipe: %1").arg(errorMessage(errno)));
+    }
+    // a bigger pipe means less context switches between the dump program and this thread
+    ::fcntl(dumpPipe[0], F_SETPIPE_SZ, static_cast<int>(pipeBufferSize));
+
+    if (const int rc = spawn(&dumpPid, dumpArgs, dumpPipe[1], errPipe[1]); rc != 0) {
+        dumpPid = -1;
+        return fail(QStringLiteral("Failed to start %1: %2").arg(m_program, errorMessage(rc)));
+    }
+    closeFd(dumpPipe[1]);
+    closeFd(errPipe[1]);
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    std::vector<char> buf(pipeBufferSize);
+    std::array<char, 4096> errBuf{};
+    bool compressError = false;
+    int readError = 0;
+    std::chrono::steady_clock::duration compressionTime{};
+
+    while (dumpPipe[0] >= 0 || errPipe[0] >= 0) {
+        std::array<struct pollfd, 2> fds = {{{dumpPipe[0], POLLIN, 0}, {errPipe[0], POLLIN, 0}}};
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            readError = errno;
+            break;
+        }
+
+        if (fds[1].revents != 0) {
+            const ssize_t n = ::read(errPipe[0], errBuf.data(), errBuf.size());
+            if (n > 0) {
+                addStandardError(errBuf.data(), n);
+            } else if (n == 0 || errno != EINTR) {
+                addStandardError(nullptr, 0);
+                closeFd(errPipe[0]);
+            }
+        }
+
+        if (fds[0].revents != 0) {
+            const ssize_t n = ::read(dumpPipe[0], buf.data(), buf.size());
+            if (n > 0) {
+                hash.addData(QByteArrayView(buf.data(), n));
+                m_result.uncompressedSize += n;
+                const auto compressStart = std::chrono::steady_clock::now();
+                compressError = !compressor->write(buf.data(), static_cast<std::size_t>(n));
+                compressionTime += std::chrono::steady_clock::now() - compressStart;
+                if (compressError) {
+                    // the dump gets SIGPIPE on its next write
+                    closeFd(dumpPipe[0]);
+                }
+            } else if (n == 0) {
+                closeFd(dumpPipe[0]);
+            } else if (errno != EINTR) {
+                readError = errno;
+                closeFd(dumpPipe[0]);
+            }
+        }
+    }
+
+    const int dumpExit = waitFor(dumpPid);
+    dumpPid = -1;
+
+    const QString writeError = QStringLiteral("Failed to write %1: %2");
+    if (compressError) {
+        return fail(writeError.arg(QFile::decodeName(tmpPath.c_str()), compressor->errorString()));
+    }
+    if (dumpExit != 0) {
+        return fail(QStringLiteral("%1 failed with exit code %2").arg(m_program, QString::number(dumpExit)));
+    }
+    if (readError != 0) {
+        return fail(QStringLiteral("Failed to read the output of %1: %2").arg(m_program, errorMessage(readError)));
+    }
+
+    const auto finishStart = std::chrono::steady_clock::now();
+    if (!compressor->finish()) {
+        return fail(writeError.arg(QFile::decodeName(tmpPath.c_str()), compressor->errorString()));
+    }
+    compressionTime += std::chrono::steady_clock::now() - finishStart;
+    compressor.reset();
+    if (::close(outFd) != 0) {
+        outFd = -1;
+        return fail(writeError.arg(QFile::decodeName(tmpPath.c_str()), errorMessage(errno)));
+    }
+    outFd = -1;
+
+    if (::rename(tmpPath.c_str(), outPath.c_str()) != 0) {
+        return fail(QStringLiteral("Failed to rename %1: %2").arg(QFile::decodeName(tmpPath.c_str()), errorMessage(errno)));
+    }
+
+    struct stat st{};
+    if (::stat(outPath.c_str(), &st) == 0) {
+        m_result.fileSize = static_cast<qint64>(st.st_size);
+    }
+    m_result.sha256 = hash.result();
+    m_result.timeUsed = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    m_result.compressionTime = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(compressionTime).count());
+
+    return true;
+}
+
+DumpPipeline::Result DumpPipeline::result() const
+{
+    return m_result;
+}
+
+QString DumpPipeline::errorString() const
+{
+    return m_errorString;
+}
+
+QString DumpPipeline::standardError() const
+{
+    return QString::fromUtf8(m_standardError);
+}
@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef DUMPPIPELINE_H
+#define DUMPPIPELINE_H
+
+#include "compressor.h"
+#include <QByteArray>
+#include <QByteArrayList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+/*!
+ * \brief Streams the output of a dump program through a hash into a compressor.
+ *
+ * The dump program is started with posix_spawnp() and writes into a pipe. Its output
+ * is read in blocks, added to a SHA-256 hash and compressed in-process by a Compressor
+ * that writes directly into the output file. The plain dump therefore never touches the
+ * disk and is read only once. The blocking pipe throttles the dump to the speed of the
+ * compressor without buffering in memory.
+ *
+ * The output is written to a temporary file next to \a outputFile that is renamed
+ * into place if the dump and the compressor succeeded and removed otherwise. Without
+ * compression the plain dump is written, for example for the chunk store.
+ */
+class DumpPipeline
+{
+public:
+    struct Result {
+        // size of the plain dump and its hash, what has been written to the file might be compressed
+        qint64 uncompressedSize = 0;
+        qint64 fileSize = 0;
+        QByteArray sha256;
+        qint64 timeUsed = 0;
+        // the part of timeUsed spent inside the compressor
+        qint64 compressionTime = 0;
+    };
+
+    DumpPipeline(const QString &program, const QStringList &arguments, const QString &outputFile);
+    ~DumpPipeline();
+
+    /*!
+     * \brief Sets the \a codec, its \a level and the number of compressor \a threads, \c 0 uses all cores.
+     */
+    void setCompression(Compressor::Codec codec, int level, int threads = 0);
+
+    /*!
+     * \brief Calls \a callback once when the dump program writes a progress line starting with one of \a markers.
+     *
+     * Progress lines start with <tt>-- </tt> like those written by <tt>mysqldump --verbose</tt>
+     * to the standard error. If markers are set, progress lines are not added to standardError().
+     * The \a callback is called from the thread executing run().
+     */
+    void setProgressMarkers(const QByteArrayList &markers, const std::function<void()> &callback);
+
+    /*!
+     * \brief Runs the pipeline and blocks until the dump has been written completely.
+     *
+     * Returns \c false if a program could not be started or failed, see errorString().
+     */
+    bool run();
+
+    [[nodiscard]] Result result() const;
+    [[nodiscard]] QString errorString() const;
+
+    /*!
+     * \brief Returns what the dump program wrote to its standard error.
+     */
+    [[nodiscard]] QString standardError() const;
+
+private:
+    void addStandardError(const char *data, qsizetype size);
+
+    QString m_program;
+    QStringList m_arguments;
+    QString m_outputFile;
+    QString m_errorString;
+    QByteArray m_standardError;
+    QByteArray m_errorLine;
+    QByteArrayList m_progressMarkers;
+    std::function<void()> m_progressCallback;
+    Result m_result;
+    Compressor::Codec m_codec = Compressor::Xz;
+    int m_level = 6;
+    int m_threads = 0;
+
+    Q_DISABLE_COPY(DumpPipeline)
+};
+
+#endif // DUMPPIPELINE_H
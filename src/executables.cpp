@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "executables.h"
+#include <QHash>
+#include <QStandardPaths>
+
+namespace {
+QHash<QString, QString> &executablesCache()
+{
+    static QHash<QString, QString> cache;
+    return cache;
+}
+}
+
+QString Executables::find(const QString &name, const QStringList &paths)
+{
+    const QString key = paths.empty() ? name : name + QLatin1Char('\n') + paths.join(QLatin1Char(':'));
+
+    auto &cache = executablesCache();
+    const auto it = cache.constFind(key);
+    if (it != cache.cend()) {
+        return it.value();
+    }
+
+    const QString path = QStandardPaths::findExecutable(name, paths);
+    if (!path.isEmpty()) {
+        cache.insert(key, path);
+    }
+
+    return path;
+}
+
+void Executables::clearCache()
+{
+    executablesCache().clear();
+}
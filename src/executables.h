@@ -0,0 +1,33 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef EXECUTABLES_H
+#define EXECUTABLES_H
+
+#include <QString>
+#include <QStringList>
+
+/*!
+ * \brief Caches the lookup of executables.
+ *
+ * Looking up executables in the search paths is done once per process, what is
+ * especially useful for the long running daemon mode. Call clearCache() after the
+ * environment might have changed, like on a configuration reload.
+ */
+class Executables
+{
+public:
+    /*!
+     * \brief Returns the absolute path of the executable \a name.
+     *
+     * If \a paths is empty, the system search paths will be used. Returns an empty
+     * string if the executable can not be found.
+     */
+    [[nodiscard]] static QString find(const QString &name, const QStringList &paths = QStringList());
+
+    static void clearCache();
+};
+
+#endif // EXECUTABLES_H
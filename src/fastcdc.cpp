@@ -0,0 +1,99 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "fastcdc.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace {
+using GearTable = std::array<quint64,256>;
+
+// splitmix64, the table has to be the same on every host and in every version
+constexpr GearTable makeGearTable(int shift)
+{
+    GearTable table{};
+    quint64 state = Q_UINT64_C(0x5369686875726921);
+    for (quint64 &value : table) {
+        state += Q_UINT64_C(0x9E3779B97F4A7C15);
+        quint64 z = state;
+        z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+        value = (z ^ (z >> 31)) << shift;
+    }
+    return table;
+}
+
+constexpr GearTable gear = makeGearTable(0);
+constexpr GearTable gearLs = makeGearTable(1);
+
+// the upper bits depend on the most bytes of the window, bit 63 is left out so that the mask can be shifted
+constexpr quint64 makeMask(int bits)
+{
+    return ((Q_UINT64_C(1) << bits) - 1) << (63 - bits);
+}
+}
+
+FastCdc::FastCdc(std::size_t minSize, std::size_t avgSize, std::size_t maxSize)
+    : m_minSize(minSize),
+      m_avgSize(avgSize),
+      m_maxSize(maxSize)
+{
+    const int bits = std::countr_zero(avgSize);
+    m_maskS = makeMask(bits + 2);
+    m_maskL = makeMask(bits - 2);
+}
+
+std::size_t FastCdc::cut(const quint8 *data, std::size_t length) const
+{
+    if (length <= m_minSize) {
+        return length;
+    }
+    const std::size_t end = std::min(length, m_maxSize);
+    const std::size_t normal = std::min(end, m_avgSize);
+    const quint64 maskSLs = m_maskS << 1;
+    const quint64 maskLLs = m_maskL << 1;
+
+    // (fp << 2) + (gear << 1) is the hash after the first byte shifted by one, checked with the shifted mask
+    quint64 fp = 0;
+    std::size_t i = m_minSize;
+    for (; i + 1 < normal; i += 2) {
+        fp = (fp << 2) + gearLs[data[i]];
+        if ((fp & maskSLs) == 0) {
+            return i + 1;
+        }
+        fp += gear[data[i + 1]];
+        if ((fp & m_maskS) == 0) {
+            return i + 2;
+        }
+    }
+    for (; i + 1 < end; i += 2) {
+        fp = (fp << 2) + gearLs[data[i]];
+        if ((fp & maskLLs) == 0) {
+            return i + 1;
+        }
+        fp += gear[data[i + 1]];
+        if ((fp & m_maskL) == 0) {
+            return i + 2;
+        }
+    }
+
+    return end;
+}
+
+std::size_t FastCdc::minSize() const
+{
+    return m_minSize;
+}
+
+std::size_t FastCdc::avgSize() const
+{
+    return m_avgSize;
+}
+
+std::size_t FastCdc::maxSize() const
+{
+    return m_maxSize;
+}
@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FASTCDC_H
+#define FASTCDC_H
+
+#include <QtGlobal>
+#include <cstddef>
+
+/*!
+ * \brief Content defined chunking with the FastCDC algorithm.
+ *
+ * Cut points are found with a Gear rolling hash, so they only depend on the content
+ * in front of them and inserting or removing bytes only changes the chunks around the
+ * modification. The first \a minSize bytes of a chunk are skipped, up to the normal
+ * size a mask with more bits than the average size is used and a mask with less bits
+ * above it, what narrows the distribution of the chunk sizes around \a avgSize. The
+ * hash is rolled by two bytes per iteration with a pre-shifted Gear table.
+ *
+ * The Gear table and the masks are fixed, changing them would change all cut points
+ * and disable the deduplication against existing chunks.
+ */
+class FastCdc
+{
+public:
+    static constexpr std::size_t defaultMinSize = 256 * 1024;
+    static constexpr std::size_t defaultAvgSize = 1024 * 1024;
+    static constexpr std::size_t defaultMaxSize = 4 * 1024 * 1024;
+
+    /*!
+     * \brief Creates a chunker, \a avgSize has to be a power of two.
+     */
+    explicit FastCdc(std::size_t minSize = defaultMinSize, std::size_t avgSize = defaultAvgSize, std::size_t maxSize = defaultMaxSize);
+
+    /*!
+     * \brief Returns the length of the next chunk at the start of \a data.
+     *
+     * \a length has to be at least maxSize() unless \a data contains the end of the input.
+     */
+    [[nodiscard]] std::size_t cut(const quint8 *data, std::size_t length) const;
+
+    [[nodiscard]] std::size_t minSize() const;
+    [[nodiscard]] std::size_t avgSize() const;
+    [[nodiscard]] std::size_t maxSize() const;
+
+private:
+    std::size_t m_minSize;
+    std::size_t m_avgSize;
+    std::size_t m_maxSize;
+    quint64 m_maskS;
+    quint64 m_maskL;
+};
+
+#endif // FASTCDC_H
@@ -0,0 +1,631 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "fileindex.h"
+#include "workstealingqueue.h"
+#include "dirents.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::array<char,8> indexMagic = {'S', 'I', 'H', 'I', 'D', 'X', '\0', '\0'};
+// version 1 stored the top level paths with a leading slash
+constexpr quint32 indexVersion = 2;
+constexpr quint32 recordHasHash = 0x1;
+constexpr std::size_t hashBufferSize = 1024 * 1024;
+
+int threadCount(int threads)
+{
+    return threads > 0 ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+}
+
+bool isDirMode(quint32 mode)
+{
+    return (mode & S_IFMT) == S_IFDIR;
+}
+
+bool isRegMode(quint32 mode)
+{
+    return (mode & S_IFMT) == S_IFREG;
+}
+
+std::string joinPath(const std::string &base, const std::string &rel)
+{
+    return rel.empty() ? base : base + '/' + rel;
+}
+
+const std::string &entryPath(const std::string &path)
+{
+    return path;
+}
+
+const std::string &entryPath(const FileIndex::Entry &entry)
+{
+    return entry.path;
+}
+}
+
+struct FileIndex::Header {
+    std::array<char,8> magic;
+    quint32 version;
+    quint32 recordSize;
+    quint64 count;
+    quint64 pathsSize;
+};
+
+struct FileIndex::Record {
+    quint64 pathOffset;
+    quint64 inode;
+    quint64 size;
+    qint64 mtimeSec;
+    qint64 ctimeSec;
+    quint32 mtimeNsec;
+    quint32 ctimeNsec;
+    quint32 pathLength;
+    quint32 mode;
+    quint32 flags;
+    quint32 reserved;
+    std::array<quint8,32> hash;
+};
+
+FileIndex::FileIndex() = default;
+
+FileIndex::~FileIndex()
+{
+    unmap();
+}
+
+bool FileIndex::map(const QString &filePath)
+{
+    unmap();
+
+    const QByteArray path = QFile::encodeName(filePath);
+    const int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        m_errorString = QString::fromLocal8Bit(std::strerror(errno));
+        return false;
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        m_errorString = QStringLiteral("Invalid index file");
+        return false;
+    }
+
+    void *data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        m_errorString = QString::fromLocal8Bit(std::strerror(errno));
+        return false;
+    }
+
+    m_mapped = static_cast<const char *>(data);
+    m_mappedSize = static_cast<std::size_t>(st.st_size);
+
+    Header header{};
+    std::memcpy(&header, m_mapped, sizeof(Header));
+    const quint64 expectedSize = sizeof(Header) + header.count * sizeof(Record) + header.pathsSize;
+    if (header.magic != indexMagic || header.version != indexVersion || header.recordSize != sizeof(Record) || expectedSize != m_mappedSize) {
+        unmap();
+        m_errorString = QStringLiteral("Invalid index file");
+        return false;
+    }
+
+    m_mappedCount = static_cast<qint64>(header.count);
+    // the records are mostly read in path order, single lookups with find() only touch a few pages
+    ::madvise(data, m_mappedSize, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+void FileIndex::unmap()
+{
+    if (m_mapped) {
+        ::munmap(const_cast<char *>(m_mapped), m_mappedSize); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        m_mapped = nullptr;
+        m_mappedSize = 0;
+        m_mappedCount = 0;
+    }
+}
+
+const FileIndex::Record *FileIndex::record(qint64 index) const
+{
+    return reinterpret_cast<const Record *>(m_mapped + sizeof(Header) + static_cast<std::size_t>(index) * sizeof(Record)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+std::string_view FileIndex::recordPath(const Record *record) const
+{
+    const char *paths = m_mapped + sizeof(Header) + static_cast<std::size_t>(m_mappedCount) * sizeof(Record);
+    return {paths + record->pathOffset, record->pathLength};
+}
+
+bool FileIndex::scan(const QString &root, int threads)
+{
+    m_root = QFile::encodeName(root).toStdString();
+    while (m_root.size() > 1 && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+    m_entries.clear();
+    m_scanError.clear();
+
+    struct statx st{};
+    if (statx(AT_FDCWD, m_root.c_str(), AT_NO_AUTOMOUNT, STATX_TYPE, &st) != 0) {
+        m_errorString = QString::fromLocal8Bit(std::strerror(errno));
+        return false;
+    }
+    if (!S_ISDIR(st.stx_mode)) {
+        m_errorString = QString::fromLocal8Bit(std::strerror(ENOTDIR));
+        return false;
+    }
+
+    const auto workers = static_cast<std::size_t>(threadCount(threads));
+    m_workerEntries.assign(workers, std::vector<Entry>());
+    WorkStealingQueue<std::string> queue(workers);
+    queue.push(0, std::string());
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (std::size_t worker = 0; worker < workers; ++worker) {
+        pool.emplace_back([this, worker, &queue](){
+            while (auto rel = queue.pop(worker)) {
+                scanDir(worker, *rel, queue);
+                queue.taskDone();
+            }
+        });
+    }
+    for (auto &thread : pool) {
+        thread.join();
+    }
+
+    std::size_t total = 0;
+    for (const auto &entries : m_workerEntries) {
+        total += entries.size();
+    }
+    m_entries.reserve(total);
+    for (auto &entries : m_workerEntries) {
+        std::move(entries.begin(), entries.end(), std::back_inserter(m_entries));
+    }
+    m_workerEntries.clear();
+
+    // a missing subtree would be seen as deleted by compareTo()
+    if (!m_scanError.isEmpty()) {
+        m_entries.clear();
+        m_errorString = m_scanError;
+        return false;
+    }
+
+    std::sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b){
+        return a.path < b.path;
+    });
+
+    return true;
+}
+
+void FileIndex::setFilter(const PathFilter &filter)
+{
+    m_filter = filter;
+}
+
+void FileIndex::scanDir(std::size_t worker, const std::string &rel, WorkStealingQueue<std::string> &queue)
+{
+    const std::string path = joinPath(m_root, rel);
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        // only directories that have been removed since their parent was read are skipped
+        if (errno != ENOENT) {
+            setScanError(rel, errno);
+        }
+        return;
+    }
+
+    thread_local std::vector<char> buffer;
+    std::vector<Entry> &entries = m_workerEntries[worker];
+
+    const bool read = Dirents::forEach(fd, buffer, [&](const char *name, unsigned char type){
+        Q_UNUSED(type)
+        std::string entryPath = rel.empty() ? std::string(name) : rel + '/' + name;
+        struct statx st{};
+        if (statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_BASIC_STATS, &st) != 0) {
+            if (errno != ENOENT) {
+                setScanError(entryPath, errno);
+            }
+            return;
+        }
+
+        Entry entry;
+        entry.path = std::move(entryPath);
+        if (!m_filter.isEmpty() && m_filter.isExcluded(entry.path, S_ISDIR(st.stx_mode))) {
+            return;
+        }
+        entry.inode = st.stx_ino;
+        entry.size = st.stx_size;
+        entry.mtimeSec = st.stx_mtime.tv_sec;
+        entry.mtimeNsec = st.stx_mtime.tv_nsec;
+        entry.ctimeSec = st.stx_ctime.tv_sec;
+        entry.ctimeNsec = st.stx_ctime.tv_nsec;
+        entry.mode = st.stx_mode;
+        entry.uid = st.stx_uid;
+        entry.gid = st.stx_gid;
+
+        if (S_ISDIR(st.stx_mode)) {
+            queue.push(worker, entry.path);
+        }
+
+        entries.push_back(std::move(entry));
+    });
+    if (!read && errno != ENOENT) {
+        setScanError(rel, errno);
+    }
+
+    ::close(fd);
+}
+
+void FileIndex::setScanError(const std::string &rel, int error)
+{
+    const std::lock_guard<std::mutex> lock(m_scanErrorMutex);
+    // the first error is reported, the scan fails anyway
+    if (m_scanError.isEmpty()) {
+        m_scanError = QStringLiteral("%1: %2").arg(QFile::decodeName(QByteArray::fromStdString(joinPath(m_root, rel))), QString::fromLocal8Bit(std::strerror(error)));
+    }
+}
+
+bool FileIndex::sameEntry(const Entry &entry, const Record *record, bool strict)
+{
+    if (entry.mode != record->mode || entry.size != record->size || entry.mtimeSec != record->mtimeSec || entry.mtimeNsec != record->mtimeNsec) {
+        return false;
+    }
+    if (strict && (entry.inode != record->inode || entry.ctimeSec != record->ctimeSec || entry.ctimeNsec != record->ctimeNsec)) {
+        return false;
+    }
+    return true;
+}
+
+FileIndex::Changes FileIndex::compareTo(const FileIndex &previous, bool strict) const
+{
+    Changes changes;
+
+    for (qint64 i = 0; i < previous.m_mappedCount; ++i) {
+        const Record *rec = previous.record(i);
+        if (!isDirMode(rec->mode)) {
+            changes.filesBefore++;
+            changes.sizeBefore += static_cast<qint64>(rec->size);
+        }
+    }
+
+    auto addChanged = [&changes](const Entry &entry, bool created){
+        changes.changed.push_back(entry.path);
+        if (!isDirMode(entry.mode)) {
+            changes.changedFiles++;
+            changes.changedBytes += static_cast<qint64>(entry.size);
+            if (created) {
+                changes.createdFiles++;
+            }
+        }
+    };
+    auto addDeleted = [&changes](std::string_view path, quint32 mode){
+        changes.deleted.emplace_back(path);
+        if (!isDirMode(mode)) {
+            changes.deletedFiles++;
+        }
+    };
+
+    for (const Entry &entry : m_entries) {
+        if (!isDirMode(entry.mode)) {
+            changes.filesAfter++;
+            changes.sizeAfter += static_cast<qint64>(entry.size);
+        }
+    }
+
+    // both lists are sorted by path, so a single merge pass finds all differences
+    std::size_t i = 0;
+    qint64 j = 0;
+    while (i < m_entries.size() || j < previous.m_mappedCount) {
+        if (j >= previous.m_mappedCount) {
+            addChanged(m_entries[i++], true);
+            continue;
+        }
+
+        const Record *rec = previous.record(j);
+        const std::string_view prevPath = previous.recordPath(rec);
+        const int cmp = i < m_entries.size() ? std::string_view(m_entries[i].path).compare(prevPath) : 1;
+        if (cmp < 0) {
+            addChanged(m_entries[i++], true);
+        } else if (cmp > 0) {
+            addDeleted(prevPath, rec->mode);
+            ++j;
+        } else {
+            const Entry &entry = m_entries[i];
+            if (!sameEntry(entry, rec, strict)) {
+                // on a type change the sync replaces the old entry on its own
+                addChanged(entry, (entry.mode & S_IFMT) != (rec->mode & S_IFMT));
+            }
+            ++i;
+            ++j;
+        }
+    }
+
+    // replacing or deleting an entry changes the modification time of the parent in the depot,
+    // the parents have to be synced as well to restore it
+    std::vector<std::string> parents;
+    auto addParent = [&parents](const std::string &path){
+        const std::string::size_type pos = path.rfind('/');
+        if (pos != std::string::npos) {
+            parents.push_back(path.substr(0, pos));
+        }
+    };
+    for (const std::string &path : changes.changed) {
+        addParent(path);
+    }
+    for (const std::string &path : changes.deleted) {
+        addParent(path);
+    }
+    if (!parents.empty()) {
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+        // deleted parents have no counterpart in the tree anymore
+        parents.erase(std::remove_if(parents.begin(), parents.end(), [this](const std::string &parent){
+            return !std::binary_search(m_entries.cbegin(), m_entries.cend(), parent, [](const auto &a, const auto &b){
+                return entryPath(a) < entryPath(b);
+            });
+        }), parents.end());
+        std::vector<std::string> merged;
+        merged.reserve(changes.changed.size() + parents.size());
+        std::set_union(changes.changed.begin(), changes.changed.end(), parents.begin(), parents.end(), std::back_inserter(merged));
+        changes.changed = std::move(merged);
+    }
+
+    return changes;
+}
+
+void FileIndex::updateHashes(const FileIndex &previous, const Changes &changes, const QString &root, int threads)
+{
+    // take over the hashes of the unchanged files, they are the ones without a newer entry in the changed list
+    std::vector<Entry *> missing;
+    qint64 j = 0;
+    std::size_t c = 0;
+    for (Entry &entry : m_entries) {
+        if (!isRegMode(entry.mode)) {
+            continue;
+        }
+        while (c < changes.changed.size() && changes.changed[c] < entry.path) {
+            ++c;
+        }
+        const bool changed = c < changes.changed.size() && changes.changed[c] == entry.path;
+        if (!changed && previous.m_mapped) {
+            while (j < previous.m_mappedCount && previous.recordPath(previous.record(j)) < std::string_view(entry.path)) {
+                ++j;
+            }
+            if (j < previous.m_mappedCount) {
+                const Record *rec = previous.record(j);
+                if (previous.recordPath(rec) == std::string_view(entry.path) && (rec->flags & recordHasHash) != 0) {
+                    entry.hash = rec->hash;
+                    entry.hasHash = true;
+                    continue;
+                }
+            }
+        }
+        missing.push_back(&entry);
+    }
+
+    hashFiles(missing, root, threads);
+}
+
+FileIndex::HashStats FileIndex::updateHashes(const FileIndex &previous, const QString &root, int threads)
+{
+    std::vector<Entry *> missing;
+    HashStats stats;
+    qint64 j = 0;
+    for (Entry &entry : m_entries) {
+        if (!isRegMode(entry.mode)) {
+            continue;
+        }
+        while (j < previous.m_mappedCount && previous.recordPath(previous.record(j)) < std::string_view(entry.path)) {
+            ++j;
+        }
+        if (j < previous.m_mappedCount) {
+            const Record *rec = previous.record(j);
+            if ((rec->flags & recordHasHash) != 0 && previous.recordPath(rec) == std::string_view(entry.path)
+                    && rec->inode == entry.inode && rec->size == entry.size && rec->mtimeSec == entry.mtimeSec && rec->mtimeNsec == entry.mtimeNsec) {
+                entry.hash = rec->hash;
+                entry.hasHash = true;
+                stats.cachedFiles++;
+                continue;
+            }
+        }
+        missing.push_back(&entry);
+    }
+
+    const HashStats hashed = hashFiles(missing, root, threads);
+    stats.hashedFiles = hashed.hashedFiles;
+    stats.hashedBytes = hashed.hashedBytes;
+    stats.failedFiles = hashed.failedFiles;
+    return stats;
+}
+
+FileIndex::HashStats FileIndex::hashFiles(const std::vector<Entry *> &entries, const QString &root, int threads)
+{
+    const std::string base = QFile::encodeName(root).toStdString();
+    std::atomic<std::size_t> next{0};
+    std::atomic<qint64> hashedFiles{0};
+    std::atomic<qint64> hashedBytes{0};
+    std::atomic<qint64> failedFiles{0};
+    const auto workers = std::min<std::size_t>(static_cast<std::size_t>(threadCount(threads)), std::max<std::size_t>(entries.size(), 1));
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (std::size_t worker = 0; worker < workers; ++worker) {
+        pool.emplace_back([&](){
+            std::vector<char> buffer(hashBufferSize);
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            for (std::size_t idx = next.fetch_add(1); idx < entries.size(); idx = next.fetch_add(1)) {
+                Entry *entry = entries[idx];
+                const int fd = ::open(joinPath(base, entry->path).c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd < 0) {
+                    failedFiles++;
+                    continue;
+                }
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                hash.reset();
+                bool ok = true;
+                qint64 bytes = 0;
+                for (;;) {
+                    const ssize_t n = ::read(fd, buffer.data(), buffer.size());
+                    if (n == 0) {
+                        break;
+                    }
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        ok = false;
+                        break;
+                    }
+                    hash.addData(QByteArrayView(buffer.data(), n));
+                    bytes += n;
+                }
+                ::close(fd);
+                hashedBytes += bytes;
+                if (ok) {
+                    const QByteArray result = hash.result();
+                    std::copy_n(result.constData(), entry->hash.size(), entry->hash.begin());
+                    entry->hasHash = true;
+                    hashedFiles++;
+                } else {
+                    failedFiles++;
+                }
+            }
+        });
+    }
+    for (auto &thread : pool) {
+        thread.join();
+    }
+
+    HashStats stats;
+    stats.hashedFiles = hashedFiles;
+    stats.hashedBytes = hashedBytes;
+    stats.failedFiles = failedFiles;
+    return stats;
+}
+
+std::optional<FileIndex::Entry> FileIndex::find(std::string_view path) const
+{
+    qint64 first = 0;
+    qint64 last = m_mappedCount;
+    while (first < last) {
+        const qint64 middle = first + (last - first) / 2;
+        if (recordPath(record(middle)) < path) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if (first >= m_mappedCount || recordPath(record(first)) != path) {
+        return std::nullopt;
+    }
+
+    return entryAt(first);
+}
+
+FileIndex::Entry FileIndex::entryAt(qint64 index) const
+{
+    const Record *rec = record(index);
+    Entry entry;
+    entry.path = recordPath(rec);
+    entry.inode = rec->inode;
+    entry.size = rec->size;
+    entry.mtimeSec = rec->mtimeSec;
+    entry.mtimeNsec = rec->mtimeNsec;
+    entry.ctimeSec = rec->ctimeSec;
+    entry.ctimeNsec = rec->ctimeNsec;
+    entry.mode = rec->mode;
+    entry.hasHash = (rec->flags & recordHasHash) != 0;
+    entry.hash = rec->hash;
+    return entry;
+}
+
+bool FileIndex::save(const QString &filePath) const
+{
+    const QFileInfo fi(filePath);
+    if (!QDir().mkpath(fi.absolutePath())) {
+        m_errorString = QStringLiteral("Failed to create directory %1").arg(fi.absolutePath());
+        return false;
+    }
+
+    std::vector<Record> records(m_entries.size());
+    std::string paths;
+    std::size_t pathsSize = 0;
+    for (const Entry &entry : m_entries) {
+        pathsSize += entry.path.size();
+    }
+    paths.reserve(pathsSize);
+
+    for (std::size_t i = 0; i < m_entries.size(); ++i) {
+        const Entry &entry = m_entries[i];
+        Record &rec = records[i];
+        rec = Record{};
+        rec.pathOffset = paths.size();
+        rec.pathLength = static_cast<quint32>(entry.path.size());
+        rec.inode = entry.inode;
+        rec.size = entry.size;
+        rec.mtimeSec = entry.mtimeSec;
+        rec.mtimeNsec = entry.mtimeNsec;
+        rec.ctimeSec = entry.ctimeSec;
+        rec.ctimeNsec = entry.ctimeNsec;
+        rec.mode = entry.mode;
+        rec.flags = entry.hasHash ? recordHasHash : 0;
+        rec.hash = entry.hash;
+        paths.append(entry.path);
+    }
+
+    Header header{};
+    header.magic = indexMagic;
+    header.version = indexVersion;
+    header.recordSize = sizeof(Record);
+    header.count = records.size();
+    header.pathsSize = paths.size();
+
+    QSaveFile f(filePath);
+    if (!f.open(QIODevice::WriteOnly)) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    f.write(reinterpret_cast<const char *>(&header), sizeof(Header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    f.write(reinterpret_cast<const char *>(records.data()), static_cast<qint64>(records.size() * sizeof(Record))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    f.write(paths.data(), static_cast<qint64>(paths.size()));
+
+    if (!f.commit()) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+qint64 FileIndex::count() const
+{
+    return m_mapped ? m_mappedCount : static_cast<qint64>(m_entries.size());
+}
+
+const std::vector<FileIndex::Entry> &FileIndex::entries() const
+{
+    return m_entries;
+}
+
+QString FileIndex::errorString() const
+{
+    return m_errorString;
+}
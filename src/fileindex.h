@@ -0,0 +1,190 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include "pathfilter.h"
+#include <QString>
+#include <array>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+template<typename T> class WorkStealingQueue;
+
+/*!
+ * \brief Index of the file metadata of a synced directory.
+ *
+ * The index contains path, inode, size, modification and change time, mode and
+ * optionally the SHA-256 hash of the content of every entry below a directory.
+ * It is stored as a binary file with fixed size records sorted by path, followed by
+ * a table with the paths. The file is memory mapped on load, so comparing a fresh
+ * scan against the index of the last run only touches the pages that are needed.
+ * The file uses the byte order of the host, it is local state and not meant to be
+ * portable.
+ *
+ * A fresh index is created by scan(), which walks the tree with multiple threads.
+ * compareTo() computes the entries that have been changed or deleted since the
+ * previous index, so that only these have to be synced, and takes over the hashes
+ * of unchanged files. Paths are relative to the scanned directory and sorted by
+ * their bytes, parents are therefore always sorted before their children.
+ *
+ * With hashes an index is also used as content manifest of a directory in the depot,
+ * single entries of a mapped manifest are looked up with find().
+ */
+class FileIndex
+{
+public:
+    struct Entry {
+        std::string path;
+        quint64 inode = 0;
+        quint64 size = 0;
+        qint64 mtimeSec = 0;
+        qint64 ctimeSec = 0;
+        quint32 mtimeNsec = 0;
+        quint32 ctimeNsec = 0;
+        quint32 mode = 0;
+        // only set by scan(), the index file does not contain the owner
+        quint32 uid = 0;
+        quint32 gid = 0;
+        bool hasHash = false;
+        std::array<quint8,32> hash{};
+    };
+
+    /*!
+     * \brief Result of compareTo(), file counts and sizes do not include directories.
+     */
+    struct Changes {
+        std::vector<std::string> changed;
+        std::vector<std::string> deleted;
+        qint64 filesBefore = 0;
+        qint64 sizeBefore = 0;
+        qint64 filesAfter = 0;
+        qint64 sizeAfter = 0;
+        qint64 createdFiles = 0;
+        qint64 deletedFiles = 0;
+        qint64 changedFiles = 0;
+        qint64 changedBytes = 0;
+    };
+
+    /*!
+     * \brief Result of updateHashes().
+     */
+    struct HashStats {
+        qint64 cachedFiles = 0;
+        qint64 hashedFiles = 0;
+        qint64 hashedBytes = 0;
+        qint64 failedFiles = 0;
+    };
+
+    FileIndex();
+    ~FileIndex();
+
+    /*!
+     * \brief Memory maps the index file at \a filePath.
+     *
+     * Returns \c false if the file does not exist or is not a valid index.
+     */
+    bool map(const QString &filePath);
+
+    /*!
+     * \brief Creates a new index of the tree below \a root using \a threads threads.
+     *
+     * \a threads <= 0 uses the number of CPU cores. Returns \c false if \a root or any
+     * directory or entry below it can not be read, the index would miss them otherwise.
+     * Entries below \a root that vanish while scanning are skipped.
+     */
+    bool scan(const QString &root, int threads = 0);
+
+    /*!
+     * \brief Leaves out the entries excluded by \a filter in the next scan().
+     */
+    void setFilter(const PathFilter &filter);
+
+    /*!
+     * \brief Compares this scanned index with the mapped \a previous index.
+     *
+     * An entry is unchanged if type, mode, size and modification time are the same.
+     * If \a strict is \c true, also the inode and the change time have to be the same,
+     * what detects ownership changes and files that have been replaced with the same
+     * size and modification time. Use non strict comparisons if the tree is a new copy
+     * on every run, like reflink snapshots.
+     */
+    [[nodiscard]] Changes compareTo(const FileIndex &previous, bool strict) const;
+
+    /*!
+     * \brief Takes over the hashes of unchanged regular files from \a previous and
+     * computes the missing hashes by reading the files below \a root.
+     */
+    void updateHashes(const FileIndex &previous, const Changes &changes, const QString &root, int threads = 0);
+
+    /*!
+     * \brief Takes over the hashes of regular files with the same inode, size and
+     * modification time in \a previous and computes the other hashes by reading the
+     * files below \a root.
+     *
+     * The change time is not compared, because it also changes when a file gets
+     * another hard link, like unchanged files in a new generation of the depot.
+     */
+    HashStats updateHashes(const FileIndex &previous, const QString &root, int threads = 0);
+
+    /*!
+     * \brief Returns the entry for \a path from the mapped index, found with a binary search.
+     *
+     * Owner and group are not part of the index file and are always \c 0.
+     */
+    [[nodiscard]] std::optional<Entry> find(std::string_view path) const;
+
+    /*!
+     * \brief Returns the entry at \a index of the mapped index, entries are sorted by path.
+     *
+     * \a index has to be lower than count(), see find() for the fields that are not set.
+     */
+    [[nodiscard]] Entry entryAt(qint64 index) const;
+
+    /*!
+     * \brief Atomically writes the scanned entries to \a filePath.
+     */
+    bool save(const QString &filePath) const;
+
+    [[nodiscard]] qint64 count() const;
+
+    /*!
+     * \brief Returns the sorted entries created by scan().
+     */
+    [[nodiscard]] const std::vector<Entry> &entries() const;
+
+    [[nodiscard]] QString errorString() const;
+
+private:
+    struct Header;
+    struct Record;
+
+    void scanDir(std::size_t worker, const std::string &rel, WorkStealingQueue<std::string> &queue);
+    void setScanError(const std::string &rel, int error);
+    [[nodiscard]] const Record *record(qint64 index) const;
+    [[nodiscard]] std::string_view recordPath(const Record *record) const;
+    [[nodiscard]] static bool sameEntry(const Entry &entry, const Record *record, bool strict);
+    static HashStats hashFiles(const std::vector<Entry *> &entries, const QString &root, int threads);
+    void unmap();
+
+    std::string m_root;
+    PathFilter m_filter;
+    std::vector<Entry> m_entries;
+    std::vector<std::vector<Entry>> m_workerEntries;
+    std::mutex m_scanErrorMutex;
+    QString m_scanError;
+    const char *m_mapped = nullptr;
+    std::size_t m_mappedSize = 0;
+    qint64 m_mappedCount = 0;
+    mutable QString m_errorString;
+
+    Q_DISABLE_COPY(FileIndex)
+};
+
+#endif // FILEINDEX_H
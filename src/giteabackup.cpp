@@ -130,6 +130,11 @@ bool GiteaBackup::loadConfiguration()
     return true;
 }
 
+bool GiteaBackup::supportsPreSync() const
+{
+    return true;
+}
+
 void GiteaBackup::doBackup()
 {
     connect(this, &DbBackup::backupDatabaseFinished, this, &GiteaBackup::onBackupDatabaseFinished);
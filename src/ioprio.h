@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef IOPRIO_H
+#define IOPRIO_H
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace IoPriority {
+
+// from linux/ioprio.h, that is not available on older systems
+constexpr int whoProcess = 1;
+constexpr int classShift = 13;
+constexpr int classIdle = 3;
+
+/*!
+ * \brief Sets the I/O scheduling class of the calling thread to idle.
+ *
+ * The thread then only gets disk time when no other process needs it. Applies to the
+ * calling thread only, every worker thread has to call it on its own.
+ */
+inline void setIdle()
+{
+    ::syscall(SYS_ioprio_set, whoProcess, 0, classIdle << classShift);
+}
+
+}
+
+#endif // IOPRIO_H
@@ -102,6 +102,11 @@ bool JoomlaBackup::loadConfiguration()
     return true;
 }
 
+bool JoomlaBackup::supportsPreSync() const
+{
+    return true;
+}
+
 void JoomlaBackup::enableMaintenance()
 {
     logInfo(qtTrId("SIHHURI_INFO_ENABLE_MAINTENANCE"));
@@ -19,6 +19,8 @@ public:
 protected:
     bool loadConfiguration() final;
 
+    [[nodiscard]] bool supportsPreSync() const final;
+
     void doBackup() final;
 
     void enableMaintenance() final;
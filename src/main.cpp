@@ -8,13 +8,10 @@
 #include <QCommandLineOption>
 #include <QCommandLineParser>
 #include <QVariantMap>
-#include <QFileInfo>
-#include <QFile>
-#include <QJsonParseError>
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QTranslator>
 #include <QLocale>
+#include <QDir>
+#include <QFileInfo>
 
 #include <cstring>
 extern "C"
@@ -24,6 +21,11 @@ extern "C"
 }
 
 #include "backupmanager.h"
+#include "backupdaemon.h"
+#include "changerecorder.h"
+#include "chunksnapshot.h"
+#include "depotverifier.h"
+#include "config.h"
 
 void journaldMessageOutput(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
@@ -63,59 +65,6 @@ void journaldMessageOutput(QtMsgType type, const QMessageLogContext &context, co
     }
 }
 
-QVariantMap loadConfig(const QString &filepath)
-{
-    QVariantMap map;
-
-    QFileInfo cfi(filepath);
-
-    if (Q_UNLIKELY(!cfi.exists())) {
-        //: Error message, %1 will be replaced by the file path
-        //% "Can not find configuration file at %1"
-        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_CONFIG_NOT_FOUND").arg(cfi.absoluteFilePath())));
-        return map;
-    }
-
-    if (Q_UNLIKELY(!cfi.isReadable())) {
-        //: Error message, %1 will be replaced by the file path
-        //% "Can not read configuration file at %1. Permission denied."
-        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_CONFIG_UNREADABLE").arg(cfi.absoluteFilePath())));
-        return map;
-    }
-
-    qDebug("Reading settings from %s", qUtf8Printable(cfi.absoluteFilePath()));
-
-    QFile fi(filepath);
-
-    if (Q_UNLIKELY(!fi.open(QIODevice::ReadOnly|QIODevice::Text))) {
-        //: Error message, %1 will be replaced by the file path, %2 by the error string
-        //% "Can not open configuration file at %1: %2"
-        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_CONFIG_FAILED_OPEN").arg(cfi.absoluteFilePath(), fi.errorString())));
-        return map;
-    }
-
-    QJsonParseError jsonError;
-    const QJsonDocument json = QJsonDocument::fromJson(fi.readAll(), &jsonError);
-    fi.close();
-    if (jsonError.error != QJsonParseError::NoError) {
-        //: Error message, %1 will be replaced by the file path, %2 by the JSON error string
-        //% "Failed to parse JSON configuration file at %1: %2"
-        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_JSON_PARSE").arg(cfi.absoluteFilePath(), jsonError.errorString())));
-        return map;
-    }
-
-    if (!json.isObject()) {
-        //: Error message, %1 will be replaced by the file path
-        //% "JSON configuration file at %1 does not contain an object as root"
-        qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_JSON_NO_OBJECT").arg(cfi.absoluteFilePath())));
-        return map;
-    }
-
-    map = json.object().toVariantMap();
-
-    return map;
-}
-
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
@@ -162,16 +111,51 @@ int main(int argc, char *argv[])
                             qtTrId("SIHHURI_CLI_OPT_TYPE_VAL"));
     parser.addOption(type);
 
+    QCommandLineOption daemon(QStringList({QStringLiteral("d"), QStringLiteral("daemon")}),
+                              //: Option description in the cli help
+                              //% "Run as long running service that backs up the items according to their schedules."
+                              qtTrId("SIHHURI_CLI_OPT_DAEMON"));
+    parser.addOption(daemon);
+
+    QCommandLineOption journal(QStringList({QStringLiteral("j"), QStringLiteral("journal")}),
+                               //: Option description in the cli help
+                               //% "Only record the changes of the directories of the items with enabled journal option, to be run alongside the timer based backups."
+                               qtTrId("SIHHURI_CLI_OPT_JOURNAL"));
+    parser.addOption(journal);
+
+    QCommandLineOption restore(QStringList({QStringLiteral("restore")}),
+                               //: Option description in the cli help
+                               //% "Restore the snapshot file of a chunk store to the directory given by --restore-to."
+                               qtTrId("SIHHURI_CLI_OPT_RESTORE"),
+                               //: Option value name in the cli help for the snapshot file
+                               //% "snapshot"
+                               qtTrId("SIHHURI_CLI_OPT_RESTORE_VAL"));
+    parser.addOption(restore);
+
+    QCommandLineOption restoreTo(QStringList({QStringLiteral("restore-to")}),
+                                 //: Option description in the cli help
+                                 //% "Directory to restore the snapshot to."
+                                 qtTrId("SIHHURI_CLI_OPT_RESTORE_TO"),
+                                 //: Option value name in the cli help for the restore directory
+                                 //% "directory"
+                                 qtTrId("SIHHURI_CLI_OPT_RESTORE_TO_VAL"));
+    parser.addOption(restoreTo);
+
+    QCommandLineOption verify(QStringList({QStringLiteral("verify")}),
+                              //: Option description in the cli help
+                              //% "Re-read the files in the depot and compare them against their stored hashes. Items to verify can be given by name as arguments, by default the complete depot is verified."
+                              qtTrId("SIHHURI_CLI_OPT_VERIFY"));
+    parser.addOption(verify);
+
+    //: Positional argument description in the cli help
+    //% "Names of the items to verify."
+    parser.addPositionalArgument(QStringLiteral("items"), qtTrId("SIHHURI_CLI_ARG_ITEMS"), QStringLiteral("[items...]"));
+
     parser.addHelpOption();
     parser.addVersionOption();
 
     parser.process(a);
 
-    const QVariantMap config = loadConfig(parser.value(configPath));
-    if (config.isEmpty()) {
-        return static_cast<int>(RC::InvalidConfig);
-    }
-
     QStringList typesList;
     if (parser.isSet(type)) {
         const QString types = parser.value(type);
@@ -180,7 +164,126 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (parser.isSet(restore)) {
+        if (parser.value(restoreTo).isEmpty()) {
+            //% "No directory to restore the snapshot to has been given."
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RESTORE_NO_TARGET")));
+            return static_cast<int>(RC::InvalidConfig);
+        }
+        // snapshots are stored in <store>/snapshots/<id>/
+        QDir storeDir = QFileInfo(parser.value(restore)).absoluteDir();
+        storeDir.cdUp();
+        storeDir.cdUp();
+        ChunkStore store(storeDir.absolutePath());
+        ChunkSnapshot snapshot;
+        if (!store.open() || !snapshot.map(parser.value(restore)) || !snapshot.restore(store, parser.value(restoreTo))) {
+            //% "Failed to restore %1: %2"
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_RESTORE_FAILED").arg(parser.value(restore), !store.errorString().isEmpty() ? store.errorString() : snapshot.errorString())));
+            return static_cast<int>(RC::FileSystemError);
+        }
+        //% "Restored %1 to %2."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_RESTORED").arg(parser.value(restore), parser.value(restoreTo))));
+        return static_cast<int>(RC::OK);
+    }
+
+    if (parser.isSet(daemon)) {
+        auto bd = new BackupDaemon(parser.value(configPath), typesList, &a); // NOLINT(cppcoreguidelines-owning-memory)
+        if (!bd->start()) {
+            return static_cast<int>(RC::InvalidConfig);
+        }
+        return a.exec();
+    }
+
+    const QVariantMap config = loadConfig(parser.value(configPath));
+    if (config.isEmpty()) {
+        return static_cast<int>(RC::InvalidConfig);
+    }
+
+    if (parser.isSet(verify)) {
+        const QVariantMap globalConfig = config.value(QStringLiteral("global")).toMap();
+        const QString depot = globalConfig.value(QStringLiteral("depot")).toString();
+        const QString stateDir = globalConfig.value(QStringLiteral("stateDir"), QStringLiteral(SIHHURI_STATEDIR)).toString();
+        DepotVerifier verifier(depot, globalConfig.value(QStringLiteral("verifyThreads"), 0).toInt());
+        // KiB per second like the --bwlimit of rsync
+        verifier.setRateLimit(globalConfig.value(QStringLiteral("verifyBwLimit"), 0).toLongLong() * 1024);
+        verifier.setParts(globalConfig.value(QStringLiteral("verifyParts"), 1).toInt());
+        verifier.setStateFile(stateDir + QLatin1String("/verify.state"));
+        // chunk stores outside of the depot
+        const QVariantList items = config.value(QStringLiteral("items")).toList();
+        for (const QVariant &item : items) {
+            const QString chunkStore = item.toMap().value(QStringLiteral("chunkStore")).toString();
+            if (!chunkStore.isEmpty()) {
+                verifier.addChunkStore(chunkStore);
+            }
+        }
+
+        if (!verifier.collect(parser.positionalArguments())) {
+            //% "Failed to read the depot %1: %2"
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_VERIFY_FAILED_READ_DEPOT").arg(depot, verifier.errorString())));
+            return static_cast<int>(RC::FileSystemError);
+        }
+
+        QLocale locale;
+        const DepotVerifier::Result total = verifier.result();
+        //% "Verifying depot %1 with %2 files and %3."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_START_VERIFY").arg(depot, locale.toString(total.totalFiles), locale.formattedDataSize(total.totalBytes))));
+
+        const bool stateSaved = verifier.run();
+        const std::vector<DepotVerifier::Issue> issues = verifier.issues();
+        for (const DepotVerifier::Issue &issue : issues) {
+            switch (issue.problem) {
+            case DepotVerifier::Missing:
+                //% "Verification failed, %1 is missing."
+                qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_VERIFY_MISSING").arg(issue.path)));
+                break;
+            case DepotVerifier::Truncated:
+                //% "Verification failed, %1 has been truncated."
+                qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_VERIFY_TRUNCATED").arg(issue.path)));
+                break;
+            case DepotVerifier::Corrupted:
+                //% "Verification failed, the content of %1 does not match its hash."
+                qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_VERIFY_CORRUPTED").arg(issue.path)));
+                break;
+            case DepotVerifier::ReadError:
+                //% "Verification failed, %1 can not be read."
+                qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_VERIFY_READ_ERROR").arg(issue.path)));
+                break;
+            }
+        }
+        if (!stateSaved) {
+            //% "Failed to save the verification state: %1"
+            qWarning("%s", qUtf8Printable(qtTrId("SIHHURI_WARN_VERIFY_FAILED_SAVE_STATE").arg(verifier.errorString())));
+        }
+
+        const DepotVerifier::Result result = verifier.result();
+        const qint64 bytesPerSecond = result.timeUsed > 0 ? result.bytes * 1000 / result.timeUsed : result.bytes;
+        //% "Verified %1 files with %2 in %3 milliseconds (%4/s), skipped %5 changed files, found %6 issues."
+        qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_FINISHED_VERIFY").arg(locale.toString(result.files), locale.formattedDataSize(result.bytes), locale.toString(result.timeUsed), locale.formattedDataSize(bytesPerSecond), locale.toString(result.skippedFiles), locale.toString(result.issues))));
+        if (result.passCompleted) {
+            //% "Reached the end of the depot, the next verification starts at the beginning."
+            qInfo("%s", qUtf8Printable(qtTrId("SIHHURI_INFO_VERIFY_PASS_COMPLETED")));
+        }
+
+        return static_cast<int>(result.issues > 0 ? RC::VerificationFailed : RC::OK);
+    }
+
+    if (parser.isSet(journal)) {
+        const QStringList dirs = ChangeRecorder::journaledDirectories(config, typesList);
+        if (dirs.empty()) {
+            //% "No items with enabled journal option have been configured."
+            qCritical("%s", qUtf8Printable(qtTrId("SIHHURI_CRIT_NO_JOURNALED_ITEMS")));
+            return static_cast<int>(RC::InvalidConfig);
+        }
+        const QString stateDir = config.value(QStringLiteral("global")).toMap().value(QStringLiteral("stateDir"), QStringLiteral(SIHHURI_STATEDIR)).toString();
+        auto cr = new ChangeRecorder(stateDir + QLatin1String("/journal"), &a); // NOLINT(cppcoreguidelines-owning-memory)
+        if (!cr->start(dirs)) {
+            return static_cast<int>(RC::FileSystemError);
+        }
+        return a.exec();
+    }
+
     auto bm = new BackupManager(config, typesList, &a); // NOLINT(cppcoreguidelines-owning-memory)
+    QObject::connect(bm, &BackupManager::finished, &a, &QCoreApplication::exit);
     bm->start();
 
     return a.exec();
@@ -0,0 +1,178 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "mariabackupchain.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QSaveFile>
+
+namespace {
+const QLatin1String chainFileName("/chain.json");
+}
+
+MariaBackupChain::MariaBackupChain(const QString &path)
+    : m_path(path)
+{
+}
+
+MariaBackupChain::~MariaBackupChain() = default;
+
+bool MariaBackupChain::load()
+{
+    m_links.clear();
+    m_preparedLsn = 0;
+
+    QFile f(m_path + chainFileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    QJsonParseError jsonError;
+    const QJsonDocument json = QJsonDocument::fromJson(f.readAll(), &jsonError);
+    if (jsonError.error != QJsonParseError::NoError) {
+        m_errorString = jsonError.errorString();
+        return false;
+    }
+
+    // LSNs are stored as strings, JSON numbers lose precision above 2^53
+    const QJsonObject root = json.object();
+    m_preparedLsn = root.value(QLatin1String("preparedLsn")).toString().toULongLong();
+    const QJsonArray links = root.value(QLatin1String("links")).toArray();
+    for (const QJsonValue &value : links) {
+        const QJsonObject o = value.toObject();
+        Link link;
+        link.dir = o.value(QLatin1String("dir")).toString();
+        link.created = QDateTime::fromString(o.value(QLatin1String("created")).toString(), Qt::ISODate);
+        link.fromLsn = o.value(QLatin1String("fromLsn")).toString().toULongLong();
+        link.toLsn = o.value(QLatin1String("toLsn")).toString().toULongLong();
+        link.incremental = o.value(QLatin1String("incremental")).toBool();
+        m_links.push_back(link);
+    }
+
+    return true;
+}
+
+bool MariaBackupChain::save()
+{
+    QJsonArray links;
+    for (const Link &link : m_links) {
+        QJsonObject o;
+        o.insert(QLatin1String("dir"), link.dir);
+        o.insert(QLatin1String("created"), link.created.toUTC().toString(Qt::ISODate));
+        o.insert(QLatin1String("fromLsn"), QString::number(link.fromLsn));
+        o.insert(QLatin1String("toLsn"), QString::number(link.toLsn));
+        o.insert(QLatin1String("incremental"), link.incremental);
+        links.append(o);
+    }
+
+    QJsonObject root;
+    root.insert(QLatin1String("links"), links);
+    root.insert(QLatin1String("preparedLsn"), QString::number(m_preparedLsn));
+
+    QSaveFile f(m_path + chainFileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        m_errorString = f.errorString();
+        return false;
+    }
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    if (!f.commit()) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool MariaBackupChain::isUsable() const
+{
+    if (m_links.empty() || m_links.front().incremental || m_preparedLsn != m_links.back().toLsn) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < m_links.size(); ++i) {
+        const Link &link = m_links.at(i);
+        if (i > 0 && (!link.incremental || link.fromLsn != m_links.at(i - 1).toLsn)) {
+            return false;
+        }
+        if (!QFileInfo(m_path + QLatin1Char('/') + link.dir).isDir()) {
+            return false;
+        }
+    }
+
+    return QFileInfo(m_path + QLatin1String("/prepared")).isDir();
+}
+
+const std::vector<MariaBackupChain::Link> &MariaBackupChain::links() const
+{
+    return m_links;
+}
+
+void MariaBackupChain::append(const Link &link)
+{
+    m_links.push_back(link);
+}
+
+QString MariaBackupChain::nextIncrementalDir() const
+{
+    return QStringLiteral("inc-%1").arg(static_cast<qulonglong>(m_links.size()), 4, 10, QLatin1Char('0'));
+}
+
+quint64 MariaBackupChain::preparedLsn() const
+{
+    return m_preparedLsn;
+}
+
+void MariaBackupChain::setPreparedLsn(quint64 lsn)
+{
+    m_preparedLsn = lsn;
+}
+
+QString MariaBackupChain::errorString() const
+{
+    return m_errorString;
+}
+
+bool MariaBackupChain::readCheckpoints(const QString &backupDir, quint64 *fromLsn, quint64 *toLsn)
+{
+    // newer versions have renamed the files of xtrabackup
+    QFile f(backupDir + QLatin1String("/mariadb_backup_checkpoints"));
+    if (!f.exists()) {
+        f.setFileName(backupDir + QLatin1String("/xtrabackup_checkpoints"));
+    }
+    if (!f.open(QIODevice::ReadOnly|QIODevice::Text)) {
+        return false;
+    }
+
+    // lines like "to_lsn = 1234567"
+    bool hasFrom = false;
+    bool hasTo = false;
+    while (!f.atEnd()) {
+        const QByteArray line = f.readLine();
+        const qsizetype eq = line.indexOf('=');
+        if (eq < 0) {
+            continue;
+        }
+        const QByteArray key = line.left(eq).trimmed();
+        bool ok = false;
+        const quint64 value = line.mid(eq + 1).trimmed().toULongLong(&ok);
+        if (!ok) {
+            continue;
+        }
+        if (key == "from_lsn") {
+            *fromLsn = value;
+            hasFrom = true;
+        } else if (key == "to_lsn") {
+            *toLsn = value;
+            hasTo = true;
+        }
+    }
+
+    return hasFrom && hasTo;
+}
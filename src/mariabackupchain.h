@@ -0,0 +1,77 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MARIABACKUPCHAIN_H
+#define MARIABACKUPCHAIN_H
+
+#include <QDateTime>
+#include <QString>
+#include <vector>
+
+/*!
+ * \brief The LSN chain of the physical MariaDB backups in one directory.
+ *
+ * The directory contains the unprepared full backup in \c full, the unprepared incremental
+ * backups in \c inc-0001, \c inc-0002 and so on, and in \c prepared a copy of the full backup
+ * that has been prepared with all incrementals applied and that can be restored with
+ * <tt>mariabackup --copy-back</tt>. The chain is stored in \c chain.json in the directory.
+ *
+ * Every incremental backup starts at the LSN the previous link ended at. The prepared copy is
+ * only usable if its LSN is the end of the last link, otherwise applying an incremental failed
+ * and the next backup has to start a new chain with a full backup.
+ */
+class MariaBackupChain
+{
+public:
+    struct Link {
+        QString dir;
+        QDateTime created;
+        quint64 fromLsn = 0;
+        quint64 toLsn = 0;
+        bool incremental = false;
+    };
+
+    explicit MariaBackupChain(const QString &path);
+    ~MariaBackupChain();
+
+    /*!
+     * \brief Loads the chain, returns \c false if there is none or if it can not be read.
+     */
+    bool load();
+    bool save();
+
+    /*!
+     * \brief Returns \c true if the links are continuous, their directories exist and the prepared copy is complete.
+     */
+    [[nodiscard]] bool isUsable() const;
+
+    [[nodiscard]] const std::vector<Link> &links() const;
+    void append(const Link &link);
+
+    /*!
+     * \brief Returns the directory name for the next incremental backup.
+     */
+    [[nodiscard]] QString nextIncrementalDir() const;
+
+    [[nodiscard]] quint64 preparedLsn() const;
+    void setPreparedLsn(quint64 lsn);
+
+    [[nodiscard]] QString errorString() const;
+
+    /*!
+     * \brief Reads the LSN range from the checkpoints file written by mariabackup into \a backupDir.
+     */
+    static bool readCheckpoints(const QString &backupDir, quint64 *fromLsn, quint64 *toLsn);
+
+private:
+    QString m_path;
+    QString m_errorString;
+    std::vector<Link> m_links;
+    quint64 m_preparedLsn = 0;
+
+    Q_DISABLE_COPY(MariaBackupChain)
+};
+
+#endif // MARIABACKUPCHAIN_H
@@ -94,6 +94,11 @@ bool MatomoBackup::loadConfiguration()
     return true;
 }
 
+bool MatomoBackup::supportsPreSync() const
+{
+    return true;
+}
+
 void MatomoBackup::enableMaintenance()
 {
     logInfo(qtTrId("SIHHURI_INFO_ENABLE_MAINTENANCE"));
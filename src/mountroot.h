@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MOUNTROOT_H
+#define MOUNTROOT_H
+
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace MountRoot {
+
+inline bool sameMount(const struct statx &a, const struct statx &b)
+{
+    // the mount id is only reported since Linux 5.8, bind mounts of the same file system share the device
+    if ((a.stx_mask & STATX_MNT_ID) && (b.stx_mask & STATX_MNT_ID)) {
+        return a.stx_mnt_id == b.stx_mnt_id;
+    }
+    return a.stx_dev_major == b.stx_dev_major && a.stx_dev_minor == b.stx_dev_minor;
+}
+
+/*!
+ * \brief Returns the path of the root of the mount the directory \a path is on.
+ *
+ * \a path has to be absolute and canonical. Walks up the parent directories as long as
+ * they are on the same mount. Returns an empty string and leaves \c errno set if \a path
+ * can not be queried.
+ */
+inline std::string of(const std::string &path)
+{
+    constexpr unsigned int mask = STATX_TYPE | STATX_INO | STATX_MNT_ID;
+
+    struct statx st{};
+    if (statx(AT_FDCWD, path.c_str(), AT_NO_AUTOMOUNT, mask, &st) != 0) {
+        return {};
+    }
+
+    std::string root = path;
+    while (root.size() > 1) {
+        const std::size_t pos = root.rfind('/');
+        const std::string parent = pos == 0 ? std::string(1, '/') : root.substr(0, pos);
+        struct statx pst{};
+        if (statx(AT_FDCWD, parent.c_str(), AT_NO_AUTOMOUNT, mask, &pst) != 0 || !sameMount(st, pst)) {
+            break;
+        }
+        root = parent;
+    }
+
+    return root;
+}
+
+}
+
+#endif // MOUNTROOT_H
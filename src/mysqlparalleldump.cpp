@@ -0,0 +1,298 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "mysqlparalleldump.h"
+#include "dumppipeline.h"
+#include <QDateTime>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+QStringList clientArgs(const QString &defaultsFile)
+{
+    // the defaults file has to be the first argument
+    return {QLatin1String("--defaults-file=") + defaultsFile, QStringLiteral("--batch"), QStringLiteral("--skip-column-names")};
+}
+
+QJsonObject partObject(const MySqlParallelDump::Part &part, Compressor::Codec codec)
+{
+    QJsonObject o;
+    o.insert(QLatin1String("file"), part.fileName + Compressor::fileExtension(codec));
+    o.insert(QLatin1String("tables"), QJsonArray::fromStringList(part.tables));
+    o.insert(QLatin1String("sha256"), QString::fromLatin1(part.sha256.toHex()));
+    o.insert(QLatin1String("size"), part.uncompressedSize);
+    return o;
+}
+}
+
+MySqlParallelDump::MySqlParallelDump(const QString &defaultsFile, const QString &database, const QString &outputDir, int jobs)
+    : m_defaultsFile(defaultsFile),
+      m_database(database),
+      m_outputDir(outputDir),
+      m_jobs(std::max(jobs, 1))
+{
+}
+
+MySqlParallelDump::~MySqlParallelDump() = default;
+
+void MySqlParallelDump::setCompression(Compressor::Codec codec, int level, int threads)
+{
+    m_codec = codec;
+    m_level = level;
+    m_threads = std::max(threads, 0);
+}
+
+void MySqlParallelDump::setLockTimeout(int seconds)
+{
+    m_lockTimeout = std::max(seconds, 1);
+}
+
+bool MySqlParallelDump::readTables(std::vector<Table> *tables, QStringList *views)
+{
+    QProcess mysql;
+    QStringList args = clientArgs(m_defaultsFile);
+    args << QStringLiteral("--raw")
+         << QStringLiteral("--execute=SELECT TABLE_NAME, TABLE_TYPE, COALESCE(DATA_LENGTH, 0) FROM information_schema.TABLES WHERE TABLE_SCHEMA = DATABASE() ORDER BY TABLE_NAME")
+         << m_database;
+    mysql.start(QStringLiteral("mysql"), args);
+    if (!mysql.waitForFinished(-1) || mysql.exitStatus() != QProcess::NormalExit || mysql.exitCode() != 0) {
+        m_standardError += QString::fromUtf8(mysql.readAllStandardError());
+        m_errorString = QStringLiteral("Failed to read the tables of %1: %2").arg(m_database, mysql.errorString());
+        return false;
+    }
+
+    const QList<QByteArray> lines = mysql.readAllStandardOutput().split('\n');
+    for (const QByteArray &line : lines) {
+        const QList<QByteArray> fields = line.split('\t');
+        if (fields.size() != 3) {
+            continue;
+        }
+        const QString name = QString::fromUtf8(fields.at(0));
+        if (fields.at(1) == "VIEW") {
+            views->append(name);
+        } else {
+            // base tables and MariaDB sequences
+            tables->push_back({name, fields.at(2).toLongLong()});
+        }
+    }
+
+    return true;
+}
+
+bool MySqlParallelDump::run()
+{
+    const auto start = std::chrono::steady_clock::now();
+    m_result = Result();
+    m_errorString.clear();
+    m_standardError.clear();
+
+    std::vector<Table> tables;
+    QStringList views;
+    if (!readTables(&tables, &views)) {
+        return false;
+    }
+
+    if (!QDir().mkpath(m_outputDir)) {
+        m_errorString = QStringLiteral("Failed to create directory %1").arg(m_outputDir);
+        return false;
+    }
+
+    // longest processing time first: the next largest table goes to the job with the least data
+    std::sort(tables.begin(), tables.end(), [](const Table &a, const Table &b){
+        return a.size > b.size;
+    });
+    // an empty database still gets a part with the header of the dump
+    const std::size_t jobCount = tables.empty() ? (views.empty() ? 1 : 0) : std::min(tables.size(), static_cast<std::size_t>(m_jobs));
+    std::vector<qint64> jobSizes(jobCount, 0);
+    m_result.parts.resize(jobCount);
+    for (const Table &table : tables) {
+        const auto smallest = static_cast<std::size_t>(std::distance(jobSizes.cbegin(), std::min_element(jobSizes.cbegin(), jobSizes.cend())));
+        jobSizes[smallest] += table.size;
+        m_result.parts[smallest].tables.append(table.name);
+    }
+    for (std::size_t i = 0; i < jobCount; ++i) {
+        m_result.parts[i].fileName = QStringLiteral("part-%1.sql").arg(i + 1, 3, 10, QLatin1Char('0'));
+        m_result.parts[i].tables.sort();
+    }
+    // views reference the tables and are restored after all of them
+    if (!views.empty()) {
+        Part viewPart;
+        viewPart.fileName = QStringLiteral("views.sql");
+        viewPart.tables = views;
+        viewPart.views = true;
+        m_result.parts.push_back(viewPart);
+    }
+
+    QProcess coordinator;
+    QStringList coordinatorArgs = clientArgs(m_defaultsFile);
+    coordinatorArgs << QStringLiteral("--unbuffered") << m_database;
+    coordinator.start(QStringLiteral("mysql"), coordinatorArgs);
+    if (!coordinator.waitForStarted(-1)) {
+        m_errorString = QStringLiteral("Failed to start mysql: %1").arg(coordinator.errorString());
+        return false;
+    }
+    coordinator.write(QStringLiteral("SET SESSION lock_wait_timeout = %1;\nFLUSH TABLES WITH READ LOCK;\nSELECT 'locked';\n").arg(m_lockTimeout).toLatin1());
+    QByteArray coordinatorOutput;
+    while (!coordinatorOutput.contains("locked\n")) {
+        if (!coordinator.waitForReadyRead(-1)) {
+            coordinator.waitForFinished(-1);
+            m_standardError += QString::fromUtf8(coordinator.readAllStandardError());
+            m_errorString = QStringLiteral("Failed to acquire the global read lock on %1").arg(m_database);
+            return false;
+        }
+        coordinatorOutput += coordinator.readAllStandardOutput();
+    }
+    const auto locked = std::chrono::steady_clock::now();
+
+    const int threads = m_threads > 0 ? m_threads : QThread::idealThreadCount();
+    const int threadsPerJob = std::max(threads / static_cast<int>(m_result.parts.size()), 1);
+
+    std::mutex mutex;
+    std::condition_variable settledCondition;
+    std::size_t settled = 0;
+    std::vector<bool> jobSettled(m_result.parts.size(), false);
+    auto settle = [&](std::size_t job){
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (!jobSettled[job]) {
+            jobSettled[job] = true;
+            settled++;
+            settledCondition.notify_one();
+        }
+    };
+
+    std::vector<std::unique_ptr<DumpPipeline>> pipelines;
+    // not std::vector<bool>, the jobs write their results concurrently
+    std::vector<char> success(m_result.parts.size(), 0);
+    std::vector<std::thread> workers;
+    // the first lines mysqldump --verbose writes after its transaction has been started
+    const QByteArrayList snapshotMarkers({QByteArrayLiteral("-- Setting savepoint"), QByteArrayLiteral("-- Retrieving table structure")});
+    pipelines.reserve(m_result.parts.size());
+    workers.reserve(m_result.parts.size());
+    for (std::size_t i = 0; i < m_result.parts.size(); ++i) {
+        const Part &part = m_result.parts.at(i);
+        QStringList args({QLatin1String("--defaults-file=") + m_defaultsFile, QStringLiteral("--single-transaction"), QStringLiteral("--verbose"), m_database});
+        args << part.tables;
+        pipelines.push_back(std::make_unique<DumpPipeline>(QStringLiteral("mysqldump"), args, m_outputDir + QLatin1Char('/') + part.fileName + Compressor::fileExtension(m_codec)));
+        DumpPipeline *pipeline = pipelines.back().get();
+        pipeline->setCompression(m_codec, m_level, threadsPerJob);
+        pipeline->setProgressMarkers(snapshotMarkers, [&settle, i](){
+            settle(i);
+        });
+        workers.emplace_back([pipeline, &success, &settle, i](){
+            success[i] = pipeline->run() ? 1 : 0;
+            // a job that failed before its transaction must not keep the lock
+            settle(i);
+        });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        settledCondition.wait(lock, [&settled, &jobSettled](){
+            return settled == jobSettled.size();
+        });
+    }
+
+    coordinator.write("UNLOCK TABLES;\n");
+    coordinator.closeWriteChannel();
+    m_result.lockTime = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - locked).count());
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    coordinator.waitForFinished(-1);
+
+    bool allSucceeded = true;
+    for (std::size_t i = 0; i < m_result.parts.size(); ++i) {
+        Part &part = m_result.parts[i];
+        const DumpPipeline &pipeline = *pipelines.at(i);
+        const QString standardError = pipeline.standardError().trimmed();
+        if (!standardError.isEmpty()) {
+            m_standardError += part.fileName + QLatin1String(": ") + standardError + QLatin1Char('\n');
+        }
+        if (success.at(i) == 0) {
+            if (allSucceeded) {
+                m_errorString = part.fileName + QLatin1String(": ") + pipeline.errorString();
+            }
+            allSucceeded = false;
+            continue;
+        }
+        const DumpPipeline::Result result = pipeline.result();
+        part.sha256 = result.sha256;
+        part.uncompressedSize = result.uncompressedSize;
+        part.fileSize = result.fileSize;
+        part.compressionTime = result.compressionTime;
+        m_result.uncompressedSize += result.uncompressedSize;
+        m_result.fileSize += result.fileSize;
+        m_result.compressionTime += result.compressionTime;
+    }
+
+    if (!allSucceeded || !writeManifest()) {
+        return false;
+    }
+
+    m_result.timeUsed = static_cast<qint64>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    return true;
+}
+
+bool MySqlParallelDump::writeManifest()
+{
+    QJsonObject root;
+    root.insert(QLatin1String("database"), m_database);
+    root.insert(QLatin1String("created"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    root.insert(QLatin1String("compression"), Compressor::codecName(m_codec));
+    root.insert(QLatin1String("compressionLevel"), m_level);
+    root.insert(QLatin1String("lockTime"), m_result.lockTime);
+
+    // the table parts can be restored in parallel, the views afterwards
+    QJsonArray parts;
+    for (const Part &part : std::as_const(m_result.parts)) {
+        if (part.views) {
+            root.insert(QLatin1String("views"), partObject(part, m_codec));
+        } else {
+            parts.append(partObject(part, m_codec));
+        }
+    }
+    root.insert(QLatin1String("parts"), parts);
+
+    QSaveFile f(m_outputDir + QLatin1String("/manifest.json"));
+    if (!f.open(QIODevice::WriteOnly)) {
+        m_errorString = f.errorString();
+        return false;
+    }
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    if (!f.commit()) {
+        m_errorString = f.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+MySqlParallelDump::Result MySqlParallelDump::result() const
+{
+    return m_result;
+}
+
+QString MySqlParallelDump::errorString() const
+{
+    return m_errorString;
+}
+
+QString MySqlParallelDump::standardError() const
+{
+    return m_standardError;
+}
@@ -0,0 +1,111 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MYSQLPARALLELDUMP_H
+#define MYSQLPARALLELDUMP_H
+
+#include "compressor.h"
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+/*!
+ * \brief Dumps the tables of a MySQL/MariaDB database with multiple mysqldump processes.
+ *
+ * The tables are distributed over the jobs by their \c DATA_LENGTH from \c information_schema,
+ * the largest table first to the job with the least data. Every job runs \c mysqldump with
+ * \c --single-transaction through its own DumpPipeline into a part file in the output directory.
+ * Views are dumped into an additional part after the tables.
+ *
+ * To get the same consistent snapshot in every job, a coordinating \c mysql connection holds
+ * <tt>FLUSH TABLES WITH READ LOCK</tt> while the jobs start their transactions. The lock is
+ * released as soon as every job has reported its first table, writes are only blocked for the
+ * time it takes to connect. Tables of non-transactional engines like MyISAM are only consistent
+ * with each other while the lock is held.
+ *
+ * A \c manifest.json in the output directory lists the parts with their tables and hashes, so
+ * that a restore can load the table parts in parallel before the views.
+ */
+class MySqlParallelDump
+{
+public:
+    struct Part {
+        QString fileName;
+        QStringList tables;
+        // the hash of the plain dump, the file might be compressed
+        QByteArray sha256;
+        qint64 uncompressedSize = 0;
+        qint64 fileSize = 0;
+        qint64 compressionTime = 0;
+        bool views = false;
+    };
+
+    struct Result {
+        std::vector<Part> parts;
+        qint64 uncompressedSize = 0;
+        qint64 fileSize = 0;
+        qint64 compressionTime = 0;
+        // time between acquiring and releasing the global read lock
+        qint64 lockTime = 0;
+        qint64 timeUsed = 0;
+    };
+
+    /*!
+     * \brief Constructs a dump of \a database with the client configuration in \a defaultsFile into \a outputDir.
+     */
+    MySqlParallelDump(const QString &defaultsFile, const QString &database, const QString &outputDir, int jobs);
+    ~MySqlParallelDump();
+
+    /*!
+     * \brief Sets the compression of the parts, the compressor \a threads are shared by all jobs.
+     */
+    void setCompression(Compressor::Codec codec, int level, int threads = 0);
+
+    /*!
+     * \brief Sets the seconds to wait for the global read lock before giving up, default is \c 60.
+     */
+    void setLockTimeout(int seconds);
+
+    /*!
+     * \brief Creates the output directory and runs the dump, blocks until all jobs have been finished.
+     *
+     * Returns \c false if a table list, the lock or a job failed, see errorString().
+     */
+    bool run();
+
+    [[nodiscard]] Result result() const;
+    [[nodiscard]] QString errorString() const;
+
+    /*!
+     * \brief Returns what the mysql and mysqldump processes wrote to their standard error.
+     */
+    [[nodiscard]] QString standardError() const;
+
+private:
+    struct Table {
+        QString name;
+        qint64 size = 0;
+    };
+
+    bool readTables(std::vector<Table> *tables, QStringList *views);
+    bool writeManifest();
+
+    QString m_defaultsFile;
+    QString m_database;
+    QString m_outputDir;
+    QString m_errorString;
+    QString m_standardError;
+    Result m_result;
+    Compressor::Codec m_codec = Compressor::Xz;
+    int m_level = 6;
+    int m_threads = 0;
+    int m_jobs = 1;
+    int m_lockTimeout = 60;
+
+    Q_DISABLE_COPY(MySqlParallelDump)
+};
+
+#endif // MYSQLPARALLELDUMP_H
@@ -99,6 +99,9 @@ bool NextcloudBackup::loadConfiguration()
         setDbType(DbBackup::MySQL);
     } else if (dbType.compare(QLatin1String("pgsql")) == 0) {
         setDbType(DbBackup::PostgreSQL);
+        if (!dbPortFound) {
+            dbPort = DbBackup::pgsqlDefaultPort;
+        }
     } else {
         logError(qtTrId("SIHHURI_CRIT_INVALID_DB_TYPE").arg(dbType));
         return false;
@@ -107,12 +110,28 @@ bool NextcloudBackup::loadConfiguration()
     setDbName(dbName);
     setDbUser(dbUser);
     setDbPassword(dbPassword);
+    // Nextcloud also allows the port or the socket to be appended to the host
+    if (!dbHost.startsWith(QLatin1Char('/')) && dbHost.count(QLatin1Char(':')) == 1) {
+        const QString appended = dbHost.section(QLatin1Char(':'), 1);
+        if (appended.startsWith(QLatin1Char('/'))) {
+            dbHost = appended;
+        } else {
+            dbPort = appended.toInt();
+            dbHost = dbHost.section(QLatin1Char(':'), 0, 0);
+        }
+    }
+
     setDbHost(dbHost);
     setDbPort(dbPort);
 
     return true;
 }
 
+bool NextcloudBackup::supportsPreSync() const
+{
+    return true;
+}
+
 void NextcloudBackup::enableMaintenance()
 {
     logInfo(qtTrId("SIHHURI_INFO_ENABLE_MAINTENANCE"));
@@ -0,0 +1,215 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "pathfilter.h"
+
+namespace {
+bool needsPath(QString pattern)
+{
+    if (pattern.endsWith(QLatin1Char('/'))) {
+        pattern.chop(1);
+    }
+    return pattern.contains(QLatin1Char('/')) || pattern.contains(QLatin1String("**"));
+}
+}
+
+PathFilter::PathFilter(const QStringList &includes, const QStringList &excludes)
+{
+    for (const QString &pattern : includes) {
+        if (!pattern.isEmpty()) {
+            m_includes.append(pattern);
+        }
+    }
+    for (const QString &pattern : excludes) {
+        if (!pattern.isEmpty()) {
+            m_excludes.append(pattern);
+        }
+    }
+
+    if (m_excludes.empty()) {
+        return;
+    }
+
+    for (const QStringList *patterns : {&m_includes, &m_excludes}) {
+        for (const QString &pattern : *patterns) {
+            if (needsPath(pattern)) {
+                m_namesOnly = false;
+            }
+        }
+    }
+
+    m_excludeRe = compile(m_excludes);
+    if (!m_excludeRe.isValid()) {
+        m_errorString = m_excludeRe.errorString();
+        return;
+    }
+    if (!m_includes.empty()) {
+        m_includeRe = compile(m_includes);
+        if (!m_includeRe.isValid()) {
+            m_errorString = m_includeRe.errorString();
+        }
+    }
+}
+
+bool PathFilter::isEmpty() const
+{
+    return m_excludes.empty();
+}
+
+bool PathFilter::isValid() const
+{
+    return m_errorString.isEmpty();
+}
+
+QString PathFilter::errorString() const
+{
+    return m_errorString;
+}
+
+bool PathFilter::isExcluded(std::string_view relPath, bool isDir) const
+{
+    if (m_excludes.empty()) {
+        return false;
+    }
+    if (m_namesOnly) {
+        const std::size_t slash = relPath.rfind('/');
+        if (slash != std::string_view::npos) {
+            relPath.remove_prefix(slash + 1);
+        }
+    }
+    QString subject = QString::fromUtf8(relPath.data(), static_cast<qsizetype>(relPath.size()));
+    if (isDir) {
+        subject.append(QLatin1Char('/'));
+    }
+    return match(subject);
+}
+
+bool PathFilter::isExcluded(const QString &relPath, bool isDir) const
+{
+    if (m_excludes.empty()) {
+        return false;
+    }
+    QString subject = m_namesOnly ? relPath.mid(relPath.lastIndexOf(QLatin1Char('/')) + 1) : relPath;
+    if (isDir) {
+        subject.append(QLatin1Char('/'));
+    }
+    return match(subject);
+}
+
+bool PathFilter::isPathExcluded(std::string_view relPath, bool isDir) const
+{
+    if (m_excludes.empty()) {
+        return false;
+    }
+    for (std::size_t pos = relPath.find('/'); pos != std::string_view::npos; pos = relPath.find('/', pos + 1)) {
+        if (isExcluded(relPath.substr(0, pos), true)) {
+            return true;
+        }
+    }
+    return isExcluded(relPath, isDir);
+}
+
+bool PathFilter::match(const QString &subject) const
+{
+    if (!m_excludeRe.match(subject).hasMatch()) {
+        return false;
+    }
+    return m_includes.empty() || !m_includeRe.match(subject).hasMatch();
+}
+
+QStringList PathFilter::rsyncArgs(const QString &dir) const
+{
+    QStringList args;
+    if (m_excludes.empty()) {
+        return args;
+    }
+
+    QString prefix = dir;
+    static const QRegularExpression wildcards(QStringLiteral("[*?\\[]"));
+    if (prefix.contains(wildcards)) {
+        prefix.replace(QRegularExpression(QStringLiteral("([*?\\[\\\\])")), QStringLiteral("\\\\1"));
+    }
+
+    // includes first, the first matching rule wins
+    for (const QString &pattern : m_includes) {
+        args << QStringLiteral("--include=") + (pattern.startsWith(QLatin1Char('/')) ? prefix + pattern : pattern);
+    }
+    for (const QString &pattern : m_excludes) {
+        args << QStringLiteral("--exclude=") + (pattern.startsWith(QLatin1Char('/')) ? prefix + pattern : pattern);
+    }
+    return args;
+}
+
+QString PathFilter::globToRegex(const QString &pattern)
+{
+    QString glob = pattern;
+    const bool dirOnly = glob.endsWith(QLatin1Char('/'));
+    if (dirOnly) {
+        glob.chop(1);
+    }
+    const bool anchored = glob.startsWith(QLatin1Char('/'));
+    if (anchored) {
+        glob.remove(0, 1);
+    }
+
+    QString re = anchored ? QStringLiteral("^") : QStringLiteral("(?:^|/)");
+    for (qsizetype i = 0; i < glob.size(); ++i) {
+        const QChar c = glob.at(i);
+        if (c == QLatin1Char('*')) {
+            if (i + 1 < glob.size() && glob.at(i + 1) == QLatin1Char('*')) {
+                re.append(QLatin1String(".*"));
+                ++i;
+            } else {
+                re.append(QLatin1String("[^/]*"));
+            }
+        } else if (c == QLatin1Char('?')) {
+            re.append(QLatin1String("[^/]"));
+        } else if (c == QLatin1Char('[')) {
+            qsizetype end = i + 1;
+            if (end < glob.size() && (glob.at(end) == QLatin1Char('!') || glob.at(end) == QLatin1Char('^'))) {
+                ++end;
+            }
+            // a ] directly after the opening bracket is part of the class
+            if (end < glob.size() && glob.at(end) == QLatin1Char(']')) {
+                ++end;
+            }
+            end = glob.indexOf(QLatin1Char(']'), end);
+            if (end < 0) {
+                re.append(QLatin1String("\\["));
+                continue;
+            }
+            QString set = glob.mid(i + 1, end - i - 1);
+            re.append(QLatin1Char('['));
+            if (set.startsWith(QLatin1Char('!')) || set.startsWith(QLatin1Char('^'))) {
+                re.append(QLatin1Char('^'));
+                set.remove(0, 1);
+            }
+            set.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+            set.replace(QLatin1Char('['), QLatin1String("\\["));
+            set.replace(QLatin1Char(']'), QLatin1String("\\]"));
+            re.append(set);
+            re.append(QLatin1Char(']'));
+            i = end;
+        } else if (c == QLatin1Char('\\') && i + 1 < glob.size()) {
+            re.append(QRegularExpression::escape(QString(glob.at(++i))));
+        } else {
+            re.append(QRegularExpression::escape(QString(c)));
+        }
+    }
+    re.append(dirOnly ? QLatin1String("/$") : QLatin1String("/?$"));
+    return re;
+}
+
+QRegularExpression PathFilter::compile(const QStringList &patterns)
+{
+    QStringList alternatives;
+    alternatives.reserve(patterns.size());
+    for (const QString &pattern : patterns) {
+        alternatives.append(QLatin1String("(?:") + globToRegex(pattern) + QLatin1Char(')'));
+    }
+    QRegularExpression re(alternatives.join(QLatin1Char('|')), QRegularExpression::DontCaptureOption);
+    re.optimize();
+    return re;
+}
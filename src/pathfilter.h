@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PATHFILTER_H
+#define PATHFILTER_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <string_view>
+
+/*!
+ * \brief Matches paths against the include and exclude glob patterns of a backup item.
+ *
+ * The patterns follow the rsync filter rules: \c * matches any characters except \c /,
+ * \c ** also matches \c /, \c ? matches a single character except \c / and \c [...] a
+ * character class. A pattern with a trailing \c / only matches directories. A pattern
+ * that starts with \c / is anchored at the synced directory, other patterns match the
+ * end of the path at a component boundary, so that \c *.log matches log files at any
+ * depth and \c cache/preview every \c preview entry inside a \c cache directory.
+ *
+ * A path is excluded if it matches an exclude pattern and no include pattern. Includes
+ * therefore only take back parts of excludes. The content of an excluded directory is
+ * excluded as well and excluded entries in the depot are not deleted, like with rsync.
+ *
+ * All patterns of a type are compiled into a single regular expression. If no pattern
+ * contains a \c / besides a trailing one, only the names of the entries are matched.
+ * Matching is thread safe.
+ */
+class PathFilter
+{
+public:
+    PathFilter() = default;
+    PathFilter(const QStringList &includes, const QStringList &excludes);
+
+    /*!
+     * \brief Returns \c true if the filter has no exclude patterns and therefore matches nothing.
+     */
+    [[nodiscard]] bool isEmpty() const;
+
+    /*!
+     * \brief Returns \c false if a pattern could not be compiled, see errorString().
+     */
+    [[nodiscard]] bool isValid() const;
+    [[nodiscard]] QString errorString() const;
+
+    /*!
+     * \brief Returns \c true if the entry at \a relPath relative to the synced directory is excluded.
+     *
+     * \a relPath has no leading \c / and is encoded with QFile::encodeName().
+     */
+    [[nodiscard]] bool isExcluded(std::string_view relPath, bool isDir) const;
+
+    /*!
+     * \overload
+     */
+    [[nodiscard]] bool isExcluded(const QString &relPath, bool isDir) const;
+
+    /*!
+     * \brief Returns \c true if \a relPath or one of its parent directories is excluded.
+     *
+     * Walkers skip excluded directories and only have to check the entries themselves,
+     * this is for single paths like the entries of change journals.
+     */
+    [[nodiscard]] bool isPathExcluded(std::string_view relPath, bool isDir) const;
+
+    /*!
+     * \brief Returns the rsync arguments for a transfer of \a dir with relative paths.
+     *
+     * Anchored patterns are prefixed with \a dir, because the transfer root of
+     * <tt>rsync -R</tt> is the file system root.
+     */
+    [[nodiscard]] QStringList rsyncArgs(const QString &dir) const;
+
+private:
+    [[nodiscard]] static QString globToRegex(const QString &pattern);
+    [[nodiscard]] static QRegularExpression compile(const QStringList &patterns);
+    [[nodiscard]] bool match(const QString &subject) const;
+
+    QStringList m_includes;
+    QStringList m_excludes;
+    QRegularExpression m_includeRe;
+    QRegularExpression m_excludeRe;
+    QString m_errorString;
+    bool m_namesOnly = true;
+};
+
+#endif // PATHFILTER_H
@@ -0,0 +1,261 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "retentionpruner.h"
+#include "workstealingqueue.h"
+#include "dirents.h"
+#include "ioprio.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QTimeZone>
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <set>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const QLatin1String incompleteSuffix(".incomplete");
+
+QDateTime generationTime(QString name)
+{
+    if (name.endsWith(incompleteSuffix)) {
+        name.chop(incompleteSuffix.size());
+    }
+    if (name.size() != 16 || name.at(8) != QLatin1Char('T') || name.at(15) != QLatin1Char('Z')) {
+        return {};
+    }
+    const QDate date = QDate::fromString(name.left(8), QStringLiteral("yyyyMMdd"));
+    const QTime time = QTime::fromString(name.mid(9, 6), QStringLiteral("HHmmss"));
+    if (!date.isValid() || !time.isValid()) {
+        return {};
+    }
+    return QDateTime(date, time, QTimeZone::utc()).toLocalTime();
+}
+}
+
+struct RetentionPruner::Worker {
+    std::vector<char> direntBuffer = std::vector<char>(Dirents::defaultBufferSize);
+    std::vector<std::pair<std::string,unsigned char>> entries;
+    std::vector<Dir> dirs;
+    std::string childPath;
+    Result result;
+};
+
+bool RetentionPruner::Policy::isEmpty() const
+{
+    return daily <= 0 && weekly <= 0 && monthly <= 0;
+}
+
+RetentionPruner::RetentionPruner(const QString &generationsDir, const QString &latest, const Policy &policy, int threads)
+    : m_generationsDir(generationsDir),
+      m_latest(latest),
+      m_policy(policy),
+      m_threads(threads > 0 ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency())))
+{
+}
+
+RetentionPruner::~RetentionPruner() = default;
+
+QStringList RetentionPruner::expired(const QStringList &generations, const QString &latest, const Policy &policy)
+{
+    std::vector<std::pair<QDateTime,QString>> complete;
+    std::vector<std::pair<QDateTime,QString>> incomplete;
+    for (const QString &name : generations) {
+        const QDateTime time = generationTime(name);
+        if (!time.isValid()) {
+            continue;
+        }
+        if (name.endsWith(incompleteSuffix)) {
+            incomplete.emplace_back(time, name);
+        } else {
+            complete.emplace_back(time, name);
+        }
+    }
+    // newest first, the names sort like their times
+    std::sort(complete.begin(), complete.end(), [](const auto &a, const auto &b){ return a.second > b.second; });
+
+    std::set<qint64> days;
+    std::set<int> weeks;
+    std::set<int> months;
+    QStringList result;
+    for (const auto &generation : complete) {
+        const QDate date = generation.first.date();
+        int weekYear = 0;
+        const int week = date.weekNumber(&weekYear);
+        bool keep = generation.second == latest;
+        if (days.size() < static_cast<std::size_t>(std::max(policy.daily, 0)) && days.insert(date.toJulianDay()).second) {
+            keep = true;
+        }
+        if (weeks.size() < static_cast<std::size_t>(std::max(policy.weekly, 0)) && weeks.insert(weekYear * 100 + week).second) {
+            keep = true;
+        }
+        if (months.size() < static_cast<std::size_t>(std::max(policy.monthly, 0)) && months.insert(date.year() * 100 + date.month()).second) {
+            keep = true;
+        }
+        if (!keep) {
+            result.append(generation.second);
+        }
+    }
+
+    // incomplete generations are only kept while they are newer than every complete one
+    const QDateTime newestComplete = complete.empty() ? QDateTime() : complete.front().first;
+    for (const auto &generation : incomplete) {
+        if (newestComplete.isValid() && generation.first <= newestComplete) {
+            result.append(generation.second);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool RetentionPruner::run()
+{
+    m_result = Result();
+    m_removed.clear();
+    m_errorString.clear();
+
+    IoPriority::setIdle();
+
+    const QDir dir(m_generationsDir);
+    if (!dir.exists()) {
+        m_errorString = QStringLiteral("%1 does not exist").arg(m_generationsDir);
+        return false;
+    }
+
+    if (m_policy.isEmpty()) {
+        return true;
+    }
+
+    const QStringList generations = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDir::Name);
+    const QStringList expiredGenerations = expired(generations, m_latest, m_policy);
+    for (const QString &generation : expiredGenerations) {
+        if (removeTree(QFile::encodeName(dir.absoluteFilePath(generation)).toStdString())) {
+            m_removed.append(generation);
+            m_result.generations++;
+        }
+    }
+
+    return true;
+}
+
+QStringList RetentionPruner::removed() const
+{
+    return m_removed;
+}
+
+RetentionPruner::Result RetentionPruner::result() const
+{
+    return m_result;
+}
+
+QString RetentionPruner::errorString() const
+{
+    return m_errorString;
+}
+
+bool RetentionPruner::removeTree(const std::string &path)
+{
+    const auto count = static_cast<std::size_t>(m_threads);
+    std::vector<Worker> workers(count);
+    WorkStealingQueue<std::string> queue(count);
+    queue.push(0, path);
+
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (std::size_t index = 0; index < count; ++index) {
+        threads.emplace_back([this, index, &workers, &queue](){
+            IoPriority::setIdle();
+            Worker &worker = workers[index];
+            while (auto dirPath = queue.pop(index)) {
+                processDir(worker, index, *dirPath, queue);
+                queue.taskDone();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<Dir> dirs;
+    qint64 errors = 0;
+    for (Worker &worker : workers) {
+        m_result.files += worker.result.files;
+        m_result.reclaimedBytes += worker.result.reclaimedBytes;
+        errors += worker.result.errors;
+        std::move(worker.dirs.begin(), worker.dirs.end(), std::back_inserter(dirs));
+    }
+
+    // children before their parents, a parent path is always shorter
+    std::sort(dirs.begin(), dirs.end(), [](const Dir &a, const Dir &b){ return a.path.size() > b.path.size(); });
+    for (const Dir &dir : dirs) {
+        if (::rmdir(dir.path.c_str()) == 0) {
+            m_result.dirs++;
+            m_result.reclaimedBytes += dir.bytes;
+        } else {
+            errors++;
+        }
+    }
+
+    m_result.errors += errors;
+    return errors == 0;
+}
+
+void RetentionPruner::processDir(Worker &worker, std::size_t index, const std::string &path, WorkStealingQueue<std::string> &queue)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        worker.result.errors++;
+        return;
+    }
+
+    struct statx dirSt{};
+    const qint64 dirBytes = statx(fd, "", AT_EMPTY_PATH, STATX_BLOCKS, &dirSt) == 0 ? static_cast<qint64>(dirSt.stx_blocks) * 512 : 0;
+    worker.dirs.push_back({path, dirBytes});
+
+    // the directory is read completely first, removing entries while reading may skip some
+    worker.entries.clear();
+    const bool ok = Dirents::forEach(fd, worker.direntBuffer, [&worker](const char *name, unsigned char type){
+        worker.entries.emplace_back(name, type);
+    });
+    if (!ok) {
+        worker.result.errors++;
+    }
+
+    for (const auto &entry : std::as_const(worker.entries)) {
+        const char *name = entry.first.c_str();
+        struct statx st{};
+        const unsigned int mask = STATX_NLINK | STATX_BLOCKS | (entry.second == DT_UNKNOWN ? STATX_TYPE : 0U);
+        const bool haveStat = entry.second != DT_DIR && statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC, mask, &st) == 0;
+
+        if (entry.second == DT_DIR || (entry.second == DT_UNKNOWN && haveStat && S_ISDIR(st.stx_mode))) {
+            worker.childPath.assign(path);
+            worker.childPath.push_back('/');
+            worker.childPath.append(entry.first);
+            queue.push(index, worker.childPath);
+            continue;
+        }
+
+        if (::unlinkat(fd, name, 0) != 0) {
+            if (errno != ENOENT) {
+                worker.result.errors++;
+            }
+            continue;
+        }
+        worker.result.files++;
+        // the blocks of files that are still linked from other generations stay allocated
+        if (haveStat && st.stx_nlink == 1) {
+            worker.result.reclaimedBytes += static_cast<qint64>(st.stx_blocks) * 512;
+        }
+    }
+
+    ::close(fd);
+}
@@ -0,0 +1,99 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef RETENTIONPRUNER_H
+#define RETENTIONPRUNER_H
+
+#include <QString>
+#include <QStringList>
+#include <string>
+#include <vector>
+
+template<typename T> class WorkStealingQueue;
+
+/*!
+ * \brief Removes the generations of a depot that are not kept by a grandfather-father-son policy.
+ *
+ * Generations are directories named after their UTC creation time, see AbstractBackup.
+ * For every day, ISO week and month in local time the newest complete generation is
+ * kept, until the number of days, weeks and months of the Policy has been reached. The
+ * \a latest generation is always kept. Generations with the suffix \c .incomplete are
+ * removed as soon as a newer complete generation exists. Other directories are ignored.
+ *
+ * Generations are removed one after another starting with the oldest, every single
+ * tree is removed by multiple threads with idle I/O priority. Each thread reads a
+ * directory completely and then unlinks its entries with unlinkat() relative to the
+ * directory, the emptied directories are removed from the deepest up after the walk.
+ * Only the blocks of files without further hard links, that are usually still used by
+ * newer generations, are counted as reclaimed.
+ */
+class RetentionPruner
+{
+public:
+    struct Policy {
+        int daily = 0;
+        int weekly = 0;
+        int monthly = 0;
+
+        /*!
+         * \brief Returns \c true if no generation count has been set, pruning is disabled then.
+         */
+        [[nodiscard]] bool isEmpty() const;
+    };
+
+    struct Result {
+        qint64 generations = 0;
+        qint64 files = 0;
+        qint64 dirs = 0;
+        qint64 reclaimedBytes = 0;
+        qint64 errors = 0;
+    };
+
+    /*!
+     * \brief Constructs a new pruner for the generations below \a generationsDir, \a threads <= 0 uses the number of CPU cores.
+     */
+    RetentionPruner(const QString &generationsDir, const QString &latest, const Policy &policy, int threads = 0);
+    ~RetentionPruner();
+
+    /*!
+     * \brief Returns the names out of \a generations that are not kept by \a policy, sorted from oldest to newest.
+     */
+    [[nodiscard]] static QStringList expired(const QStringList &generations, const QString &latest, const Policy &policy);
+
+    /*!
+     * \brief Removes the expired generations and blocks until it has been finished.
+     *
+     * Lowers the I/O priority of the calling thread. Returns \c false if the generations
+     * directory can not be read. Entries that can not be removed are counted in
+     * Result::errors, their generation is then kept partially.
+     */
+    bool run();
+
+    [[nodiscard]] QStringList removed() const;
+    [[nodiscard]] Result result() const;
+    [[nodiscard]] QString errorString() const;
+
+private:
+    struct Worker;
+    struct Dir {
+        std::string path;
+        qint64 bytes = 0;
+    };
+
+    bool removeTree(const std::string &path);
+    void processDir(Worker &worker, std::size_t index, const std::string &path, WorkStealingQueue<std::string> &queue);
+
+    QString m_generationsDir;
+    QString m_latest;
+    QStringList m_removed;
+    QString m_errorString;
+    Result m_result;
+    Policy m_policy;
+    int m_threads = 1;
+
+    Q_DISABLE_COPY(RetentionPruner)
+};
+
+#endif // RETENTIONPRUNER_H
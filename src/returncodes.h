@@ -9,6 +9,7 @@
 enum class RC : int {
     OK = 0,
     FileSystemError = 1,
+    VerificationFailed = 2,
     InvalidConfig = 6
 };
 
@@ -103,12 +103,12 @@ void RoundcubeBackup::onBackupDatabaseFinished()
 
 void RoundcubeBackup::onBackupDatabaseFailed()
 {
-    emitFinished();
+    disableMaintenance();
 }
 
 void RoundcubeBackup::onBackupDirectoriesFinished()
 {
-    emitFinished();
+    disableMaintenance();
 }
 
 #include "moc_roundcubebackup.cpp"
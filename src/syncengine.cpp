@@ -0,0 +1,1100 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "syncengine.h"
+#include "workstealingqueue.h"
+#include <QFile>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/fs.h>
+#include <map>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace {
+constexpr unsigned int statxMask = STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_ATIME | STATX_MTIME | STATX_SIZE | STATX_NLINK | STATX_INO | STATX_BLOCKS;
+constexpr std::size_t copyBufferSize = 256 * 1024;
+
+std::string joinPath(const std::string &base, const std::string &rel)
+{
+    if (rel.empty()) {
+        return base;
+    }
+    return base + '/' + rel;
+}
+
+bool statEntry(int dirFd, const char *name, struct statx *st)
+{
+    return statx(dirFd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, statxMask, st) == 0;
+}
+
+bool sameTime(const struct statx_timestamp &a, const struct statx_timestamp &b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+unsigned int fileType(const struct statx &st)
+{
+    return st.stx_mode & S_IFMT;
+}
+
+// the size from statx is only a hint, the link might have been replaced by a longer one since
+bool readLink(int dirFd, const char *name, std::size_t sizeHint, std::string *target)
+{
+    constexpr std::size_t maxLinkSize = 1024 * 1024;
+    std::size_t size = std::max<std::size_t>(sizeHint + 1, 256);
+    for (;;) {
+        target->resize(size);
+        const ssize_t len = ::readlinkat(dirFd, name, target->data(), target->size());
+        if (len < 0) {
+            return false;
+        }
+        // a completely filled buffer might have been truncated
+        if (static_cast<std::size_t>(len) < target->size()) {
+            target->resize(static_cast<std::size_t>(len));
+            return true;
+        }
+        if (size >= maxLinkSize) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        size *= 2;
+    }
+}
+
+// RAII wrapper to not leak file descriptors on the many early returns
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int fd = -1) : m_fd(fd) {}
+    ~FileDescriptor() { reset(); }
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    [[nodiscard]] int get() const { return m_fd; }
+    [[nodiscard]] bool isValid() const { return m_fd >= 0; }
+    void reset(int fd = -1)
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+        m_fd = fd;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+// allocated sizes below one block are inline data or tails, not holes
+qint64 holeBytes(const struct statx &st)
+{
+    const qint64 holes = static_cast<qint64>(st.stx_size) - static_cast<qint64>(st.stx_blocks) * 512;
+    return holes >= 4096 ? holes : 0;
+}
+
+using Xattrs = std::map<std::string, std::string>;
+
+// returns 0 or the error number, a file system without extended attributes has none
+int readXattrs(const std::string &path, bool acls, bool others, Xattrs *attrs)
+{
+    attrs->clear();
+    std::vector<char> names;
+    for (;;) {
+        const ssize_t len = ::llistxattr(path.c_str(), nullptr, 0);
+        if (len <= 0) {
+            return len == 0 || errno == EOPNOTSUPP ? 0 : errno;
+        }
+        names.resize(static_cast<std::size_t>(len));
+        const ssize_t got = ::llistxattr(path.c_str(), names.data(), names.size());
+        if (got >= 0) {
+            names.resize(static_cast<std::size_t>(got));
+            break;
+        }
+        // the list has grown in between
+        if (errno != ERANGE) {
+            return errno;
+        }
+    }
+
+    for (std::size_t pos = 0; pos < names.size(); pos += std::strlen(names.data() + pos) + 1) {
+        const char *name = names.data() + pos;
+        const std::string_view view(name);
+        // other attributes of the system namespace are managed by the file systems
+        if (view.starts_with("system.posix_acl_") ? !acls : (!others || view.starts_with("system."))) {
+            continue;
+        }
+        std::string value;
+        ssize_t got = -1;
+        do {
+            const ssize_t len = ::lgetxattr(path.c_str(), name, nullptr, 0);
+            if (len < 0) {
+                break;
+            }
+            value.resize(static_cast<std::size_t>(len));
+            got = ::lgetxattr(path.c_str(), name, value.data(), value.size());
+        } while (got < 0 && errno == ERANGE);
+        if (got < 0) {
+            // removed in between
+            if (errno == ENODATA) {
+                continue;
+            }
+            return errno;
+        }
+        value.resize(static_cast<std::size_t>(got));
+        attrs->emplace(name, std::move(value));
+    }
+    return 0;
+}
+
+// copies len bytes at offset without moving the file offsets, returns 0 or the error number
+int copyRange(int in, int out, qint64 offset, qint64 len, std::vector<char> &buf)
+{
+    auto inOff = static_cast<loff_t>(offset);
+    auto outOff = static_cast<loff_t>(offset);
+    while (len > 0) {
+        const ssize_t n = ::copy_file_range(in, &inOff, out, &outOff, static_cast<size_t>(std::min<qint64>(len, 1LL << 30)), 0);
+        if (n > 0) {
+            len -= n;
+        } else if (n == 0) {
+            return 0;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+            break;
+        } else {
+            return errno;
+        }
+    }
+
+    if (len > 0 && buf.empty()) {
+        buf.resize(copyBufferSize);
+    }
+    while (len > 0) {
+        const ssize_t r = ::pread(in, buf.data(), static_cast<size_t>(std::min<qint64>(len, static_cast<qint64>(buf.size()))), inOff);
+        if (r == 0) {
+            return 0;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        ssize_t written = 0;
+        while (written < r) {
+            const ssize_t w = ::pwrite(out, buf.data() + written, static_cast<size_t>(r - written), outOff + written);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            written += w;
+        }
+        inOff += r;
+        outOff += r;
+        len -= r;
+    }
+    return 0;
+}
+
+// copies only the data regions of a file with holes, returns 0 or the error number
+int copySparse(int in, int out, qint64 size, qint64 *holes)
+{
+    std::vector<char> buf;
+    qint64 data = 0;
+    qint64 offset = 0;
+    while (offset < size) {
+        const off_t start = ::lseek(in, offset, SEEK_DATA);
+        if (start < 0) {
+            // only a hole follows
+            if (errno == ENXIO) {
+                break;
+            }
+            return errno;
+        }
+        if (start >= size) {
+            break;
+        }
+        const off_t end = ::lseek(in, start, SEEK_HOLE);
+        if (end < 0) {
+            return errno;
+        }
+        const qint64 len = std::min<qint64>(end, size) - start;
+        if (const int rc = copyRange(in, out, start, len, buf); rc != 0) {
+            return rc;
+        }
+        data += len;
+        offset = start + len;
+    }
+    // the holes are left out by only extending the file to its size
+    if (::ftruncate(out, size) != 0) {
+        return errno;
+    }
+    *holes = size - data;
+    return 0;
+}
+
+// nftw() has no user data pointer, the removed files are counted per thread
+thread_local qint64 removedFiles = 0;
+
+int removeCallback(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    Q_UNUSED(st)
+    Q_UNUSED(ftw)
+    if (type == FTW_DP) {
+        return ::rmdir(path);
+    }
+    const int rc = ::unlink(path);
+    if (rc == 0) {
+        removedFiles++;
+    }
+    return rc;
+}
+}
+
+SyncEngine::SyncEngine(const QString &sourceRoot, const QString &path, const QString &destinationRoot, int threads)
+    : m_sourceRoot(QFile::encodeName(sourceRoot).toStdString()),
+      m_destinationRoot(QFile::encodeName(destinationRoot).toStdString()),
+      m_path(QFile::encodeName(path).toStdString()),
+      m_threads(threads > 0 ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()))),
+      m_preserveOwner(::geteuid() == 0)
+{
+    while (m_destinationRoot.size() > 1 && m_destinationRoot.back() == '/') {
+        m_destinationRoot.pop_back();
+    }
+    while (m_path.size() > 1 && m_path.back() == '/') {
+        m_path.pop_back();
+    }
+    if (m_path.empty() || m_path.front() != '/') {
+        m_path.insert(m_path.begin(), '/');
+    }
+    m_source = m_sourceRoot + m_path;
+    m_destination = m_destinationRoot + m_path;
+}
+
+SyncEngine::~SyncEngine() = default;
+
+struct SyncEngine::ParentDirs {
+    std::string rel;
+    FileDescriptor src;
+    FileDescriptor dst;
+    bool valid = false;
+};
+
+void SyncEngine::setFileList(std::vector<std::string> changed, std::vector<std::string> deleted, std::vector<std::string> recursive)
+{
+    m_listMode = true;
+    m_changedList = std::move(changed);
+    m_recursiveList = std::move(recursive);
+    m_vanished.clear();
+    m_vanished.reserve(deleted.size());
+    for (const std::string &rel : deleted) {
+        m_vanished.push_back(joinPath(m_destination, rel));
+    }
+}
+
+bool SyncEngine::hasFileList() const
+{
+    return m_listMode;
+}
+
+void SyncEngine::setFilter(const PathFilter &filter)
+{
+    m_filter = filter;
+}
+
+void SyncEngine::setLinkDest(const QString &linkDestRoot)
+{
+    std::string root = QFile::encodeName(linkDestRoot).toStdString();
+    while (root.size() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+    m_linkDest = root.empty() ? root : root + m_path;
+}
+
+void SyncEngine::setPreserve(const Preserve &preserve)
+{
+    m_preserve = preserve;
+}
+
+bool SyncEngine::run()
+{
+    if (!prepareRoot()) {
+        return false;
+    }
+
+    if (m_listMode) {
+        processList();
+        if (!m_recursiveList.empty()) {
+            walk(m_recursiveList);
+        }
+    } else {
+        walk({std::string()});
+    }
+
+    // before the directory times are set, because the links change them
+    createHardLinks();
+    deleteVanished();
+    applyDirAttributes();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_errors.empty();
+}
+
+void SyncEngine::walk(const std::vector<std::string> &roots)
+{
+    const auto workers = static_cast<std::size_t>(m_threads);
+    WorkStealingQueue<std::string> queue(workers);
+    for (std::size_t i = 0; i < roots.size(); ++i) {
+        queue.push(i % workers, roots[i]);
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (std::size_t worker = 0; worker < workers; ++worker) {
+        threads.emplace_back([this, worker, &queue](){
+            while (auto rel = queue.pop(worker)) {
+                processDir(worker, *rel, queue);
+                queue.taskDone();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+SyncEngine::Result SyncEngine::result() const
+{
+    Result r;
+    r.files = m_files.load();
+    r.totalSize = m_totalSize.load();
+    r.created = m_created.load();
+    r.dirs = m_dirs.load();
+    r.transferred = m_transferred.load();
+    r.transferredBytes = m_transferredBytes.load();
+    r.reflinked = m_reflinked.load();
+    r.linked = m_linked.load();
+    r.linkedBytes = m_linkedBytes.load();
+    r.deleted = m_deleted.load();
+    r.hardLinked = m_hardLinked.load();
+    r.hardLinkedBytes = m_hardLinkedBytes.load();
+    r.sparseBytes = m_sparseBytes.load();
+    return r;
+}
+
+QStringList SyncEngine::errors() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_errors;
+}
+
+int SyncEngine::threads() const
+{
+    return m_threads;
+}
+
+bool SyncEngine::prepareRoot()
+{
+    struct statx src{};
+    if (statx(AT_FDCWD, m_source.c_str(), AT_NO_AUTOMOUNT, statxMask, &src) != 0) {
+        addError(m_source, errno);
+        return false;
+    }
+    if (fileType(src) != S_IFDIR) {
+        addError(m_source, ENOTDIR);
+        return false;
+    }
+
+    // like rsync, only the last component of the destination is created if it is missing
+    if (::mkdir(m_destinationRoot.c_str(), 0755) != 0 && errno != EEXIST) {
+        addError(m_destinationRoot, errno);
+        return false;
+    }
+
+    // create the implied directories like rsync -R, taking the attributes from the source side
+    std::string::size_type pos = 0;
+    while ((pos = m_path.find('/', pos + 1)) != std::string::npos) {
+        const std::string implied = m_path.substr(0, pos);
+        const std::string dst = m_destinationRoot + implied;
+        struct statx impliedSrc{};
+        const bool haveSrc = statx(AT_FDCWD, (m_sourceRoot + implied).c_str(), AT_NO_AUTOMOUNT, statxMask, &impliedSrc) == 0;
+        if (::mkdir(dst.c_str(), 0700) == 0) {
+            if (haveSrc) {
+                addDirAttributes(dst, impliedSrc);
+            }
+        } else if (errno != EEXIST) {
+            addError(dst, errno);
+            return false;
+        }
+    }
+
+    struct statx dst{};
+    if (statx(AT_FDCWD, m_destination.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, statxMask, &dst) == 0) {
+        if (fileType(dst) != S_IFDIR && !removeTree(m_destination)) {
+            return false;
+        }
+    }
+    if (::mkdir(m_destination.c_str(), 0700) != 0 && errno != EEXIST) {
+        addError(m_destination, errno);
+        return false;
+    }
+    if (m_preserve.acls || m_preserve.xattrs) {
+        syncXattrs(m_source, m_destination);
+    }
+    addDirAttributes(m_destination, src);
+    m_dirs.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void SyncEngine::processDir(std::size_t worker, const std::string &rel, WorkStealingQueue<std::string> &queue)
+{
+    const std::string srcPath = joinPath(m_source, rel);
+    const std::string dstPath = joinPath(m_destination, rel);
+
+    FileDescriptor srcFd(::open(srcPath.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (!srcFd.isValid()) {
+        addError(srcPath, errno);
+        return;
+    }
+    FileDescriptor dstFd(::open(dstPath.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (!dstFd.isValid()) {
+        addError(dstPath, errno);
+        return;
+    }
+
+    // collect the current destination entries to find the ones that vanished from the source
+    std::unordered_set<std::string> dstNames;
+    {
+        DIR *d = ::fdopendir(::dup(dstFd.get()));
+        if (!d) {
+            addError(dstPath, errno);
+            return;
+        }
+        while (const struct dirent *e = ::readdir(d)) {
+            if (std::strcmp(e->d_name, ".") != 0 && std::strcmp(e->d_name, "..") != 0) {
+                dstNames.emplace(e->d_name);
+            }
+        }
+        ::closedir(d);
+    }
+
+    DIR *d = ::fdopendir(::dup(srcFd.get()));
+    if (!d) {
+        addError(srcPath, errno);
+        return;
+    }
+    errno = 0;
+    while (const struct dirent *e = ::readdir(d)) {
+        const char *name = e->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        const bool listed = dstNames.erase(name) > 0;
+
+        struct statx src{};
+        if (!statEntry(srcFd.get(), name, &src)) {
+            // vanished while walking, rsync reports this as a warning only
+            if (errno != ENOENT) {
+                addError(joinPath(srcPath, name), errno);
+            }
+            continue;
+        }
+
+        // excluded entries are neither synced nor deleted in the destination
+        if (!m_filter.isEmpty() && m_filter.isExcluded(joinPath(rel, name), fileType(src) == S_IFDIR)) {
+            continue;
+        }
+
+        bool isDir = false;
+        if (syncEntry(srcFd.get(), dstFd.get(), rel, name, src, listed, &isDir) && isDir) {
+            queue.push(worker, joinPath(rel, name));
+        }
+        errno = 0;
+    }
+    if (errno != 0) {
+        addError(srcPath, errno);
+    }
+    ::closedir(d);
+
+    if (!dstNames.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::string &name : dstNames) {
+            struct statx dst{};
+            if (!m_filter.isEmpty() && statEntry(dstFd.get(), name.c_str(), &dst) && m_filter.isExcluded(joinPath(rel, name), fileType(dst) == S_IFDIR)) {
+                continue;
+            }
+            m_vanished.push_back(joinPath(dstPath, name));
+        }
+    }
+}
+
+void SyncEngine::processList()
+{
+    // directories are created in order first, so that the parents exist when the files are synced in parallel
+    std::vector<const std::string *> files;
+    files.reserve(m_changedList.size());
+    ParentDirs parents;
+    for (const std::string &rel : m_changedList) {
+        struct statx src{};
+        if (statx(AT_FDCWD, joinPath(m_source, rel).c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, statxMask, &src) != 0) {
+            if (errno != ENOENT) {
+                addError(joinPath(m_source, rel), errno);
+            }
+            continue;
+        }
+        if (fileType(src) == S_IFDIR) {
+            syncListEntry(parents, rel, &src);
+            // a new directory file descriptor might be needed for the children
+            parents.valid = false;
+        } else {
+            files.push_back(&rel);
+        }
+    }
+
+    std::atomic<std::size_t> next{0};
+    const auto workers = std::min<std::size_t>(static_cast<std::size_t>(m_threads), std::max<std::size_t>(files.size(), 1));
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (std::size_t worker = 0; worker < workers; ++worker) {
+        threads.emplace_back([this, &files, &next](){
+            ParentDirs workerParents;
+            for (std::size_t idx = next.fetch_add(1); idx < files.size(); idx = next.fetch_add(1)) {
+                syncListEntry(workerParents, *files[idx], nullptr);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void SyncEngine::syncListEntry(ParentDirs &parents, const std::string &rel, const struct statx *src)
+{
+    const std::string::size_type pos = rel.rfind('/');
+    const std::string parent = pos == std::string::npos ? std::string() : rel.substr(0, pos);
+    const std::string name = pos == std::string::npos ? rel : rel.substr(pos + 1);
+
+    // the lists are sorted, so consecutive entries usually share their parent
+    if (!parents.valid || parents.rel != parent) {
+        parents.valid = false;
+        parents.rel = parent;
+        parents.src.reset(::open(joinPath(m_source, parent).c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if (!parents.src.isValid()) {
+            if (errno != ENOENT) {
+                addError(joinPath(m_source, parent), errno);
+            }
+            return;
+        }
+        parents.dst.reset(::open(joinPath(m_destination, parent).c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if (!parents.dst.isValid()) {
+            addError(joinPath(m_destination, parent), errno);
+            return;
+        }
+        parents.valid = true;
+    }
+
+    struct statx st{};
+    if (!src) {
+        if (!statEntry(parents.src.get(), name.c_str(), &st)) {
+            if (errno != ENOENT) {
+                addError(joinPath(m_source, rel), errno);
+            }
+            return;
+        }
+        src = &st;
+    }
+
+    bool isDir = false;
+    syncEntry(parents.src.get(), parents.dst.get(), parent, name.c_str(), *src, true, &isDir);
+}
+
+bool SyncEngine::syncEntry(int srcDirFd, int dstDirFd, const std::string &rel, const char *name, const struct statx &src, bool dstListed, bool *isDir)
+{
+    struct statx dst{};
+    bool exists = dstListed && statEntry(dstDirFd, name, &dst);
+
+    if (exists && fileType(dst) != fileType(src)) {
+        if (!removeTree(joinPath(joinPath(m_destination, rel), name))) {
+            return false;
+        }
+        exists = false;
+    }
+
+    if (fileType(src) != S_IFDIR) {
+        m_files.fetch_add(1, std::memory_order_relaxed);
+        m_totalSize.fetch_add(static_cast<qint64>(src.stx_size), std::memory_order_relaxed);
+        if (!exists) {
+            m_created.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    switch (fileType(src)) {
+    case S_IFDIR:
+        *isDir = true;
+        m_dirs.fetch_add(1, std::memory_order_relaxed);
+        if (!exists && ::mkdirat(dstDirFd, name, 0700) != 0) {
+            addError(joinPath(joinPath(m_destination, rel), name), errno);
+            return false;
+        }
+        if (m_preserve.acls || m_preserve.xattrs) {
+            syncXattrs(joinPath(joinPath(m_source, rel), name), joinPath(joinPath(m_destination, rel), name));
+        }
+        // directory times have to be set after their content has been synced
+        addDirAttributes(joinPath(joinPath(m_destination, rel), name), src);
+        return true;
+    case S_IFREG:
+        // further paths of a hard linked inode are linked to the first one after the walk
+        if (m_preserve.hardLinks && src.stx_nlink > 1 && !claimInode(rel, name, src)) {
+            return true;
+        }
+        if (!exists && !m_linkDest.empty() && linkFile(dstDirFd, rel, name, src)) {
+            return true;
+        }
+        if (!exists || dst.stx_size != src.stx_size || !sameTime(dst.stx_mtime, src.stx_mtime)) {
+            return copyFile(srcDirFd, dstDirFd, rel, name, src, exists);
+        }
+        if (m_preserve.sparse) {
+            m_sparseBytes.fetch_add(holeBytes(dst), std::memory_order_relaxed);
+        }
+        setAttributes(dstDirFd, rel, name, src, &dst);
+        return true;
+    case S_IFLNK:
+        return copySymlink(srcDirFd, dstDirFd, rel, name, src, exists);
+    default:
+        if (exists && dst.stx_rdev_major == src.stx_rdev_major && dst.stx_rdev_minor == src.stx_rdev_minor) {
+            setAttributes(dstDirFd, rel, name, src, &dst);
+            return true;
+        }
+        if (exists && ::unlinkat(dstDirFd, name, 0) != 0) {
+            addError(joinPath(joinPath(m_destination, rel), name), errno);
+            return false;
+        }
+        return copySpecial(dstDirFd, rel, name, src);
+    }
+}
+
+bool SyncEngine::claimInode(const std::string &rel, const char *name, const struct statx &src)
+{
+    const InodeKey key{makedev(src.stx_dev_major, src.stx_dev_minor), src.stx_ino};
+    std::string dstPath = joinPath(joinPath(m_destination, rel), name);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_inodes.find(key);
+    if (it == m_inodes.end()) {
+        m_inodes.emplace(key, std::move(dstPath));
+        return true;
+    }
+    m_hardLinks.push_back({std::move(dstPath), it->second, static_cast<qint64>(src.stx_size)});
+    return false;
+}
+
+bool SyncEngine::linkFile(int dstDirFd, const std::string &rel, const char *name, const struct statx &src)
+{
+    const std::string linkPath = joinPath(joinPath(m_linkDest, rel), name);
+    struct statx old{};
+    if (statx(AT_FDCWD, linkPath.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, statxMask, &old) != 0) {
+        return false;
+    }
+    // the linked inode is shared with the older generation, so all its attributes have to match
+    if (fileType(old) != S_IFREG || old.stx_size != src.stx_size || !sameTime(old.stx_mtime, src.stx_mtime) || (old.stx_mode & 07777) != (src.stx_mode & 07777)) {
+        return false;
+    }
+    if (m_preserveOwner && (old.stx_uid != src.stx_uid || old.stx_gid != src.stx_gid)) {
+        return false;
+    }
+    if ((m_preserve.acls || m_preserve.xattrs) && !sameXattrs(joinPath(joinPath(m_source, rel), name), linkPath)) {
+        return false;
+    }
+    // too many links or another file system, the file is copied instead
+    if (::linkat(AT_FDCWD, linkPath.c_str(), dstDirFd, name, 0) != 0) {
+        return false;
+    }
+    m_linked.fetch_add(1, std::memory_order_relaxed);
+    m_linkedBytes.fetch_add(static_cast<qint64>(src.stx_size), std::memory_order_relaxed);
+    if (m_preserve.sparse) {
+        m_sparseBytes.fetch_add(holeBytes(old), std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool SyncEngine::copyFile(int srcDirFd, int dstDirFd, const std::string &rel, const char *name, const struct statx &src, bool replace)
+{
+    const std::string dstPath = joinPath(joinPath(m_destination, rel), name);
+
+    FileDescriptor in(::openat(srcDirFd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (!in.isValid()) {
+        if (errno != ENOENT) {
+            addError(joinPath(joinPath(m_source, rel), name), errno);
+        }
+        return false;
+    }
+
+    // existing files are replaced atomically, new files are written directly as an incomplete copy
+    // will have a different size or modification time and will be copied again on the next run;
+    // the short temporary name can not exceed NAME_MAX and leftovers of aborted runs are deleted as vanished entries
+    const std::string tmpName = replace ? ".sihhuri." + std::to_string(::getpid()) + '.' + std::to_string(m_tmpCounter.fetch_add(1, std::memory_order_relaxed)) : std::string(name);
+    FileDescriptor out(::openat(dstDirFd, tmpName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600));
+    if (!out.isValid()) {
+        addError(dstPath, errno);
+        return false;
+    }
+
+    auto fail = [&](int errorNumber) {
+        addError(dstPath, errorNumber);
+        out.reset();
+        ::unlinkat(dstDirFd, tmpName.c_str(), 0);
+        return false;
+    };
+
+    const auto size = static_cast<qint64>(src.stx_size);
+    if (size > 0) {
+        bool cloned = false;
+        if (m_tryReflink.load(std::memory_order_relaxed)) {
+            cloned = ::ioctl(out.get(), FICLONE, in.get()) == 0;
+            if (cloned) {
+                m_reflinked.fetch_add(1, std::memory_order_relaxed);
+                // clones share the extents and keep the holes
+                if (m_preserve.sparse) {
+                    m_sparseBytes.fetch_add(holeBytes(src), std::memory_order_relaxed);
+                }
+            } else if (errno == EXDEV || errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL) {
+                // source and destination do not share a file system that supports reflinks
+                m_tryReflink.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        if (!cloned && m_preserve.sparse && static_cast<qint64>(src.stx_blocks) * 512 < size) {
+            qint64 holes = 0;
+            if (const int rc = copySparse(in.get(), out.get(), size, &holes); rc != 0) {
+                return fail(rc);
+            }
+            m_sparseBytes.fetch_add(holes, std::memory_order_relaxed);
+        } else if (!cloned) {
+            qint64 copied = 0;
+            bool useCopyFileRange = true;
+            while (useCopyFileRange) {
+                const ssize_t n = ::copy_file_range(in.get(), nullptr, out.get(), nullptr, static_cast<size_t>(std::min<qint64>(size - copied, 1LL << 30)), 0);
+                if (n > 0) {
+                    copied += n;
+                    if (copied >= size) {
+                        // the file might have grown while copying, copy the rest with read/write
+                        useCopyFileRange = false;
+                    }
+                } else if (n == 0) {
+                    break;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (copied == 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                    useCopyFileRange = false;
+                } else {
+                    return fail(errno);
+                }
+            }
+
+            if (!useCopyFileRange) {
+                std::vector<char> buf(copyBufferSize);
+                for (;;) {
+                    const ssize_t r = ::read(in.get(), buf.data(), buf.size());
+                    if (r == 0) {
+                        break;
+                    }
+                    if (r < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        return fail(errno);
+                    }
+                    ssize_t written = 0;
+                    while (written < r) {
+                        const ssize_t w = ::write(out.get(), buf.data() + written, static_cast<size_t>(r - written));
+                        if (w < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+                            return fail(errno);
+                        }
+                        written += w;
+                    }
+                }
+            }
+        }
+    }
+
+    if (m_preserveOwner && ::fchown(out.get(), src.stx_uid, src.stx_gid) != 0) {
+        return fail(errno);
+    }
+    if (::fchmod(out.get(), src.stx_mode & 07777) != 0) {
+        return fail(errno);
+    }
+    const std::array<struct timespec, 2> times = {{
+        {static_cast<time_t>(src.stx_atime.tv_sec), static_cast<long>(src.stx_atime.tv_nsec)},
+        {static_cast<time_t>(src.stx_mtime.tv_sec), static_cast<long>(src.stx_mtime.tv_nsec)}
+    }};
+    if (::futimens(out.get(), times.data()) != 0) {
+        return fail(errno);
+    }
+    out.reset();
+
+    if (replace && ::renameat(dstDirFd, tmpName.c_str(), dstDirFd, name) != 0) {
+        const int errorNumber = errno;
+        ::unlinkat(dstDirFd, tmpName.c_str(), 0);
+        addError(dstPath, errorNumber);
+        return false;
+    }
+
+    if (m_preserve.acls || m_preserve.xattrs) {
+        syncXattrs(joinPath(joinPath(m_source, rel), name), dstPath);
+    }
+
+    m_transferred.fetch_add(1, std::memory_order_relaxed);
+    m_transferredBytes.fetch_add(size, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool SyncEngine::copySymlink(int srcDirFd, int dstDirFd, const std::string &rel, const char *name, const struct statx &src, bool exists)
+{
+    std::string target;
+    if (!readLink(srcDirFd, name, static_cast<std::size_t>(src.stx_size), &target)) {
+        addError(joinPath(joinPath(m_source, rel), name), errno);
+        return false;
+    }
+
+    const std::string dstPath = joinPath(joinPath(m_destination, rel), name);
+
+    if (exists) {
+        std::string current;
+        if (readLink(dstDirFd, name, target.size(), &current) && current == target) {
+            if (m_preserve.acls || m_preserve.xattrs) {
+                syncXattrs(joinPath(joinPath(m_source, rel), name), dstPath);
+            }
+            return true;
+        }
+        if (::unlinkat(dstDirFd, name, 0) != 0) {
+            addError(dstPath, errno);
+            return false;
+        }
+    }
+
+    if (::symlinkat(target.c_str(), dstDirFd, name) != 0) {
+        addError(dstPath, errno);
+        return false;
+    }
+
+    setAttributes(dstDirFd, rel, name, src, nullptr);
+    m_transferred.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool SyncEngine::copySpecial(int dstDirFd, const std::string &rel, const char *name, const struct statx &src)
+{
+    if (::mknodat(dstDirFd, name, src.stx_mode, makedev(src.stx_rdev_major, src.stx_rdev_minor)) != 0) {
+        addError(joinPath(joinPath(m_destination, rel), name), errno);
+        return false;
+    }
+
+    setAttributes(dstDirFd, rel, name, src, nullptr);
+    m_transferred.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void SyncEngine::setAttributes(int dirFd, const std::string &rel, const char *name, const struct statx &src, const struct statx *dst)
+{
+    const bool isLink = fileType(src) == S_IFLNK;
+
+    if (m_preserveOwner && (!dst || dst->stx_uid != src.stx_uid || dst->stx_gid != src.stx_gid)) {
+        if (::fchownat(dirFd, name, src.stx_uid, src.stx_gid, AT_SYMLINK_NOFOLLOW) != 0) {
+            addError(joinPath(joinPath(m_destination, rel), name), errno);
+        }
+    }
+
+    // permissions of symbolic links are not used on Linux and can not be changed
+    if (!isLink && (!dst || (dst->stx_mode & 07777) != (src.stx_mode & 07777))) {
+        if (::fchmodat(dirFd, name, src.stx_mode & 07777, 0) != 0) {
+            addError(joinPath(joinPath(m_destination, rel), name), errno);
+        }
+    }
+
+    if (!dst || !sameTime(dst->stx_mtime, src.stx_mtime)) {
+        const std::array<struct timespec, 2> times = {{
+            {static_cast<time_t>(src.stx_atime.tv_sec), static_cast<long>(src.stx_atime.tv_nsec)},
+            {static_cast<time_t>(src.stx_mtime.tv_sec), static_cast<long>(src.stx_mtime.tv_nsec)}
+        }};
+        if (::utimensat(dirFd, name, times.data(), AT_SYMLINK_NOFOLLOW) != 0) {
+            addError(joinPath(joinPath(m_destination, rel), name), errno);
+        }
+    }
+
+    // changing extended attributes only updates the change time
+    if (m_preserve.acls || m_preserve.xattrs) {
+        syncXattrs(joinPath(joinPath(m_source, rel), name), joinPath(joinPath(m_destination, rel), name));
+    }
+}
+
+void SyncEngine::syncXattrs(const std::string &srcPath, const std::string &dstPath)
+{
+    Xattrs src;
+    Xattrs dst;
+    if (const int rc = readXattrs(srcPath, m_preserve.acls, m_preserve.xattrs, &src); rc != 0) {
+        addError(srcPath, rc);
+        return;
+    }
+    if (const int rc = readXattrs(dstPath, m_preserve.acls, m_preserve.xattrs, &dst); rc != 0) {
+        addError(dstPath, rc);
+        return;
+    }
+    if (src == dst) {
+        return;
+    }
+
+    for (const auto &[name, value] : dst) {
+        if (!src.contains(name) && ::lremovexattr(dstPath.c_str(), name.c_str()) != 0 && errno != ENODATA) {
+            addError(dstPath, errno);
+        }
+    }
+    for (const auto &[name, value] : src) {
+        const auto it = dst.find(name);
+        if ((it == dst.end() || it->second != value) && ::lsetxattr(dstPath.c_str(), name.c_str(), value.data(), value.size(), 0) != 0) {
+            addError(dstPath, errno);
+        }
+    }
+}
+
+bool SyncEngine::sameXattrs(const std::string &srcPath, const std::string &dstPath) const
+{
+    Xattrs src;
+    Xattrs dst;
+    return readXattrs(srcPath, m_preserve.acls, m_preserve.xattrs, &src) == 0 && readXattrs(dstPath, m_preserve.acls, m_preserve.xattrs, &dst) == 0 && src == dst;
+}
+
+void SyncEngine::addDirAttributes(const std::string &path, const struct statx &src)
+{
+    DirAttributes attrs;
+    attrs.path = path;
+    attrs.mode = src.stx_mode & 07777;
+    attrs.uid = src.stx_uid;
+    attrs.gid = src.stx_gid;
+    attrs.atimeSec = src.stx_atime.tv_sec;
+    attrs.atimeNsec = src.stx_atime.tv_nsec;
+    attrs.mtimeSec = src.stx_mtime.tv_sec;
+    attrs.mtimeNsec = src.stx_mtime.tv_nsec;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirAttributes.push_back(std::move(attrs));
+}
+
+void SyncEngine::applyDirAttributes()
+{
+    // deepest directories first, setting the times of a child would otherwise change the mtime of its parent
+    std::sort(m_dirAttributes.begin(), m_dirAttributes.end(), [](const DirAttributes &a, const DirAttributes &b){
+        return a.path.size() > b.path.size();
+    });
+
+    for (const DirAttributes &attrs : m_dirAttributes) {
+        if (m_preserveOwner && ::lchown(attrs.path.c_str(), attrs.uid, attrs.gid) != 0) {
+            addError(attrs.path, errno);
+        }
+        if (::chmod(attrs.path.c_str(), attrs.mode) != 0) {
+            addError(attrs.path, errno);
+        }
+        const std::array<struct timespec, 2> times = {{
+            {static_cast<time_t>(attrs.atimeSec), static_cast<long>(attrs.atimeNsec)},
+            {static_cast<time_t>(attrs.mtimeSec), static_cast<long>(attrs.mtimeNsec)}
+        }};
+        if (::utimensat(AT_FDCWD, attrs.path.c_str(), times.data(), AT_SYMLINK_NOFOLLOW) != 0) {
+            addError(attrs.path, errno);
+        }
+    }
+}
+
+void SyncEngine::createHardLinks()
+{
+    for (const HardLink &link : m_hardLinks) {
+        struct statx target{};
+        if (statx(AT_FDCWD, link.target.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_INO, &target) != 0) {
+            addError(link.target, errno);
+            continue;
+        }
+
+        struct statx current{};
+        if (statx(AT_FDCWD, link.path.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_INO, &current) == 0) {
+            const bool linked = current.stx_ino == target.stx_ino && current.stx_dev_major == target.stx_dev_major && current.stx_dev_minor == target.stx_dev_minor;
+            if (!linked) {
+                // existing files are replaced atomically like copied files
+                const std::string tmpPath = link.path.substr(0, link.path.rfind('/')) + "/.sihhuri." + std::to_string(::getpid()) + '.' + std::to_string(m_tmpCounter.fetch_add(1, std::memory_order_relaxed));
+                if (::link(link.target.c_str(), tmpPath.c_str()) != 0) {
+                    addError(link.path, errno);
+                    continue;
+                }
+                if (::rename(tmpPath.c_str(), link.path.c_str()) != 0) {
+                    const int errorNumber = errno;
+                    ::unlink(tmpPath.c_str());
+                    addError(link.path, errorNumber);
+                    continue;
+                }
+            }
+        } else if (::link(link.target.c_str(), link.path.c_str()) != 0) {
+            addError(link.path, errno);
+            continue;
+        }
+
+        m_hardLinked.fetch_add(1, std::memory_order_relaxed);
+        m_hardLinkedBytes.fetch_add(link.size, std::memory_order_relaxed);
+    }
+}
+
+void SyncEngine::deleteVanished()
+{
+    for (const std::string &path : m_vanished) {
+        removeTree(path);
+    }
+}
+
+bool SyncEngine::removeTree(const std::string &path)
+{
+    if (::unlink(path.c_str()) == 0) {
+        m_deleted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (errno == ENOENT) {
+        return true;
+    }
+    if (errno != EISDIR && errno != EPERM) {
+        addError(path, errno);
+        return false;
+    }
+    removedFiles = 0;
+    const int rc = ::nftw(path.c_str(), removeCallback, 32, FTW_DEPTH | FTW_PHYS);
+    m_deleted.fetch_add(removedFiles, std::memory_order_relaxed);
+    if (rc != 0) {
+        addError(path, errno);
+        return false;
+    }
+    return true;
+}
+
+void SyncEngine::addError(const std::string &path, int errorNumber)
+{
+    const QString msg = QFile::decodeName(QByteArray::fromStdString(path)) + QLatin1String(": ") + QString::fromStdString(std::generic_category().message(errorNumber));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_errors.append(msg);
+}
@@ -0,0 +1,226 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SYNCENGINE_H
+#define SYNCENGINE_H
+
+#include "pathfilter.h"
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct statx;
+template<typename T> class WorkStealingQueue;
+
+/*!
+ * \brief In-process replacement for <tt>rsync -aR --delete --delete-after</tt>.
+ *
+ * Mirrors the directory \a path below \a sourceRoot to \a destinationRoot + \a path,
+ * creating the implied parent directories like <tt>rsync -R</tt> does. If \a sourceRoot
+ * is empty, \a path is used as source directly, otherwise it is the root of a snapshot
+ * that contains \a path.
+ *
+ * The source tree is walked by multiple threads that take directories from a
+ * WorkStealingQueue. Files are compared by type, size and modification time using
+ * statx() and only changed files are copied, preferring a reflink and falling back to
+ * copy_file_range() and plain read/write. Existing files are replaced by writing to a
+ * temporary file that is renamed into place after the attributes have been set. Entries that
+ * no longer exist in the source are removed after all directories have been synced.
+ *
+ * If a link destination is set, files that are missing in the destination but unchanged
+ * in the link destination are hard linked from there instead of being copied, like
+ * <tt>rsync --link-dest</tt> does.
+ *
+ * Ownership is only preserved if the process runs as root, like rsync does. Hard
+ * links, ACLs, extended attributes and holes of sparse files are only preserved if
+ * they are enabled with setPreserve(), what matches the \c -a option of rsync and
+ * the \c -H, \c -A, \c -X and \c -S options that enable them there.
+ */
+class SyncEngine
+{
+public:
+    /*!
+     * \brief Statistics of a sync run.
+     *
+     * \a files, \a created and \a deleted count all entries that are not directories,
+     * \a totalSize is the size of these entries in the source like the "Total file size"
+     * of rsync --stats.
+     */
+    struct Result {
+        qint64 files = 0;
+        qint64 dirs = 0;
+        qint64 totalSize = 0;
+        qint64 created = 0;
+        qint64 transferred = 0;
+        qint64 transferredBytes = 0;
+        qint64 reflinked = 0;
+        qint64 linked = 0;
+        qint64 linkedBytes = 0;
+        qint64 deleted = 0;
+        // additional paths of hard linked source files that have been linked instead of copied
+        qint64 hardLinked = 0;
+        qint64 hardLinkedBytes = 0;
+        // holes of the sparse files in the destination, only counted if sparse files are preserved
+        qint64 sparseBytes = 0;
+    };
+
+    /*!
+     * \brief Metadata that is only preserved on request, like the matching rsync options.
+     *
+     * \a hardLinks links the paths of a source inode together in the destination, but only
+     * the paths that are synced by the same run. \a acls copies the \c system.posix_acl_*
+     * attributes, \a xattrs all other extended attributes. \a sparse copies only the data
+     * regions of files that have holes, found with \c SEEK_DATA and \c SEEK_HOLE.
+     */
+    struct Preserve {
+        bool hardLinks = false;
+        bool acls = false;
+        bool xattrs = false;
+        bool sparse = false;
+    };
+
+    /*!
+     * \brief Constructs a new engine, \a threads <= 0 uses the number of CPU cores.
+     */
+    SyncEngine(const QString &sourceRoot, const QString &path, const QString &destinationRoot, int threads = 0);
+    ~SyncEngine();
+
+    /*!
+     * \brief Restricts the sync to the entries in \a changed and \a deleted.
+     *
+     * Instead of walking the whole tree only the given entries are synced and deleted.
+     * The paths are relative to the synced directory and have to be sorted so that
+     * parents come before their children, like the lists created by FileIndex::compareTo().
+     * The directories in \a recursive are walked and mirrored completely after the
+     * \a changed entries have been synced, they have to be part of \a changed themselves.
+     * The statistics in result() only cover the given entries.
+     */
+    void setFileList(std::vector<std::string> changed, std::vector<std::string> deleted, std::vector<std::string> recursive = {});
+    [[nodiscard]] bool hasFileList() const;
+
+    /*!
+     * \brief Skips the entries excluded by \a filter, they are also not deleted in the destination.
+     *
+     * Paths are matched relative to the synced directory. The entries of file lists set by
+     * setFileList() are not filtered, but the trees below the recursive entries are.
+     */
+    void setFilter(const PathFilter &filter);
+
+    /*!
+     * \brief Hard links unchanged files from the tree below \a linkDestRoot, that has the same layout as the destination root.
+     */
+    void setLinkDest(const QString &linkDestRoot);
+
+    /*!
+     * \brief Enables the preservation of the metadata in \a preserve.
+     */
+    void setPreserve(const Preserve &preserve);
+
+    /*!
+     * \brief Performs the sync and blocks until it has been finished.
+     *
+     * Returns \c false if any error occurred, the messages are available via errors().
+     * Like rsync, the engine continues with the remaining entries after an error.
+     */
+    bool run();
+
+    [[nodiscard]] Result result() const;
+    [[nodiscard]] QStringList errors() const;
+    [[nodiscard]] int threads() const;
+
+private:
+    struct DirAttributes {
+        std::string path;
+        unsigned int mode = 0;
+        unsigned int uid = 0;
+        unsigned int gid = 0;
+        long long atimeSec = 0;
+        unsigned int atimeNsec = 0;
+        long long mtimeSec = 0;
+        unsigned int mtimeNsec = 0;
+    };
+
+    struct HardLink {
+        std::string path;
+        std::string target;
+        qint64 size = 0;
+    };
+
+    struct InodeKey {
+        quint64 dev = 0;
+        quint64 ino = 0;
+        bool operator==(const InodeKey &other) const { return dev == other.dev && ino == other.ino; }
+    };
+
+    struct InodeKeyHash {
+        std::size_t operator()(const InodeKey &key) const { return std::hash<quint64>()(key.ino ^ (key.dev << 32U)); }
+    };
+
+    struct ParentDirs;
+
+    bool prepareRoot();
+    void walk(const std::vector<std::string> &roots);
+    void processList();
+    void syncListEntry(ParentDirs &parents, const std::string &rel, const struct statx *src);
+    void processDir(std::size_t worker, const std::string &rel, WorkStealingQueue<std::string> &queue);
+    bool syncEntry(int srcDirFd, int dstDirFd, const std::string &rel, const char *name, const struct statx &src, bool dstListed, bool *isDir);
+    bool claimInode(const std::string &rel, const char *name, const struct statx &src);
+    bool linkFile(int dstDirFd, const std::string &rel, const char *name, const struct statx &src);
+    bool copyFile(int srcDirFd, int dstDirFd, const std::string &rel, const char *name, const struct statx &src, bool replace);
+    bool copySymlink(int srcDirFd, int dstDirFd, const std::string &rel, const char *name, const struct statx &src, bool exists);
+    bool copySpecial(int dstDirFd, const std::string &rel, const char *name, const struct statx &src);
+    void setAttributes(int dirFd, const std::string &rel, const char *name, const struct statx &src, const struct statx *dst);
+    void syncXattrs(const std::string &srcPath, const std::string &dstPath);
+    [[nodiscard]] bool sameXattrs(const std::string &srcPath, const std::string &dstPath) const;
+    void addDirAttributes(const std::string &path, const struct statx &src);
+    void applyDirAttributes();
+    void createHardLinks();
+    void deleteVanished();
+    bool removeTree(const std::string &path);
+    void addError(const std::string &path, int errorNumber);
+
+    std::string m_source;
+    std::string m_destination;
+    std::string m_sourceRoot;
+    std::string m_destinationRoot;
+    std::string m_path;
+    std::string m_linkDest;
+    PathFilter m_filter;
+    std::vector<DirAttributes> m_dirAttributes;
+    std::vector<std::string> m_vanished;
+    std::vector<std::string> m_changedList;
+    std::vector<std::string> m_recursiveList;
+    std::unordered_map<InodeKey, std::string, InodeKeyHash> m_inodes;
+    std::vector<HardLink> m_hardLinks;
+    QStringList m_errors;
+    mutable std::mutex m_mutex;
+    std::atomic<qint64> m_files{0};
+    std::atomic<qint64> m_totalSize{0};
+    std::atomic<qint64> m_created{0};
+    std::atomic<qint64> m_dirs{0};
+    std::atomic<qint64> m_transferred{0};
+    std::atomic<qint64> m_transferredBytes{0};
+    std::atomic<qint64> m_reflinked{0};
+    std::atomic<qint64> m_linked{0};
+    std::atomic<qint64> m_linkedBytes{0};
+    std::atomic<qint64> m_deleted{0};
+    std::atomic<qint64> m_hardLinked{0};
+    std::atomic<qint64> m_hardLinkedBytes{0};
+    std::atomic<qint64> m_sparseBytes{0};
+    std::atomic<quint64> m_tmpCounter{0};
+    std::atomic<bool> m_tryReflink{true};
+    Preserve m_preserve;
+    int m_threads = 1;
+    bool m_preserveOwner = false;
+    bool m_listMode = false;
+
+    Q_DISABLE_COPY(SyncEngine)
+};
+
+#endif // SYNCENGINE_H
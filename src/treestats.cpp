@@ -0,0 +1,182 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "treestats.h"
+#include "workstealingqueue.h"
+#include "dirents.h"
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+struct TreeStats::Worker {
+    // the arena of every thread, reused for all directories it reads
+    std::vector<char> direntBuffer = std::vector<char>(Dirents::defaultBufferSize);
+    std::string childPath;
+    std::string filterPath;
+    std::vector<LinkedInode> linkedInodes;
+    Result result;
+};
+
+namespace {
+// allocated sizes below one block are inline data or tails, not holes
+qint64 holeBytes(const struct statx &st)
+{
+    const qint64 holes = static_cast<qint64>(st.stx_size) - static_cast<qint64>(st.stx_blocks) * 512;
+    return holes >= 4096 ? holes : 0;
+}
+}
+
+TreeStats::TreeStats(const QString &path, int threads)
+    : m_path(QFile::encodeName(path).toStdString()),
+      m_threads(threads > 0 ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency())))
+{
+    while (m_path.size() > 1 && m_path.back() == '/') {
+        m_path.pop_back();
+    }
+}
+
+TreeStats::~TreeStats() = default;
+
+bool TreeStats::run()
+{
+    m_result = Result();
+
+    struct statx st{};
+    if (statx(AT_FDCWD, m_path.c_str(), AT_NO_AUTOMOUNT, STATX_TYPE, &st) != 0 || !S_ISDIR(st.stx_mode)) {
+        return false;
+    }
+
+    const auto count = static_cast<std::size_t>(m_threads);
+    std::vector<Worker> workers(count);
+    WorkStealingQueue<std::string> queue(count);
+    queue.push(0, m_path);
+
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (std::size_t index = 0; index < count; ++index) {
+        threads.emplace_back([this, index, &workers, &queue](){
+            Worker &worker = workers[index];
+            while (auto path = queue.pop(index)) {
+                processDir(worker, index, *path, queue);
+                queue.taskDone();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (const Worker &worker : std::as_const(workers)) {
+        m_result.files += worker.result.files;
+        m_result.dirs += worker.result.dirs;
+        m_result.apparentSize += worker.result.apparentSize;
+        m_result.allocatedSize += worker.result.allocatedSize;
+        m_result.errors += worker.result.errors;
+        m_result.holeSize += worker.result.holeSize;
+    }
+
+    if (m_countHardLinks) {
+        std::vector<LinkedInode> inodes;
+        for (Worker &worker : workers) {
+            inodes.insert(inodes.end(), worker.linkedInodes.begin(), worker.linkedInodes.end());
+        }
+        std::sort(inodes.begin(), inodes.end(), [](const LinkedInode &a, const LinkedInode &b){
+            return a.dev < b.dev || (a.dev == b.dev && a.ino < b.ino);
+        });
+        for (std::size_t i = 0; i < inodes.size(); ++i) {
+            if (i > 0 && inodes[i].dev == inodes[i - 1].dev && inodes[i].ino == inodes[i - 1].ino) {
+                m_result.hardLinkedFiles++;
+                m_result.hardLinkedSize += inodes[i].size;
+            } else {
+                m_result.holeSize += inodes[i].holes;
+            }
+        }
+    }
+
+    return true;
+}
+
+void TreeStats::setFilter(const PathFilter &filter, const QString &base)
+{
+    m_filter = filter;
+    m_filterBase = QFile::encodeName(base).toStdString();
+    if (!m_filterBase.empty()) {
+        m_filterBase.push_back('/');
+    }
+}
+
+void TreeStats::setCountHardLinks(bool enabled)
+{
+    m_countHardLinks = enabled;
+}
+
+TreeStats::Result TreeStats::result() const
+{
+    return m_result;
+}
+
+void TreeStats::processDir(Worker &worker, std::size_t index, const std::string &path, WorkStealingQueue<std::string> &queue)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        worker.result.errors++;
+        return;
+    }
+
+    worker.result.dirs++;
+
+    const bool ok = Dirents::forEach(fd, worker.direntBuffer, [&](const char *name, unsigned char type){
+        bool isDir = type == DT_DIR;
+        struct statx st{};
+        if (!isDir) {
+            const unsigned int mask = STATX_SIZE | STATX_BLOCKS | (type == DT_UNKNOWN ? STATX_TYPE : 0U) | (m_countHardLinks ? STATX_NLINK | STATX_INO : 0U);
+            if (statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC, mask, &st) != 0) {
+                worker.result.errors++;
+                return;
+            }
+            isDir = type == DT_UNKNOWN && S_ISDIR(st.stx_mode);
+        }
+
+        worker.childPath.assign(path);
+        worker.childPath.push_back('/');
+        worker.childPath.append(name);
+
+        if (!m_filter.isEmpty()) {
+            worker.filterPath.assign(m_filterBase);
+            worker.filterPath.append(worker.childPath, m_path.size() + 1);
+            if (m_filter.isExcluded(worker.filterPath, isDir)) {
+                return;
+            }
+        }
+
+        if (isDir) {
+            queue.push(index, worker.childPath);
+        } else {
+            worker.result.files++;
+            worker.result.apparentSize += static_cast<qint64>(st.stx_size);
+            worker.result.allocatedSize += static_cast<qint64>(st.stx_blocks) * 512;
+            if (S_ISREG(st.stx_mode) || type == DT_REG) {
+                // the holes of linked files are added once per inode after the walk
+                if (m_countHardLinks && st.stx_nlink > 1) {
+                    worker.linkedInodes.push_back({makedev(st.stx_dev_major, st.stx_dev_minor), st.stx_ino, static_cast<qint64>(st.stx_size), holeBytes(st)});
+                } else {
+                    worker.result.holeSize += holeBytes(st);
+                }
+            }
+        }
+    });
+    if (!ok) {
+        worker.result.errors++;
+    }
+
+    ::close(fd);
+}
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include "pathfilter.h"
+#include <QString>
+#include <string>
+
+template<typename T> class WorkStealingQueue;
+
+/*!
+ * \brief Collects the statistics of a directory tree.
+ *
+ * The tree is walked by multiple threads that read the directory entries with raw
+ * getdents64() calls into a per thread buffer and only call statx() for entries that
+ * are not directories or where the file system does not report the entry type. The
+ * counters are kept per thread and are summed up after the walk, so the threads do
+ * not share any state besides the work queue.
+ *
+ * Symbolic links are not followed and are counted as files with their own size.
+ * Directories on other file systems are walked, hard linked files are counted for
+ * every link. With setCountHardLinks() the additional links of files inside the
+ * tree are reported separately, the holes of sparse files are always reported.
+ */
+class TreeStats
+{
+public:
+    struct Result {
+        qint64 files = 0;
+        qint64 dirs = 0;
+        qint64 apparentSize = 0;
+        qint64 allocatedSize = 0;
+        qint64 errors = 0;
+        // additional paths of files that are hard linked inside the tree and their size
+        qint64 hardLinkedFiles = 0;
+        qint64 hardLinkedSize = 0;
+        // bytes of regular files that are not allocated, every inode is only counted once
+        qint64 holeSize = 0;
+    };
+
+    /*!
+     * \brief Constructs a new walker for \a path, \a threads <= 0 uses the number of CPU cores.
+     */
+    explicit TreeStats(const QString &path, int threads = 0);
+    ~TreeStats();
+
+    /*!
+     * \brief Walks the tree and blocks until it has been finished.
+     *
+     * Returns \c false if \a path is not a readable directory. Entries that vanish or can
+     * not be read while walking are counted in Result::errors but do not fail the walk.
+     */
+    bool run();
+
+    /*!
+     * \brief Skips the entries below the walked path that are excluded by \a filter.
+     *
+     * \a base is the path of the walked directory relative to the directory the patterns
+     * of \a filter are relative to, it is empty if both are the same.
+     */
+    void setFilter(const PathFilter &filter, const QString &base = QString());
+
+    /*!
+     * \brief Collects the inodes of files with multiple links to count the links inside the tree.
+     */
+    void setCountHardLinks(bool enabled);
+
+    [[nodiscard]] Result result() const;
+
+private:
+    struct Worker;
+    struct LinkedInode {
+        quint64 dev = 0;
+        quint64 ino = 0;
+        qint64 size = 0;
+        qint64 holes = 0;
+    };
+
+    void processDir(Worker &worker, std::size_t index, const std::string &path, WorkStealingQueue<std::string> &queue);
+
+    std::string m_path;
+    PathFilter m_filter;
+    std::string m_filterBase;
+    Result m_result;
+    int m_threads = 1;
+    bool m_countHardLinks = false;
+
+    Q_DISABLE_COPY(TreeStats)
+};
+
+#endif // TREESTATS_H
@@ -92,6 +92,11 @@ bool WordPressBackup::loadConfiguration()
     return true;
 }
 
+bool WordPressBackup::supportsPreSync() const
+{
+    return true;
+}
+
 
 void WordPressBackup::enableMaintenance()
 {
@@ -0,0 +1,134 @@
+/*
+ * SPDX-FileCopyrightText: (C) 2025 Matthias Fehring / www.huessenbergnetz.de
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef WORKSTEALINGQUEUE_H
+#define WORKSTEALINGQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/*!
+ * \brief Task queue for a fixed number of workers that steal work from each other.
+ *
+ * Every worker has its own deque. New tasks are pushed to the back of the deque of
+ * the worker that created them and are taken from there again, so a worker stays
+ * local to the sub tree it is currently walking. Idle workers steal from the front
+ * of the other deques, which usually contains the tasks closest to the root and
+ * therefore the largest chunks of remaining work.
+ *
+ * The queue tracks the number of pending tasks. A task counts as pending from push()
+ * until taskDone() has been called for it, so pop() only returns an empty optional
+ * after all tasks, including the ones created while processing other tasks, have
+ * been finished or after abort() has been called.
+ */
+template<typename T>
+class WorkStealingQueue
+{
+public:
+    explicit WorkStealingQueue(std::size_t workers)
+    {
+        m_deques.reserve(workers);
+        for (std::size_t i = 0; i < workers; ++i) {
+            m_deques.push_back(std::make_unique<Deque>());
+        }
+    }
+
+    void push(std::size_t worker, T task)
+    {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            Deque &d = *m_deques[worker];
+            std::lock_guard<std::mutex> lock(d.mutex);
+            d.tasks.push_back(std::move(task));
+        }
+        m_waitCondition.notify_one();
+    }
+
+    std::optional<T> pop(std::size_t worker)
+    {
+        for (;;) {
+            if (m_aborted.load(std::memory_order_relaxed)) {
+                return std::nullopt;
+            }
+
+            if (auto task = takeOwn(worker)) {
+                return task;
+            }
+
+            for (std::size_t i = 1; i < m_deques.size(); ++i) {
+                if (auto task = steal((worker + i) % m_deques.size())) {
+                    return task;
+                }
+            }
+
+            if (m_pending.load(std::memory_order_acquire) == 0) {
+                m_waitCondition.notify_all();
+                return std::nullopt;
+            }
+
+            // the timeout covers tasks that are pushed between the checks above and the wait
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_waitCondition.wait_for(lock, std::chrono::milliseconds(2));
+        }
+    }
+
+    void taskDone()
+    {
+        if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            m_waitCondition.notify_all();
+        }
+    }
+
+    void abort()
+    {
+        m_aborted.store(true, std::memory_order_relaxed);
+        m_waitCondition.notify_all();
+    }
+
+private:
+    struct Deque {
+        std::mutex mutex;
+        std::deque<T> tasks;
+    };
+
+    std::optional<T> takeOwn(std::size_t worker)
+    {
+        Deque &d = *m_deques[worker];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if (d.tasks.empty()) {
+            return std::nullopt;
+        }
+        T task = std::move(d.tasks.back());
+        d.tasks.pop_back();
+        return task;
+    }
+
+    std::optional<T> steal(std::size_t victim)
+    {
+        Deque &d = *m_deques[victim];
+        std::unique_lock<std::mutex> lock(d.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || d.tasks.empty()) {
+            return std::nullopt;
+        }
+        T task = std::move(d.tasks.front());
+        d.tasks.pop_front();
+        return task;
+    }
+
+    std::vector<std::unique_ptr<Deque>> m_deques;
+    std::mutex m_waitMutex;
+    std::condition_variable m_waitCondition;
+    std::atomic<std::size_t> m_pending{0};
+    std::atomic<bool> m_aborted{false};
+};
+
+#endif // WORKSTEALINGQUEUE_H